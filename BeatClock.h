@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include "Util.h"
+
+// Beats counted in samples inside update(), so a beat lands on its sample within the block rather than at the start of
+// the next block after loop() noticed it. Positions are on the effect's sample clock (samples since it started, see
+// GLITCH_DELAY_EFFECT::sample_clock()). loop() only hands over the tempo and, when it changes, the position of one beat;
+// every later beat follows from them. The period keeps FRACTION_BITS of fraction, so beats don't drift from a tempo
+// that isn't a whole number of samples. A beat position within half a beat after the last beat is that beat moved by
+// a tempo follower's correction, so it isn't played again.
+
+////////////////////////////////////
+
+class BEAT_CLOCK
+{
+public:
+
+    static const int            FRACTION_BITS       = 12;
+    static const uint32_t       MAX_PERIOD_SAMPLES  = ( 1u << ( 32 - FRACTION_BITS ) ) - 1;
+
+private:
+
+    static const uint32_t       FRACTION_MASK       = ( 1u << FRACTION_BITS ) - 1;
+
+    uint32_t                    m_period;           // samples per beat with FRACTION_BITS of fraction, 0 - stopped
+    uint32_t                    m_next_beat;        // on the sample clock
+    uint32_t                    m_next_beat_fraction;
+    uint32_t                    m_sync_count;       // of the last beat position taken
+    uint32_t                    m_last_beat;        // on the sample clock
+    bool                        m_last_beat_valid;
+
+    void                        skip( uint32_t num_beats )
+    {
+        const uint64_t distance = ( static_cast<uint64_t>( m_period ) * num_beats ) + m_next_beat_fraction;
+        m_next_beat             += static_cast<uint32_t>( distance >> FRACTION_BITS );
+        m_next_beat_fraction    = static_cast<uint32_t>( distance & FRACTION_MASK );
+    }
+
+public:
+
+    BEAT_CLOCK() :
+        m_period( 0 ),
+        m_next_beat( 0 ),
+        m_next_beat_fraction( 0 ),
+        m_sync_count( 0 ),
+        m_last_beat( 0 ),
+        m_last_beat_valid( false )
+    {
+    }
+
+    // samples per beat in the clock's fixed point, 0 stops the clock
+    static uint32_t             to_period( float period_samples )
+    {
+        if( period_samples <= 0.0f )
+        {
+            return 0;
+        }
+        return static_cast<uint32_t>( min_val( period_samples, static_cast<float>( MAX_PERIOD_SAMPLES ) ) * ( 1 << FRACTION_BITS ) );
+    }
+
+    // from the published parameters each block, a new sync_count moves the next beat to beat_sample
+    void                        set( uint32_t period, uint32_t beat_sample, uint32_t sync_count )
+    {
+        m_period                = period;
+        if( sync_count != m_sync_count )
+        {
+            m_sync_count        = sync_count;
+            m_next_beat         = beat_sample;
+            m_next_beat_fraction = 0;
+            if( m_last_beat_valid && static_cast<int32_t>( beat_sample - m_last_beat ) < static_cast<int32_t>( m_period >> ( FRACTION_BITS + 1 ) ) )
+            {
+                skip( 1 );
+            }
+        }
+    }
+
+    // the offset of the beat in the num_samples from block_start on the sample clock, -1 for none. Beats before the
+    // block (from a beat position already passed) are skipped, and a period shorter than the block gets one beat
+    int                         beat_in_block( uint32_t block_start, int num_samples )
+    {
+        if( m_period == 0 )
+        {
+            return -1;
+        }
+
+        const int32_t behind    = static_cast<int32_t>( block_start - m_next_beat );
+        if( behind > 0 )
+        {
+            skip( static_cast<uint32_t>( ( ( static_cast<uint64_t>( behind ) << FRACTION_BITS ) + m_period - 1 ) / m_period ) );
+        }
+
+        const int32_t offset    = static_cast<int32_t>( m_next_beat - block_start );
+        if( offset < 0 || offset >= num_samples )
+        {
+            return -1;
+        }
+
+        m_last_beat             = m_next_beat;
+        m_last_beat_valid       = true;
+        skip( 1 );
+        if( static_cast<int32_t>( m_next_beat - block_start ) < num_samples )
+        {
+            // more than one beat in this block, the rest are dropped
+            skip( static_cast<uint32_t>( ( ( static_cast<uint64_t>( num_samples ) << FRACTION_BITS ) + m_period - 1 ) / m_period ) );
+        }
+        return offset;
+    }
+};
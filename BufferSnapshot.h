@@ -0,0 +1,323 @@
+#pragma once
+
+#include <stdint.h>
+#include "GlitchDelayEffect.h"
+
+// Saves a frozen delay buffer to a file and recalls it, one chunk per control tick, so the audio never waits on the
+// file. update() copies each chunk to or from the buffer (see BUFFER_TRANSFER) and loop() moves it to or from the
+// file. The file holds the bit depth, channels, size and write head, then the buffer's bytes as stored, then a checksum
+// of them, so the recalled buffer is bit for bit the one saved.
+//
+// A recall publishes the saved bit depth and freeze along with the effect's other parameters, so nothing else should
+// change those until it is done. Unfreezing part way through fails the save or recall, and a failed recall leaves the
+// buffer part loaded. The buffer stays frozen until freeze is switched off.
+
+// the file, opened and closed by the caller (SDSnapshotFile.h on the Teensy, Host/StdioSnapshotFile.h on the host)
+class SNAPSHOT_FILE
+{
+public:
+
+    virtual ~SNAPSHOT_FILE() {}
+
+    // return the bytes moved, fewer than size on an error or at the end of the file
+    virtual int                 read( uint8_t* data, int size ) = 0;
+    virtual int                 write( const uint8_t* data, int size ) = 0;
+};
+
+////////////////////////////////////
+
+// file layout, little endian: magic, u16 version, u8 bit depth, u8 channels, u32 size in bytes, u32 write head,
+// the bytes, u32 FNV-1a checksum of the bytes
+static const uint8_t            SNAPSHOT_MAGIC[4]                   = { 'G', 'D', 'F', 'B' };
+static const int                SNAPSHOT_VERSION                    = 1;
+static const int                SNAPSHOT_HEADER_SIZE_IN_BYTES       = 16;
+static const int                SNAPSHOT_CHECKSUM_SIZE_IN_BYTES     = 4;
+
+struct SNAPSHOT_HEADER
+{
+    int                         m_sample_size_in_bits;
+    int                         m_num_channels;
+    int                         m_size_in_bytes;
+    int                         m_write_head;
+};
+
+inline void write_snapshot_u32( uint8_t* data, uint32_t value )
+{
+    for( int b = 0; b < 4; ++b )
+    {
+        data[b]                 = static_cast<uint8_t>( value >> ( b * 8 ) );
+    }
+}
+
+inline uint32_t read_snapshot_u32( const uint8_t* data )
+{
+    return data[0] | ( data[1] << 8 ) | ( data[2] << 16 ) | ( static_cast<uint32_t>( data[3] ) << 24 );
+}
+
+inline void encode_snapshot_header( const SNAPSHOT_HEADER& header, uint8_t* data )
+{
+    memcpy( data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) );
+    data[4]                     = SNAPSHOT_VERSION & 0xFF;
+    data[5]                     = SNAPSHOT_VERSION >> 8;
+    data[6]                     = static_cast<uint8_t>( header.m_sample_size_in_bits );
+    data[7]                     = static_cast<uint8_t>( header.m_num_channels );
+    write_snapshot_u32( data + 8, header.m_size_in_bytes );
+    write_snapshot_u32( data + 12, header.m_write_head );
+}
+
+// false if it isn't a snapshot this version can read
+inline bool decode_snapshot_header( const uint8_t* data, SNAPSHOT_HEADER& header )
+{
+    if( memcmp( data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) ) != 0 || ( data[4] | ( data[5] << 8 ) ) != SNAPSHOT_VERSION )
+    {
+        return false;
+    }
+
+    header.m_sample_size_in_bits = data[6];
+    header.m_num_channels       = data[7];
+    header.m_size_in_bytes      = static_cast<int>( read_snapshot_u32( data + 8 ) );
+    header.m_write_head         = static_cast<int>( read_snapshot_u32( data + 12 ) );
+    return true;
+}
+
+////////////////////////////////////
+
+class BUFFER_SNAPSHOT
+{
+public:
+
+    enum STATE
+    {
+        IDLE,
+        SAVING,
+        RECALLING,
+        DONE,
+        FAILED,
+    };
+
+private:
+
+    static const uint32_t       CHECKSUM_START      = 2166136261u;
+    static const uint32_t       CHECKSUM_PRIME      = 16777619u;
+
+    GLITCH_DELAY_EFFECT&        m_effect;
+    SNAPSHOT_FILE*              m_file;
+    STATE                       m_state;
+
+    BUFFER_TRANSFER             m_transfer;         // the request with the effect, then its result
+    int                         m_offset;           // bytes saved or recalled
+    uint32_t                    m_checksum;
+    uint32_t                    m_num_ticks;
+
+    void                        add_to_checksum( const uint8_t* data, int size )
+    {
+        for( int b = 0; b < size; ++b )
+        {
+            m_checksum          = ( m_checksum ^ data[b] ) * CHECKSUM_PRIME;
+        }
+    }
+
+    STATE                       fail()
+    {
+        m_state                 = FAILED;
+        return m_state;
+    }
+
+    int                         next_chunk_size() const
+    {
+        const int max_size      = BUFFER_TRANSFER::MAX_CHUNK_SIZE_IN_BYTES;
+        return min_val( max_size, m_transfer.m_size_in_bytes - m_offset );
+    }
+
+    void                        request( BUFFER_TRANSFER::REQUEST request )
+    {
+        m_transfer.m_request    = request;
+        m_transfer.m_offset     = m_offset;
+        m_transfer.m_size       = next_chunk_size();
+
+        // only when something else is using the effect's transfers
+        if( !m_effect.request_buffer_transfer( m_transfer ) )
+        {
+            fail();
+        }
+    }
+
+    bool                        write_header()
+    {
+        SNAPSHOT_HEADER header;
+        header.m_sample_size_in_bits = m_transfer.m_sample_size_in_bits;
+        header.m_num_channels   = m_transfer.m_num_channels;
+        header.m_size_in_bytes  = m_transfer.m_size_in_bytes;
+        header.m_write_head     = m_transfer.m_write_head;
+
+        uint8_t data[SNAPSHOT_HEADER_SIZE_IN_BYTES];
+        encode_snapshot_header( header, data );
+        return m_file->write( data, SNAPSHOT_HEADER_SIZE_IN_BYTES ) == SNAPSHOT_HEADER_SIZE_IN_BYTES;
+    }
+
+    bool                        write_checksum()
+    {
+        uint8_t data[SNAPSHOT_CHECKSUM_SIZE_IN_BYTES];
+        write_snapshot_u32( data, m_checksum );
+        return m_file->write( data, SNAPSHOT_CHECKSUM_SIZE_IN_BYTES ) == SNAPSHOT_CHECKSUM_SIZE_IN_BYTES;
+    }
+
+    bool                        read_checksum()
+    {
+        uint8_t data[SNAPSHOT_CHECKSUM_SIZE_IN_BYTES];
+        return m_file->read( data, SNAPSHOT_CHECKSUM_SIZE_IN_BYTES ) == SNAPSHOT_CHECKSUM_SIZE_IN_BYTES && read_snapshot_u32( data ) == m_checksum;
+    }
+
+    // each result is followed by the next request, or the end
+    STATE                       update_save()
+    {
+        if( m_transfer.m_request == BUFFER_TRANSFER::INFO )
+        {
+            if( !m_transfer.m_frozen || !write_header() )
+            {
+                return fail();
+            }
+        }
+        else
+        {
+            if( !m_transfer.m_success || m_file->write( m_transfer.m_data, m_transfer.m_size ) != m_transfer.m_size )
+            {
+                return fail();
+            }
+            add_to_checksum( m_transfer.m_data, m_transfer.m_size );
+            m_offset            += m_transfer.m_size;
+        }
+
+        if( m_offset == m_transfer.m_size_in_bytes )
+        {
+            m_state             = write_checksum() ? DONE : FAILED;
+            return m_state;
+        }
+
+        request( BUFFER_TRANSFER::READ_CHUNK );
+        return m_state;
+    }
+
+    STATE                       update_recall()
+    {
+        switch( m_transfer.m_request )
+        {
+            case BUFFER_TRANSFER::INFO:
+            {
+                // check the file fits the buffer before anything changes, the effect checks the rest
+                uint8_t data[SNAPSHOT_HEADER_SIZE_IN_BYTES];
+                SNAPSHOT_HEADER header;
+                if( m_file->read( data, SNAPSHOT_HEADER_SIZE_IN_BYTES ) != SNAPSHOT_HEADER_SIZE_IN_BYTES || !decode_snapshot_header( data, header ) ||
+                    header.m_num_channels != m_transfer.m_num_channels || header.m_size_in_bytes != m_transfer.m_size_in_bytes ||
+                    !DELAY_BUFFER::valid_bit_depth( header.m_sample_size_in_bits ) )
+                {
+                    return fail();
+                }
+
+                // published first, so the block that restores also keeps the bit depth and freeze
+                m_effect.set_bit_depth( header.m_sample_size_in_bits );
+                m_effect.set_freeze_active( true );
+                m_effect.publish_parameters();
+
+                m_transfer.m_sample_size_in_bits = header.m_sample_size_in_bits;
+                m_transfer.m_write_head = header.m_write_head;
+                request( BUFFER_TRANSFER::RESTORE );
+                return m_state;
+            }
+            case BUFFER_TRANSFER::RESTORE:
+            case BUFFER_TRANSFER::WRITE_CHUNK:
+            {
+                if( !m_transfer.m_success )
+                {
+                    return fail();
+                }
+                m_offset        += m_transfer.m_request == BUFFER_TRANSFER::WRITE_CHUNK ? m_transfer.m_size : 0;
+                break;
+            }
+            case BUFFER_TRANSFER::READ_CHUNK:
+            {
+                return fail();
+            }
+        }
+
+        if( m_offset == m_transfer.m_size_in_bytes )
+        {
+            m_state             = read_checksum() ? DONE : FAILED;
+            return m_state;
+        }
+
+        const int size          = next_chunk_size();
+        if( m_file->read( m_transfer.m_data, size ) != size )
+        {
+            return fail();
+        }
+        add_to_checksum( m_transfer.m_data, size );
+
+        request( BUFFER_TRANSFER::WRITE_CHUNK );
+        return m_state;
+    }
+
+    bool                        start( SNAPSHOT_FILE& file, STATE state )
+    {
+        if( busy() )
+        {
+            return false;
+        }
+
+        m_file                  = &file;
+        m_state                 = state;
+        m_transfer              = BUFFER_TRANSFER();
+        m_offset                = 0;
+        m_checksum              = CHECKSUM_START;
+        m_num_ticks             = 0;
+
+        if( !m_effect.request_buffer_transfer( m_transfer ) )
+        {
+            fail();
+            return false;
+        }
+        return true;
+    }
+
+public:
+
+    explicit BUFFER_SNAPSHOT( GLITCH_DELAY_EFFECT& effect ) :
+        m_effect( effect ),
+        m_file( nullptr ),
+        m_state( IDLE ),
+        m_transfer(),
+        m_offset( 0 ),
+        m_checksum( CHECKSUM_START ),
+        m_num_ticks( 0 )
+    {
+    }
+
+    // the buffer has to be frozen for the whole save, file must stay open until update() returns DONE or FAILED
+    bool                        start_save( SNAPSHOT_FILE& file )       { return start( file, SAVING ); }
+    bool                        start_recall( SNAPSHOT_FILE& file )     { return start( file, RECALLING ); }
+
+    // from loop(), once per control tick, moves at most one chunk
+    STATE                       update()
+    {
+        if( !busy() )
+        {
+            return m_state;
+        }
+
+        ++m_num_ticks;
+        if( !m_effect.collect_buffer_transfer( m_transfer ) )
+        {
+            // update() hasn't run since the request
+            return m_state;
+        }
+
+        return m_state == SAVING ? update_save() : update_recall();
+    }
+
+    STATE                       state() const           { return m_state; }
+    bool                        busy() const            { return m_state == SAVING || m_state == RECALLING; }
+
+    int                         bytes_done() const      { return m_offset; }
+    int                         size_in_bytes() const   { return m_transfer.m_size_in_bytes; }
+    uint32_t                    num_ticks() const       { return m_num_ticks; }
+};
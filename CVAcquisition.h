@@ -0,0 +1,301 @@
+#pragma once
+
+#include <stdint.h>
+#include "SeqLock.h"
+
+// Reads the CV inputs from the PIC (PIC/CV_I2C.c) without stalling loop(). loop() starts a transfer each control
+// tick and carries on, the bus interrupt fills the receive buffer and hands the finished frame to CV_ACQUISITION,
+// which checks it and publishes it to loop() through a SEQLOCK_BUFFER (the two frame buffers).
+//
+// The PIC answers on two addresses. Reading the full address gives every channel:
+//      6 x 10-bit channel (low byte first), scan sequence, checksum                    14 bytes
+// reading the delta address gives only the channels that moved since they were last sent:
+//      change mask, 10-bit channel for each set bit, scan sequence, checksum           3 to 15 bytes
+// The sequence only moves when the PIC has finished a new scan of every channel, so a full frame repeating the last
+// sequence is stale. The checksum is the inverted 8-bit sum of the other bytes, which also fails for a bus that
+// reads back all 0s or all 1s when the PIC isn't answering.
+// A lost delta frame loses those changes, so the next read after any failure is a full one, as is every
+// CV_FULL_READ_INTERVAL'th read.
+
+static const int                CV_NUM_CHANNELS             = 6;
+static const int                CV_FRAME_SIZE_IN_BYTES      = CV_NUM_CHANNELS * 2 + 2;
+static const int                CV_MAX_READ_SIZE_IN_BYTES   = CV_FRAME_SIZE_IN_BYTES + 1;
+static const int                CV_FULL_READ_INTERVAL       = 64;
+
+struct CV_FRAME
+{
+    uint16_t                    m_values[CV_NUM_CHANNELS];
+    uint8_t                     m_sequence;
+};
+
+inline uint8_t cv_frame_checksum( const uint8_t* data, int size )
+{
+    uint8_t sum = 0;
+    for( int b = 0; b < size - 1; ++b )
+    {
+        sum += data[b];
+    }
+
+    return ~sum;
+}
+
+inline int cv_delta_size( uint8_t change_mask )
+{
+    int size = 3;
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        size += ( change_mask >> c ) & 1 ? 2 : 0;
+    }
+
+    return size;
+}
+
+// returns false if the checksum doesn't match
+inline bool decode_cv_frame( const uint8_t* data, CV_FRAME& frame )
+{
+    if( data[ CV_FRAME_SIZE_IN_BYTES - 1 ] != cv_frame_checksum( data, CV_FRAME_SIZE_IN_BYTES ) )
+    {
+        return false;
+    }
+
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        frame.m_values[c]       = data[ c * 2 ] | ( data[ c * 2 + 1 ] << 8 );
+    }
+    frame.m_sequence            = data[ CV_NUM_CHANNELS * 2 ];
+
+    return true;
+}
+
+// applies the changed channels to frame, returns false (leaving frame alone) if the checksum doesn't match
+inline bool decode_cv_delta( const uint8_t* data, CV_FRAME& frame )
+{
+    const uint8_t change_mask   = data[0];
+    const int size              = cv_delta_size( change_mask );
+    if( change_mask >> CV_NUM_CHANNELS || data[ size - 1 ] != cv_frame_checksum( data, size ) )
+    {
+        return false;
+    }
+
+    const uint8_t* value        = data + 1;
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        if( ( change_mask >> c ) & 1 )
+        {
+            frame.m_values[c]   = value[0] | ( value[1] << 8 );
+            value               += 2;
+        }
+    }
+    frame.m_sequence            = data[ size - 2 ];
+
+    return true;
+}
+
+inline void encode_cv_frame( const CV_FRAME& frame, uint8_t* data )
+{
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        data[ c * 2 ]           = frame.m_values[c] & 0xFF;
+        data[ c * 2 + 1 ]       = frame.m_values[c] >> 8;
+    }
+    data[ CV_NUM_CHANNELS * 2 ] = frame.m_sequence;
+    data[ CV_FRAME_SIZE_IN_BYTES - 1 ] = cv_frame_checksum( data, CV_FRAME_SIZE_IN_BYTES );
+}
+
+// returns the size written
+inline int encode_cv_delta( const CV_FRAME& frame, uint8_t change_mask, uint8_t* data )
+{
+    int size                    = 0;
+    data[ size++ ]              = change_mask;
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        if( ( change_mask >> c ) & 1 )
+        {
+            data[ size++ ]      = frame.m_values[c] & 0xFF;
+            data[ size++ ]      = frame.m_values[c] >> 8;
+        }
+    }
+    data[ size++ ]              = frame.m_sequence;
+    data[ size ]                = cv_frame_checksum( data, size + 1 );
+
+    return size + 1;
+}
+
+////////////////////////////////////
+
+class CV_BUS_LISTENER
+{
+public:
+
+    virtual ~CV_BUS_LISTENER() {}
+
+    // the length of a read can depend on its first byte, the bus asks once it has arrived
+    virtual int                 read_size( uint8_t first_byte ) const = 0;
+    virtual void                read_complete( bool success ) = 0;
+};
+
+// a bus that can read from a device in the background (I2C_CV_BUS on the Teensy, MOCK_CV_BUS on the host)
+class CV_BUS
+{
+public:
+
+    virtual ~CV_BUS() {}
+
+    // start reading from the device at address into data (max_size bytes long) and return straight away, or return
+    // false if the bus is busy. listener->read_size() and read_complete() are called from the bus interrupt
+    virtual bool                start_read( uint8_t address, uint8_t* data, int max_size, CV_BUS_LISTENER* listener ) = 0;
+};
+
+////////////////////////////////////
+
+class CV_ACQUISITION : public CV_BUS_LISTENER
+{
+    CV_BUS&                     m_bus;
+    uint8_t                     m_full_address;
+    uint8_t                     m_delta_address;
+
+    // bus interrupt side
+    uint8_t                     m_receive_buffer[CV_MAX_READ_SIZE_IN_BYTES];
+    bool                        m_transfer_active;
+    bool                        m_delta_read;
+    bool                        m_need_full_read;
+    bool                        m_sequence_valid;
+    CV_FRAME                    m_current_frame;
+
+    SEQLOCK_BUFFER< CV_FRAME >  m_frames;
+
+    // loop() side
+    uint32_t                    m_frames_taken;
+    int                         m_reads_since_full;
+
+    uint32_t                    m_num_transfers;
+    uint32_t                    m_num_failed;
+    uint32_t                    m_num_corrupt;
+    uint32_t                    m_num_stale;
+    uint32_t                    m_num_bytes;
+
+    static uint32_t             load( const uint32_t& counter )             { return __atomic_load_n( &counter, __ATOMIC_RELAXED ); }
+    static void                 add( uint32_t& counter, uint32_t amount )   { __atomic_store_n( &counter, counter + amount, __ATOMIC_RELAXED ); }
+
+public:
+
+    // delta_address == full_address always reads full frames
+    CV_ACQUISITION( CV_BUS& bus, uint8_t full_address, uint8_t delta_address ) :
+        m_bus( bus ),
+        m_full_address( full_address ),
+        m_delta_address( delta_address ),
+        m_receive_buffer(),
+        m_transfer_active( false ),
+        m_delta_read( false ),
+        m_need_full_read( true ),
+        m_sequence_valid( false ),
+        m_current_frame(),
+        m_frames(),
+        m_frames_taken( 0 ),
+        m_reads_since_full( 0 ),
+        m_num_transfers( 0 ),
+        m_num_failed( 0 ),
+        m_num_corrupt( 0 ),
+        m_num_stale( 0 ),
+        m_num_bytes( 0 )
+    {
+    }
+
+    // loop() only, starts the next frame unless the last one is still on the bus
+    bool                        start_read()
+    {
+        if( __atomic_load_n( &m_transfer_active, __ATOMIC_ACQUIRE ) )
+        {
+            return false;
+        }
+
+        const bool full_read    = m_need_full_read || m_delta_address == m_full_address || m_reads_since_full >= CV_FULL_READ_INTERVAL;
+        m_delta_read            = !full_read;
+
+        __atomic_store_n( &m_transfer_active, true, __ATOMIC_RELAXED );
+        if( !m_bus.start_read( full_read ? m_full_address : m_delta_address, m_receive_buffer, CV_MAX_READ_SIZE_IN_BYTES, this ) )
+        {
+            __atomic_store_n( &m_transfer_active, false, __ATOMIC_RELAXED );
+            return false;
+        }
+
+        m_reads_since_full      = full_read ? 0 : m_reads_since_full + 1;
+
+        return true;
+    }
+
+    // loop() only, returns true and fills in frame if a new frame has arrived since the last call, otherwise frame is left alone
+    bool                        latest_frame( CV_FRAME& frame )
+    {
+        const uint32_t frames_published = m_frames.publish_count();
+        if( frames_published == m_frames_taken )
+        {
+            return false;
+        }
+
+        CV_FRAME new_frame;
+        if( !m_frames.read( new_frame ) )
+        {
+            return false;
+        }
+
+        frame           = new_frame;
+        m_frames_taken  = frames_published;
+
+        return true;
+    }
+
+    bool                        transfer_active() const     { return __atomic_load_n( &m_transfer_active, __ATOMIC_ACQUIRE ); }
+
+    uint32_t                    num_frames() const          { return m_frames.publish_count(); }
+    uint32_t                    num_transfers() const       { return load( m_num_transfers ); }
+    uint32_t                    num_failed() const          { return load( m_num_failed ); }      // bus errors, PIC didn't answer
+    uint32_t                    num_corrupt() const         { return load( m_num_corrupt ); }     // checksum mismatch
+    uint32_t                    num_stale() const           { return load( m_num_stale ); }       // nothing new since the last read
+    uint32_t                    num_bytes() const           { return load( m_num_bytes ); }       // read successfully
+
+    // bus interrupt only
+    int                         read_size( uint8_t first_byte ) const override
+    {
+        return m_delta_read ? cv_delta_size( first_byte ) : CV_FRAME_SIZE_IN_BYTES;
+    }
+
+    void                        read_complete( bool success ) override
+    {
+        add( m_num_transfers, 1 );
+
+        CV_FRAME frame          = m_current_frame;
+        if( !success )
+        {
+            add( m_num_failed, 1 );
+            m_need_full_read    = true;
+        }
+        else if( m_delta_read ? !decode_cv_delta( m_receive_buffer, frame ) : !decode_cv_frame( m_receive_buffer, frame ) )
+        {
+            add( m_num_corrupt, 1 );
+            m_need_full_read    = true;
+        }
+        else
+        {
+            add( m_num_bytes, m_delta_read ? cv_delta_size( m_receive_buffer[0] ) : CV_FRAME_SIZE_IN_BYTES );
+
+            // a delta only carries what moved, a full frame is only new if the PIC has finished another scan
+            const bool changed  = m_delta_read ? m_receive_buffer[0] != 0 : !m_sequence_valid || frame.m_sequence != m_current_frame.m_sequence;
+
+            m_need_full_read    = false;
+            m_sequence_valid    = true;
+            m_current_frame     = frame;
+
+            if( changed )
+            {
+                m_frames.publish( frame );
+            }
+            else
+            {
+                add( m_num_stale, 1 );
+            }
+        }
+
+        __atomic_store_n( &m_transfer_active, false, __ATOMIC_RELEASE );
+    }
+};
@@ -3,6 +3,35 @@
 //#define DEBUG_OUTPUT
 //#define STANDALONE_AUDIO
 #define PERF_CHECK
+//#define PROFILE_AUDIO         // per stage cycle counts for the audio update, see Profiler.h
+#if !defined(TARGET_HOST) && !defined(TARGET_JUCE)    // host builds (see Host/) and the JUCE plugin define theirs before including anything
 #define TARGET_TEENSY
+#else
+#define PROFILE_AUDIO
+#endif
 //#define SET_TEMPO
+//#define CLOCK_INPUT           // follow clock pulses on GLITCH_DELAY_INTERFACE::CLOCK_INPUT_PIN as well as taps, see TempoTracker.h
+#ifndef PLAY_HEAD_POOL_SIZE     // maximum play heads, the number in use is set by GLITCH_DELAY_EFFECT::configure_play_heads()
+#ifdef TARGET_HOST
+#define PLAY_HEAD_POOL_SIZE 16
+#else
+#define PLAY_HEAD_POOL_SIZE 8
+#endif
+#endif
+#ifndef MAX_BLOCK_SAMPLES       // largest block update() can be handed, sizes the scratch buffers, see ENGINE_CONFIG. The JUCE plugin may define its own
+#ifdef TARGET_TEENSY
+#define MAX_BLOCK_SAMPLES 128
+#else
+#define MAX_BLOCK_SAMPLES 512
+#endif
+#endif
+#ifndef MAX_DELAY_CHANNELS      // 2 allows the stereo interleaved delay buffer (ENGINE_CONFIG::m_num_channels), and doubles the scratch buffers
+#ifdef TARGET_TEENSY
+#define MAX_DELAY_CHANNELS 1
+#else
+#define MAX_DELAY_CHANNELS 2
+#endif
+#endif
+//#define EXTERNAL_DELAY_MEMORY  // the delay buffer lives in external memory, see DelayStorage.h, and the internal buffer shrinks to 64KB
+//#define ADPCM_DELAY_BUFFER    // store the delay buffer as 4-bit ADPCM (SampleFormat.h), nearly 3 times the delay of 12-bit
 #define I2C_INTERFACE
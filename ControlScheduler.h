@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Util.h"
+
+// loop() runs the interface at a fixed rate rather than as fast as it can, and only pushes the values that
+// have moved since they were last pushed, so the I2C bus and the mixers aren't busy while the audio interrupt runs
+
+class CONTROL_SCHEDULER
+{
+public:
+
+  CONTROL_SCHEDULER( uint32_t rate_hz );
+
+  void                      set_rate( uint32_t rate_hz );
+
+  bool                      tick_due( uint32_t time_in_us );  // returns true at most once per period, missed ticks are dropped
+
+private:
+
+  uint32_t                  m_period_us;
+  uint32_t                  m_next_tick_us;
+};
+
+//////////////////////////////////////////////////
+
+class CONTROL_VALUE
+{
+public:
+
+  CONTROL_VALUE( float threshold );
+
+  bool                      changed( float value );           // returns true (and takes value as pushed) on the first call and when value moves more than the threshold
+  void                      force_push();                     // the next call to changed() returns true
+
+private:
+
+  float                     m_pushed_value;
+  float                     m_threshold;
+  bool                      m_valid;
+};
@@ -0,0 +1,66 @@
+#include "ControlScheduler.h"
+
+CONTROL_SCHEDULER::CONTROL_SCHEDULER( uint32_t rate_hz ) :
+  m_period_us( 0 ),
+  m_next_tick_us( 0 )
+{
+  set_rate( rate_hz );
+}
+
+void CONTROL_SCHEDULER::set_rate( uint32_t rate_hz )
+{
+  ASSERT_MSG( rate_hz > 0, "CONTROL_SCHEDULER::set_rate() rate must be positive" );
+  m_period_us = 1000000 / rate_hz;
+}
+
+bool CONTROL_SCHEDULER::tick_due( uint32_t time_in_us )
+{
+  // signed difference so the comparison survives micros() wrapping
+  if( static_cast<int32_t>( time_in_us - m_next_tick_us ) < 0 )
+  {
+    return false;
+  }
+
+  m_next_tick_us += m_period_us;
+
+  // fallen more than a period behind (first tick, or a long serial write), restart from now rather than catching up in a burst
+  if( static_cast<int32_t>( time_in_us - m_next_tick_us ) >= 0 )
+  {
+    m_next_tick_us = time_in_us + m_period_us;
+  }
+
+  return true;
+}
+
+//////////////////////////////////////////////////
+
+CONTROL_VALUE::CONTROL_VALUE( float threshold ) :
+  m_pushed_value( 0.0f ),
+  m_threshold( threshold ),
+  m_valid( false )
+{
+  
+}
+
+bool CONTROL_VALUE::changed( float value )
+{
+  const float difference = value > m_pushed_value ? value - m_pushed_value : m_pushed_value - value;
+
+  // always let a dial settle exactly on its end stops, even if it got there in a step smaller than the threshold
+  const bool at_end_stop = ( value <= 0.0f || value >= 1.0f ) && value != m_pushed_value;
+
+  if( m_valid && difference <= m_threshold && !at_end_stop )
+  {
+    return false;
+  }
+
+  m_pushed_value  = value;
+  m_valid         = true;
+
+  return true;
+}
+
+void CONTROL_VALUE::force_push()
+{
+  m_valid = false;
+}
@@ -0,0 +1,542 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "CompileSwitches.h"
+#include "Util.h"
+
+// Where DELAY_BUFFER keeps its bytes. The sample formats (SampleFormat.h) work on one block of the storage at a time:
+// reads and writes never cross a block, and every block is a multiple of DELAY_STORAGE_BLOCK_ALIGNMENT bytes, so it
+// starts on a whole group (and a whole frame) of every format and can be packed as if it were a buffer of its own.
+// An ADPCM group doesn't divide the alignment, so a block holds as many whole groups as fit and the bytes after them
+// go unused.
+//
+// INTERNAL_DELAY_STORAGE is the RAM buffer, as a single block. CACHED_DELAY_STORAGE keeps a longer buffer in slower
+// external memory (a DELAY_MEMORY) behind a small cache of blocks in RAM. The play heads ask for the blocks they will
+// read next with prefetch() at the end of each update(), so the memory has until the next update() to load them.
+
+#ifdef EXTERNAL_DELAY_MEMORY
+static const int                DELAY_BUFFER_SIZE_IN_BYTES      = 1024 * 64;       // only used until the external storage is attached
+#else
+static const int                DELAY_BUFFER_SIZE_IN_BYTES      = 1024 * 240;      // 240k
+#endif
+
+static const int                DELAY_STORAGE_BLOCK_ALIGNMENT   = 12;               // 8, 12 and 16-bit groups, mono or stereo
+
+class DELAY_STORAGE
+{
+public:
+
+    virtual ~DELAY_STORAGE() {}
+
+    virtual int                 size_in_bytes() const = 0;
+    virtual int                 block_size_in_bytes() const = 0;
+
+    // the bytes of a block, only valid until the next call to the storage
+    virtual const uint8_t*      read_block( int block ) = 0;
+    virtual uint8_t*            write_block( int block ) = 0;
+
+    // start loading the blocks covering these bytes in the background, ready for a later read or write
+    virtual void                prefetch( int /*first_byte*/, int /*num_bytes*/ )  {}
+
+    // zero every byte, called from update() on a bit depth change so has to be quick
+    virtual void                clear() = 0;
+
+    // times update() has had to wait for the storage
+    virtual uint32_t            num_stalls() const                          { return 0; }
+};
+
+////////////////////////////////////
+
+class INTERNAL_DELAY_STORAGE : public DELAY_STORAGE
+{
+    uint8_t                     m_buffer[DELAY_BUFFER_SIZE_IN_BYTES];
+
+public:
+
+    INTERNAL_DELAY_STORAGE() :
+        m_buffer()
+    {
+    }
+
+    int                         size_in_bytes() const override              { return DELAY_BUFFER_SIZE_IN_BYTES; }
+    int                         block_size_in_bytes() const override        { return DELAY_BUFFER_SIZE_IN_BYTES; }
+
+    const uint8_t*              read_block( int ) override                  { return m_buffer; }
+    uint8_t*                    write_block( int ) override                 { return m_buffer; }
+
+    void                        clear() override                            { memset( m_buffer, 0, sizeof(m_buffer) ); }
+};
+
+////////////////////////////////////
+
+class DELAY_MEMORY_LISTENER
+{
+public:
+
+    virtual ~DELAY_MEMORY_LISTENER() {}
+
+    // a transfer finished in the background (the memory's interrupt), so the next can start. Not called while the
+    // listener is inside a DELAY_MEMORY call, so a memory interrupting update() has to defer it to the same priority
+    virtual void                transfer_complete() = 0;
+};
+
+// slow memory behind CACHED_DELAY_STORAGE (MAPPED_DELAY_MEMORY, or LATENCY_DELAY_MEMORY on the host), one transfer at a time
+class DELAY_MEMORY
+{
+public:
+
+    virtual ~DELAY_MEMORY() {}
+
+    // a memory that copies straight away never calls it
+    virtual void                set_listener( DELAY_MEMORY_LISTENER* /*listener*/ )    {}
+
+    virtual int                 size_in_bytes() const = 0;
+
+    // start a transfer and return straight away, or return false if the last one hasn't finished. data has to stay
+    // valid until the transfer has finished
+    virtual bool                start_read( int address, uint8_t* data, int size ) = 0;
+    virtual bool                start_write( int address, const uint8_t* data, int size ) = 0;
+
+    virtual bool                transfer_active() = 0;
+
+    // block until the transfer in progress has finished
+    virtual void                wait_for_transfer() = 0;
+};
+
+// external RAM mapped into the address space (EXTMEM PSRAM on a Teensy 4.1), copied in full when a transfer starts
+class MAPPED_DELAY_MEMORY : public DELAY_MEMORY
+{
+    uint8_t*                    m_memory;
+    int                         m_size_in_bytes;
+
+public:
+
+    MAPPED_DELAY_MEMORY( uint8_t* memory, int size_in_bytes ) :
+        m_memory( memory ),
+        m_size_in_bytes( size_in_bytes )
+    {
+    }
+
+    int                         size_in_bytes() const override      { return m_size_in_bytes; }
+
+    bool                        start_read( int address, uint8_t* data, int size ) override
+    {
+        memcpy( data, m_memory + address, size );
+        return true;
+    }
+
+    bool                        start_write( int address, const uint8_t* data, int size ) override
+    {
+        memcpy( m_memory + address, data, size );
+        return true;
+    }
+
+    bool                        transfer_active() override          { return false; }
+    void                        wait_for_transfer() override        {}
+};
+
+////////////////////////////////////
+
+// A DELAY_MEMORY seen through NUM_SLOTS blocks of RAM. Blocks are evicted least recently used first. Prefetched blocks
+// are queued and loaded one after another as the memory finishes each transfer, and when nothing is queued the
+// memory writes back a block the write head has finished with, so evicting rarely has to wait for a write. Blocks
+// that haven't been written since clear() are never read from the memory, they are zeroed in the cache instead.
+// update() only waits when it reads a block that isn't loaded yet, which the counters report.
+class CACHED_DELAY_STORAGE : public DELAY_STORAGE, public DELAY_MEMORY_LISTENER
+{
+public:
+
+    static const int            MAX_SLOTS               = 64;
+    static const int            MAX_BLOCKS              = 8192;     // of the memory, for the cleared flags
+
+private:
+
+    enum SLOT_STATE
+    {
+        SLOT_EMPTY,
+        SLOT_QUEUED,            // prefetched, waiting for the memory
+        SLOT_LOADING,
+        SLOT_VALID,
+    };
+
+    struct SLOT
+    {
+        int                     m_block;
+        uint8_t                 m_state;
+        bool                    m_dirty;
+        bool                    m_writing;                  // being written back, can be read but not changed
+        uint32_t                m_last_used;
+    };
+
+    struct QUEUED_READ
+    {
+        int                     m_slot;
+        int                     m_block;
+    };
+
+    DELAY_MEMORY&               m_memory;
+    uint8_t*                    m_cache;
+    int                         m_block_size_in_bytes;
+    int                         m_num_slots;
+    int                         m_num_blocks;
+
+    SLOT                        m_slots[MAX_SLOTS];
+    uint32_t                    m_use_count;
+    int                         m_last_slot;                // most recent lookup, heads read several runs from the same block
+    int                         m_last_written_block;
+
+    QUEUED_READ                 m_queue[MAX_SLOTS * 2];     // stale entries are skipped, so allow for some
+    int                         m_queue_start;
+    int                         m_queue_size;
+
+    int                         m_transfer_slot;            // < 0 when the memory is idle
+    bool                        m_transfer_is_write;
+
+    uint8_t                     m_cleared[MAX_BLOCKS / 8];
+
+    uint32_t                    m_num_hits;
+    uint32_t                    m_num_late;
+    uint32_t                    m_num_misses;
+    uint32_t                    m_num_stalls;
+    uint32_t                    m_num_prefetches;
+    uint32_t                    m_num_write_backs;
+
+    uint8_t*                    slot_bytes( int slot )                  { return m_cache + ( slot * m_block_size_in_bytes ); }
+
+    bool                        block_cleared( int block ) const        { return ( m_cleared[ block >> 3 ] >> ( block & 7 ) ) & 1; }
+
+    int                         find_slot( int block )
+    {
+        if( m_slots[m_last_slot].m_block == block && m_slots[m_last_slot].m_state != SLOT_EMPTY )
+        {
+            return m_last_slot;
+        }
+
+        for( int s = 0; s < m_num_slots; ++s )
+        {
+            if( m_slots[s].m_block == block && m_slots[s].m_state != SLOT_EMPTY )
+            {
+                m_last_slot = s;
+                return s;
+            }
+        }
+
+        return -1;
+    }
+
+    void                        stall()
+    {
+        ++m_num_stalls;
+        m_memory.wait_for_transfer();
+        finish_transfer();
+    }
+
+    void                        finish_transfer()
+    {
+        if( m_transfer_slot < 0 || m_memory.transfer_active() )
+        {
+            return;
+        }
+
+        SLOT& slot              = m_slots[m_transfer_slot];
+        if( m_transfer_is_write )
+        {
+            slot.m_writing      = false;
+        }
+        else
+        {
+            slot.m_state        = SLOT_VALID;
+        }
+
+        m_transfer_slot         = -1;
+    }
+
+    void                        start_transfer( int slot, bool write )
+    {
+        ASSERT_MSG( m_transfer_slot < 0, "CACHED_DELAY_STORAGE::start_transfer() memory busy" );
+
+        SLOT& s                 = m_slots[slot];
+        const int address       = s.m_block * m_block_size_in_bytes;
+        if( write )
+        {
+            m_cleared[ s.m_block >> 3 ] &= ~( 1 << ( s.m_block & 7 ) );
+            s.m_dirty           = false;
+            s.m_writing         = true;
+            m_memory.start_write( address, slot_bytes( slot ), m_block_size_in_bytes );
+            ++m_num_write_backs;
+        }
+        else
+        {
+            s.m_state           = SLOT_LOADING;
+            m_memory.start_read( address, slot_bytes( slot ), m_block_size_in_bytes );
+        }
+
+        m_transfer_slot         = slot;
+        m_transfer_is_write     = write;
+
+        // a memory that copies straight away has already finished
+        finish_transfer();
+    }
+
+    // a block that was never written needs no transfer, returns false if it does
+    bool                        load_cleared( int slot )
+    {
+        SLOT& s                 = m_slots[slot];
+        if( !block_cleared( s.m_block ) )
+        {
+            return false;
+        }
+
+        memset( slot_bytes( slot ), 0, m_block_size_in_bytes );
+        s.m_state               = SLOT_VALID;
+        return true;
+    }
+
+    // keep the memory busy, queued reads first then writing back blocks the write head has left
+    void                        service()
+    {
+        finish_transfer();
+
+        while( m_transfer_slot < 0 && m_queue_size > 0 )
+        {
+            const QUEUED_READ read  = m_queue[m_queue_start];
+            m_queue_start           = ( m_queue_start + 1 ) % ( MAX_SLOTS * 2 );
+            --m_queue_size;
+
+            SLOT& s                 = m_slots[read.m_slot];
+            if( s.m_state == SLOT_QUEUED && s.m_block == read.m_block && !load_cleared( read.m_slot ) )
+            {
+                start_transfer( read.m_slot, false );
+            }
+        }
+
+        if( m_transfer_slot < 0 )
+        {
+            int oldest_slot         = -1;
+            for( int s = 0; s < m_num_slots; ++s )
+            {
+                const SLOT& slot    = m_slots[s];
+                if( slot.m_dirty && !slot.m_writing && slot.m_block != m_last_written_block &&
+                    ( oldest_slot < 0 || slot.m_last_used < m_slots[oldest_slot].m_last_used ) )
+                {
+                    oldest_slot     = s;
+                }
+            }
+
+            if( oldest_slot >= 0 )
+            {
+                start_transfer( oldest_slot, true );
+            }
+        }
+    }
+
+    // the least recently used slot that can be reused, a dirty slot only when allow_write_back (it has to be written
+    // back first, which waits for the memory), returns -1 if there isn't one
+    int                         find_victim( bool allow_write_back )
+    {
+        int victim              = -1;
+        for( int s = 0; s < m_num_slots; ++s )
+        {
+            const SLOT& slot    = m_slots[s];
+            if( slot.m_state == SLOT_EMPTY )
+            {
+                return s;
+            }
+
+            const bool usable   = slot.m_state != SLOT_LOADING && !slot.m_writing && ( allow_write_back || !slot.m_dirty );
+            if( usable && ( victim < 0 || slot.m_last_used < m_slots[victim].m_last_used ) )
+            {
+                victim          = s;
+            }
+        }
+
+        return victim;
+    }
+
+    int                         assign_slot( int slot, int block )
+    {
+        SLOT& s                 = m_slots[slot];
+        if( s.m_dirty )
+        {
+            while( m_transfer_slot >= 0 )
+            {
+                stall();
+            }
+            start_transfer( slot, true );
+            while( m_transfer_slot >= 0 )
+            {
+                stall();
+            }
+        }
+
+        s.m_block               = block;
+        s.m_state               = SLOT_EMPTY;
+        s.m_dirty               = false;
+        m_last_slot             = slot;
+
+        return slot;
+    }
+
+    // the slot holding block, loaded, waiting for the memory if it has to
+    int                         load_block( int block )
+    {
+        service();
+
+        int slot                = find_slot( block );
+        if( slot >= 0 && m_slots[slot].m_state == SLOT_VALID )
+        {
+            ++m_num_hits;
+        }
+        else
+        {
+            if( slot >= 0 )
+            {
+                ++m_num_late;
+            }
+            else
+            {
+                ++m_num_misses;
+                slot            = assign_slot( find_victim( true ), block );
+            }
+
+            SLOT& s             = m_slots[slot];
+            if( s.m_state != SLOT_LOADING && !load_cleared( slot ) )
+            {
+                // jump the queue
+                while( m_transfer_slot >= 0 )
+                {
+                    stall();
+                }
+                start_transfer( slot, false );
+            }
+
+            while( s.m_state != SLOT_VALID )
+            {
+                stall();
+            }
+        }
+
+        m_slots[slot].m_last_used = ++m_use_count;
+        return slot;
+    }
+
+public:
+
+    // cache is num_slots blocks of block_size_in_bytes (a multiple of DELAY_STORAGE_BLOCK_ALIGNMENT), only whole blocks
+    // of the memory are used
+    CACHED_DELAY_STORAGE( DELAY_MEMORY& memory, uint8_t* cache, int block_size_in_bytes, int num_slots ) :
+        m_memory( memory ),
+        m_cache( cache ),
+        m_block_size_in_bytes( block_size_in_bytes ),
+        m_num_slots( num_slots ),
+        m_num_blocks( memory.size_in_bytes() / block_size_in_bytes ),
+        m_slots(),
+        m_use_count( 0 ),
+        m_last_slot( 0 ),
+        m_last_written_block( -1 ),
+        m_queue(),
+        m_queue_start( 0 ),
+        m_queue_size( 0 ),
+        m_transfer_slot( -1 ),
+        m_transfer_is_write( false ),
+        m_cleared(),
+        m_num_hits( 0 ),
+        m_num_late( 0 ),
+        m_num_misses( 0 ),
+        m_num_stalls( 0 ),
+        m_num_prefetches( 0 ),
+        m_num_write_backs( 0 )
+    {
+        m_memory.set_listener( this );
+
+        ASSERT_MSG( block_size_in_bytes > 0 && block_size_in_bytes % DELAY_STORAGE_BLOCK_ALIGNMENT == 0, "CACHED_DELAY_STORAGE() invalid block size" );
+        ASSERT_MSG( num_slots > 1 && num_slots <= MAX_SLOTS, "CACHED_DELAY_STORAGE() invalid number of slots" );
+        ASSERT_MSG( m_num_blocks <= MAX_BLOCKS, "CACHED_DELAY_STORAGE() memory too large for the block size" );
+
+        clear();
+    }
+
+    int                         size_in_bytes() const override              { return m_num_blocks * m_block_size_in_bytes; }
+    int                         block_size_in_bytes() const override        { return m_block_size_in_bytes; }
+
+    const uint8_t*              read_block( int block ) override
+    {
+        return slot_bytes( load_block( block ) );
+    }
+
+    uint8_t*                    write_block( int block ) override
+    {
+        const int slot          = load_block( block );
+        SLOT& s                 = m_slots[slot];
+        while( s.m_writing )
+        {
+            stall();
+        }
+
+        s.m_dirty               = true;
+        m_last_written_block    = block;
+
+        return slot_bytes( slot );
+    }
+
+    void                        prefetch( int first_byte, int num_bytes ) override
+    {
+        const int last_block    = ( first_byte + num_bytes - 1 ) / m_block_size_in_bytes;
+        for( int block = first_byte / m_block_size_in_bytes; block <= last_block; ++block )
+        {
+            int slot            = find_slot( block );
+            if( slot < 0 )
+            {
+                // never wait to make room for a prefetch
+                const int victim = find_victim( false );
+                if( victim < 0 || m_queue_size == MAX_SLOTS * 2 )
+                {
+                    break;
+                }
+
+                slot            = assign_slot( victim, block );
+                m_slots[slot].m_state = SLOT_QUEUED;
+
+                m_queue[ ( m_queue_start + m_queue_size ) % ( MAX_SLOTS * 2 ) ] = { slot, block };
+                ++m_queue_size;
+                ++m_num_prefetches;
+            }
+
+            m_slots[slot].m_last_used = ++m_use_count;
+        }
+
+        service();
+    }
+
+    void                        clear() override
+    {
+        while( m_transfer_slot >= 0 )
+        {
+            stall();
+        }
+
+        for( int s = 0; s < m_num_slots; ++s )
+        {
+            m_slots[s]          = SLOT();
+            m_slots[s].m_block  = -1;
+        }
+        m_queue_size            = 0;
+        m_last_written_block    = -1;
+
+        memset( m_cleared, 0xFF, sizeof(m_cleared) );
+    }
+
+    void                        transfer_complete() override
+    {
+        service();
+    }
+
+    uint32_t                    num_stalls() const override     { return m_num_stalls; }
+
+    uint32_t                    num_hits() const                { return m_num_hits; }          // reads and writes of a loaded block
+    uint32_t                    num_late() const                { return m_num_late; }          // of a prefetched block that hadn't loaded yet
+    uint32_t                    num_misses() const              { return m_num_misses; }        // of a block that wasn't prefetched
+    uint32_t                    num_prefetches() const          { return m_num_prefetches; }
+    uint32_t                    num_write_backs() const         { return m_num_write_backs; }
+};
@@ -1,9 +1,40 @@
 #pragma once
 
 #include "TeensyJuce.h"
+#include "BeatClock.h"
+#include "DelayStorage.h"
+#include "PlayHeadRandom.h"
+#include "Profiler.h"
+#include "SeqLock.h"
 #include "Util.h"
 
-static const int DELAY_BUFFER_SIZE_IN_BYTES(1024*240);      // 240k
+////////////////////////////////////
+
+// fixed at init (GLITCH_DELAY_EFFECT::configure_engine()), defaults to the audio library's rate and block size
+struct ENGINE_CONFIG
+{
+	float                       m_sample_rate;
+	int                         m_max_block_samples;    // update() takes any block length up to this, 1 - MAX_BLOCK_SAMPLES
+	int                         m_num_channels;         // 1, or 2 for interleaved stereo frames (up to MAX_DELAY_CHANNELS)
+	
+	ENGINE_CONFIG();
+	ENGINE_CONFIG( float sample_rate, int max_block_samples, int num_channels = 1 );
+};
+
+// every time based limit, in samples, derived from an ENGINE_CONFIG
+struct ENGINE_LIMITS
+{
+	float                       m_sample_rate;
+	int                         m_max_block_samples;
+	int                         m_num_channels;
+	int                         m_samples_per_ms;
+	int                         m_fade_samples;         // fixed cross fade time
+	int                         m_min_loop_size;
+	int                         m_max_loop_size;
+	int                         m_max_jitter_size;
+	
+	explicit ENGINE_LIMITS( const ENGINE_CONFIG& config );
+};
 
 ////////////////////////////////////
 
@@ -11,9 +42,94 @@ class DELAY_BUFFER;
 
 ////////////////////////////////////
 
+// shared by the play heads, write head fade in and freeze transitions
+// gains are precomputed in Q15 so fades are integer only
+class FADE_CURVE
+{
+public:
+	
+	enum CURVE_TYPE
+	{
+		LINEAR,
+		EQUAL_POWER,
+		RAISED_COSINE,
+	};
+	
+private:
+	
+	static const int            MAX_TABLE_STEPS = 256;
+	static const int            UNITY_GAIN      = 1 << 15;
+	
+	uint16_t                    m_gains[MAX_TABLE_STEPS + 1];     // gain of the signal being faded out, indexed by fade samples remaining
+	int                         m_table_steps;
+	int                         m_fade_step;                      // Q16 table step per sample
+	CURVE_TYPE                  m_curve_type;
+	
+public:
+	
+	explicit FADE_CURVE( int fade_samples );
+	
+	void                        set_curve( CURVE_TYPE curve_type, int fade_samples );
+	CURVE_TYPE                  curve_type() const;
+	
+	int16_t                     cross_fade( int16_t from, int16_t to, int fade_samples_remaining ) const;
+	// size frames of CHANNELS interleaved samples, fade_samples_remaining is for the first frame, and counts down through the segment
+	template< int CHANNELS >
+	void                        cross_fade( int16_t* dest, const int16_t* from, const int16_t* to, int size, int fade_samples_remaining ) const;
+};
+
+////////////////////////////////////
+
+// interpolates runs of output samples from a window of decoded input samples, positions are Q16 relative to the window start
+class RESAMPLER
+{
+public:
+	
+	enum QUALITY
+	{
+		LINEAR,
+		HERMITE,                // 4-point cubic
+		SINC,                   // 12-tap polyphase windowed sinc
+	};
+	
+	static const int            MAX_SPEED       = 4;
+	static const int            WINDOW_BEFORE   = 5;        // input samples needed before the read position
+	static const int            WINDOW_AFTER    = 6;        // input samples needed after the read position
+	static const int            MAX_WINDOW_SIZE = ( MAX_BLOCK_SAMPLES * MAX_SPEED ) + WINDOW_BEFORE + WINDOW_AFTER + 1;
+	
+private:
+	
+	static const int            NUM_TAPS        = WINDOW_BEFORE + WINDOW_AFTER + 1;
+	static const int            NUM_PHASES      = 32;
+	static const int            PHASE_SHIFT     = 11;       // Q16 fraction -> phase
+	static const int            COEFF_SHIFT     = 14;       // coefficients are Q14
+	
+	// filter for playing at up to normal speed, and a half band filter for playing an octave up
+	int16_t                     m_sinc_full_band[NUM_PHASES][NUM_TAPS];
+	int16_t                     m_sinc_half_band[NUM_PHASES][NUM_TAPS];
+	
+	QUALITY                     m_quality;
+	
+	static void                 build_sinc_table( int16_t (&table)[NUM_PHASES][NUM_TAPS], float cutoff );
+	
+public:
+	
+	RESAMPLER();
+	
+	QUALITY                     quality() const;
+	void                        set_quality( QUALITY quality );
+	
+	// window must hold WINDOW_BEFORE frames before the first position and WINDOW_AFTER after the last, window and dest
+	// hold frames of CHANNELS interleaved samples, and the channels share the phase of each frame
+	template< int CHANNELS >
+	void                        resample( int16_t* dest, int size, const int16_t* window, int position, int step ) const;
+};
+
+////////////////////////////////////
+
 class PLAY_HEAD
 {
-	const DELAY_BUFFER&         m_delay_buffer;     // TODO pass in to save storage?
+	const DELAY_BUFFER*         m_delay_buffer;     // TODO pass in to save storage?
 	
 	float                       m_current_play_head;
 	float                       m_destination_play_head;
@@ -25,19 +141,43 @@ class PLAY_HEAD
 	int                         m_unjittered_loop_start;
 	int                         m_shift_speed;
 	
-	float                       m_next_loop_size_ratio;
+	int                         m_loop_size_span;           // above the minimum loop size, before the variation each loop
 	float                       m_next_shift_speed_ratio;
-	float                       m_jitter_ratio;
+	int                         m_shift_speed_span;
+	int                         m_max_jitter_offset;        // either side of the unjittered loop start
+	PLAY_HEAD_RANDOM::DISTRIBUTION m_jitter_distribution;
+	int                         m_jitter_subdivisions;      // QUANTIZED jitter moves in steps of the loop size over this
+	PLAY_HEAD_RANDOM            m_random;
 	
 	bool                        m_initial_loop_crossfade_complete;
+	int                         m_beat_offset;              // sample of this block's read the beat lands on, -1 for none
+	
+	uint8_t                     m_events;           // PROFILE_EVENT flags since the last take_events()
 	
 	int                         play_head_to_write_head_buffer_size() const;
-	int16_t                     read_sample_with_cross_fade();
+	
+	int                         samples_until_loop_end( int max_samples ) const;
+	// samples until the next loop end, cross fade end, or buffer wrap for a straight copy
+	int                         next_event_run_length( int max_samples, bool straight_copy ) const;
+	
+	// per sample format, so there is no bit depth switch inside the per-sample loops
+	template< typename FORMAT >
+	void                        read_cross_fade_run( int16_t* dest, int size );
+	template< typename FORMAT >
+	void                        read_resampled_run( int16_t* dest, int size );
+	template< typename FORMAT >
+	void                        read_steady_run( int16_t* dest, int size );
+	template< typename FORMAT >
+	void                        read_from_play_head_impl( int16_t* dest, int size );
 	
 public:
 	
+	PLAY_HEAD();                                    // unused pool entry, configure() before reading
 	PLAY_HEAD( const DELAY_BUFFER& delay_buffer, float play_speed );
 	
+	void                        configure( const DELAY_BUFFER& delay_buffer, float play_speed );
+	void                        reset();            // back behind the write head, after the buffer has changed size
+	
 	int                         current_position() const;
 	int                         destination_position() const;
 	
@@ -56,16 +196,27 @@ public:
 	void                        set_loop_size( float loop_size_ratio );
 	void                        set_shift_speed( float speed );
 	void                        set_jitter( float jitter );
+	void                        set_jitter_distribution( PLAY_HEAD_RANDOM::DISTRIBUTION distribution, int subdivisions );
+	void                        seed_random( uint32_t seed );
 	void                        set_play_head( int offset_from_write_head );
 	void                        set_next_loop();
+	// on the sample offset into the next read_from_play_head(), heads playing in reverse ignore beats
+	void                        set_beat( int offset );
 	
-	void                        set_loop_behind_write_head();
+	// write_head_lag - samples written since the moment the loop is for, so a beat within a block loops the audio up to it
+	void                        set_loop_behind_write_head( int write_head_lag = 0 );
 	
+	// size frames, interleaved when the buffer is stereo
 	void                        read_from_play_head( int16_t* dest, int size );
 	
+	// ask the storage for what the next read_from_play_head() will need
+	void                        prefetch() const;
+	
 	void                        enable_loop( int start, int end );
 	void                        disable_loop();
 	
+	uint8_t                     take_events();
+	
 #ifdef DEBUG_OUTPUT
 	void                        debug_output();
 #endif
@@ -77,24 +228,52 @@ class DELAY_BUFFER
 {
 	friend PLAY_HEAD;
 	
-	uint8_t                     m_buffer[DELAY_BUFFER_SIZE_IN_BYTES];
-	int                         m_buffer_size_in_samples;
+	INTERNAL_DELAY_STORAGE      m_internal_storage;
+	DELAY_STORAGE*              m_storage;
+	int                         m_storage_block_bits;       // bits in each block of m_storage
+	ENGINE_LIMITS               m_limits;
+	int                         m_buffer_size_in_samples;   // per channel, so frames when stereo
 	int                         m_sample_size_in_bits;
 	
 	int                         m_write_head;
 	
 	int                         m_fade_samples_remaining;
+	FADE_CURVE                  m_fade_curve;
+	RESAMPLER                   m_resampler;
 	
 	bool						            m_freeze_active;
+	bool                        m_freeze_fade;      // fading out the write head before freezing
+	uint32_t                    m_freeze_count;     // changes whenever frozen contents could have changed, see BUFFER_TRANSFER
 	
 	/////////
 	void                        fade_in_write();
+	void                        update_buffer_size();
+	
+	// the fewest whole frames, and the bytes they pack into, that a bit depth stores on their own
+	static void                 frame_group( int sample_size_in_bits, int num_channels, int& group_frames, int& group_bytes );
+	
+	// frames of FORMAT in each block of the storage, runs are split so they never cross a block
+	template< typename FORMAT >
+	int                         frames_per_block() const;
+	
+	template< typename FORMAT >
+	void                        write_to_buffer_impl( const int16_t* source, int size );
 
 	
 public:
 	
 	DELAY_BUFFER();
 	
+	// clears the buffer, at init only
+	void                        configure( const ENGINE_CONFIG& config );
+	const ENGINE_LIMITS&        limits() const;
+	int                         num_channels() const;
+	
+	// where the samples are kept, nullptr for the internal buffer, clears the buffer, at init only
+	void                        set_storage( DELAY_STORAGE* storage );
+	const DELAY_STORAGE&        storage() const;
+	int                         buffer_size_in_frames() const;
+	
 	int                         position_offset_from_head( int offset ) const;
 	int                         delay_offset_from_ratio( float ratio ) const;
 	int                         delay_offset_from_time( int time_in_ms ) const;
@@ -102,19 +281,72 @@ public:
 	int                         wrap_to_buffer( int position ) const;
 	bool                        write_buffer_fading_in() const;
 	
+	// mono buffers only, dispatch on the current bit depth, index is of a sample
+	void                        write_sample( int16_t sample, int index );
+	int16_t                     read_sample( int index ) const;
+	
+	// FORMAT must match the current bit depth and channels (see SampleFormat.h), the run functions below index frames
+	template< typename FORMAT >
 	void                        write_sample( int16_t sample, int index );
+	template< typename FORMAT >
 	int16_t                     read_sample( int index ) const;
-	int16_t                     read_sample_with_speed( float index, float speed ) const;
 	
-	void                        increment_head( int& head ) const;
-	void                        increment_head( float& head, float speed ) const;
+	// runs of samples, must not cross the end of the buffer
+	template< typename FORMAT >
+	void                        write_samples( const int16_t* source, int index, int count );
+	template< typename FORMAT >
+	void                        read_samples( int16_t* dest, int index, int count ) const;
+	
+	// index may be outside the buffer, and the run may cross the end of the buffer
+	template< typename FORMAT >
+	void                        read_samples_wrapped( int16_t* dest, int index, int count ) const;
+	
+	// read a run at any speed up to RESAMPLER::MAX_SPEED, advancing head
+	template< typename FORMAT >
+	void                        read_with_speed( int16_t* dest, int size, float& head, float speed ) const;
+	
+	// feedback gains are fixed point, UNITY_FEEDBACK is a gain of 1
+	static const int            FEEDBACK_BITS = 12;
+	static const int            UNITY_FEEDBACK = 1 << FEEDBACK_BITS;
+	static const int            MAX_FEEDBACK = ( UNITY_FEEDBACK * 95 ) / 100;    // below 1, so every repeat decays
+	static const int            SOFT_CLIP_KNEE = 24576;  // soft_clip() is linear up to here
 	
+	// linear up to SOFT_CLIP_KNEE, then bending smoothly towards full scale without reaching it
+	static int16_t              soft_clip( int32_t sample );
+	
+	// size frames, interleaved when stereo
 	void                        write_to_buffer( const int16_t* source, int size );
+	// with feedback (the same frames) mixed in at feedback_gain 0 - MAX_FEEDBACK. Only the feedback goes through
+	// soft_clip(), so the repeats saturate rather than wrap while the input is written the same at any gain
+	void                        write_to_buffer( const int16_t* source, const int16_t* feedback, int feedback_gain, int size );
+	
+	// load count frames from index in the background, backwards from index when count is negative, index may be
+	// outside the buffer
+	void                        prefetch_frames( int index, int count ) const;
+	void                        prefetch_write_head() const;
 	
+	// 8, 12 or 16-bit PCM, or 4 for 4-bit ADPCM (ADPCM_FORMAT in SampleFormat.h)
 	void                        set_bit_depth( int sample_size_in_bits );
+	int                         bit_depth() const;
+	static bool                 valid_bit_depth( int sample_size_in_bits );
+	// the buffer size at a bit depth, in frames of the current channels
+	int                         frames_in_storage( int sample_size_in_bits ) const;
 	
 	bool						            freeze_active() const;
 	void						            set_freeze( bool freeze );
+	uint32_t                    freeze_count() const;
+	
+	// the stored bytes, in storage order, for saving and restoring a frozen buffer
+	int                         size_in_bytes() const;
+	void                        read_bytes( uint8_t* dest, int offset, int size ) const;
+	void                        write_bytes( const uint8_t* source, int offset, int size );
+	void                        prefetch_bytes( int offset, int size ) const;
+	
+	// freeze straight away (no fade) with the write head at write_head, ready for the bytes to be written back
+	void                        restore_frozen( int sample_size_in_bits, int write_head );
+	
+	void                        set_fade_curve( FADE_CURVE::CURVE_TYPE curve_type );
+	void                        set_resample_quality( RESAMPLER::QUALITY quality );
 	
 #ifdef DEBUG_OUTPUT
 	void                        debug_output();
@@ -123,37 +355,166 @@ public:
 
 ////////////////////////////////////
 
+struct PLAY_HEAD_CONFIG
+{
+	float                       m_speed;            // 0 - RESAMPLER::MAX_SPEED
+	bool                        m_reverse;          // reverse heads don't loop
+	float                       m_loop_size_ratio;
+	float                       m_jitter_ratio;
+	int                         m_output_channel;   // 0 - MAX_PLAY_HEADS-1, heads sharing an output channel are summed, a stereo head uses channels 2n and 2n+1
+};
+
+////////////////////////////////////
+
+// everything set from loop(), handed to update() as one consistent set
+struct GLITCH_DELAY_PARAMETERS
+{
+	int                         m_sample_size_in_bits;
+	bool                        m_loop_moving;
+	bool                        m_freeze_active;
+	FADE_CURVE::CURVE_TYPE      m_fade_curve;
+	RESAMPLER::QUALITY          m_resample_quality;
+	uint32_t                    m_beat_count;       // counts beats, so a beat is neither lost nor repeated between publishes
+	uint32_t                    m_beat_period;      // BEAT_CLOCK fixed point, 0 - no beat clock
+	uint32_t                    m_beat_sample;      // a beat on the sample clock, taken when m_beat_sync_count changes
+	uint32_t                    m_beat_sync_count;
+	
+	float                       m_loop_size_ratio[PLAY_HEAD_POOL_SIZE];
+	float                       m_jitter_ratio[PLAY_HEAD_POOL_SIZE];
+	PLAY_HEAD_RANDOM::DISTRIBUTION m_jitter_distribution[PLAY_HEAD_POOL_SIZE];
+	int                         m_jitter_subdivisions[PLAY_HEAD_POOL_SIZE];
+	int                         m_head_gain[PLAY_HEAD_POOL_SIZE];     // fixed point, GLITCH_DELAY_EFFECT::UNITY_HEAD_GAIN is 1
+	int                         m_feedback_gain;    // fixed point, DELAY_BUFFER::UNITY_FEEDBACK is 1
+	
+	GLITCH_DELAY_PARAMETERS();
+};
+
+////////////////////////////////////
+
+// a request from loop() to read or write the delay buffer, carried out by update() at the start of a block so it never
+// races the audio, see BufferSnapshot.h. Chunks are only read or written while the buffer stays frozen
+struct BUFFER_TRANSFER
+{
+	enum REQUEST
+	{
+		INFO,                   // fills in the fields below from the buffer
+		READ_CHUNK,             // m_size bytes from m_offset into m_data
+		RESTORE,                // freeze with the bit depth and write head below, when the channels and size match
+		WRITE_CHUNK,            // m_size bytes from m_data to m_offset
+	};
+	
+	static const int            MAX_CHUNK_SIZE_IN_BYTES = 512;
+	
+	REQUEST                     m_request;
+	bool                        m_success;
+	
+	int                         m_sample_size_in_bits;
+	int                         m_num_channels;
+	int                         m_size_in_bytes;
+	int                         m_write_head;
+	bool                        m_frozen;
+	uint32_t                    m_freeze_count;     // READ_CHUNK fails if this no longer matches the buffer
+	
+	int                         m_offset;
+	int                         m_size;
+	uint8_t                     m_data[MAX_CHUNK_SIZE_IN_BYTES];
+	
+	BUFFER_TRANSFER();
+};
+
+////////////////////////////////////
+
 class GLITCH_DELAY_EFFECT : public TEENSY_AUDIO_STREAM_WRAPPER
 {
 public:
 
-  static const int NUM_PLAY_HEADS = 4;
+  static const int MAX_PLAY_HEADS = PLAY_HEAD_POOL_SIZE;
+  static const int NUM_DEFAULT_PLAY_HEADS = 4;
+  static const PLAY_HEAD_CONFIG DEFAULT_PLAY_HEADS[NUM_DEFAULT_PLAY_HEADS];
+  
+  // head gains are fixed point, UNITY_HEAD_GAIN is a gain of 1
+  static const int HEAD_GAIN_BITS = 12;
+  static const int UNITY_HEAD_GAIN = 1 << HEAD_GAIN_BITS;
+  
+  enum OUTPUT_MODE
+  {
+    HEAD_OUTPUTS,       // each head on its config's output channel, heads sharing a channel are summed
+    MIXED_OUTPUT,       // every head summed into output 0 (a pair when stereo), so one block per update() to allocate and transmit
+  };
 
 private:
   
 	DELAY_BUFFER          	m_delay_buffer;
 	
-	PLAY_HEAD             	m_play_heads[NUM_PLAY_HEADS];
+	PLAY_HEAD             	m_play_heads[MAX_PLAY_HEADS];
+	int                   	m_num_play_heads;
+	
+	int                   	m_output_channel[MAX_PLAY_HEADS];  // output of each head, a pair of channels when stereo
+	int                   	m_num_output_channels;            // head outputs, so pairs when stereo
+	uint8_t               	m_render_order[MAX_PLAY_HEADS];   // heads sorted by buffer position, so neighbouring reads are rendered together
+	
+	// the setters change m_pending_parameters, publish_parameters() hands the whole set to the interrupt
+	GLITCH_DELAY_PARAMETERS m_pending_parameters;
+	SEQLOCK_BUFFER< GLITCH_DELAY_PARAMETERS > m_published_parameters;
 	
-	float                 	m_loop_size_ratio[NUM_PLAY_HEADS];
-	float					          m_jitter_ratio[NUM_PLAY_HEADS];
+	// only touched by update()
+	GLITCH_DELAY_PARAMETERS m_parameters;
+	uint32_t              	m_parameters_publish_count;
+	uint32_t              	m_beat_count;
+	uint32_t              	m_storage_stalls;
+	uint32_t              	m_random_seed;
 	
-	bool                  	m_loop_moving;
+	BEAT_CLOCK            	m_beat_clock;
+	uint32_t              	m_sample_clock;                   // samples since the effect started, at the start of this block
+	int                   	m_block_samples;                  // of this block, from the audio in
 	
-	// store 'next' values, otherwise interrupt could be called during calculation of values
-	int                   	m_next_sample_size_in_bits;
-	bool                  	m_next_loop_moving;
-	bool                  	m_next_beat;
-	bool					          m_next_freeze_active;
+	// the audio in is written once the heads have read the block, with the outputs fed back into it
+	int16_t               	m_input_frames[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
+	int16_t               	m_feedback_frames[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];   // every output summed, interleaved when stereo
+	bool                  	m_input_received;
+	
+	// one BUFFER_TRANSFER at a time, loop() owns m_transfer unless m_transfer_state is TRANSFER_REQUESTED
+	enum TRANSFER_STATE
+	{
+		TRANSFER_IDLE,
+		TRANSFER_REQUESTED,
+		TRANSFER_COMPLETE,
+	};
+	
+	BUFFER_TRANSFER       	m_transfer;
+	uint32_t              	m_transfer_state;
+	
+	PROFILER              	m_profiler;
 	
 protected:
 	
 	void					          process_audio_in_impl( int channel, const int16_t* sample_data, int num_samples ) override;
 	void					          process_audio_out_impl( int channel, int16_t* sample_data, int num_samples ) override;
+	void                  	process_audio_in_stereo_impl( int left_channel, const int16_t* left_data, const int16_t* right_data, int num_samples ) override;
+	void                  	process_audio_out_stereo_impl( int left_channel, int16_t* left_data, int16_t* right_data, int num_samples ) override;
+	
+	void                  	sort_render_order();
+	bool                  	adopt_parameters();
+	bool                  	carry_out_transfer();
 	
 public:
 	
-	GLITCH_DELAY_EFFECT();
+	explicit GLITCH_DELAY_EFFECT( const ENGINE_CONFIG& config = ENGINE_CONFIG() );
+	
+	// set the sample rate and maximum block size, at init only (not while update() can be called), resets the heads
+	void                  	configure_engine( const ENGINE_CONFIG& config );
+	const ENGINE_LIMITS&  	engine_limits() const;
+	
+	// keep the delay buffer in storage (see DelayStorage.h), nullptr for the internal buffer, at init only, clears the
+	// buffer and resets the heads
+	void                  	set_delay_storage( DELAY_STORAGE* storage );
+	
+	// set the heads in use, at init only (not while update() can be called), MIXED_OUTPUT ignores the configs' output channels
+	void                  	configure_play_heads( const PLAY_HEAD_CONFIG* configs, int num_heads, OUTPUT_MODE output_mode = HEAD_OUTPUTS );
+	int                   	num_play_heads() const;
+	
+	// seed every head's loop size and jitter variation, at init only, heads configured later are seeded from it too
+	void                  	set_random_seed( uint32_t seed );
 	
 	int                   	num_input_channels() const override;
 	int                   	num_output_channels() const override;
@@ -165,10 +526,40 @@ public:
 	
 	void                  	set_loop_size( int play_head, float loop_size );
 	void                  	set_jitter( int play_head, float jitter );
+	// QUANTIZED moves the loop start in steps of the loop size over subdivisions, so loops stay on the beat's divisions
+	void                  	set_jitter_distribution( int play_head, PLAY_HEAD_RANDOM::DISTRIBUTION distribution, int subdivisions );
+	// the head's level where heads are summed, in place of a mixer after the effect, -4 - 4 (1 when configured)
+	void                  	set_head_gain( int play_head, float gain );
+	
+	// every output summed and written back into the delay buffer with the next block's input, 0 - 1 scaled to a gain
+	// of 0 - DELAY_BUFFER::MAX_FEEDBACK. The heads read before the input is written, so each repeat is exactly a head's
+	// delay later
+	void                  	set_feedback( float feedback );
 	
+	// a beat at the start of the next block
 	void                  	set_beat();
 	
+	// beats counted by the audio, every period_samples (which needn't be whole) from the beat at beat_sample on
+	// sample_clock(), each on its own sample within a block. 0 stops the clock
+	void                  	set_beat_clock( float period_samples, uint32_t beat_sample );
+	// a new tempo, with the next beat where the old tempo put it
+	void                  	set_beat_tempo( float period_samples );
+	// the sample clock at the start of the current (or next) block, from loop() to place beats
+	uint32_t              	sample_clock() const;
+	
 	void					          set_freeze_active( bool active );
+	void                  	set_fade_curve( FADE_CURVE::CURVE_TYPE curve_type );
+	void                  	set_resample_quality( RESAMPLER::QUALITY quality );
+	
+	// make the values from the setters above visible to update(), all at once
+	void                  	publish_parameters();
+	
+	// hand a request to the next update(), returns false if the last one hasn't been collected
+	bool                  	request_buffer_transfer( const BUFFER_TRANSFER& transfer );
+	// returns true, and the request with its results, once update() has carried it out
+	bool                  	collect_buffer_transfer( BUFFER_TRANSFER& transfer );
+	
+	PROFILER&             	profiler();
 	
 	// for plugin display only
 	int                   	num_heads() const;
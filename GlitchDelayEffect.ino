@@ -9,85 +9,352 @@
 #include <string.h>
 #include <math.h>
 #include "GlitchDelayEffect.h"
+#include "SampleFormat.h"
 #include "CompileSwitches.h"
 
 
 const float MIN_SPEED( 0.25f );
-const float MAX_SPEED( 4.0f );
+const float MAX_SPEED( RESAMPLER::MAX_SPEED );
 
-#ifdef TARGET_JUCE
-const int AUDIO_BLOCK_SAMPLES( 512 );           // TODO need a value in JUCE, is it even constant?
-const int AUDIO_SAMPLE_RATE( 44100 );           // TODO need a value in JUCE
-#endif
-
-const int FIXED_FADE_TIME_SAMPLES( (AUDIO_SAMPLE_RATE / 1000.0f ) * 4 ); // 4ms cross fade
-const int MIN_LOOP_SIZE_IN_SAMPLES( (FIXED_FADE_TIME_SAMPLES * 2) + AUDIO_BLOCK_SAMPLES );
-const int MAX_LOOP_SIZE_IN_SAMPLES( AUDIO_SAMPLE_RATE * 0.5f );
+const float FADE_TIME_MS( 4.0f );
+const float MAX_LOOP_TIME_S( 0.5f );
+const float MAX_JITTER_TIME_S( 0.2f );
 const int MIN_SHIFT_SPEED( 0 );
 const int MAX_SHIFT_SPEED( 100 );
-const int MAX_JITTER_SIZE( AUDIO_SAMPLE_RATE * 0.2f );
+const int LOOP_VARIATION_SHIFT( 12 );                 // each loop's size varies by up to 512/4096 (12.5%) either way
+const int MAX_LOOP_VARIATION( 512 );
+const int DEFAULT_JITTER_SUBDIVISIONS( 4 );
 
 
 /////////////////////////////////////////////////////////////////////
 
-int delay_buffer_size_in_samples( int sample_size_in_bits )
+ENGINE_CONFIG::ENGINE_CONFIG() :
+    m_sample_rate( AUDIO_SAMPLE_RATE ),
+    m_max_block_samples( AUDIO_BLOCK_SAMPLES ),
+    m_num_channels( 1 )
+{
+}
+
+ENGINE_CONFIG::ENGINE_CONFIG( float sample_rate, int max_block_samples, int num_channels ) :
+    m_sample_rate( sample_rate ),
+    m_max_block_samples( max_block_samples ),
+    m_num_channels( num_channels )
+{
+}
+
+ENGINE_LIMITS::ENGINE_LIMITS( const ENGINE_CONFIG& config ) :
+    m_sample_rate( config.m_sample_rate ),
+    m_max_block_samples( config.m_max_block_samples ),
+    m_num_channels( config.m_num_channels ),
+    m_samples_per_ms( config.m_sample_rate / 1000 ),
+    m_fade_samples( ( config.m_sample_rate / 1000.0f ) * FADE_TIME_MS ),
+    m_min_loop_size( ( m_fade_samples * 2 ) + config.m_max_block_samples ),
+    m_max_loop_size( config.m_sample_rate * MAX_LOOP_TIME_S ),
+    m_max_jitter_size( config.m_sample_rate * MAX_JITTER_TIME_S )
 {
-    const float bytes_per_sample = sample_size_in_bits / 8.0f;
-    return static_cast<int>(DELAY_BUFFER_SIZE_IN_BYTES / bytes_per_sample);
+    ASSERT_MSG( config.m_max_block_samples > 0 && config.m_max_block_samples <= MAX_BLOCK_SAMPLES, "ENGINE_LIMITS() invalid block size" );
+    ASSERT_MSG( config.m_num_channels > 0 && config.m_num_channels <= MAX_DELAY_CHANNELS, "ENGINE_LIMITS() invalid number of channels" );
 }
 
-int convert_time_in_ms_to_samples( int time_in_ms )
+/////////////////////////////////////////////////////////////////////
+
+FADE_CURVE::FADE_CURVE( int fade_samples ) :
+    m_gains(),
+    m_table_steps(0),
+    m_fade_step(0),
+    m_curve_type(LINEAR)
 {
-    static int num_samples_per_ms = AUDIO_SAMPLE_RATE / 1000;
-    return num_samples_per_ms * time_in_ms;
+    set_curve( LINEAR, fade_samples );
 }
 
-int fade_out_in( int x, int y, float t )
+void FADE_CURVE::set_curve( CURVE_TYPE curve_type, int fade_samples )
 {
-    // fade down then back up
-    if( t < 0.5f )
+    m_curve_type                = curve_type;
+    
+    // one table entry per fade sample where possible, otherwise step through the table
+    m_table_steps               = min_val( fade_samples, MAX_TABLE_STEPS );
+    m_fade_step                 = ( m_table_steps << 16 ) / fade_samples;
+    
+    for( int i = 0; i <= m_table_steps; ++i )
     {
-        // t = 0.0 -> 1, t = 0.5 -> 0
-        t = 1.0f - ( t * 2.0f );
+        // x=1 at the start of the fade, x=0 at the end
+        const float x           = static_cast<float>(i) / m_table_steps;
+        float gain              = x;
+        
+        switch( m_curve_type )
+        {
+            case LINEAR:
+            {
+                gain            = x;
+                break;
+            }
+            case EQUAL_POWER:
+            {
+                gain            = sinf( x * static_cast<float>(M_PI) * 0.5f );
+                break;
+            }
+            case RAISED_COSINE:
+            {
+                gain            = 0.5f - ( 0.5f * cosf( x * static_cast<float>(M_PI) ) );
+                break;
+            }
+        }
         
-        return round( x * t );
+        m_gains[i]              = static_cast<uint16_t>( round( gain * UNITY_GAIN ) );
     }
-    else
+}
+
+FADE_CURVE::CURVE_TYPE FADE_CURVE::curve_type() const
+{
+    return m_curve_type;
+}
+
+int16_t FADE_CURVE::cross_fade( int16_t from, int16_t to, int fade_samples_remaining ) const
+{
+    const int out_index         = ( fade_samples_remaining * m_fade_step ) >> 16;
+    
+    const int sample            = ( ( from * m_gains[ out_index ] ) + ( to * m_gains[ m_table_steps - out_index ] ) + ( UNITY_GAIN / 2 ) ) >> 15;
+    
+    return clamp( sample, -32768, 32767 );
+}
+
+template< int CHANNELS >
+void FADE_CURVE::cross_fade( int16_t* dest, const int16_t* from, const int16_t* to, int size, int fade_samples_remaining ) const
+{
+    ASSERT_MSG( size <= fade_samples_remaining, "FADE_CURVE::cross_fade() segment longer than the fade" );
+    
+    int phase                   = fade_samples_remaining * m_fade_step;
+    
+    for( int x = 0; x < size; ++x )
+    {
+        const int out_index     = phase >> 16;
+        const int from_gain     = m_gains[ out_index ];
+        const int to_gain       = m_gains[ m_table_steps - out_index ];
+        
+        for( int c = 0; c < CHANNELS; ++c )
+        {
+            const int i         = ( x * CHANNELS ) + c;
+            const int sample    = ( ( from[i] * from_gain ) + ( to[i] * to_gain ) + ( UNITY_GAIN / 2 ) ) >> 15;
+            
+            dest[i]             = clamp( sample, -32768, 32767 );
+        }
+        
+        phase                   -= m_fade_step;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+
+RESAMPLER::RESAMPLER() :
+    m_sinc_full_band(),
+    m_sinc_half_band(),
+    m_quality(SINC)
+{
+    build_sinc_table( m_sinc_full_band, 1.0f );
+    build_sinc_table( m_sinc_half_band, 0.45f );
+}
+
+void RESAMPLER::build_sinc_table( int16_t (&table)[NUM_PHASES][NUM_TAPS], float cutoff )
+{
+    const float pi = static_cast<float>(M_PI);
+    
+    for( int p = 0; p < NUM_PHASES; ++p )
     {
-        // t = 0.5 -> 0, t = 1 -> 1
-        t = ( t * 2.0f ) - 1.0f;
+        const float fraction    = static_cast<float>(p) / NUM_PHASES;
+        
+        float coeffs[NUM_TAPS];
+        float sum               = 0.0f;
+        
+        for( int t = 0; t < NUM_TAPS; ++t )
+        {
+            // distance from the read position to this tap
+            const float x       = ( t - WINDOW_BEFORE ) - fraction;
+            const float sx      = cutoff * x * pi;
+            const float sinc    = fabsf( sx ) < 1e-6f ? 1.0f : sinf( sx ) / sx;
+            
+            // blackman window across the taps
+            const float w       = ( x + ( NUM_TAPS / 2 ) ) / NUM_TAPS;
+            const float window  = 0.42f - ( 0.5f * cosf( 2.0f * pi * w ) ) + ( 0.08f * cosf( 4.0f * pi * w ) );
+            
+            coeffs[t]           = sinc * window;
+            sum                 += coeffs[t];
+        }
         
-        return round( y * t );
+        // normalise for unity gain at DC
+        int total               = 0;
+        for( int t = 0; t < NUM_TAPS; ++t )
+        {
+            table[p][t]         = static_cast<int16_t>( round( ( coeffs[t] / sum ) * ( 1 << COEFF_SHIFT ) ) );
+            total               += table[p][t];
+        }
+        table[p][WINDOW_BEFORE] += ( 1 << COEFF_SHIFT ) - total;
+    }
+}
+
+RESAMPLER::QUALITY RESAMPLER::quality() const
+{
+    return m_quality;
+}
+
+void RESAMPLER::set_quality( QUALITY quality )
+{
+    m_quality = quality;
+}
+
+template< int CHANNELS >
+void RESAMPLER::resample( int16_t* dest, int size, const int16_t* window, int position, int step ) const
+{
+    switch( m_quality )
+    {
+        case LINEAR:
+        {
+            for( int x = 0; x < size; ++x )
+            {
+                const int16_t* s        = window + ( ( position >> 16 ) * CHANNELS );
+                const int t             = ( position & 0xffff ) >> 1;      // Q15
+                
+                for( int c = 0; c < CHANNELS; ++c )
+                {
+                    dest[c]             = s[c] + ( ( ( s[CHANNELS + c] - s[c] ) * t ) >> 15 );
+                }
+                
+                dest                    += CHANNELS;
+                position                += step;
+            }
+            break;
+        }
+        case HERMITE:
+        {
+            for( int x = 0; x < size; ++x )
+            {
+                const int16_t* s        = window + ( ( position >> 16 ) * CHANNELS );
+                const int t             = ( position & 0xffff ) >> 1;      // Q15
+                
+                for( int c = 0; c < CHANNELS; ++c )
+                {
+                    const int y0        = s[c - CHANNELS];
+                    const int y1        = s[c];
+                    const int y2        = s[c + CHANNELS];
+                    const int y3        = s[c + ( 2 * CHANNELS )];
+                    
+                    // catmull-rom coefficients, evaluated with horner's method in Q15. Full scale input takes the
+                    // coefficients past 17 bits, so the products are 64-bit
+                    const int c1        = ( y2 - y0 ) >> 1;
+                    const int c2        = y0 - ( ( 5 * y1 ) >> 1 ) + ( 2 * y2 ) - ( y3 >> 1 );
+                    const int c3        = ( ( y3 - y0 ) >> 1 ) + ( ( 3 * ( y1 - y2 ) ) >> 1 );
+                    
+                    int sample          = static_cast<int>( ( static_cast<int64_t>( c3 ) * t ) >> 15 );
+                    sample              = static_cast<int>( ( static_cast<int64_t>( sample + c2 ) * t ) >> 15 );
+                    sample              = static_cast<int>( ( static_cast<int64_t>( sample + c1 ) * t ) >> 15 );
+                    
+                    dest[c]             = clamp( sample + y1, -32768, 32767 );
+                }
+                
+                dest                    += CHANNELS;
+                position                += step;
+            }
+            break;
+        }
+        case SINC:
+        {
+            // band limit when playing faster than normal speed
+            const int16_t (&table)[NUM_PHASES][NUM_TAPS] = abs( step ) > ( 3 << 15 ) ? m_sinc_half_band : m_sinc_full_band;
+            
+            for( int x = 0; x < size; ++x )
+            {
+                const int16_t* s        = window + ( ( ( position >> 16 ) - WINDOW_BEFORE ) * CHANNELS );
+                const int16_t* coeffs   = table[ ( position & 0xffff ) >> PHASE_SHIFT ];
+                
+                for( int c = 0; c < CHANNELS; ++c )
+                {
+                    int sum             = 0;
+                    for( int t = 0; t < NUM_TAPS; ++t )
+                    {
+                        sum             += s[ ( t * CHANNELS ) + c ] * coeffs[t];
+                    }
+                    
+                    dest[c]             = clamp( ( sum + ( 1 << ( COEFF_SHIFT - 1 ) ) ) >> COEFF_SHIFT, -32768, 32767 );
+                }
+                
+                dest                    += CHANNELS;
+                position                += step;
+            }
+            break;
+        }
     }
 }
 
-int cross_fade_samples( int x, int y, float t )
+/////////////////////////////////////////////////////////////////////
+
+// reverse the order of size frames of CHANNELS interleaved samples, keeping the channels of each frame in order
+template< int CHANNELS >
+void reverse_frames( int16_t* frames, int size )
 {
-    return round( lerp<float>( x, y, t ) );
+    for( int x = 0, y = size - 1; x < y; ++x, --y )
+    {
+        for( int c = 0; c < CHANNELS; ++c )
+        {
+            const int16_t sample        = frames[ ( x * CHANNELS ) + c ];
+            frames[ ( x * CHANNELS ) + c ] = frames[ ( y * CHANNELS ) + c ];
+            frames[ ( y * CHANNELS ) + c ] = sample;
+        }
+    }
 }
 
 /////////////////////////////////////////////////////////////////////
 
-PLAY_HEAD::PLAY_HEAD( const DELAY_BUFFER& delay_buffer, float play_speed ) :
-    m_delay_buffer( delay_buffer ),
+PLAY_HEAD::PLAY_HEAD() :
+    m_delay_buffer( nullptr ),
     m_current_play_head( 0.0f ),
     m_destination_play_head( 0.0f ),
-    m_play_speed( play_speed ),
+    m_play_speed( 1.0f ),
     m_fade_samples_remaining( 0 ),
     m_loop_start( -1 ),
     m_loop_end( -1 ),
     m_unjittered_loop_start( -1 ),
     m_shift_speed( 0 ),
-    m_next_loop_size_ratio( 1.0f ),
+    m_loop_size_span( 0 ),
     m_next_shift_speed_ratio( 0.0f ),
-    m_jitter_ratio( 0.0f ),
-    m_initial_loop_crossfade_complete(false)
+    m_shift_speed_span( 0 ),
+    m_max_jitter_offset( 0 ),
+    m_jitter_distribution( PLAY_HEAD_RANDOM::UNIFORM ),
+    m_jitter_subdivisions( DEFAULT_JITTER_SUBDIVISIONS ),
+    m_random(),
+    m_initial_loop_crossfade_complete(false),
+    m_beat_offset(-1),
+    m_events(0)
+{
+}
+
+PLAY_HEAD::PLAY_HEAD( const DELAY_BUFFER& delay_buffer, float play_speed ) :
+    PLAY_HEAD()
+{
+    configure( delay_buffer, play_speed );
+}
+
+void PLAY_HEAD::reset()
+{
+    configure( *m_delay_buffer, m_play_speed );
+}
+
+void PLAY_HEAD::configure( const DELAY_BUFFER& delay_buffer, float play_speed )
 {
+    ASSERT_MSG( play_speed != 0.0f && fabsf( play_speed ) <= MAX_SPEED, "PLAY_HEAD::configure() invalid speed" );
+    
+    // the random sequence carries on through a reset, so a render stays the same for its seed
+    const PLAY_HEAD_RANDOM random       = m_random;
+    *this                               = PLAY_HEAD();
+    m_random                            = random;
+    
+    m_delay_buffer                      = &delay_buffer;
+    m_play_speed                        = play_speed;
+    m_loop_size_span                    = m_delay_buffer->m_limits.m_max_loop_size - m_delay_buffer->m_limits.m_min_loop_size;
+    
     if( play_forwards() )
     {
         // all forward playing heads default to looping
         m_loop_start                    = 0;
-        m_loop_end                      = MAX_LOOP_SIZE_IN_SAMPLES;
+        m_loop_end                      = m_delay_buffer->m_limits.m_max_loop_size;
     }
     
     set_loop_behind_write_head();
@@ -120,15 +387,16 @@ int PLAY_HEAD::loop_end() const
 
 int PLAY_HEAD::play_head_to_write_head_buffer_size() const
 {
-    const int half_jitter     = ( MAX_JITTER_SIZE / 2 ) + 1;
-    const int buffer_samples  = FIXED_FADE_TIME_SAMPLES + FIXED_FADE_TIME_SAMPLES + AUDIO_BLOCK_SAMPLES + half_jitter;
+    const ENGINE_LIMITS& limits = m_delay_buffer->m_limits;
+    const int half_jitter     = ( limits.m_max_jitter_size / 2 ) + 1;
+    const int buffer_samples  = limits.m_fade_samples + limits.m_fade_samples + limits.m_max_block_samples + half_jitter;
     
     return buffer_samples;
 }
 
 int PLAY_HEAD::buffered_loop_start() const
 {
-    const int extended_start  = m_delay_buffer.wrap_to_buffer( m_loop_start - play_head_to_write_head_buffer_size() );
+    const int extended_start  = m_delay_buffer->wrap_to_buffer( m_loop_start - play_head_to_write_head_buffer_size() );
     return extended_start;
 }
 
@@ -140,7 +408,7 @@ int PLAY_HEAD::current_loop_size() const
     }
     else
     {
-        return ( m_delay_buffer.m_buffer_size_in_samples - m_loop_start ) + m_loop_end;
+        return ( m_delay_buffer->m_buffer_size_in_samples - m_loop_start ) + m_loop_end;
     }
 }
 
@@ -185,14 +453,14 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
             {
                 const int fade_read_size = min_val<int>( read_size, m_fade_samples_remaining ) - 1; // read_size -1 because if 1 sample is read start == end
                 
-                const int current_cf_end = m_delay_buffer.wrap_to_buffer( m_current_play_head + fade_read_size );
+                const int current_cf_end = m_delay_buffer->wrap_to_buffer( m_current_play_head + fade_read_size );
                 if( position_inside_section( position, m_current_play_head, current_cf_end ) )
                 {
                     // inside the cross fade from current to destination
                     return true;
                 }
                 
-                const int destination_end = m_delay_buffer.wrap_to_buffer( m_destination_play_head + read_size - 1 ); // after fading, destination will become current, read_size samples will be read
+                const int destination_end = m_delay_buffer->wrap_to_buffer( m_destination_play_head + read_size - 1 ); // after fading, destination will become current, read_size samples will be read
                 if( position_inside_section( position, m_destination_play_head, destination_end ) )
                 {
                     // inside the cross fade from current to destination
@@ -202,7 +470,7 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
             else
             {
                 // not cross-fading
-                const int read_end = m_delay_buffer.wrap_to_buffer( m_current_play_head + read_size - 1);
+                const int read_end = m_delay_buffer->wrap_to_buffer( m_current_play_head + read_size - 1);
                 if( position_inside_section( position, m_current_play_head, read_end ) )
                 {
                     return true;
@@ -215,14 +483,14 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
             {
                 const int fade_read_size = min_val<int>( read_size, m_fade_samples_remaining ) - 1; // read_size -1 because if 1 sample is read start == end
                 
-                const int current_cf_start = m_delay_buffer.wrap_to_buffer( m_current_play_head - fade_read_size );
+                const int current_cf_start = m_delay_buffer->wrap_to_buffer( m_current_play_head - fade_read_size );
                 if( position_inside_section( position, current_cf_start, m_current_play_head ) )
                 {
                     // inside the cross fade from current to destination
                     return true;
                 }
                 
-                const int destination_end = m_delay_buffer.wrap_to_buffer( m_destination_play_head - read_size - 1 ); // after fading, destination will become current, read_size samples will be read
+                const int destination_end = m_delay_buffer->wrap_to_buffer( m_destination_play_head - read_size - 1 ); // after fading, destination will become current, read_size samples will be read
                 if( position_inside_section( position, destination_end, m_destination_play_head ) )
                 {
                     // inside the cross fade from current to destination
@@ -232,7 +500,7 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
             else
             {
                 // not cross-fading
-                const int read_end = m_delay_buffer.wrap_to_buffer( m_current_play_head - read_size - 1);
+                const int read_end = m_delay_buffer->wrap_to_buffer( m_current_play_head - read_size - 1);
                 if( position_inside_section( position, read_end, m_current_play_head ) )
                 {
                     return true;
@@ -246,7 +514,7 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
         ASSERT_MSG( play_forwards(), "Loop not supported playing forwards" );
         
         // NOTE this tests entire loop NOT next read per-se
-        const int loop_end_cf_end = m_delay_buffer.wrap_to_buffer( m_loop_end + FIXED_FADE_TIME_SAMPLES - 1 );
+        const int loop_end_cf_end = m_delay_buffer->wrap_to_buffer( m_loop_end + m_delay_buffer->m_limits.m_fade_samples - 1 );
         if( position_inside_section( position, m_loop_start, loop_end_cf_end ) )
         {
             return true;
@@ -258,7 +526,7 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
          
          }
          
-         const int loop_end_cf_end = m_delay_buffer.wrap_to_buffer( m_loop_end + FIXED_FADE_TIME_SAMPLES - 1 );
+         const int loop_end_cf_end = m_delay_buffer->wrap_to_buffer( m_loop_end + m_delay_buffer->m_limits.m_fade_samples - 1 );
          int samples_left_of_loop( 0 );
          if( loop_end_cf_end > m_loop_start )
          {
@@ -266,10 +534,10 @@ bool PLAY_HEAD::position_inside_next_read( int position, int read_size ) const
          }
          else
          {
-         samples_left_of_loop = ( m_delay_buffer.m_buffer_size_in_samples - m_destination_play_head ) + loop_end_cf_end;
+         samples_left_of_loop = ( m_delay_buffer->m_buffer_size_in_samples - m_destination_play_head ) + loop_end_cf_end;
          }
          const int samples_to_read = min( read_size, samples_left_of_loop );
-         const int read_end = m_delay_buffer.wrap_to_buffer( m_destination_play_head + samples_to_read );
+         const int read_end = m_delay_buffer->wrap_to_buffer( m_destination_play_head + samples_to_read );
          if( position_inside_section( position, m_destination_play_head, read_end ) )
          {
          // inside the cross fade from current to destination
@@ -303,33 +571,32 @@ void PLAY_HEAD::set_next_loop()
     ASSERT_MSG( m_initial_loop_crossfade_complete, "looping before we've finished the cross-fade into the loop\n" );
     ASSERT_MSG( !crossfade_active(), "starting new loop whist still cross fading" );
     
-    // set next loop parameters
-    float r                               = (random(1000) / 1000.0f) * 0.25f;
-    r                                     = 1.0f + ( r - 0.125f ); // r = 0.875 => 1.125
+    m_events |= PROFILE_EVENT_NEW_LOOP;
     
-    const int loop_size                   = round( lerp<float>( MIN_LOOP_SIZE_IN_SAMPLES, MAX_LOOP_SIZE_IN_SAMPLES, m_next_loop_size_ratio * r ) );
+    // set next loop parameters, integer only, the spans were worked out when the parameters were set
+    const int variation                   = m_random.offset( MAX_LOOP_VARIATION, PLAY_HEAD_RANDOM::UNIFORM, 1 );
+    const int loop_size                   = m_delay_buffer->m_limits.m_min_loop_size + m_loop_size_span + ( ( m_loop_size_span * variation ) >> LOOP_VARIATION_SHIFT );
     
     if( m_next_shift_speed_ratio > 0.0f )
     {
-        m_shift_speed                       = round( lerp<float>( MIN_SHIFT_SPEED, MAX_SHIFT_SPEED, m_next_shift_speed_ratio * r ) );
+        m_shift_speed                       = MIN_SHIFT_SPEED + m_shift_speed_span + ( ( m_shift_speed_span * variation ) >> LOOP_VARIATION_SHIFT );
     }
     else
     {
         m_shift_speed                       = 0;
         
-        r                                   = (random(1000) / 1000.0f);
-        r                                   -= 0.5f; // r = -0.5 => 0.5
-        int jitter_offset                   = MAX_JITTER_SIZE * r * m_jitter_ratio;
+        const int jitter_step               = m_jitter_subdivisions > 0 ? loop_size / m_jitter_subdivisions : 0;
+        const int jitter_offset             = m_random.offset( m_max_jitter_offset, m_jitter_distribution, jitter_step );
         
-        m_loop_start                        = m_delay_buffer.wrap_to_buffer( m_unjittered_loop_start + jitter_offset );
+        m_loop_start                        = m_delay_buffer->wrap_to_buffer( m_unjittered_loop_start + jitter_offset );
     }
     
-    m_loop_end                           = m_delay_buffer.wrap_to_buffer( m_loop_start + loop_size );
+    m_loop_end                           = m_delay_buffer->wrap_to_buffer( m_loop_start + loop_size );
     
     ASSERT_MSG( current_loop_size() == loop_size, "Error in loop size calculation" );
     
     // check whether the write head is about to run over the read head, in which case cross fade read head to new position
-    if( position_inside_section( m_delay_buffer.write_head(), buffered_loop_start(), m_loop_end ) )
+    if( position_inside_section( m_delay_buffer->write_head(), buffered_loop_start(), m_loop_end ) )
     {
         set_loop_behind_write_head();
     }
@@ -337,55 +604,61 @@ void PLAY_HEAD::set_next_loop()
     set_play_head( m_loop_start );
 }
 
-int16_t PLAY_HEAD::read_sample_with_cross_fade()
+template< typename FORMAT >
+void PLAY_HEAD::read_cross_fade_run( int16_t* dest, int size )
 {
-    ASSERT_MSG( m_fade_samples_remaining >= 0, "PLAY_HEAD::read_sample_with_cross_fade()" );
+    ASSERT_MSG( size > 0 && size <= m_fade_samples_remaining && size <= m_delay_buffer->m_limits.m_max_block_samples, "PLAY_HEAD::read_cross_fade_run()" );
     
-    int16_t sample(0);
+    int16_t current_samples[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
+    int16_t destination_samples[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
     
-    // cross-fading
-    if( m_fade_samples_remaining > 0 )
-    {
-        int16_t current_sample            = m_delay_buffer.read_sample_with_speed( m_current_play_head, m_play_speed );
-        
-        int16_t destination_sample        = m_delay_buffer.read_sample_with_speed( m_destination_play_head, m_play_speed );
-        
-        const float t                     = static_cast<float>(m_fade_samples_remaining) / FIXED_FADE_TIME_SAMPLES; // t=0 at destination, t=1 at current
-        --m_fade_samples_remaining;
-        
-        sample                            = cross_fade_samples( destination_sample, current_sample, t );
-        
-        m_delay_buffer.increment_head( m_current_play_head, m_play_speed );
-        m_delay_buffer.increment_head( m_destination_play_head, m_play_speed );
-    }
-    // not cross-fading
-    else
-    {
-        m_initial_loop_crossfade_complete = true;
-        
-        m_current_play_head               = m_destination_play_head;
-        sample                            = m_delay_buffer.read_sample( m_current_play_head );
-        
-        m_delay_buffer.increment_head( m_current_play_head, m_play_speed );
-        m_destination_play_head           = m_current_play_head;
-    }
+    m_delay_buffer->read_with_speed<FORMAT>( current_samples, size, m_current_play_head, m_play_speed );
+    m_delay_buffer->read_with_speed<FORMAT>( destination_samples, size, m_destination_play_head, m_play_speed );
+    
+    // fade from current to destination
+    m_delay_buffer->m_fade_curve.cross_fade< FORMAT::CHANNELS >( dest, current_samples, destination_samples, size, m_fade_samples_remaining );
+    
+    m_fade_samples_remaining              -= size;
+    m_events                              |= PROFILE_EVENT_CROSS_FADE;
+}
+
+template< typename FORMAT >
+void PLAY_HEAD::read_resampled_run( int16_t* dest, int size )
+{
+    ASSERT_MSG( m_fade_samples_remaining == 0, "PLAY_HEAD::read_resampled_run() called during a cross fade" );
     
-    return sample;
+    m_initial_loop_crossfade_complete = true;
+    
+    m_delay_buffer->read_with_speed<FORMAT>( dest, size, m_destination_play_head, m_play_speed );
+    m_current_play_head               = m_destination_play_head;
 }
 
 void PLAY_HEAD::set_loop_size( float loop_size_ratio )
 {
-    m_next_loop_size_ratio = loop_size_ratio;
+    const ENGINE_LIMITS& limits = m_delay_buffer->m_limits;
+    m_loop_size_span = roundf( ( limits.m_max_loop_size - limits.m_min_loop_size ) * loop_size_ratio );
 }
 
 void PLAY_HEAD::set_shift_speed( float speed )
 {
     m_next_shift_speed_ratio = speed;
+    m_shift_speed_span = roundf( ( MAX_SHIFT_SPEED - MIN_SHIFT_SPEED ) * speed );
 }
 
 void PLAY_HEAD::set_jitter( float jitter )
 {
-    m_jitter_ratio = jitter;
+    m_max_jitter_offset = roundf( m_delay_buffer->m_limits.m_max_jitter_size * jitter * 0.5f );
+}
+
+void PLAY_HEAD::set_jitter_distribution( PLAY_HEAD_RANDOM::DISTRIBUTION distribution, int subdivisions )
+{
+    m_jitter_distribution = distribution;
+    m_jitter_subdivisions = subdivisions;
+}
+
+void PLAY_HEAD::seed_random( uint32_t seed )
+{
+    m_random.seed( seed );
 }
 
 void PLAY_HEAD::set_play_head( int new_play_head )
@@ -404,48 +677,211 @@ void PLAY_HEAD::set_play_head( int new_play_head )
     
     m_destination_play_head       = new_play_head;
     
-    m_fade_samples_remaining      = FIXED_FADE_TIME_SAMPLES;
+    m_fade_samples_remaining      = m_delay_buffer->m_limits.m_fade_samples;
+}
+
+void PLAY_HEAD::set_beat( int offset )
+{
+    m_beat_offset = offset;
 }
 
-void PLAY_HEAD::set_loop_behind_write_head()
+void PLAY_HEAD::set_loop_behind_write_head( int write_head_lag )
 {
+    m_events |= PROFILE_EVENT_REPOSITION;
+    
     if( looping() )
     {
         const int loop_size                     = current_loop_size();
-        int loop_end                            = m_delay_buffer.write_head() - ( play_head_to_write_head_buffer_size() + m_shift_speed );
-        loop_end                                = m_delay_buffer.wrap_to_buffer( loop_end );
-        const int loop_start                    = m_delay_buffer.wrap_to_buffer( loop_end - loop_size );
+        int loop_end                            = m_delay_buffer->write_head() - ( play_head_to_write_head_buffer_size() + m_shift_speed + write_head_lag );
+        loop_end                                = m_delay_buffer->wrap_to_buffer( loop_end );
+        const int loop_start                    = m_delay_buffer->wrap_to_buffer( loop_end - loop_size );
         
-        ASSERT_MSG( loop_size + FIXED_FADE_TIME_SAMPLES + 1 < DELAY_BUFFER_SIZE_IN_BYTES, "Loop size too large\n" );
-        ASSERT_MSG( loop_size > FIXED_FADE_TIME_SAMPLES * 2, "Loop size too small\n" );
+        ASSERT_MSG( loop_size + m_delay_buffer->m_limits.m_fade_samples + 1 < m_delay_buffer->m_buffer_size_in_samples, "Loop size too large\n" );
+        ASSERT_MSG( loop_size > m_delay_buffer->m_limits.m_fade_samples * 2, "Loop size too small\n" );
         
         enable_loop( loop_start, loop_end );
     }
     else
     {
-        int position                           = m_delay_buffer.write_head() - ( play_head_to_write_head_buffer_size() + m_shift_speed );
-        m_destination_play_head                = m_delay_buffer.wrap_to_buffer( position );
+        int position                           = m_delay_buffer->write_head() - ( play_head_to_write_head_buffer_size() + m_shift_speed + write_head_lag );
+        m_destination_play_head                = m_delay_buffer->wrap_to_buffer( position );
         m_current_play_head                    = m_destination_play_head;
-        m_fade_samples_remaining               = FIXED_FADE_TIME_SAMPLES;
+        m_fade_samples_remaining               = m_delay_buffer->m_limits.m_fade_samples;
     }
 }
 
-void PLAY_HEAD::read_from_play_head( int16_t* dest, int size )
+int PLAY_HEAD::samples_until_loop_end( int max_samples ) const
 {
-    for( int x = 0; x < size; ++x )
+    if( m_loop_end < 0 )
+    {
+        return max_samples;
+    }
+    
+    ASSERT_MSG( play_forwards(), "Loop not supported playing forwards" );
+    
+    // the destination head is checked against the loop before every sample, stop at the last sample still inside the loop
+    float distance          = m_loop_end - m_destination_play_head;
+    if( m_loop_end < static_cast<int>( m_destination_play_head ) )
+    {
+        distance            += m_delay_buffer->m_buffer_size_in_samples;
+    }
+    
+    const int samples       = static_cast<int>( floorf( distance / m_play_speed ) ) + 1;
+    
+    return clamp( samples, 1, max_samples );
+}
+
+int PLAY_HEAD::next_event_run_length( int max_samples, bool straight_copy ) const
+{
+    int run                 = max_samples;
+    
+    if( m_fade_samples_remaining > 0 )
+    {
+        // stop at the end of the cross fade, both heads wrap inside read_with_speed()
+        run                 = min_val( run, m_fade_samples_remaining );
+    }
+    else if( straight_copy )
+    {
+        // stop at the end (or start when reversing) of the buffer
+        const int position  = m_destination_play_head;
+        run                 = play_forwards() ? min_val( run, m_delay_buffer->m_buffer_size_in_samples - position ) : min_val( run, position + 1 );
+    }
+    
+    // stop after the loop end, the next run will start a new loop
+    return samples_until_loop_end( run );
+}
+
+template< typename FORMAT >
+void PLAY_HEAD::read_steady_run( int16_t* dest, int size )
+{
+    m_initial_loop_crossfade_complete = true;
+    
+    const int position                = m_destination_play_head;
+    
+    if( play_forwards() )
+    {
+        // straight copy for 16-bit
+        m_delay_buffer->read_samples<FORMAT>( dest, position, size );
+        
+        m_current_play_head           = m_delay_buffer->wrap_to_buffer( position + size );
+    }
+    else
+    {
+        // read in buffer order then reverse
+        const int start               = position - size + 1;
+        m_delay_buffer->read_samples<FORMAT>( dest, start, size );
+        reverse_frames< FORMAT::CHANNELS >( dest, size );
+        
+        m_current_play_head           = m_delay_buffer->wrap_to_buffer( start - 1 );
+    }
+    
+    m_destination_play_head           = m_current_play_head;
+}
+
+template< typename FORMAT >
+void PLAY_HEAD::read_from_play_head_impl( int16_t* dest, int size )
+{
+    // only heads playing at normal speed (forwards or reverse) can copy straight from the buffer
+    const bool unit_speed = m_play_speed == 1.0f || m_play_speed == -1.0f;
+    
+    // render the longest run up to the next event (loop end, cross fade end or buffer wrap) in one loop
+    int x = 0;
+    while( x < size )
     {
+        if( x == m_beat_offset )
+        {
+            // the block is written after the heads read it, so the loop goes where it would have with the write head at
+            // the beat's sample, unless frozen, when the write head stays put
+            m_beat_offset         = -1;
+            if( !crossfade_active() )
+            {
+                set_next_loop();
+                set_loop_behind_write_head( m_delay_buffer->freeze_active() ? 0 : -x );
+            }
+        }
+        
         if( m_loop_end >= 0  && !position_inside_section( m_destination_play_head, m_loop_start, m_loop_end ) )
         {
             set_next_loop();
         }
         
-        dest[x] = read_sample_with_cross_fade();
+        const bool straight_copy  = unit_speed && m_destination_play_head == truncf( m_destination_play_head );
+        int run                   = next_event_run_length( size - x, straight_copy );
+        if( m_beat_offset > x )
+        {
+            run                   = min_val( run, m_beat_offset - x );
+        }
+        
+        int16_t* run_dest         = dest + ( x * FORMAT::CHANNELS );
+        if( m_fade_samples_remaining > 0 )
+        {
+            read_cross_fade_run<FORMAT>( run_dest, run );
+        }
+        else if( straight_copy )
+        {
+            read_steady_run<FORMAT>( run_dest, run );
+        }
+        else
+        {
+            read_resampled_run<FORMAT>( run_dest, run );
+        }
+        
+        x                         += run;
     }
     
     if( m_shift_speed > 0 && !crossfade_active() )
     {
-        m_loop_start      = m_delay_buffer.wrap_to_buffer( m_loop_start + m_shift_speed );
-        m_loop_end        = m_delay_buffer.wrap_to_buffer( m_loop_end + m_shift_speed );
+        m_loop_start      = m_delay_buffer->wrap_to_buffer( m_loop_start + m_shift_speed );
+        m_loop_end        = m_delay_buffer->wrap_to_buffer( m_loop_end + m_shift_speed );
+    }
+}
+
+void PLAY_HEAD::read_from_play_head( int16_t* dest, int size )
+{
+    // pick the storage format once per block
+    const bool stereo = MAX_DELAY_CHANNELS > 1 && m_delay_buffer->num_channels() == 2;
+    switch( m_delay_buffer->m_sample_size_in_bits )
+    {
+        case 4:
+        {
+            stereo ? read_from_play_head_impl< STEREO_FORMAT<SAMPLE_FORMAT_ADPCM_4> >( dest, size ) : read_from_play_head_impl<SAMPLE_FORMAT_ADPCM_4>( dest, size );
+            break;
+        }
+        case 8:
+        {
+            stereo ? read_from_play_head_impl< STEREO_FORMAT<SAMPLE_FORMAT_8> >( dest, size ) : read_from_play_head_impl<SAMPLE_FORMAT_8>( dest, size );
+            break;
+        }
+        case 12:
+        {
+            stereo ? read_from_play_head_impl< STEREO_FORMAT<SAMPLE_FORMAT_12> >( dest, size ) : read_from_play_head_impl<SAMPLE_FORMAT_12>( dest, size );
+            break;
+        }
+        case 16:
+        {
+            stereo ? read_from_play_head_impl< STEREO_FORMAT<SAMPLE_FORMAT_16> >( dest, size ) : read_from_play_head_impl<SAMPLE_FORMAT_16>( dest, size );
+            break;
+        }
+    }
+}
+
+void PLAY_HEAD::prefetch() const
+{
+    // the next block at the play speed, with the resampler's window either side
+    const float speed       = fabsf( m_play_speed );
+    const int read_ahead    = static_cast<int>( m_delay_buffer->m_limits.m_max_block_samples * speed ) + RESAMPLER::WINDOW_BEFORE + RESAMPLER::WINDOW_AFTER + 1;
+    const int direction     = play_forwards() ? 1 : -1;
+    
+    m_delay_buffer->prefetch_frames( static_cast<int>( m_current_play_head ) - ( direction * RESAMPLER::WINDOW_BEFORE ), direction * read_ahead );
+    if( m_destination_play_head != m_current_play_head )
+    {
+        m_delay_buffer->prefetch_frames( static_cast<int>( m_destination_play_head ) - ( direction * RESAMPLER::WINDOW_BEFORE ), direction * read_ahead );
+    }
+    
+    // the head jumps back to the loop start when it reaches the loop end (which the read above reaches first)
+    if( looping() )
+    {
+        m_delay_buffer->prefetch_frames( m_loop_start - RESAMPLER::WINDOW_BEFORE, read_ahead );
     }
 }
 
@@ -461,7 +897,7 @@ void PLAY_HEAD::enable_loop( int start, int end )
     
     // force a new cross fade
     m_destination_play_head           = m_loop_start;
-    m_fade_samples_remaining          = FIXED_FADE_TIME_SAMPLES;
+    m_fade_samples_remaining          = m_delay_buffer->m_limits.m_fade_samples;
 }
 
 
@@ -471,6 +907,13 @@ void PLAY_HEAD::disable_loop()
     m_loop_end                        = -1;
 }
 
+uint8_t PLAY_HEAD::take_events()
+{
+    const uint8_t events              = m_events;
+    m_events                          = 0;
+    return events;
+}
+
 #ifdef DEBUG_OUTPUT
 void PLAY_HEAD::debug_output()
 {
@@ -495,56 +938,123 @@ void PLAY_HEAD::debug_output()
 /////////////////////////////////////////////////////////////////////
 
 DELAY_BUFFER::DELAY_BUFFER() :
-    m_buffer(),
+    m_internal_storage(),
+    m_storage( &m_internal_storage ),
+    m_storage_block_bits( m_internal_storage.block_size_in_bytes() * 8 ),
+    m_limits( ENGINE_CONFIG() ),
     m_buffer_size_in_samples(0),
     m_sample_size_in_bits(0),
     m_write_head(0),
     m_fade_samples_remaining(0),
-	m_freeze_active(false)
+    m_fade_curve( m_limits.m_fade_samples ),
+    m_resampler(),
+	m_freeze_active(false),
+    m_freeze_fade(false),
+    m_freeze_count(0)
 {
     set_bit_depth( 16 );
 }
 
-int DELAY_BUFFER::position_offset_from_head( int offset ) const
+void DELAY_BUFFER::configure( const ENGINE_CONFIG& config )
 {
-    ASSERT_MSG( offset >= 0 && offset < m_buffer_size_in_samples - 1, "DELAY_BUFFER::position_offset_from_head()" );
+    m_limits                    = ENGINE_LIMITS( config );
+    m_fade_curve.set_curve( m_fade_curve.curve_type(), m_limits.m_fade_samples );
     
-    int position = wrap_to_buffer( m_write_head - offset );
+    m_write_head                = 0;
+    m_fade_samples_remaining    = 0;
+    m_freeze_active             = false;
+    m_freeze_fade               = false;
+    ++m_freeze_count;
     
-    ASSERT_MSG( position >= 0 && position < m_buffer_size_in_samples, "DELAY_BUFFER::position_offset_from_head()" );
-    return position;
+    m_storage->clear();
+    update_buffer_size();
 }
 
-int DELAY_BUFFER::delay_offset_from_ratio( float ratio_of_max_delay ) const
+void DELAY_BUFFER::update_buffer_size()
 {
-    int offset = trunc_to_int( ratio_of_max_delay * ( m_buffer_size_in_samples - AUDIO_BLOCK_SAMPLES ) );
-    ASSERT_MSG( offset >= 0 && offset <= m_buffer_size_in_samples - AUDIO_BLOCK_SAMPLES, "DELAY_BUFFER::delay_offset_from_ratio()" );
-    return offset;
+    m_buffer_size_in_samples    = frames_in_storage( m_sample_size_in_bits );
+    
+    // the longest loop, with its jitter and the gap to the write head, has to fit
+    ASSERT_MSG( m_limits.m_max_loop_size + m_limits.m_max_jitter_size + ( m_limits.m_fade_samples * 2 ) + ( m_limits.m_max_block_samples * 2 ) < m_buffer_size_in_samples, "DELAY_BUFFER sample rate too high for the storage" );
 }
 
-int DELAY_BUFFER::delay_offset_from_time( int time_in_ms ) const
+void DELAY_BUFFER::set_storage( DELAY_STORAGE* storage )
 {
-    int offset   = convert_time_in_ms_to_samples( time_in_ms );
+    m_storage                   = storage != nullptr ? storage : &m_internal_storage;
+    m_storage_block_bits        = m_storage->block_size_in_bytes() * 8;
     
-    if( offset > m_buffer_size_in_samples - AUDIO_BLOCK_SAMPLES )
-    {
-        offset = m_buffer_size_in_samples - AUDIO_BLOCK_SAMPLES;
-    }
+    ASSERT_MSG( m_storage->size_in_bytes() % DELAY_STORAGE_BLOCK_ALIGNMENT == 0 && m_storage->block_size_in_bytes() % DELAY_STORAGE_BLOCK_ALIGNMENT == 0, "DELAY_BUFFER::set_storage() storage not aligned" );
     
-    ASSERT_MSG( offset >= 0 && offset <= m_buffer_size_in_samples - AUDIO_BLOCK_SAMPLES, "DELAY_BUFFER::delay_offset_from_time()" );
-    return offset;
+    m_write_head                = 0;
+    m_fade_samples_remaining    = 0;
+    ++m_freeze_count;
+    
+    m_storage->clear();
+    update_buffer_size();
 }
 
-int DELAY_BUFFER::write_head() const
+const DELAY_STORAGE& DELAY_BUFFER::storage() const
 {
-    return m_write_head;
+    return *m_storage;
 }
 
-int DELAY_BUFFER::wrap_to_buffer( int position ) const
+int DELAY_BUFFER::buffer_size_in_frames() const
 {
-    if( position < 0 )
-    {
-        return m_buffer_size_in_samples + position;
+    return m_buffer_size_in_samples;
+}
+
+const ENGINE_LIMITS& DELAY_BUFFER::limits() const
+{
+    return m_limits;
+}
+
+int DELAY_BUFFER::num_channels() const
+{
+    return m_limits.m_num_channels;
+}
+
+int DELAY_BUFFER::position_offset_from_head( int offset ) const
+{
+    ASSERT_MSG( offset >= 0 && offset < m_buffer_size_in_samples - 1, "DELAY_BUFFER::position_offset_from_head()" );
+    
+    int position = wrap_to_buffer( m_write_head - offset );
+    
+    ASSERT_MSG( position >= 0 && position < m_buffer_size_in_samples, "DELAY_BUFFER::position_offset_from_head()" );
+    return position;
+}
+
+int DELAY_BUFFER::delay_offset_from_ratio( float ratio_of_max_delay ) const
+{
+    const int max_offset = m_buffer_size_in_samples - m_limits.m_max_block_samples;
+    int offset = trunc_to_int( ratio_of_max_delay * max_offset );
+    ASSERT_MSG( offset >= 0 && offset <= max_offset, "DELAY_BUFFER::delay_offset_from_ratio()" );
+    return offset;
+}
+
+int DELAY_BUFFER::delay_offset_from_time( int time_in_ms ) const
+{
+    const int max_offset = m_buffer_size_in_samples - m_limits.m_max_block_samples;
+    int offset   = m_limits.m_samples_per_ms * time_in_ms;
+    
+    if( offset > max_offset )
+    {
+        offset = max_offset;
+    }
+    
+    ASSERT_MSG( offset >= 0 && offset <= max_offset, "DELAY_BUFFER::delay_offset_from_time()" );
+    return offset;
+}
+
+int DELAY_BUFFER::write_head() const
+{
+    return m_write_head;
+}
+
+int DELAY_BUFFER::wrap_to_buffer( int position ) const
+{
+    if( position < 0 )
+    {
+        return m_buffer_size_in_samples + position;
     }
     else if( position >= m_buffer_size_in_samples )
     {
@@ -561,48 +1071,28 @@ bool DELAY_BUFFER::write_buffer_fading_in() const
 
 void DELAY_BUFFER::write_sample( int16_t sample, int index )
 {
-    ASSERT_MSG( index >= 0 && index < m_buffer_size_in_samples, "DELAY_BUFFER::write_sample() writing outside buffer" );
+    ASSERT_MSG( num_channels() == 1, "DELAY_BUFFER::write_sample() indexes mono samples, stereo buffers take the run functions" );
     
     switch( m_sample_size_in_bits )
     {
+        case 4:
+        {
+            write_sample<SAMPLE_FORMAT_ADPCM_4>( sample, index );
+            break;
+        }
         case 8:
         {
-            int8_t sample8                          = (sample >> 8) & 0x00ff;
-            int8_t* sample_buffer                   = reinterpret_cast<int8_t*>(m_buffer);
-            sample_buffer[ index ]                  = sample8;
+            write_sample<SAMPLE_FORMAT_8>( sample, index );
             break;
         }
         case 12:
         {
-            int8_t* sample_buffer                   = reinterpret_cast<int8_t*>(m_buffer);
-            
-            const int offset_index                  = static_cast<int>( index * 1.5f );
-            
-            ASSERT_MSG( offset_index + 1 < DELAY_BUFFER_SIZE_IN_BYTES, "Buffer overrun" );
-            
-            if( index & 1 )
-            {
-                // odd indices
-                const uint8_t prev_byte                  = sample_buffer[ offset_index ];
-                sample_buffer[ offset_index ]            = ( (sample & 0xf000) >> 12 ) | (prev_byte & 0x00f0);
-                sample_buffer[ offset_index + 1 ]        = (( sample & 0x0ff0 ) >> 4);
-            }
-            else
-            {
-                // even indices
-                sample_buffer[ offset_index ]            = (sample >> 8);
-                const uint8_t prev_byte                  = sample_buffer[ offset_index + 1 ];
-                sample_buffer[ offset_index + 1 ]        = ( sample & 0x00f0 ) | ( prev_byte & 0x000f );
-                
-                // read sample asserts if you read at the write head ASSERT_MSG( abs( read_sample( index ) - sample ) < 16, "EVEN 12 bit converison failure" );
-            }
-            
+            write_sample<SAMPLE_FORMAT_12>( sample, index );
             break;
         }
         case 16:
         {
-            int16_t* sample_buffer                  = reinterpret_cast<int16_t*>(m_buffer);
-            sample_buffer[ index ]                  = sample;
+            write_sample<SAMPLE_FORMAT_16>( sample, index );
             break;
         }
     }
@@ -610,111 +1100,189 @@ void DELAY_BUFFER::write_sample( int16_t sample, int index )
 
 int16_t DELAY_BUFFER::read_sample( int index ) const
 {
-    ASSERT_MSG( index >= 0 && index < m_buffer_size_in_samples, "DELAY_BUFFER::read_sample() writing outside buffer" );
-    //ASSERT_MSG( index != m_write_head, "Reading from the write head position, expect a glitch" );
+    ASSERT_MSG( num_channels() == 1, "DELAY_BUFFER::read_sample() indexes mono samples, stereo buffers take the run functions" );
     
     switch( m_sample_size_in_bits )
     {
+        case 4:
+        {
+            return read_sample<SAMPLE_FORMAT_ADPCM_4>( index );
+        }
         case 8:
         {
-            const int8_t* sample_buffer    = reinterpret_cast<const int8_t*>(m_buffer);
-            const int8_t sample            = sample_buffer[ index ];
-            
-            int16_t sample16               = sample;
-            sample16                       <<= 8;
-            
-            return sample16;
+            return read_sample<SAMPLE_FORMAT_8>( index );
         }
         case 12:
         {
-            const int8_t* sample_buffer    = reinterpret_cast<const int8_t*>(m_buffer);
-            
-            const int offset_index         = static_cast<int>( index * 1.5f );
-            
-            if( index & 1 )
-            {
-                // odd indices
-                const uint8_t top           = sample_buffer[offset_index] & 0x000f;
-                const uint8_t bottom        = sample_buffer [offset_index + 1 ];
-                return ( (top << 12) | (bottom << 4) );
-            }
-            else
-            {
-                // even indices
-                const uint8_t top           = sample_buffer[offset_index];
-                const uint8_t bottom        = sample_buffer [offset_index + 1 ] & 0x00f0;
-                return ( (top << 8) | bottom );
-            }
-            
-            break;
+            return read_sample<SAMPLE_FORMAT_12>( index );
         }
         case 16:
         {
-            const int16_t* sample_buffer    = reinterpret_cast<const int16_t*>(m_buffer);
-            const int16_t sample            = sample_buffer[ index ];
-            return sample;
+            return read_sample<SAMPLE_FORMAT_16>( index );
         }
     }
     
     return 0;
 }
 
-int16_t DELAY_BUFFER::read_sample_with_speed( float index, float speed ) const
+template< typename FORMAT >
+int DELAY_BUFFER::frames_per_block() const
+{
+    const int groups            = m_storage_block_bits / ( FORMAT::BYTES_PER_GROUP * 8 );
+    return ( groups * FORMAT::SAMPLES_PER_GROUP ) / FORMAT::CHANNELS;
+}
+
+void DELAY_BUFFER::frame_group( int sample_size_in_bits, int num_channels, int& group_frames, int& group_bytes )
 {
-    if( speed < 1.0f )
+    if( sample_size_in_bits == SAMPLE_FORMAT_ADPCM_4::BITS )
     {
-        float nif = index;
-        increment_head( nif, speed );
-        
-        int curr_index = index;
-        int next_index = nif;
-        
-        if( curr_index == next_index )
-        {
-            // both current and next are in the same sample
-            return read_sample( curr_index );
-        }
-        else
-        {
-            // crossing 2 samples - calculate how much of each sample to use, then lerp between them
-            // use the fractional part - if 0.3 'into' next sample, then we mix 0.3 of next and 0.7 of current
-            float int_part;
-            float rem             = modff( nif, &int_part );
-            const float t         = rem / speed;
-            return lerp( read_sample(curr_index), read_sample(next_index), t );
-        }
+        group_frames            = SAMPLE_FORMAT_ADPCM_4::BLOCK_FRAMES;
+        group_bytes             = SAMPLE_FORMAT_ADPCM_4::CHANNEL_BLOCK_BYTES * num_channels;
     }
     else
     {
-        return read_sample( index );
+        // a 12-bit mono frame is the only one that isn't whole bytes
+        const int frame_bits    = sample_size_in_bits * num_channels;
+        group_frames            = frame_bits % 8 == 0 ? 1 : 2;
+        group_bytes             = ( group_frames * frame_bits ) / 8;
     }
 }
 
-void DELAY_BUFFER::increment_head( int& head ) const
+int DELAY_BUFFER::frames_in_storage( int sample_size_in_bits ) const
+{
+    // storage sizes are a multiple of DELAY_STORAGE_BLOCK_ALIGNMENT so the PCM formats fill every block exactly
+    int group_frames;
+    int group_bytes;
+    frame_group( sample_size_in_bits, m_limits.m_num_channels, group_frames, group_bytes );
+    
+    const int block_bytes       = m_storage->block_size_in_bytes();
+    return ( m_storage->size_in_bytes() / block_bytes ) * ( ( block_bytes / group_bytes ) * group_frames );
+}
+
+template< typename FORMAT >
+void DELAY_BUFFER::write_sample( int16_t sample, int index )
+{
+    ASSERT_MSG( index >= 0 && index < m_buffer_size_in_samples, "DELAY_BUFFER::write_sample() writing outside buffer" );
+    
+    const int block_samples     = frames_per_block<FORMAT>();
+    FORMAT::write( m_storage->write_block( index / block_samples ), index % block_samples, sample );
+}
+
+template< typename FORMAT >
+int16_t DELAY_BUFFER::read_sample( int index ) const
+{
+    ASSERT_MSG( index >= 0 && index < m_buffer_size_in_samples, "DELAY_BUFFER::read_sample() writing outside buffer" );
+    //ASSERT_MSG( index != m_write_head, "Reading from the write head position, expect a glitch" );
+    
+    const int block_samples     = frames_per_block<FORMAT>();
+    return FORMAT::read( m_storage->read_block( index / block_samples ), index % block_samples );
+}
+
+template< typename FORMAT >
+void DELAY_BUFFER::write_samples( const int16_t* source, int index, int count )
 {
-    ++head;
+    ASSERT_MSG( index >= 0 && index + count <= m_buffer_size_in_samples, "DELAY_BUFFER::write_samples() writing outside buffer" );
     
-    if( head >= m_buffer_size_in_samples )
+    const int block_frames      = frames_per_block<FORMAT>();
+    while( count > 0 )
     {
-        head = 0;
+        const int block         = index / block_frames;
+        const int block_index   = index - ( block * block_frames );
+        const int run           = min_val( count, block_frames - block_index );
+        FORMAT::write_run( m_storage->write_block( block ), block_index, source, run );
+        
+        source                  += run * FORMAT::CHANNELS;
+        index                   += run;
+        count                   -= run;
     }
 }
 
-void DELAY_BUFFER::increment_head( float& head, float speed ) const
+template< typename FORMAT >
+void DELAY_BUFFER::read_samples( int16_t* dest, int index, int count ) const
 {
-    head                        += speed;
-    if( head >= m_buffer_size_in_samples )
+    ASSERT_MSG( index >= 0 && index + count <= m_buffer_size_in_samples, "DELAY_BUFFER::read_samples() reading outside buffer" );
+    
+    const int block_frames      = frames_per_block<FORMAT>();
+    while( count > 0 )
     {
-        const float rem         = head - m_buffer_size_in_samples;
-        head                    = rem;
+        const int block         = index / block_frames;
+        const int block_index   = index - ( block * block_frames );
+        const int run           = min_val( count, block_frames - block_index );
+        FORMAT::read_run( m_storage->read_block( block ), block_index, dest, run );
+        
+        dest                    += run * FORMAT::CHANNELS;
+        index                   += run;
+        count                   -= run;
     }
-    else if( head < 0.0f )
+}
+
+template< typename FORMAT >
+void DELAY_BUFFER::read_samples_wrapped( int16_t* dest, int index, int count ) const
+{
+    while( count > 0 )
     {
-        head                    = m_buffer_size_in_samples + head;
+        index               = wrap_to_buffer( index );
+        
+        const int run       = min_val( count, m_buffer_size_in_samples - index );
+        read_samples<FORMAT>( dest, index, run );
+        
+        dest                += run * FORMAT::CHANNELS;
+        index               += run;
+        count               -= run;
     }
+}
+
+template< typename FORMAT >
+void DELAY_BUFFER::read_with_speed( int16_t* dest, int size, float& head, float speed ) const
+{
+    ASSERT_MSG( size > 0 && size <= m_limits.m_max_block_samples, "DELAY_BUFFER::read_with_speed() invalid size" );
+    ASSERT_MSG( fabsf( speed ) <= RESAMPLER::MAX_SPEED, "DELAY_BUFFER::read_with_speed() invalid speed" );
     
-    ASSERT_MSG( truncf(head) >= 0 && truncf(head) < m_buffer_size_in_samples, "DELAY_BUFFER::increment_head()" );
+    if( ( speed == 1.0f || speed == -1.0f ) && head == truncf( head ) )
+    {
+        // no interpolation required, straight copy
+        const int position      = head;
+        
+        if( speed > 0.0f )
+        {
+            read_samples_wrapped<FORMAT>( dest, position, size );
+        }
+        else
+        {
+            // read in buffer order then reverse
+            read_samples_wrapped<FORMAT>( dest, position - size + 1, size );
+            reverse_frames< FORMAT::CHANNELS >( dest, size );
+        }
+    }
+    else
+    {
+        // decode the section of the buffer covered by this run, then interpolate from it
+        const float last_head   = head + ( ( size - 1 ) * speed );
+        const int first_index   = static_cast<int>( floorf( min_val( head, last_head ) ) );
+        const int last_index    = static_cast<int>( floorf( max_val( head, last_head ) ) );
+        
+        const int window_start  = first_index - RESAMPLER::WINDOW_BEFORE;
+        const int window_size   = ( last_index - first_index ) + RESAMPLER::WINDOW_BEFORE + RESAMPLER::WINDOW_AFTER + 1;
+        
+        int16_t window[RESAMPLER::MAX_WINDOW_SIZE * MAX_DELAY_CHANNELS];
+        read_samples_wrapped<FORMAT>( window, window_start, window_size );
+        
+        const int position      = static_cast<int>( ( head - first_index ) * 65536.0f );
+        const int step          = static_cast<int>( roundf( speed * 65536.0f ) );
+        
+        m_resampler.resample< FORMAT::CHANNELS >( dest, size, window + ( RESAMPLER::WINDOW_BEFORE * FORMAT::CHANNELS ), position, step );
+    }
     
+    // advance the head
+    head                        += size * speed;
+    while( head >= m_buffer_size_in_samples )
+    {
+        head                    -= m_buffer_size_in_samples;
+    }
+    while( head < 0.0f )
+    {
+        head                    += m_buffer_size_in_samples;
+    }
 }
 
 void DELAY_BUFFER::write_to_buffer( const int16_t* source, int size )
@@ -726,28 +1294,159 @@ void DELAY_BUFFER::write_to_buffer( const int16_t* source, int size )
 		return;
 	}
 	
-    for( int x = 0; x < size; ++x )
+    // pick the storage format once per block
+    const bool stereo = MAX_DELAY_CHANNELS > 1 && m_limits.m_num_channels == 2;
+    switch( m_sample_size_in_bits )
+    {
+        case 4:
+        {
+            stereo ? write_to_buffer_impl< STEREO_FORMAT<SAMPLE_FORMAT_ADPCM_4> >( source, size ) : write_to_buffer_impl<SAMPLE_FORMAT_ADPCM_4>( source, size );
+            break;
+        }
+        case 8:
+        {
+            stereo ? write_to_buffer_impl< STEREO_FORMAT<SAMPLE_FORMAT_8> >( source, size ) : write_to_buffer_impl<SAMPLE_FORMAT_8>( source, size );
+            break;
+        }
+        case 12:
+        {
+            stereo ? write_to_buffer_impl< STEREO_FORMAT<SAMPLE_FORMAT_12> >( source, size ) : write_to_buffer_impl<SAMPLE_FORMAT_12>( source, size );
+            break;
+        }
+        case 16:
+        {
+            stereo ? write_to_buffer_impl< STEREO_FORMAT<SAMPLE_FORMAT_16> >( source, size ) : write_to_buffer_impl<SAMPLE_FORMAT_16>( source, size );
+            break;
+        }
+    }
+}
+
+void DELAY_BUFFER::write_to_buffer( const int16_t* source, const int16_t* feedback, int feedback_gain, int size )
+{
+    ASSERT_MSG( feedback_gain >= 0 && feedback_gain <= MAX_FEEDBACK, "DELAY_BUFFER::write_to_buffer() invalid feedback gain" );
+    
+    if( feedback_gain == 0 || m_freeze_active )
+    {
+        write_to_buffer( source, size );
+        return;
+    }
+    
+    const int num_samples = size * m_limits.m_num_channels;
+    int16_t mixed[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
+    for( int s = 0; s < num_samples; ++s )
     {
-        // fading in the write head
+        mixed[s] = clamp( source[s] + soft_clip( ( feedback[s] * feedback_gain ) >> FEEDBACK_BITS ), -32768, 32767 );
+    }
+    
+    write_to_buffer( mixed, size );
+}
+
+int16_t DELAY_BUFFER::soft_clip( int32_t sample )
+{
+    const int32_t magnitude     = sample < 0 ? -sample : sample;
+    if( magnitude <= SOFT_CLIP_KNEE )
+    {
+        return sample;
+    }
+    
+    // knee + range * over / ( range + over ) starts with a slope of 1 and never reaches full scale
+    const int32_t range         = 32767 - SOFT_CLIP_KNEE;
+    const int32_t over          = magnitude - SOFT_CLIP_KNEE;
+    const int32_t clipped       = SOFT_CLIP_KNEE + ( ( range * over ) / ( range + over ) );
+    return static_cast<int16_t>( sample < 0 ? -clipped : clipped );
+}
+
+template< typename FORMAT >
+void DELAY_BUFFER::write_to_buffer_impl( const int16_t* source, int size )
+{
+    int x = 0;
+    while( x < size )
+    {
+        // never cross the end of the buffer in a single run
+        const int max_run            = min_val( size - x, m_buffer_size_in_samples - m_write_head );
+        
         if( m_fade_samples_remaining > 0 )
         {
-            int16_t old_sample       = read_sample( m_write_head );
-            int16_t new_sample       = source[x];
+            const int run            = min_val( max_run, m_fade_samples_remaining );
             
-            const float t            = static_cast<float>(m_fade_samples_remaining) / FIXED_FADE_TIME_SAMPLES; // t=1 at old t=0 at new
-            --m_fade_samples_remaining;
+            int16_t old_samples[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
+            read_samples<FORMAT>( old_samples, m_write_head, run );
             
-            int16_t cf_sample         = cross_fade_samples( new_sample, old_sample, t );
+            int16_t cf_samples[MAX_BLOCK_SAMPLES * MAX_DELAY_CHANNELS];
+            if( m_freeze_fade )
+            {
+                // fading the new audio back into the old, ready to freeze
+                m_fade_curve.cross_fade< FORMAT::CHANNELS >( cf_samples, source + ( x * FORMAT::CHANNELS ), old_samples, run, m_fade_samples_remaining );
+            }
+            else
+            {
+                // fading the new audio in over the old
+                m_fade_curve.cross_fade< FORMAT::CHANNELS >( cf_samples, old_samples, source + ( x * FORMAT::CHANNELS ), run, m_fade_samples_remaining );
+            }
+            
+            write_samples<FORMAT>( cf_samples, m_write_head, run );
+            
+            m_fade_samples_remaining -= run;
+            m_write_head             = wrap_to_buffer( m_write_head + run );
+            x                        += run;
             
-            write_sample( cf_sample, m_write_head );
+            if( m_freeze_fade && m_fade_samples_remaining == 0 )
+            {
+                // stop writing
+                m_freeze_fade        = false;
+                m_freeze_active      = true;
+                ++m_freeze_count;
+                return;
+            }
         }
         else
         {
-            write_sample( source[x], m_write_head );
+            // write a whole run
+            write_samples<FORMAT>( source + ( x * FORMAT::CHANNELS ), m_write_head, max_run );
+            
+            m_write_head             = wrap_to_buffer( m_write_head + max_run );
+            x                        += max_run;
         }
+    }
+}
+
+void DELAY_BUFFER::prefetch_frames( int index, int count ) const
+{
+    if( count < 0 )
+    {
+        index                   += count + 1;
+        count                   = -count;
+    }
+    count                       = min_val( count, m_buffer_size_in_samples );
+    
+    // whole groups, within one block at a time
+    int group_frames;
+    int group_bytes;
+    frame_group( m_sample_size_in_bits, m_limits.m_num_channels, group_frames, group_bytes );
+    
+    const int block_bytes       = m_storage->block_size_in_bytes();
+    const int block_frames      = ( block_bytes / group_bytes ) * group_frames;
+    while( count > 0 )
+    {
+        index                   = wrap_to_buffer( index );
+        
+        const int block         = index / block_frames;
+        const int block_index   = index - ( block * block_frames );
+        const int run           = min_val( min_val( count, m_buffer_size_in_samples - index ), block_frames - block_index );
+        const int first_byte    = ( block * block_bytes ) + ( ( block_index / group_frames ) * group_bytes );
+        const int end_byte      = ( block * block_bytes ) + ( ( ( block_index + run + group_frames - 1 ) / group_frames ) * group_bytes );
+        m_storage->prefetch( first_byte, end_byte - first_byte );
         
-        // increment write head
-        increment_head( m_write_head );
+        index                   += run;
+        count                   -= run;
+    }
+}
+
+void DELAY_BUFFER::prefetch_write_head() const
+{
+    if( !m_freeze_active )
+    {
+        prefetch_frames( m_write_head, m_limits.m_max_block_samples );
     }
 }
 
@@ -757,14 +1456,24 @@ void DELAY_BUFFER::set_bit_depth( int sample_size_in_bits )
     if( sample_size_in_bits != m_sample_size_in_bits )
     {
         m_sample_size_in_bits       = sample_size_in_bits;
-        m_buffer_size_in_samples    = delay_buffer_size_in_samples( m_sample_size_in_bits );
-        
         m_write_head                = 0;
+        ++m_freeze_count;
         
-        memset( m_buffer, 0, sizeof(m_buffer) );
+        m_storage->clear();
+        update_buffer_size();
     }
 }
 
+int DELAY_BUFFER::bit_depth() const
+{
+    return m_sample_size_in_bits;
+}
+
+bool DELAY_BUFFER::valid_bit_depth( int sample_size_in_bits )
+{
+    return sample_size_in_bits == SAMPLE_FORMAT_ADPCM_4::BITS || sample_size_in_bits == 8 || sample_size_in_bits == 12 || sample_size_in_bits == 16;
+}
+
 bool DELAY_BUFFER::freeze_active() const
 {
 	return m_freeze_active;
@@ -783,15 +1492,95 @@ void DELAY_BUFFER::set_freeze( bool freeze )
 		}
 		else
 		{
-			m_freeze_active = true;
+			// keep writing until the new audio has faded back into the old, then freeze
+			m_fade_samples_remaining  = m_limits.m_fade_samples;
+			m_freeze_fade             = true;
 		}
 	}
 }
 
+uint32_t DELAY_BUFFER::freeze_count() const
+{
+    return m_freeze_count;
+}
+
+int DELAY_BUFFER::size_in_bytes() const
+{
+    return m_storage->size_in_bytes();
+}
+
+void DELAY_BUFFER::read_bytes( uint8_t* dest, int offset, int size ) const
+{
+    ASSERT_MSG( offset >= 0 && size >= 0 && offset + size <= m_storage->size_in_bytes(), "DELAY_BUFFER::read_bytes()" );
+    
+    const int block_size        = m_storage->block_size_in_bytes();
+    while( size > 0 )
+    {
+        const int block_offset  = offset % block_size;
+        const int run           = min_val( size, block_size - block_offset );
+        memcpy( dest, m_storage->read_block( offset / block_size ) + block_offset, run );
+        
+        dest                    += run;
+        offset                  += run;
+        size                    -= run;
+    }
+}
+
+void DELAY_BUFFER::write_bytes( const uint8_t* source, int offset, int size )
+{
+    ASSERT_MSG( offset >= 0 && size >= 0 && offset + size <= m_storage->size_in_bytes(), "DELAY_BUFFER::write_bytes()" );
+    
+    const int block_size        = m_storage->block_size_in_bytes();
+    while( size > 0 )
+    {
+        const int block_offset  = offset % block_size;
+        const int run           = min_val( size, block_size - block_offset );
+        memcpy( m_storage->write_block( offset / block_size ) + block_offset, source, run );
+        
+        source                  += run;
+        offset                  += run;
+        size                    -= run;
+    }
+}
+
+void DELAY_BUFFER::prefetch_bytes( int offset, int size ) const
+{
+    size                        = min_val( size, m_storage->size_in_bytes() - offset );
+    if( offset >= 0 && size > 0 )
+    {
+        m_storage->prefetch( offset, size );
+    }
+}
+
+void DELAY_BUFFER::restore_frozen( int sample_size_in_bits, int write_head )
+{
+    set_bit_depth( sample_size_in_bits );
+    
+    ASSERT_MSG( write_head >= 0 && write_head < m_buffer_size_in_samples, "DELAY_BUFFER::restore_frozen()" );
+    m_write_head                = write_head;
+    m_fade_samples_remaining    = 0;
+    m_freeze_active             = true;
+    m_freeze_fade               = false;
+    ++m_freeze_count;
+}
+
+void DELAY_BUFFER::set_fade_curve( FADE_CURVE::CURVE_TYPE curve_type )
+{
+    if( curve_type != m_fade_curve.curve_type() )
+    {
+        m_fade_curve.set_curve( curve_type, m_limits.m_fade_samples );
+    }
+}
+
+void DELAY_BUFFER::set_resample_quality( RESAMPLER::QUALITY quality )
+{
+    m_resampler.set_quality( quality );
+}
+
 void DELAY_BUFFER::fade_in_write()
 {
     ASSERT_MSG( m_fade_samples_remaining == 0, "DELAY_BUFFER::fade_in_write() trying to start a fade during a fade" );
-    m_fade_samples_remaining = FIXED_FADE_TIME_SAMPLES;
+    m_fade_samples_remaining = m_limits.m_fade_samples;
 }
 
 #ifdef DEBUG_OUTPUT
@@ -809,74 +1598,502 @@ void DELAY_BUFFER::debug_output()
 
 /////////////////////////////////////////////////////////////////////
 
-GLITCH_DELAY_EFFECT::GLITCH_DELAY_EFFECT() :
-  m_delay_buffer(),
-  m_play_heads( { PLAY_HEAD( m_delay_buffer, 0.5f ), PLAY_HEAD( m_delay_buffer, 1.0f ), PLAY_HEAD( m_delay_buffer, 2.0f ), PLAY_HEAD( m_delay_buffer, -1.0f ) } ),
-  m_loop_size_ratio(),
-	m_jitter_ratio(),
+GLITCH_DELAY_PARAMETERS::GLITCH_DELAY_PARAMETERS() :
+  m_sample_size_in_bits(12),
   m_loop_moving(true),
-  m_next_sample_size_in_bits(12),
-  m_next_loop_moving(true),
-  m_next_beat(false),
-	m_next_freeze_active(false)
+  m_freeze_active(false),
+  m_fade_curve(FADE_CURVE::LINEAR),
+  m_resample_quality(RESAMPLER::SINC),
+  m_beat_count(0),
+  m_beat_period(0),
+  m_beat_sample(0),
+  m_beat_sync_count(0),
+  m_loop_size_ratio(),
+  m_jitter_ratio(),
+  m_jitter_distribution(),
+  m_jitter_subdivisions(),
+  m_head_gain(),
+  m_feedback_gain(0)
 {
-	for( int i = 0; i < NUM_PLAY_HEADS; ++ i )
-	{
-		m_loop_size_ratio[i]	= 0.0f;
-		m_jitter_ratio[i]		= 0.0f;
-	}
 }
 
-void GLITCH_DELAY_EFFECT::process_audio_in_impl( int channel, const int16_t* sample_data, int num_samples )
+/////////////////////////////////////////////////////////////////////
+
+BUFFER_TRANSFER::BUFFER_TRANSFER() :
+  m_request(INFO),
+  m_success(false),
+  m_sample_size_in_bits(0),
+  m_num_channels(0),
+  m_size_in_bytes(0),
+  m_write_head(0),
+  m_frozen(false),
+  m_freeze_count(0),
+  m_offset(0),
+  m_size(0),
+  m_data()
 {
-    ASSERT_MSG( channel == 0, "Only mono input supported" );
+}
+
+/////////////////////////////////////////////////////////////////////
+
+const PLAY_HEAD_CONFIG GLITCH_DELAY_EFFECT::DEFAULT_PLAY_HEADS[NUM_DEFAULT_PLAY_HEADS] =
+{
+  // speed  reverse  loop size  jitter  output
+  { 0.5f,   false,   0.0f,      0.0f,   0 },
+  { 1.0f,   false,   0.0f,      0.0f,   1 },
+  { 2.0f,   false,   0.0f,      0.0f,   2 },
+  { 1.0f,   true,    0.0f,      0.0f,   3 },
+};
+
+GLITCH_DELAY_EFFECT::GLITCH_DELAY_EFFECT( const ENGINE_CONFIG& config ) :
+  m_delay_buffer(),
+  m_play_heads(),
+  m_num_play_heads(0),
+  m_output_channel(),
+  m_num_output_channels(0),
+  m_render_order(),
+  m_pending_parameters(),
+  m_published_parameters(),
+  m_parameters(),
+  m_parameters_publish_count(0),
+  m_beat_count(0),
+  m_storage_stalls(0),
+  m_random_seed(1),
+  m_beat_clock(),
+  m_sample_clock(0),
+  m_block_samples(config.m_max_block_samples),
+  m_input_frames(),
+  m_feedback_frames(),
+  m_input_received(false),
+  m_transfer(),
+  m_transfer_state(TRANSFER_IDLE),
+  m_profiler()
+{
+  configure_engine( config );
+  configure_play_heads( DEFAULT_PLAY_HEADS, NUM_DEFAULT_PLAY_HEADS );
+}
+
+void GLITCH_DELAY_EFFECT::configure_engine( const ENGINE_CONFIG& config )
+{
+  m_delay_buffer.configure( config );
+  
+  // the buffer has been cleared, so start the heads again
+  for( int pi = 0; pi < m_num_play_heads; ++pi )
+  {
+    m_play_heads[pi].reset();
+  }
+  
+  // keep the detail of blocks using more than 85% of the time of the longest block
+  m_profiler.set_spike_ticks( static_cast<uint32_t>( ( static_cast<float>( PROFILER::ticks_per_second() ) * config.m_max_block_samples * 0.85f ) / config.m_sample_rate ) );
+}
+
+const ENGINE_LIMITS& GLITCH_DELAY_EFFECT::engine_limits() const
+{
+  return m_delay_buffer.limits();
+}
+
+void GLITCH_DELAY_EFFECT::set_delay_storage( DELAY_STORAGE* storage )
+{
+  m_delay_buffer.set_storage( storage );
+  m_storage_stalls = m_delay_buffer.storage().num_stalls();
+  
+  for( int pi = 0; pi < m_num_play_heads; ++pi )
+  {
+    m_play_heads[pi].reset();
+  }
+}
+
+void GLITCH_DELAY_EFFECT::configure_play_heads( const PLAY_HEAD_CONFIG* configs, int num_heads, OUTPUT_MODE output_mode )
+{
+  ASSERT_MSG( num_heads > 0 && num_heads <= MAX_PLAY_HEADS, "GLITCH_DELAY_EFFECT::configure_play_heads() invalid number of heads" );
+  
+  m_num_play_heads                = num_heads;
+  m_num_output_channels           = 0;
+  
+  for( int pi = 0; pi < num_heads; ++pi )
+  {
+    const PLAY_HEAD_CONFIG& config  = configs[pi];
+    ASSERT_MSG( config.m_output_channel >= 0 && config.m_output_channel < MAX_PLAY_HEADS, "GLITCH_DELAY_EFFECT::configure_play_heads() invalid output channel" );
+    
+    m_play_heads[pi].configure( m_delay_buffer, config.m_reverse ? -config.m_speed : config.m_speed );
+    
+    m_pending_parameters.m_loop_size_ratio[pi] = config.m_loop_size_ratio;
+    m_pending_parameters.m_jitter_ratio[pi]    = config.m_jitter_ratio;
+    m_pending_parameters.m_jitter_distribution[pi] = PLAY_HEAD_RANDOM::UNIFORM;
+    m_pending_parameters.m_jitter_subdivisions[pi] = DEFAULT_JITTER_SUBDIVISIONS;
+    m_pending_parameters.m_head_gain[pi] = UNITY_HEAD_GAIN;
+    m_output_channel[pi]          = output_mode == MIXED_OUTPUT ? 0 : config.m_output_channel;
+    m_render_order[pi]            = pi;
+    
+    m_num_output_channels         = max_val( m_num_output_channels, m_output_channel[pi] + 1 );
+  }
+  
+  m_parameters                    = m_pending_parameters;
+  publish_parameters();
+  
+  set_random_seed( m_random_seed );
+  
+  m_profiler.set_num_heads( num_heads );
+}
+
+int GLITCH_DELAY_EFFECT::num_play_heads() const
+{
+  return m_num_play_heads;
+}
+
+void GLITCH_DELAY_EFFECT::set_random_seed( uint32_t seed )
+{
+  m_random_seed                   = seed;
+  
+  // a different sequence for each head
+  for( int pi = 0; pi < m_num_play_heads; ++pi )
+  {
+    m_play_heads[pi].seed_random( seed + ( pi * 0x9E3779B9u ) );
+  }
+}
+
+void GLITCH_DELAY_EFFECT::sort_render_order()
+{
+  // insertion sort, the order barely changes between blocks
+  for( int i = 1; i < m_num_play_heads; ++i )
+  {
+    const uint8_t head            = m_render_order[i];
+    const int position            = m_play_heads[head].current_position();
+    
+    int j = i;
+    for( ; j > 0 && m_play_heads[ m_render_order[j - 1] ].current_position() > position; --j )
+    {
+      m_render_order[j]           = m_render_order[j - 1];
+    }
+    m_render_order[j]             = head;
+  }
+}
+
+void GLITCH_DELAY_EFFECT::process_audio_in_impl( int /*channel*/, const int16_t* sample_data, int num_samples )
+{
+    ASSERT_MSG( m_delay_buffer.num_channels() == 1, "Mono input only, stereo buffers take process_audio_in_stereo_impl()" );
+    ASSERT_MSG( num_samples <= m_delay_buffer.limits().m_max_block_samples, "GLITCH_DELAY_EFFECT::process_audio_in_impl() block longer than configured" );
 	
-    m_delay_buffer.write_to_buffer( sample_data, num_samples );
+    // the asserts compile out, a longer block would overrun m_input_frames (the JUCE wrapper splits them, see update_in_blocks())
+    num_samples = min_val( num_samples, m_delay_buffer.limits().m_max_block_samples );
+    memcpy( m_input_frames, sample_data, num_samples * sizeof(int16_t) );
+    m_block_samples = num_samples;
+    m_input_received = true;
 }
 
 void GLITCH_DELAY_EFFECT::process_audio_out_impl( int channel, int16_t* sample_data, int num_samples )
 {
-    ASSERT_MSG( !m_play_heads[channel].position_inside_next_read( m_delay_buffer.write_head(), num_samples ), "Non - reading over write buffer\n" ); // position after write head is OLD DATA
- 
-	m_play_heads[channel].read_from_play_head( sample_data, num_samples );
+    ASSERT_MSG( num_samples <= m_delay_buffer.limits().m_max_block_samples, "GLITCH_DELAY_EFFECT::process_audio_out_impl() block longer than configured" );
+    
+    // past the configured length the scratch buffers would overrun, leave it silent
+    const int silent_samples = max_val( num_samples - m_delay_buffer.limits().m_max_block_samples, 0 );
+    num_samples -= silent_samples;
+    memset( sample_data + num_samples, 0, silent_samples * sizeof(int16_t) );
+    
+    bool first_head = true;
+    
+    // every head routed to this channel, in render order, at its gain
+    for( int i = 0; i < m_num_play_heads; ++i )
+    {
+        const int pi = m_render_order[i];
+        if( m_output_channel[pi] != channel )
+        {
+            continue;
+        }
+        
+        PLAY_HEAD& play_head = m_play_heads[pi];
+        ASSERT_MSG( !play_head.position_inside_next_read( m_delay_buffer.write_head(), num_samples ), "Non - reading over write buffer\n" ); // position after write head is OLD DATA
+        
+        const uint32_t start_ticks = PROFILER::now();
+        const int gain = m_parameters.m_head_gain[pi];
+        
+        if( first_head )
+        {
+            // straight into the output block, scaled in place
+            play_head.read_from_play_head( sample_data, num_samples );
+            if( gain != UNITY_HEAD_GAIN )
+            {
+                for( int x = 0; x < num_samples; ++x )
+                {
+                    sample_data[x] = clamp( ( sample_data[x] * gain ) >> HEAD_GAIN_BITS, -32768, 32767 );
+                }
+            }
+            first_head = false;
+        }
+        else
+        {
+            int16_t head_samples[MAX_BLOCK_SAMPLES];
+            play_head.read_from_play_head( head_samples, num_samples );
+            
+            for( int x = 0; x < num_samples; ++x )
+            {
+                sample_data[x] = clamp( sample_data[x] + ( ( head_samples[x] * gain ) >> HEAD_GAIN_BITS ), -32768, 32767 );
+            }
+        }
+        
+        m_profiler.add_head( pi, PROFILER::now() - start_ticks, play_head.take_events() );
+    }
+    
+    if( first_head )
+    {
+        // nothing routed here
+        memset( sample_data, 0, num_samples * sizeof(int16_t) );
+    }
+    else if( m_parameters.m_feedback_gain != 0 )
+    {
+        for( int x = 0; x < num_samples; ++x )
+        {
+            m_feedback_frames[x] = clamp( m_feedback_frames[x] + sample_data[x], -32768, 32767 );
+        }
+    }
+}
+
+void GLITCH_DELAY_EFFECT::process_audio_in_stereo_impl( int /*left_channel*/, const int16_t* left_data, const int16_t* right_data, int num_samples )
+{
+    ASSERT_MSG( m_delay_buffer.num_channels() == 2, "Stereo input only into a stereo buffer" );
+    ASSERT_MSG( num_samples <= m_delay_buffer.limits().m_max_block_samples, "GLITCH_DELAY_EFFECT::process_audio_in_stereo_impl() block longer than configured" );
+    
+    // as process_audio_in_impl()
+    num_samples = min_val( num_samples, m_delay_buffer.limits().m_max_block_samples );
+    m_block_samples = num_samples;
+    m_input_received = true;
+    
+    // the buffer stores L/R frames
+    for( int x = 0; x < num_samples; ++x )
+    {
+        m_input_frames[ x * 2 ]       = left_data[x];
+        m_input_frames[ ( x * 2 ) + 1 ] = right_data[x];
+    }
+}
+
+void GLITCH_DELAY_EFFECT::process_audio_out_stereo_impl( int left_channel, int16_t* left_data, int16_t* right_data, int num_samples )
+{
+    ASSERT_MSG( m_delay_buffer.num_channels() == 2, "Stereo output only from a stereo buffer" );
+    ASSERT_MSG( num_samples <= m_delay_buffer.limits().m_max_block_samples, "GLITCH_DELAY_EFFECT::process_audio_out_stereo_impl() block longer than configured" );
+    
+    // as process_audio_out_impl()
+    const int silent_samples = max_val( num_samples - m_delay_buffer.limits().m_max_block_samples, 0 );
+    num_samples -= silent_samples;
+    memset( left_data + num_samples, 0, silent_samples * sizeof(int16_t) );
+    memset( right_data + num_samples, 0, silent_samples * sizeof(int16_t) );
+    
+    const int output = left_channel / 2;
+    bool first_head = true;
+    
+    // every head routed to this pair, in render order, each head reads both channels of a frame at once
+    for( int i = 0; i < m_num_play_heads; ++i )
+    {
+        const int pi = m_render_order[i];
+        if( m_output_channel[pi] != output )
+        {
+            continue;
+        }
+        
+        PLAY_HEAD& play_head = m_play_heads[pi];
+        ASSERT_MSG( !play_head.position_inside_next_read( m_delay_buffer.write_head(), num_samples ), "Non - reading over write buffer\n" ); // position after write head is OLD DATA
+        
+        const uint32_t start_ticks = PROFILER::now();
+        const int gain = m_parameters.m_head_gain[pi];
+        
+        int16_t frames[MAX_BLOCK_SAMPLES * 2];
+        play_head.read_from_play_head( frames, num_samples );
+        
+        if( first_head )
+        {
+            for( int x = 0; x < num_samples; ++x )
+            {
+                left_data[x]  = clamp( ( frames[ x * 2 ] * gain ) >> HEAD_GAIN_BITS, -32768, 32767 );
+                right_data[x] = clamp( ( frames[ ( x * 2 ) + 1 ] * gain ) >> HEAD_GAIN_BITS, -32768, 32767 );
+            }
+            first_head = false;
+        }
+        else
+        {
+            for( int x = 0; x < num_samples; ++x )
+            {
+                left_data[x]  = clamp( left_data[x] + ( ( frames[ x * 2 ] * gain ) >> HEAD_GAIN_BITS ), -32768, 32767 );
+                right_data[x] = clamp( right_data[x] + ( ( frames[ ( x * 2 ) + 1 ] * gain ) >> HEAD_GAIN_BITS ), -32768, 32767 );
+            }
+        }
+        
+        m_profiler.add_head( pi, PROFILER::now() - start_ticks, play_head.take_events() );
+    }
+    
+    if( first_head )
+    {
+        // nothing routed here
+        memset( left_data, 0, num_samples * sizeof(int16_t) );
+        memset( right_data, 0, num_samples * sizeof(int16_t) );
+    }
+    else if( m_parameters.m_feedback_gain != 0 )
+    {
+        for( int x = 0; x < num_samples; ++x )
+        {
+            m_feedback_frames[ x * 2 ]       = clamp( m_feedback_frames[ x * 2 ] + left_data[x], -32768, 32767 );
+            m_feedback_frames[ ( x * 2 ) + 1 ] = clamp( m_feedback_frames[ ( x * 2 ) + 1 ] + right_data[x], -32768, 32767 );
+        }
+    }
 }
 
 int GLITCH_DELAY_EFFECT::num_input_channels() const
 {
-    return 1;
+    return m_delay_buffer.num_channels();
 }
 
 int GLITCH_DELAY_EFFECT::num_output_channels() const
 {
-    return NUM_PLAY_HEADS;
+    return m_num_output_channels * m_delay_buffer.num_channels();
+}
+
+bool GLITCH_DELAY_EFFECT::adopt_parameters()
+{
+    const uint32_t publish_count = m_published_parameters.publish_count();
+    if( publish_count == m_parameters_publish_count )
+    {
+        return false;
+    }
+    
+    // keep the previous set if every read overlapped a publish, the next block will pick it up
+    GLITCH_DELAY_PARAMETERS parameters;
+    if( m_published_parameters.read( parameters ) )
+    {
+        m_parameters                = parameters;
+        m_parameters_publish_count  = publish_count;
+        return true;
+    }
+    
+    return false;
+}
+
+bool GLITCH_DELAY_EFFECT::carry_out_transfer()
+{
+    if( __atomic_load_n( &m_transfer_state, __ATOMIC_ACQUIRE ) != TRANSFER_REQUESTED )
+    {
+        return false;
+    }
+    
+    BUFFER_TRANSFER& transfer   = m_transfer;
+    const bool chunk_in_range   = transfer.m_offset >= 0 && transfer.m_size >= 0 && transfer.m_size <= BUFFER_TRANSFER::MAX_CHUNK_SIZE_IN_BYTES &&
+                                  transfer.m_offset + transfer.m_size <= m_delay_buffer.size_in_bytes();
+    switch( transfer.m_request )
+    {
+        case BUFFER_TRANSFER::INFO:
+        {
+            transfer.m_sample_size_in_bits = m_delay_buffer.bit_depth();
+            transfer.m_num_channels     = m_delay_buffer.num_channels();
+            transfer.m_size_in_bytes    = m_delay_buffer.size_in_bytes();
+            transfer.m_write_head       = m_delay_buffer.write_head();
+            transfer.m_frozen           = m_delay_buffer.freeze_active();
+            transfer.m_freeze_count     = m_delay_buffer.freeze_count();
+            transfer.m_success          = true;
+            break;
+        }
+        case BUFFER_TRANSFER::READ_CHUNK:
+        {
+            transfer.m_success          = chunk_in_range && m_delay_buffer.freeze_active() && transfer.m_freeze_count == m_delay_buffer.freeze_count();
+            if( transfer.m_success )
+            {
+                m_delay_buffer.read_bytes( transfer.m_data, transfer.m_offset, transfer.m_size );
+            }
+            break;
+        }
+        case BUFFER_TRANSFER::RESTORE:
+        {
+            const int bits              = transfer.m_sample_size_in_bits;
+            transfer.m_success          = DELAY_BUFFER::valid_bit_depth( bits ) && transfer.m_num_channels == m_delay_buffer.num_channels() &&
+                                          transfer.m_size_in_bytes == m_delay_buffer.size_in_bytes() && transfer.m_write_head >= 0 &&
+                                          transfer.m_write_head < m_delay_buffer.frames_in_storage( bits );
+            if( transfer.m_success )
+            {
+                m_delay_buffer.restore_frozen( bits, transfer.m_write_head );
+                transfer.m_freeze_count = m_delay_buffer.freeze_count();
+                
+                // the old audio is gone, so start the heads again
+                for( int pi = 0; pi < m_num_play_heads; ++pi )
+                {
+                    m_play_heads[pi].reset();
+                }
+            }
+            break;
+        }
+        case BUFFER_TRANSFER::WRITE_CHUNK:
+        {
+            // the heads play what has been written so far
+            transfer.m_success          = chunk_in_range && m_delay_buffer.freeze_active() && transfer.m_freeze_count == m_delay_buffer.freeze_count();
+            if( transfer.m_success )
+            {
+                m_delay_buffer.write_bytes( transfer.m_data, transfer.m_offset, transfer.m_size );
+            }
+            break;
+        }
+    }
+    
+    // chunks usually follow one another, so have the next one ready in slow storage
+    if( transfer.m_request == BUFFER_TRANSFER::READ_CHUNK || transfer.m_request == BUFFER_TRANSFER::WRITE_CHUNK )
+    {
+        m_delay_buffer.prefetch_bytes( transfer.m_offset + transfer.m_size, transfer.m_size );
+    }
+    
+    __atomic_store_n( &m_transfer_state, static_cast<uint32_t>( TRANSFER_COMPLETE ), __ATOMIC_RELEASE );
+    return true;
 }
 
 void GLITCH_DELAY_EFFECT::update()
 {
-    static int num_updates(0);
-    ++num_updates;
+    m_profiler.begin_block();
+    const uint32_t start_ticks  = PROFILER::now();
+    
+    if( adopt_parameters() )
+    {
+        m_profiler.add_event( PROFILE_EVENT_PARAMETERS );
+    }
+    
+    if( m_parameters.m_sample_size_in_bits != m_delay_buffer.bit_depth() )
+    {
+        m_profiler.add_event( PROFILE_EVENT_BIT_DEPTH );
+        m_delay_buffer.set_bit_depth( m_parameters.m_sample_size_in_bits );
+        
+        // the buffer has been cleared and resized, so the heads may now be outside it
+        for( int pi = 0; pi < m_num_play_heads; ++pi )
+        {
+            m_play_heads[pi].reset();
+        }
+    }
+	m_delay_buffer.set_freeze( m_parameters.m_freeze_active );
+    m_delay_buffer.set_fade_curve( m_parameters.m_fade_curve );
+    m_delay_buffer.set_resample_quality( m_parameters.m_resample_quality );
     
-    m_delay_buffer.set_bit_depth( m_next_sample_size_in_bits );
-	m_delay_buffer.set_freeze( m_next_freeze_active );
+    // after the parameters, so a restore isn't undone by the freeze and bit depth published with it
+    if( carry_out_transfer() )
+    {
+        m_profiler.add_event( PROFILE_EVENT_BUFFER_TRANSFER );
+    }
 	
-    m_loop_moving               = m_next_loop_moving;
+    const bool beat             = m_parameters.m_beat_count != m_beat_count;
+    m_beat_count                = m_parameters.m_beat_count;
+    m_beat_clock.set( m_parameters.m_beat_period, m_parameters.m_beat_sample, m_parameters.m_beat_sync_count );
+    if( beat )
+    {
+        m_profiler.add_event( PROFILE_EVENT_BEAT );
+    }
     
-    for( int pi = 0; pi < NUM_PLAY_HEADS; ++pi )
+    for( int pi = 0; pi < m_num_play_heads; ++pi )
     {
         PLAY_HEAD& play_head = m_play_heads[pi];
-        if( m_loop_moving )
+        if( m_parameters.m_loop_moving )
         {
-            play_head.set_shift_speed( m_jitter_ratio[pi] ); // TODO remove this mode?
+            play_head.set_shift_speed( m_parameters.m_jitter_ratio[pi] ); // TODO remove this mode?
         }
         else
         {
             play_head.set_shift_speed( 0.0f );
-            play_head.set_jitter( m_jitter_ratio[pi] );
+            play_head.set_jitter( m_parameters.m_jitter_ratio[pi] );
+            play_head.set_jitter_distribution( m_parameters.m_jitter_distribution[pi], m_parameters.m_jitter_subdivisions[pi] );
         }
         
-        play_head.set_loop_size( m_loop_size_ratio[pi] );
+        play_head.set_loop_size( m_parameters.m_loop_size_ratio[pi] );
         
-        if( m_next_beat && play_head.play_forwards() && !play_head.crossfade_active() ) // let the reverse head play regardless of beats
+        if( beat && play_head.play_forwards() && !play_head.crossfade_active() ) // let the reverse head play regardless of beats
         {
             play_head.set_next_loop();
             play_head.set_loop_behind_write_head();
@@ -894,92 +2111,252 @@ void GLITCH_DELAY_EFFECT::update()
             }
             else
             {
-                if( play_head.position_inside_next_read( m_delay_buffer.write_head(), AUDIO_BLOCK_SAMPLES * 2 ) )
+                if( play_head.position_inside_next_read( m_delay_buffer.write_head(), m_delay_buffer.limits().m_max_block_samples * 2 ) )
                 {
                     play_head.set_loop_behind_write_head();
                 }
             }
         }
     }
-    m_next_beat = false;
     
-    // read in on channel 0
-    process_audio_in( 0 );
+    const uint32_t bookkeeping_end_ticks = PROFILER::now();
+    m_profiler.add_stage( PROFILE_BOOKKEEPING, bookkeeping_end_ticks - start_ticks );
     
-    // write out all the playheads
-    for( int pi = 0; pi < NUM_PLAY_HEADS; ++pi )
+    // read in on channel 0, or the pair 0 and 1
+    const bool stereo           = m_delay_buffer.num_channels() == 2;
+    if( stereo )
     {
-        process_audio_out( pi );
+        process_audio_in_stereo( 0 );
+    }
+    else
+    {
+        process_audio_in( 0 );
+    }
+    
+    // the clock's beat lands on its sample inside each forward head's read, now the block length is known
+    const int clock_beat_offset = m_beat_clock.beat_in_block( m_sample_clock, m_block_samples );
+    for( int pi = 0; pi < m_num_play_heads; ++pi )
+    {
+        if( m_play_heads[pi].play_forwards() )
+        {
+            m_play_heads[pi].set_beat( clock_beat_offset );
+        }
     }
+    if( clock_beat_offset >= 0 )
+    {
+        m_profiler.add_event( PROFILE_EVENT_BEAT );
+    }
+    
+    const uint32_t audio_in_end_ticks = PROFILER::now();
+    m_profiler.add_stage( PROFILE_AUDIO_IN, audio_in_end_ticks - bookkeeping_end_ticks );
+    
+    // write out each channel when the first head routed to it comes up in render order, summing the feedback as they go
+    sort_render_order();
+    
+    if( m_parameters.m_feedback_gain != 0 )
+    {
+        memset( m_feedback_frames, 0, m_block_samples * m_delay_buffer.num_channels() * sizeof(int16_t) );
+    }
+    
+    bool channel_written[MAX_PLAY_HEADS] = {};
+    for( int i = 0; i < m_num_play_heads; ++i )
+    {
+        const int channel = m_output_channel[ m_render_order[i] ];
+        if( !channel_written[channel] )
+        {
+            channel_written[channel] = true;
+            if( stereo )
+            {
+                process_audio_out_stereo( channel * 2 );
+            }
+            else
+            {
+                process_audio_out( channel );
+            }
+        }
+    }
+    
+    const uint32_t audio_out_end_ticks = PROFILER::now();
+    m_profiler.add_stage( PROFILE_AUDIO_OUT, audio_out_end_ticks - audio_in_end_ticks );
+    
+    // the heads have read everything before this block, so the input (and the feedback from what they read) goes in now
+    if( m_input_received )
+    {
+        m_delay_buffer.write_to_buffer( m_input_frames, m_feedback_frames, m_parameters.m_feedback_gain, m_block_samples );
+        m_input_received = false;
+    }
+    
+    const uint32_t write_end_ticks = PROFILER::now();
+    m_profiler.add_stage( PROFILE_AUDIO_IN, write_end_ticks - audio_out_end_ticks );
+    
+    // the heads have moved on, so slow storage can load what the next update() reads while this one is idle
+    m_delay_buffer.prefetch_write_head();
+    for( int pi = 0; pi < m_num_play_heads; ++pi )
+    {
+        m_play_heads[pi].prefetch();
+    }
+    
+    const uint32_t storage_stalls = m_delay_buffer.storage().num_stalls();
+    if( storage_stalls != m_storage_stalls )
+    {
+        m_profiler.add_event( PROFILE_EVENT_STORAGE_STALL );
+        m_storage_stalls        = storage_stalls;
+    }
+    
+    __atomic_store_n( &m_sample_clock, m_sample_clock + m_block_samples, __ATOMIC_RELAXED );
+    
+    const uint32_t end_ticks    = PROFILER::now();
+    m_profiler.add_stage( PROFILE_PREFETCH, end_ticks - write_end_ticks );
+    m_profiler.add_stage( PROFILE_UPDATE, end_ticks - start_ticks );
+    m_profiler.end_block();
 }
 
 void GLITCH_DELAY_EFFECT::set_bit_depth( int sample_size_in_bits )
 {
-    m_next_sample_size_in_bits = sample_size_in_bits;
+    m_pending_parameters.m_sample_size_in_bits = sample_size_in_bits;
     //set_bit_depth_impl( sample_size_in_bits );
 }
 
 void GLITCH_DELAY_EFFECT::set_loop_moving( bool moving )
 {
-    m_next_loop_moving = moving;
+    m_pending_parameters.m_loop_moving = moving;
 }
 
 void GLITCH_DELAY_EFFECT::set_loop_size( int play_head, float loop_size )
 {
-	ASSERT_MSG( play_head < NUM_PLAY_HEADS, "Invalid play head index" );
-	m_loop_size_ratio[play_head] = loop_size;
+	ASSERT_MSG( play_head < m_num_play_heads, "Invalid play head index" );
+	m_pending_parameters.m_loop_size_ratio[play_head] = loop_size;
 }
 
 void GLITCH_DELAY_EFFECT::set_jitter( int play_head, float jitter )
 {
-	ASSERT_MSG( play_head < NUM_PLAY_HEADS, "Invalid play head index" );
-	m_jitter_ratio[play_head] = jitter;
+	ASSERT_MSG( play_head < m_num_play_heads, "Invalid play head index" );
+	m_pending_parameters.m_jitter_ratio[play_head] = jitter;
+}
+
+void GLITCH_DELAY_EFFECT::set_jitter_distribution( int play_head, PLAY_HEAD_RANDOM::DISTRIBUTION distribution, int subdivisions )
+{
+	ASSERT_MSG( play_head < m_num_play_heads, "Invalid play head index" );
+	m_pending_parameters.m_jitter_distribution[play_head] = distribution;
+	m_pending_parameters.m_jitter_subdivisions[play_head] = subdivisions;
+}
+
+void GLITCH_DELAY_EFFECT::set_feedback( float feedback )
+{
+	m_pending_parameters.m_feedback_gain = static_cast<int>( roundf( clamp( feedback, 0.0f, 1.0f ) * DELAY_BUFFER::MAX_FEEDBACK ) );
+}
+
+void GLITCH_DELAY_EFFECT::set_head_gain( int play_head, float gain )
+{
+	ASSERT_MSG( play_head < m_num_play_heads, "Invalid play head index" );
+	m_pending_parameters.m_head_gain[play_head] = static_cast<int>( roundf( clamp( gain, -4.0f, 4.0f ) * UNITY_HEAD_GAIN ) );
 }
 
 void GLITCH_DELAY_EFFECT::set_beat()
 {
-    m_next_beat = true;
+    ++m_pending_parameters.m_beat_count;
+}
+
+void GLITCH_DELAY_EFFECT::set_beat_clock( float period_samples, uint32_t beat_sample )
+{
+    m_pending_parameters.m_beat_period = BEAT_CLOCK::to_period( period_samples );
+    m_pending_parameters.m_beat_sample = beat_sample;
+    ++m_pending_parameters.m_beat_sync_count;
+}
+
+void GLITCH_DELAY_EFFECT::set_beat_tempo( float period_samples )
+{
+    m_pending_parameters.m_beat_period = BEAT_CLOCK::to_period( period_samples );
+}
+
+uint32_t GLITCH_DELAY_EFFECT::sample_clock() const
+{
+    return __atomic_load_n( &m_sample_clock, __ATOMIC_RELAXED );
+}
+
+bool GLITCH_DELAY_EFFECT::request_buffer_transfer( const BUFFER_TRANSFER& transfer )
+{
+    if( __atomic_load_n( &m_transfer_state, __ATOMIC_ACQUIRE ) != TRANSFER_IDLE )
+    {
+        return false;
+    }
+    
+    m_transfer = transfer;
+    __atomic_store_n( &m_transfer_state, static_cast<uint32_t>( TRANSFER_REQUESTED ), __ATOMIC_RELEASE );
+    return true;
+}
+
+bool GLITCH_DELAY_EFFECT::collect_buffer_transfer( BUFFER_TRANSFER& transfer )
+{
+    if( __atomic_load_n( &m_transfer_state, __ATOMIC_ACQUIRE ) != TRANSFER_COMPLETE )
+    {
+        return false;
+    }
+    
+    transfer = m_transfer;
+    __atomic_store_n( &m_transfer_state, static_cast<uint32_t>( TRANSFER_IDLE ), __ATOMIC_RELEASE );
+    return true;
 }
 
 void GLITCH_DELAY_EFFECT::set_freeze_active( bool active )
 {
-	m_next_freeze_active = active;
+	m_pending_parameters.m_freeze_active = active;
+}
+
+void GLITCH_DELAY_EFFECT::set_fade_curve( FADE_CURVE::CURVE_TYPE curve_type )
+{
+    m_pending_parameters.m_fade_curve = curve_type;
+}
+
+void GLITCH_DELAY_EFFECT::set_resample_quality( RESAMPLER::QUALITY quality )
+{
+    m_pending_parameters.m_resample_quality = quality;
+}
+
+void GLITCH_DELAY_EFFECT::publish_parameters()
+{
+    m_published_parameters.publish( m_pending_parameters );
+}
+
+PROFILER& GLITCH_DELAY_EFFECT::profiler()
+{
+    return m_profiler;
 }
 
 int GLITCH_DELAY_EFFECT::num_heads() const
 {
-    return NUM_PLAY_HEADS + 1; // + 1 for write head
+    return m_num_play_heads + 1; // + 1 for write head
 }
 
 void GLITCH_DELAY_EFFECT::head_ratio_details( int head, float& loop_start, float& loop_end, float& current_position ) const
 {
-    auto convert_12_bit_sample_to_ratio = []( int sample_index ) -> float
+    auto convert_sample_to_ratio = [this]( int sample_index ) -> float
     {
-        const float ratio = ( sample_index * 1.5f ) / DELAY_BUFFER_SIZE_IN_BYTES;
+        const float ratio = sample_index / static_cast<float>( m_delay_buffer.buffer_size_in_frames() );
         return ratio;
     };
     
-    if( head < NUM_PLAY_HEADS )
+    if( head < m_num_play_heads )
     {
         const PLAY_HEAD& play_head = m_play_heads[head];
         
         if( play_head.loop_start() >= 0 )
         {
-            loop_start      = convert_12_bit_sample_to_ratio( play_head.loop_start() );
-            loop_end        = convert_12_bit_sample_to_ratio( play_head.loop_end() );
+            loop_start      = convert_sample_to_ratio( play_head.loop_start() );
+            loop_end        = convert_sample_to_ratio( play_head.loop_end() );
         }
         else
         {
             loop_start      = 0;
             loop_end        = 0;
         }
-        current_position    = convert_12_bit_sample_to_ratio( play_head.current_position() );
+        current_position    = convert_sample_to_ratio( play_head.current_position() );
     }
-    else if( head == NUM_PLAY_HEADS )
+    else if( head == m_num_play_heads )
     {
         loop_start          = 0;
         loop_end            = 0;
-        current_position    = convert_12_bit_sample_to_ratio( m_delay_buffer.write_head() );
+        current_position    = convert_sample_to_ratio( m_delay_buffer.write_head() );
     }
     else
     {
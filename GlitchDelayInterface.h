@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CVAcquisition.h"
+#include "I2CCVBus.h"
 #include "Interface.h"
 #include "TapBPM.h"
 
@@ -7,6 +9,8 @@ class GLITCH_DELAY_INTERFACE
 {
   static const int        MODE_BUTTON_PIN                 = 1;
   static const int        BPM_BUTTON_PIN                  = 2;
+  static const int        CLOCK_INPUT_PIN                 = 3;    // with CLOCK_INPUT
+  static const int        CLOCK_PULSES_PER_BEAT           = 1;
   static const int        LED_1_PIN                       = 29;
   static const int        LED_2_PIN                       = 11;
   static const int        LED_3_PIN                       = 7;
@@ -24,9 +28,13 @@ class GLITCH_DELAY_INTERFACE
 
   CV_DIAL                 m_dials[NUM_DIALS];
 
+  I2C_CV_BUS              m_cv_bus;
+  CV_ACQUISITION          m_cv_acquisition;
+  CV_FRAME                m_cv_frame;         // latest frame from the PIC, kept until a newer one arrives
+
   BUTTON                  m_bpm_button;
   BUTTON                  m_mode_button;
-  TAP_BPM                 m_tap_bpm;        // same button as mode
+  TAP_BPM                 m_tap_bpm;        // same button as bpm, and the clock input
   
   LED                     m_beat_led;
   LED                     m_mode_leds[NUM_MODES];
@@ -35,6 +43,7 @@ class GLITCH_DELAY_INTERFACE
   PUSH_AND_TURN           m_feedback_push_and_turn;
 
   int                     m_current_mode;
+  bool                    m_controls_changed;
   bool                    m_change_bit_depth_valid;
   bool                    m_reduced_bit_depth;
 
@@ -44,6 +53,7 @@ public:
 
   void                    setup();
   void                    update( ADC& adc, uint32_t time_in_ms );
+  bool                    controls_changed() const;   // a dial, CV or push and turn value moved on the last update
 
   float                   loop_size() const;
   float                   loop_speed() const;
@@ -57,6 +67,7 @@ public:
   float                   head_mix() const;
 
   const TAP_BPM&          tap_bpm() const;
+  const CV_ACQUISITION&   cv_acquisition() const;
 
   int                     mode() const;
   bool                    reduced_bit_depth() const;
@@ -2,18 +2,26 @@
 #include "CompileSwitches.h"
 
 constexpr int I2C_ADDRESS(111); 
-constexpr int I2C_DATA_SIZE_IN_BYTES(12);
+constexpr int I2C_DELTA_ADDRESS(110);   // PIC sends only the channels that changed
   
 GLITCH_DELAY_INTERFACE::GLITCH_DELAY_INTERFACE() :
-  m_dials( { CV_DIAL( A20 ), CV_DIAL( A19 ), CV_DIAL( A18 ), CV_DIAL( A17 ), CV_DIAL( A16 ), CV_DIAL( A13 ) } ),
+  m_dials( { CV_DIAL( A20, 0 ), CV_DIAL( A19, 1 ), CV_DIAL( A18, 2 ), CV_DIAL( A17, 3 ), CV_DIAL( A16, 4 ), CV_DIAL( A13, 5 ) } ),
+  m_cv_bus(),
+  m_cv_acquisition( m_cv_bus, I2C_ADDRESS, I2C_DELTA_ADDRESS ),
+  m_cv_frame(),
   m_bpm_button( BPM_BUTTON_PIN, false ),
   m_mode_button( MODE_BUTTON_PIN, false ),
-  m_tap_bpm( BPM_BUTTON_PIN ),
+#ifdef CLOCK_INPUT
+  m_tap_bpm( BPM_BUTTON_PIN, CLOCK_INPUT_PIN ),
+#else
+  m_tap_bpm( BPM_BUTTON_PIN, -1 ),
+#endif
   m_beat_led(),
   m_mode_leds(),
   m_head_mix_push_and_turn( m_dials[0].dial(), m_bpm_button, HEAD_MIX_INITIAL_VALUE ),
   m_feedback_push_and_turn( m_dials[0].dial(), m_mode_button, FEEDBACK_INITIAL_VALUE ),
   m_current_mode( 0 ),
+  m_controls_changed( true ),
   m_change_bit_depth_valid( true ),
   m_reduced_bit_depth( false )
 {
@@ -27,6 +35,11 @@ void GLITCH_DELAY_INTERFACE::setup()
   m_bpm_button.setup();
   m_mode_button.setup();
 
+  TEMPO_SOURCE_CONFIG clock_config = TEMPO_TRACKER::default_config( TEMPO_SOURCE_CLOCK );
+  clock_config.m_pulses_per_beat = CLOCK_PULSES_PER_BEAT;
+  m_tap_bpm.set_clock_config( clock_config );
+  m_tap_bpm.setup();
+
   m_beat_led.setup();
   m_beat_led.set_brightness( 0.25f );
 
@@ -38,29 +51,42 @@ void GLITCH_DELAY_INTERFACE::setup()
 
 #ifdef I2C_INTERFACE
   Wire.begin();
+  m_cv_bus.setup();
+
+  m_cv_acquisition.start_read();
 #endif
 }
 
 void GLITCH_DELAY_INTERFACE::update( ADC& adc, uint32_t time_in_ms )
 {
 #ifdef I2C_INTERFACE
-  // start I2C with PIC chip
-  Wire.requestFrom(I2C_ADDRESS, I2C_DATA_SIZE_IN_BYTES);
+  // the frame started last update has normally landed by now, if not the dials keep the previous one
+  m_cv_acquisition.latest_frame( m_cv_frame );
 #endif
 
   // read each pot
+  m_controls_changed = false;
   for( int d = 0; d < NUM_DIALS; ++d )
   {
-    m_dials[d].update( adc );
+    m_controls_changed |= m_dials[d].update( adc, m_cv_frame );
   }
+
+#ifdef I2C_INTERFACE
+  // fetch the next frame from the PIC in the background
+  m_cv_acquisition.start_read();
+#endif
   
   m_bpm_button.update( time_in_ms );
   m_mode_button.update( time_in_ms );
 
-  m_tap_bpm.update( time_in_ms );
+  m_tap_bpm.update( micros() );
 
+  // a push and turn can take the dial's value when the button's held long enough, without the dial moving
+  const float prev_head_mix = head_mix();
+  const float prev_feedback = feedback();
   m_head_mix_push_and_turn.update();
   m_feedback_push_and_turn.update();
+  m_controls_changed |= head_mix() != prev_head_mix || feedback() != prev_feedback;
  
   if( m_tap_bpm.beat_type() != TAP_BPM::NO_BEAT )
   {
@@ -99,6 +125,11 @@ void GLITCH_DELAY_INTERFACE::update( ADC& adc, uint32_t time_in_ms )
 #endif // DEBUG_OUTPUT
 }
 
+bool GLITCH_DELAY_INTERFACE::controls_changed() const
+{
+  return m_controls_changed;
+}
+
 float GLITCH_DELAY_INTERFACE::loop_size() const
 {
   return m_dials[0].value();
@@ -149,6 +180,11 @@ const TAP_BPM& GLITCH_DELAY_INTERFACE::tap_bpm() const
   return m_tap_bpm;
 }
 
+const CV_ACQUISITION& GLITCH_DELAY_INTERFACE::cv_acquisition() const
+{
+  return m_cv_acquisition;
+}
+
 int GLITCH_DELAY_INTERFACE::mode() const
 {
   return m_current_mode;
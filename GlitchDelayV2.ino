@@ -6,10 +6,14 @@
 #include <Bounce.h>     // Arduino compiler can get confused if you don't include include all required headers in this file?!?
 
 #include "CompileSwitches.h"
+#include "ControlScheduler.h"
 #include "GlitchDelayEffect.h"
 #include "GlitchDelayInterface.h"
 #include "TapBPM.h"
 #include "Util.h"
+#ifdef STANDALONE_AUDIO
+#include "SDSnapshotFile.h"
+#endif
 
 
 // Use these with the audio adaptor board
@@ -41,15 +45,18 @@ IO io;
 
 GLITCH_DELAY_EFFECT      glitch_delay_effect;
 AudioMixer4              delay_mixer;
-AudioMixer4              glitch_mixer;
 AudioMixer4              wet_dry_mixer;
 //AudioEffectDelay         audio_delay;
 
 const int DRY_CHANNEL( 0 );
 const int WET_CHANNEL( 1 );
-const int FEEDBACK_CHANNEL( 1 );
 
-const float MAX_FEEDBACK( 0.95f );
+// the effect mixes its heads into one block, so each block is the input, the delay mixer, the effect, the wet/dry mix,
+// and the two the output holds, with room to spare
+const int AUDIO_MEMORY_BLOCKS( 10 );
+
+const uint32_t CONTROL_RATE_HZ( 200 );          // interface reads and parameter pushes per second
+const float CONTROL_THRESHOLD( 1.0f / 512 );    // smallest change in a control worth pushing
 
 #ifdef STANDALONE_AUDIO
 AudioPlaySdRaw           raw_player;
@@ -57,31 +64,35 @@ AudioPlaySdRaw           raw_player;
 //AudioConnection          patch_cord_R1( raw_player, 1, audio_output, 1 );
 AudioConnection          patch_cord_L1( raw_player, 0, delay_mixer, 0 );
 AudioConnection          patch_cord_L2( delay_mixer, 0, glitch_delay_effect, 0 );
-AudioConnection          patch_cord_L3( glitch_delay_effect, 0, glitch_mixer, 0 );
-AudioConnection          patch_cord_L4( glitch_delay_effect, 1, glitch_mixer, 1 );
-AudioConnection          patch_cord_L5( glitch_delay_effect, 2, glitch_mixer, 2 );
-AudioConnection          patch_cord_L6( glitch_delay_effect, 3, glitch_mixer, 3 );
-AudioConnection          patch_cord_L7( glitch_mixer, 0, delay_mixer, FEEDBACK_CHANNEL );
-AudioConnection          patch_cord_L8( glitch_mixer, 0, wet_dry_mixer, WET_CHANNEL );
-AudioConnection          patch_cord_L9( raw_player, 0, wet_dry_mixer, DRY_CHANNEL );
-AudioConnection          patch_cord_L10( wet_dry_mixer, 0, audio_output, 0 );
+AudioConnection          patch_cord_L3( glitch_delay_effect, 0, wet_dry_mixer, WET_CHANNEL );
+AudioConnection          patch_cord_L4( raw_player, 0, wet_dry_mixer, DRY_CHANNEL );
+AudioConnection          patch_cord_L5( wet_dry_mixer, 0, audio_output, 0 );
+
+// the frozen buffer, saved to and recalled from the SD card a chunk per control tick
+const char* const        SNAPSHOT_FILENAME( "FREEZE.BIN" );
+BUFFER_SNAPSHOT          buffer_snapshot( glitch_delay_effect );
+File                     snapshot_file;
+SD_SNAPSHOT_FILE         sd_snapshot_file( snapshot_file );
 #else // STANDALONE_AUDIO
 AudioConnection          patch_cord_L1( io.audio_input, 0, delay_mixer, 0 );
 AudioConnection          patch_cord_L2( delay_mixer, 0, glitch_delay_effect, 0 );
-AudioConnection          patch_cord_L3( glitch_delay_effect, 0, glitch_mixer, 0 );
-AudioConnection          patch_cord_L4( glitch_delay_effect, 1, glitch_mixer, 1 );
-AudioConnection          patch_cord_L5( glitch_delay_effect, 2, glitch_mixer, 2 );
-AudioConnection          patch_cord_L6( glitch_delay_effect, 3, glitch_mixer, 3 );
-AudioConnection          patch_cord_L7( glitch_mixer, 0, delay_mixer, FEEDBACK_CHANNEL );
-AudioConnection          patch_cord_L8( glitch_mixer, 0, wet_dry_mixer, WET_CHANNEL );
-AudioConnection          patch_cord_L9( io.audio_input, 0, wet_dry_mixer, DRY_CHANNEL );
-AudioConnection          patch_cord_L10( wet_dry_mixer, 0, io.audio_output, 0 );
+AudioConnection          patch_cord_L3( glitch_delay_effect, 0, wet_dry_mixer, WET_CHANNEL );
+AudioConnection          patch_cord_L4( io.audio_input, 0, wet_dry_mixer, DRY_CHANNEL );
+AudioConnection          patch_cord_L5( wet_dry_mixer, 0, io.audio_output, 0 );
 //AudioConnection          patch_cord_L1( audio_input, 0, audio_output, 0 );    // left channel passes straight through (for testing)
 //AudioConnection          patch_cord_R1( io.audio_input, 1, io.audio_output, 1 );      // right channel passes straight through
 #endif // !STANDALONE_AUDIO
 
 GLITCH_DELAY_INTERFACE   glitch_delay_interface;
 
+CONTROL_SCHEDULER        control_scheduler( CONTROL_RATE_HZ );
+CONTROL_VALUE            wet_dry_control( CONTROL_THRESHOLD );
+CONTROL_VALUE            feedback_control( CONTROL_THRESHOLD );
+CONTROL_VALUE            jitter_control( CONTROL_THRESHOLD );
+CONTROL_VALUE            size_control( CONTROL_THRESHOLD );
+CONTROL_VALUE            head_gain_controls[4] = { CONTROL_VALUE( CONTROL_THRESHOLD ), CONTROL_VALUE( CONTROL_THRESHOLD ),
+                                                   CONTROL_VALUE( CONTROL_THRESHOLD ), CONTROL_VALUE( CONTROL_THRESHOLD ) };
+
 
 //////////////////////////////////////
 
@@ -124,7 +135,7 @@ void setup()
   Serial.print("Setup started!\n");
 #endif // DEBUG_OUTPUT
 
-  AudioMemory(16);
+  AudioMemory( AUDIO_MEMORY_BLOCKS );
 
   analogReference(INTERNAL);
 
@@ -153,18 +164,181 @@ void setup()
   wet_dry_mixer.gain( DRY_CHANNEL, 0.5f );
   wet_dry_mixer.gain( WET_CHANNEL, 0.5f );
 
+  // input headroom, the effect feeds its output back itself
   delay_mixer.gain( 0, 0.5f );
-  delay_mixer.gain( 1, 0.25f );
 
-  glitch_mixer.gain( 0, 0.3f );
-  glitch_mixer.gain( 1, 0.5f );
-  glitch_mixer.gain( 2, 0.2f );
+  // the heads are summed inside the effect at their own gains, rather than by a mixer after it
+  AudioNoInterrupts();
+  glitch_delay_effect.configure_play_heads( GLITCH_DELAY_EFFECT::DEFAULT_PLAY_HEADS, GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS, GLITCH_DELAY_EFFECT::MIXED_OUTPUT );
+  AudioInterrupts();
+
+  glitch_delay_effect.set_head_gain( 0, 0.3f );
+  glitch_delay_effect.set_head_gain( 1, 0.5f );
+  glitch_delay_effect.set_head_gain( 2, 0.2f );
+
+  glitch_delay_effect.set_loop_moving( false );
+#ifdef ADPCM_DELAY_BUFFER
+  glitch_delay_effect.set_bit_depth( 4 );
+#endif // ADPCM_DELAY_BUFFER
+  glitch_delay_effect.publish_parameters();
   
 #ifdef DEBUG_OUTPUT
   Serial.print("Setup finished!\n");
 #endif // DEBUG_OUTPUT
 }
 
+// push the dial and CV driven values that have moved to the mixers and the effect, returns true if any effect parameter changed
+bool push_dial_controls()
+{
+  const float wet_dry = clamp( glitch_delay_interface.dry_wet_mix(), 0.0f, 1.0f );
+  if( wet_dry_control.changed( wet_dry ) )
+  {
+    wet_dry_mixer.gain( DRY_CHANNEL, 1.0f - wet_dry );
+    wet_dry_mixer.gain( WET_CHANNEL, wet_dry );
+  }
+  
+  bool parameters_changed = false;
+
+  const float feedback = clamp( glitch_delay_interface.feedback(), 0.0f, 1.0f );
+  if( feedback_control.changed( feedback ) )
+  {
+    glitch_delay_effect.set_feedback( feedback );
+    parameters_changed = true;
+  }
+
+  const float jitter  = clamp( glitch_delay_interface.loop_speed(), 0.0f, 1.0f );
+  if( jitter_control.changed( jitter ) )
+  {
+    for( int h = 0; h < glitch_delay_effect.num_play_heads(); ++h )
+    {
+      glitch_delay_effect.set_jitter( h, jitter );
+    }
+    parameters_changed = true;
+  }
+
+  const float size  = clamp( glitch_delay_interface.loop_size(), 0.0f, 1.0f );
+  if( size_control.changed( size ) )
+  {
+    for( int h = 0; h < glitch_delay_effect.num_play_heads(); ++h )
+    {
+      glitch_delay_effect.set_loop_size( h, size );
+    }
+    parameters_changed = true;
+  }
+
+  const float head_mix = glitch_delay_interface.head_mix();
+  const float head_gains[4] = { glitch_delay_interface.low_mix() * head_mix,
+                                glitch_delay_interface.normal_mix() * head_mix,
+                                glitch_delay_interface.high_mix() * head_mix,
+                                glitch_delay_interface.reverse_mix() * head_mix };
+  for( int c = 0; c < 4; ++c )
+  {
+    if( head_gain_controls[c].changed( head_gains[c] ) )
+    {
+      glitch_delay_effect.set_head_gain( c, head_gains[c] );
+      parameters_changed = true;
+    }
+  }
+
+  return parameters_changed;
+}
+
+// read the interface and push whatever has moved to the mixers and the effect
+void update_controls( uint32_t time_in_ms )
+{
+  glitch_delay_interface.update( io.adc, time_in_ms );
+
+  // the dials are filtered, so mostly nothing has moved
+  bool parameters_changed = false;
+  if( glitch_delay_interface.controls_changed() )
+  {
+    parameters_changed = push_dial_controls();
+  }
+
+  static bool prev_freeze = false;
+  const bool freeze = glitch_delay_interface.mode() == 1;
+  if( freeze != prev_freeze )
+  {
+    glitch_delay_effect.set_freeze_active( freeze );
+    prev_freeze = freeze;
+    parameters_changed = true;
+  }
+
+  // the effect counts the beats itself, so only a move in the followed tempo or phase (or the first valid tempo)
+  // moves its beat clock, to the next beat the tempo follower expects
+  static bool beat_clock_started = false;
+  const TAP_BPM& tap_bpm = glitch_delay_interface.tap_bpm();
+  if( tap_bpm.valid_bpm() && ( tap_bpm.tempo_changed() || !beat_clock_started ) )
+  {
+    const float period_samples = ( tap_bpm.beat_duration_ms() * AUDIO_SAMPLE_RATE ) / 1000.0f;
+    const uint32_t time_us = micros();
+    const float samples_to_beat = ( static_cast<int32_t>( tap_bpm.next_beat_us( time_us ) - time_us ) * AUDIO_SAMPLE_RATE ) / 1000000.0f;
+    glitch_delay_effect.set_beat_clock( period_samples, glitch_delay_effect.sample_clock() + static_cast<uint32_t>( samples_to_beat ) );
+    beat_clock_started = true;
+    parameters_changed = true;
+  }
+
+  // hand this tick's settings to the audio interrupt as one set
+  if( parameters_changed )
+  {
+    glitch_delay_effect.publish_parameters();
+  }
+}
+
+#ifdef STANDALONE_AUDIO
+void start_snapshot( bool save )
+{
+  if( buffer_snapshot.busy() )
+  {
+    return;
+  }
+
+  if( save )
+  {
+    // FILE_WRITE appends
+    SD.remove( SNAPSHOT_FILENAME );
+    snapshot_file = SD.open( SNAPSHOT_FILENAME, FILE_WRITE );
+  }
+  else
+  {
+    snapshot_file = SD.open( SNAPSHOT_FILENAME, FILE_READ );
+  }
+
+  if( !snapshot_file )
+  {
+    Serial.println( "Unable to open the snapshot" );
+    return;
+  }
+
+  const bool started = save ? buffer_snapshot.start_save( sd_snapshot_file ) : buffer_snapshot.start_recall( sd_snapshot_file );
+  if( !started )
+  {
+    snapshot_file.close();
+    Serial.println( "Snapshot failed to start" );
+  }
+}
+
+// moves one chunk, then closes the file once the snapshot is done
+void update_snapshot()
+{
+  if( !buffer_snapshot.busy() )
+  {
+    return;
+  }
+
+  const BUFFER_SNAPSHOT::STATE state = buffer_snapshot.update();
+  if( !buffer_snapshot.busy() )
+  {
+    snapshot_file.close();
+    Serial.print( state == BUFFER_SNAPSHOT::DONE ? "Snapshot done, " : "Snapshot failed, " );
+    Serial.print( buffer_snapshot.bytes_done() );
+    Serial.print( " bytes in " );
+    Serial.print( buffer_snapshot.num_ticks() );
+    Serial.print( " ticks\n" );
+  }
+}
+#endif // STANDALONE_AUDIO
+
 void loop()
 {
   uint32_t time_in_ms = millis();
@@ -183,48 +357,31 @@ void loop()
   wet_dry_mixer.gain( DRY_CHANNEL, 0.0f );
   wet_dry_mixer.gain( WET_CHANNEL, 1.0f );
 
-  delay_mixer.gain( FEEDBACK_CHANNEL, MAX_FEEDBACK );
-  //delay_mixer.gain( FEEDBACK_CHANNEL, 0.0f );
+  glitch_delay_effect.set_feedback( 1.0f );
+  //glitch_delay_effect.set_feedback( 0.0f );
 
   glitch_delay_effect.set_speed( 0.3f );
 
   glitch_delay_effect.set_loop_size( 0.2f );
   */
   
-  glitch_delay_interface.update( io.adc, time_in_ms );
-
-  const float wet_dry = clamp( glitch_delay_interface.dry_wet_mix(), 0.0f, 1.0f );
-  wet_dry_mixer.gain( DRY_CHANNEL, 1.0f - wet_dry );
-  wet_dry_mixer.gain( WET_CHANNEL, wet_dry );
-  
-  const float feedback = glitch_delay_interface.feedback();
-  delay_mixer.gain( FEEDBACK_CHANNEL, feedback * MAX_FEEDBACK );
-
-  const float jitter  = clamp( glitch_delay_interface.loop_speed(), 0.0f, 1.0f );
-  const float size  = clamp( glitch_delay_interface.loop_size(), 0.0f, 1.0f );
-
-  for( int h = 0; h < GLITCH_DELAY_EFFECT::NUM_PLAY_HEADS; ++h )
+  if( control_scheduler.tick_due( micros() ) )
   {
-    glitch_delay_effect.set_jitter( h, jitter );
-    glitch_delay_effect.set_loop_size( h, size );
+    update_controls( time_in_ms );
+#ifdef STANDALONE_AUDIO
+    update_snapshot();
+#endif
   }
 
-  //const bool move_loop = glitch_delay_interface.mode() == 0;
-  glitch_delay_effect.set_loop_moving( false );
-
-  const bool freeze = glitch_delay_interface.mode() == 1;
-  glitch_delay_effect.set_freeze_active( freeze );
-
-  const float head_mix = glitch_delay_interface.head_mix();
-  glitch_mixer.gain( 0, glitch_delay_interface.low_mix() * head_mix );
-  glitch_mixer.gain( 1,glitch_delay_interface.normal_mix() * head_mix );
-  glitch_mixer.gain( 2, glitch_delay_interface.high_mix() * head_mix );
-  glitch_mixer.gain( 3, glitch_delay_interface.reverse_mix() * head_mix );
-
-  if( glitch_delay_interface.tap_bpm().beat_type() == TAP_BPM::AUTO_BEAT )
+  // single character commands over Serial
+  const int command = Serial.available() > 0 ? Serial.read() : 0;
+#ifdef STANDALONE_AUDIO
+  // 's' saves the frozen buffer to the SD card, 'r' recalls it
+  if( command == 's' || command == 'r' )
   {
-    glitch_delay_effect.set_beat();
+    start_snapshot( command == 's' );
   }
+#endif
 
 #ifdef DEBUG_OUTPUT
   /*
@@ -240,7 +397,7 @@ void loop()
     Serial.print("\t");
 
     Serial.print("feedback ");
-    Serial.print(feedback * MAX_FEEDBACK);
+    Serial.print(feedback);
     Serial.print("\t");
       
     Serial.print("mix ");
@@ -260,5 +417,49 @@ void loop()
     Serial.print( processor_usage );
     Serial.print( "\n" );
   }
+
+  // a block that couldn't be allocated is a block of silence
+  static bool audio_memory_reported = false;
+  if( !audio_memory_reported && AudioMemoryUsageMax() >= AUDIO_MEMORY_BLOCKS )
+  {
+    audio_memory_reported = true;
+    Serial.print( "Audio memory used up: " );
+    Serial.print( AUDIO_MEMORY_BLOCKS );
+    Serial.print( " blocks\n" );
+  }
+
+#ifdef PROFILE_AUDIO
+  // name the block and heads behind each new spike
+  PROFILER& profiler = glitch_delay_effect.profiler();
+  static uint32_t num_spikes_reported = 0;
+  if( profiler.num_spikes() != num_spikes_reported )
+  {
+    num_spikes_reported = profiler.num_spikes();
+
+    const PROFILE_BLOCK& spike = profiler.last_spike();
+    Serial.print( "Spike block " );
+    Serial.print( spike.m_block );
+    Serial.print( " cycles " );
+    Serial.print( spike.m_stage_ticks[PROFILE_UPDATE] );
+    Serial.print( " events " );
+    Serial.print( spike.m_events, HEX );
+    for( int h = 0; h < profiler.num_heads(); ++h )
+    {
+      Serial.print( " | head " );
+      Serial.print( h );
+      Serial.print( " " );
+      Serial.print( spike.m_head_ticks[h] );
+      Serial.print( " " );
+      Serial.print( spike.m_head_events[h], HEX );
+    }
+    Serial.print( "\n" );
+  }
+
+  // send 'p' for the binary dump, read with Host/GlitchDelayProfile.cpp
+  if( command == 'p' )
+  {
+    profiler.dump( []( const uint8_t* data, int size ) { Serial.write( data, size ); } );
+  }
+#endif // PROFILE_AUDIO
 #endif
 }
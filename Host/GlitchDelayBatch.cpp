@@ -0,0 +1,414 @@
+//
+//  GlitchDelayBatch.cpp
+//
+//  Renders every input file with every parameter set, in parallel, one effect per job, with worker threads taking
+//  jobs from a shared queue. Writes each job's mix (and with -H each head) to output_dir, and a summary of every job
+//  to the console and output_dir/summary.tsv.
+//
+//  Each line of the sets file is a name then glitch_delay_render options. An option given a comma separated list of
+//  values is swept, so the line expands to a set for every combination, named after the swept values:
+//
+//      # name      options
+//      default
+//      sizes       -s 0.1,0.25,0.5 -j 0,0.3 -t 500
+//      low_bits    -b 8 -q linear,hermite,sinc
+//
+//  build:  g++ -O2 -std=c++11 -pthread Host/GlitchDelayBatch.cpp -o glitch_delay_batch
+//  usage:  glitch_delay_batch [-T threads] [-H] sets.txt output_dir input.wav [input.wav ...]
+//
+
+#define TARGET_HOST
+
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+#include "RenderJob.h"
+
+struct PARAMETER_SET
+{
+    std::string             m_name;
+    std::string             m_options;          // as given to glitch_delay_render
+    RENDER_SETTINGS         m_settings;
+};
+
+struct BATCH_INPUT
+{
+    std::string             m_filename;
+    std::string             m_name;             // for the output files
+    WAV_FILE                m_wav;
+};
+
+struct JOB_SUMMARY
+{
+    bool                    m_success;
+    double                  m_seconds;          // of audio
+    double                  m_ns_per_sample;    // update() only, with other jobs running
+    double                  m_worst_block_us;
+    double                  m_peak_dbfs;        // of the mix
+    double                  m_rms_dbfs;
+    uint32_t                m_storage_stalls;
+    uint64_t                m_hash;             // of every output, to spot renders that changed
+
+    JOB_SUMMARY() :
+        m_success( false ),
+        m_seconds( 0.0 ),
+        m_ns_per_sample( 0.0 ),
+        m_worst_block_us( 0.0 ),
+        m_peak_dbfs( 0.0 ),
+        m_rms_dbfs( 0.0 ),
+        m_storage_stalls( 0 ),
+        m_hash( 0 )
+    {
+    }
+};
+
+// hands out job indices in order to any number of worker threads
+class WORK_QUEUE
+{
+    std::atomic< int >      m_next_job;
+    const int               m_num_jobs;
+
+public:
+
+    explicit WORK_QUEUE( int num_jobs ) :
+        m_next_job( 0 ),
+        m_num_jobs( num_jobs )
+    {
+    }
+
+    // false once every job has been taken
+    bool                    take( int& job )
+    {
+        job = m_next_job.fetch_add( 1 );
+        return job < m_num_jobs;
+    }
+};
+
+////////////////////////////////////
+
+static void print_usage()
+{
+    printf( "usage: glitch_delay_batch [-T threads] [-H] sets.txt output_dir input.wav [input.wav ...]\n" );
+    printf( "  -T threads   worker threads (default one per core)\n" );
+    printf( "  -H           write each head as well as the mix\n" );
+    printf( "each line of sets.txt is a name then options, comma separated values are swept, # starts a comment:\n" );
+    print_render_options();
+}
+
+static std::vector< std::string > split( const std::string& text, char separator )
+{
+    std::vector< std::string > parts;
+    std::string part;
+    std::istringstream stream( text );
+    while( std::getline( stream, part, separator ) )
+    {
+        parts.push_back( part );
+    }
+    return parts;
+}
+
+// expands the swept options of one line from option onwards, each set named after the values it was swept to
+static bool expand_sets( const std::vector< std::pair< std::string, std::vector< std::string > > >& options, size_t option,
+                         const PARAMETER_SET& set, std::vector< PARAMETER_SET >& sets )
+{
+    if( option == options.size() )
+    {
+        if( !check_render_settings( set.m_settings ) )
+        {
+            return false;
+        }
+        sets.push_back( set );
+        return true;
+    }
+
+    const std::string& name                 = options[option].first;
+    const std::vector< std::string >& values = options[option].second;
+    for( const std::string& value : values )
+    {
+        PARAMETER_SET expanded              = set;
+        expanded.m_options                  += ( expanded.m_options.empty() ? "" : " " ) + name + " " + value;
+        if( values.size() > 1 )
+        {
+            expanded.m_name                 += "_" + name.substr( 1 ) + value;
+        }
+
+        if( !parse_render_option( name, value.c_str(), expanded.m_settings ) || !expand_sets( options, option + 1, expanded, sets ) )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool read_sets( const char* filename, std::vector< PARAMETER_SET >& sets )
+{
+    FILE* file = fopen( filename, "r" );
+    if( file == nullptr )
+    {
+        printf( "Unable to read %s\n", filename );
+        return false;
+    }
+
+    char line_buffer[4096];
+    int line_number = 0;
+    bool success    = true;
+    while( success && fgets( line_buffer, sizeof(line_buffer), file ) != nullptr )
+    {
+        ++line_number;
+
+        std::string line( line_buffer );
+        line        = line.substr( 0, line.find( '#' ) );
+        line        = line.substr( 0, line.find_last_not_of( " \t\r\n" ) + 1 );
+
+        std::vector< std::string > tokens;
+        std::istringstream stream( line );
+        for( std::string token; stream >> token; )
+        {
+            tokens.push_back( token );
+        }
+
+        if( tokens.empty() )
+        {
+            continue;
+        }
+
+        // options in pairs after the name, -p would have every job write the same file
+        std::vector< std::pair< std::string, std::vector< std::string > > > options;
+        success     = tokens.size() % 2 == 1;
+        for( size_t t = 1; t + 1 < tokens.size() && success; t += 2 )
+        {
+            options.push_back( std::make_pair( tokens[t], split( tokens[t + 1], ',' ) ) );
+            success = tokens[t] != "-p" && !options.back().second.empty();
+        }
+
+        PARAMETER_SET set;
+        set.m_name  = tokens[0];
+        success     = success && expand_sets( options, 0, set, sets );
+        if( !success )
+        {
+            printf( "%s:%d: invalid set \"%s\"\n", filename, line_number, line.c_str() );
+        }
+    }
+
+    fclose( file );
+    return success && !sets.empty();
+}
+
+// file name without its directory or extension, made unique among the inputs
+static std::string input_name( const std::string& filename, const std::vector< BATCH_INPUT >& inputs )
+{
+    std::string name        = filename.substr( filename.find_last_of( '/' ) + 1 );
+    name                    = name.substr( 0, name.find_last_of( '.' ) );
+
+    for( const BATCH_INPUT& input : inputs )
+    {
+        if( input.m_name == name )
+        {
+            return name + "_" + std::to_string( inputs.size() );
+        }
+    }
+    return name;
+}
+
+static double to_dbfs( double level )
+{
+    return level > 0.0 ? 20.0 * log10( level / 32768.0 ) : -999.0;
+}
+
+static uint64_t hash_samples( uint64_t hash, const std::vector< int16_t >& samples )
+{
+    // FNV-1a
+    for( int16_t sample : samples )
+    {
+        const uint16_t bits = static_cast<uint16_t>( sample );
+        hash                = ( hash ^ ( bits & 0xFF ) ) * 1099511628211ull;
+        hash                = ( hash ^ ( bits >> 8 ) ) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static JOB_SUMMARY run_job( const BATCH_INPUT& input, const PARAMETER_SET& set, const std::string& output_dir, bool write_heads )
+{
+    RENDER_RESULT result;
+    render( input.m_wav, set.m_settings, result );
+
+    JOB_SUMMARY summary;
+    const std::string output_name = output_dir + "/" + input.m_name + "_" + set.m_name;
+    summary.m_success       = write_wav_file( ( output_name + "_mix.wav" ).c_str(), result.m_mix_output );
+    for( size_t h = 0; h < result.m_head_outputs.size() && write_heads; ++h )
+    {
+        summary.m_success   &= write_wav_file( ( output_name + "_head" + std::to_string( h ) + ".wav" ).c_str(), result.m_head_outputs[h] );
+    }
+
+    double sum_of_squares   = 0.0;
+    int peak                = 0;
+    for( int16_t sample : result.m_mix_output.m_samples )
+    {
+        sum_of_squares      += static_cast<double>( sample ) * sample;
+        peak                = max_val( peak, sample < 0 ? -sample : static_cast<int>( sample ) );
+    }
+
+    uint64_t hash           = 14695981039346656037ull;
+    for( const WAV_FILE& head_output : result.m_head_outputs )
+    {
+        hash                = hash_samples( hash, head_output.m_samples );
+    }
+
+    const size_t num_samples = result.m_mix_output.m_samples.size();
+    summary.m_seconds       = result.m_num_samples / static_cast<double>( input.m_wav.m_sample_rate );
+    summary.m_ns_per_sample = result.m_num_samples > 0 ? static_cast<double>( result.m_total_time_ns ) / result.m_num_samples : 0.0;
+    summary.m_worst_block_us = result.m_worst_block_time_ns / 1e3;
+    summary.m_peak_dbfs     = to_dbfs( peak );
+    summary.m_rms_dbfs      = to_dbfs( num_samples > 0 ? sqrt( sum_of_squares / num_samples ) : 0.0 );
+    summary.m_storage_stalls = result.m_storage_stalls;
+    summary.m_hash          = hash_samples( hash, result.m_mix_output.m_samples );
+
+    return summary;
+}
+
+////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+    int num_threads         = static_cast<int>( std::thread::hardware_concurrency() );
+    bool write_heads        = false;
+
+    int a = 1;
+    for( ; a < argc && argv[a][0] == '-'; ++a )
+    {
+        const std::string option( argv[a] );
+        if( option == "-T" && a + 1 < argc )
+        {
+            num_threads     = atoi( argv[++a] );
+        }
+        else if( option == "-H" )
+        {
+            write_heads     = true;
+        }
+        else
+        {
+            a               = argc;
+        }
+    }
+
+    if( argc - a < 3 )
+    {
+        print_usage();
+        return 1;
+    }
+
+    std::vector< PARAMETER_SET > sets;
+    if( !read_sets( argv[a], sets ) )
+    {
+        return 1;
+    }
+
+    const std::string output_dir( argv[a + 1] );
+    if( mkdir( output_dir.c_str(), 0755 ) != 0 && errno != EEXIST )
+    {
+        printf( "Unable to create %s\n", output_dir.c_str() );
+        return 1;
+    }
+
+    std::vector< BATCH_INPUT > inputs;
+    for( int i = a + 2; i < argc; ++i )
+    {
+        BATCH_INPUT input;
+        input.m_filename    = argv[i];
+        input.m_name        = input_name( input.m_filename, inputs );
+        if( !read_wav_file( argv[i], input.m_wav ) )
+        {
+            printf( "Unable to read %s (16-bit PCM WAV only)\n", argv[i] );
+            return 1;
+        }
+        inputs.push_back( input );
+    }
+
+    // every input with every set, the inputs are only read by the workers
+    const int num_jobs      = static_cast<int>( inputs.size() * sets.size() );
+    num_threads             = clamp( num_threads, 1, num_jobs );
+    printf( "%d inputs x %d sets = %d jobs on %d threads\n", static_cast<int>( inputs.size() ), static_cast<int>( sets.size() ), num_jobs, num_threads );
+
+    std::vector< JOB_SUMMARY > summaries( num_jobs );
+    WORK_QUEUE queue( num_jobs );
+    std::mutex print_mutex;
+    int num_done            = 0;
+
+    const auto start_time   = std::chrono::steady_clock::now();
+
+    auto worker = [&]()
+    {
+        for( int job; queue.take( job ); )
+        {
+            const BATCH_INPUT& input    = inputs[ job / sets.size() ];
+            const PARAMETER_SET& set    = sets[ job % sets.size() ];
+            summaries[job]              = run_job( input, set, output_dir, write_heads );
+
+            std::lock_guard< std::mutex > lock( print_mutex );
+            printf( "[%d/%d] %s %s %s\n", ++num_done, num_jobs, input.m_name.c_str(), set.m_name.c_str(), summaries[job].m_success ? "" : "UNABLE TO WRITE" );
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for( int t = 0; t < num_threads; ++t )
+    {
+        threads.push_back( std::thread( worker ) );
+    }
+    for( std::thread& thread : threads )
+    {
+        thread.join();
+    }
+
+    const double wall_seconds = std::chrono::duration_cast< std::chrono::microseconds >( std::chrono::steady_clock::now() - start_time ).count() / 1e6;
+
+    // in job order, whichever thread finished first
+    const std::string summary_filename = output_dir + "/summary.tsv";
+    FILE* summary_file      = fopen( summary_filename.c_str(), "w" );
+    if( summary_file != nullptr )
+    {
+        fprintf( summary_file, "input\tset\toptions\tseconds\tns_per_sample\tworst_block_us\tpeak_dbfs\trms_dbfs\tstalls\thash\n" );
+    }
+
+    printf( "\n%-16s %-28s %7s %9s %10s %8s %8s %7s %-16s  %s\n", "input", "set", "seconds", "ns/sample", "worst(us)", "peak dB", "rms dB", "stalls", "hash", "options" );
+
+    bool success            = summary_file != nullptr;
+    double audio_seconds    = 0.0;
+    for( int job = 0; job < num_jobs; ++job )
+    {
+        const BATCH_INPUT& input    = inputs[ job / sets.size() ];
+        const PARAMETER_SET& set    = sets[ job % sets.size() ];
+        const JOB_SUMMARY& summary  = summaries[job];
+        success                     &= summary.m_success;
+        audio_seconds               += summary.m_seconds;
+
+        printf( "%-16s %-28s %7.2f %9.2f %10.2f %8.2f %8.2f %7u %016llx  %s\n", input.m_name.c_str(), set.m_name.c_str(), summary.m_seconds,
+                summary.m_ns_per_sample, summary.m_worst_block_us, summary.m_peak_dbfs, summary.m_rms_dbfs, summary.m_storage_stalls,
+                static_cast<unsigned long long>( summary.m_hash ), set.m_options.c_str() );
+
+        if( summary_file != nullptr )
+        {
+            fprintf( summary_file, "%s\t%s\t%s\t%.3f\t%.2f\t%.2f\t%.2f\t%.2f\t%u\t%016llx\n", input.m_name.c_str(), set.m_name.c_str(), set.m_options.c_str(),
+                     summary.m_seconds, summary.m_ns_per_sample, summary.m_worst_block_us, summary.m_peak_dbfs, summary.m_rms_dbfs,
+                     summary.m_storage_stalls, static_cast<unsigned long long>( summary.m_hash ) );
+        }
+    }
+
+    if( summary_file != nullptr )
+    {
+        fclose( summary_file );
+    }
+
+    printf( "\n%.1fs of audio rendered in %.1fs (%.0fx real-time), summary in %s\n", audio_seconds, wall_seconds, audio_seconds / wall_seconds,
+            summary_filename.c_str() );
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+//
+//  GlitchDelayBeatTiming.cpp
+//
+//  Measures how far beat triggered loops land from an ideal beat grid. A ramp is recorded into a 16-bit buffer and a
+//  single head plays it at normal speed, so each loop jump shows as the first output sample that breaks the ramp, and
+//  is matched to the nearest beat on the grid.
+//
+//  Beats are sent two ways. The control tick way is how the sketch sent them before the beat clock: loop() runs every
+//  control tick (CONTROL_RATE_HZ in GlitchDelayV2.ino), notices the beat from millis() and calls set_beat(), which
+//  lands at the start of the next block. The beat clock way hands the tempo and the first beat to the effect once and
+//  lets update() count samples. Each is run at a few tempos and block sizes, reporting the error in samples (positive
+//  is late). Fails if any beat clock loop is more than a sample from its beat, or any beat is missed.
+//
+//  build:  g++ -O2 -std=c++11 Host/GlitchDelayBeatTiming.cpp -o glitch_delay_beat_timing
+//  usage:  glitch_delay_beat_timing
+//
+
+#define TARGET_HOST
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+
+static const float  CONTROL_TICK_MS     = 5.0f;         // the sketch's 200Hz control rate
+static const int    TEST_SECONDS        = 30;
+static const double FIRST_BEAT_SECONDS  = 1.0;          // once the buffer holds a full loop
+static const int    MAX_CLOCK_ERROR     = 1;
+
+struct TIMING_RESULT
+{
+    int                     m_num_beats;
+    int                     m_num_missed;
+    int                     m_num_skipped;      // jumps too small to hear
+    double                  m_mean_error;
+    int                     m_min_error;
+    int                     m_max_error;
+
+    TIMING_RESULT() :
+        m_num_beats( 0 ),
+        m_num_missed( 0 ),
+        m_num_skipped( 0 ),
+        m_mean_error( 0.0 ),
+        m_min_error( 0 ),
+        m_max_error( 0 )
+    {
+    }
+};
+
+////////////////////////////////////
+
+// renders the ramp through one normal speed head with beats from the control tick or the beat clock
+static void render_beats( bool beat_clock, double period_samples, int block_samples, std::vector< int16_t >& output )
+{
+    const float sample_rate     = AUDIO_SAMPLE_RATE;
+    std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT( ENGINE_CONFIG( sample_rate, block_samples ) ) );
+
+    // the longest loop, which the tempos are faster than, so loops only end on a beat
+    const PLAY_HEAD_CONFIG head = { 1.0f, false, 1.0f, 0.0f, 0 };
+    effect->configure_play_heads( &head, 1 );
+    effect->set_bit_depth( 16 );
+    effect->set_loop_moving( false );
+    effect->set_loop_size( 0, 1.0f );
+    effect->set_jitter( 0, 0.0f );
+
+    const double first_beat     = FIRST_BEAT_SECONDS * sample_rate;
+    if( beat_clock )
+    {
+        effect->set_beat_clock( static_cast<float>( period_samples ), static_cast<uint32_t>( first_beat ) );
+    }
+    effect->publish_parameters();
+
+    const int num_blocks        = static_cast<int>( ( TEST_SECONDS * sample_rate ) / block_samples );
+    const double tick_samples   = ( CONTROL_TICK_MS * sample_rate ) / 1000.0;
+    double next_tick            = 0.0;
+    int next_beat               = 0;
+
+    output.resize( num_blocks * block_samples );
+
+    int16_t block[MAX_BLOCK_SAMPLES];
+    for( int b = 0; b < num_blocks; ++b )
+    {
+        const int block_start   = b * block_samples;
+        for( int x = 0; x < block_samples; ++x )
+        {
+            block[x]            = static_cast<int16_t>( ( block_start + x ) & 0x7FFF );
+        }
+        effect->set_input_block( 0, block, block_samples );
+
+        // the block is processed once its input has arrived, after the control ticks up to then
+        for( ; !beat_clock && next_tick < block_start + block_samples; next_tick += tick_samples )
+        {
+            const uint32_t time_ms      = static_cast<uint32_t>( ( next_tick * 1000.0 ) / sample_rate );
+            const double beat_ms        = ( ( first_beat + ( next_beat * period_samples ) ) * 1000.0 ) / sample_rate;
+            if( time_ms > beat_ms )
+            {
+                effect->set_beat();
+                effect->publish_parameters();
+                ++next_beat;
+            }
+        }
+
+        effect->update();
+
+        memcpy( output.data() + block_start, effect->output_block( 0 ), block_samples * sizeof(int16_t) );
+    }
+}
+
+// the delay the head is playing the ramp back at, at sample x
+static int delay_at( const std::vector< int16_t >& output, int x )
+{
+    return ( x - output[x] ) & 0x7FFF;
+}
+
+// matches the first sample of each break in the ramp to the nearest beat within a window either side. A loop that
+// starts less than a fade from where the head already was doesn't break the ramp, so its beat is skipped
+static TIMING_RESULT measure( const std::vector< int16_t >& output, double period_samples, int window )
+{
+    const int steady_samples    = 16;   // a jump is only new once the ramp (or the silence before the first loop) has run this long again
+    const int fade_samples      = static_cast<int>( ( AUDIO_SAMPLE_RATE / 1000.0f ) * FADE_TIME_MS );
+
+    std::vector< int > jumps;
+    int steady                  = 0;
+    for( size_t x = 1; x < output.size(); ++x )
+    {
+        const int step          = ( output[x] - output[x - 1] ) & 0x7FFF;
+        const bool on_ramp      = step == 1 || ( step == 0 && output[x] == 0 );
+        if( !on_ramp && steady >= steady_samples )
+        {
+            jumps.push_back( static_cast<int>( x ) );
+        }
+        steady                  = on_ramp ? steady + 1 : 0;
+    }
+
+    TIMING_RESULT result;
+    result.m_min_error          = INT32_MAX;
+    result.m_max_error          = INT32_MIN;
+
+    const double first_beat     = FIRST_BEAT_SECONDS * AUDIO_SAMPLE_RATE;
+    double total_error          = 0.0;
+    size_t j                    = 0;
+    for( double beat = first_beat; beat + window + fade_samples < output.size(); beat += period_samples )
+    {
+        const int ideal         = static_cast<int>( beat );
+        ++result.m_num_beats;
+
+        const int delay_before  = delay_at( output, ideal - window - 1 );
+        const int delay_after   = delay_at( output, ideal + window + fade_samples );
+        const int moved         = ( ( ( delay_after - delay_before ) + 0x4000 ) & 0x7FFF ) - 0x4000;
+        if( output[ideal - window - 1] != 0 && abs( moved ) < fade_samples )
+        {
+            ++result.m_num_skipped;
+            continue;
+        }
+
+        for( ; j < jumps.size() && jumps[j] < ideal - window; ++j )
+        {
+        }
+
+        if( j == jumps.size() || jumps[j] > ideal + window )
+        {
+            ++result.m_num_missed;
+            continue;
+        }
+
+        const int error         = jumps[j] - ideal;
+        total_error             += error;
+        result.m_min_error      = min_val( result.m_min_error, error );
+        result.m_max_error      = max_val( result.m_max_error, error );
+    }
+
+    const int num_found         = result.m_num_beats - result.m_num_missed - result.m_num_skipped;
+    result.m_mean_error         = num_found > 0 ? total_error / num_found : 0.0;
+    if( num_found == 0 )
+    {
+        result.m_min_error      = 0;
+        result.m_max_error      = 0;
+    }
+    return result;
+}
+
+////////////////////////////////////
+
+int main()
+{
+    const float tempos[]        = { 150.0f, 172.5f, 200.0f };    // beats shorter than the shortest full size loop
+    const int block_sizes[]     = { 16, 128 };
+
+    printf( "beat triggered loop error in samples against the ideal grid, %d s each, %.2f Hz\n", TEST_SECONDS, AUDIO_SAMPLE_RATE );
+    printf( "%-12s %6s %6s %6s %7s %8s %8s %6s %6s %7s\n", "beats", "bpm", "block", "beats", "missed", "skipped", "mean", "min", "max", "spread" );
+
+    bool success                = true;
+    for( int mode = 0; mode < 2; ++mode )
+    {
+        const bool beat_clock   = mode == 1;
+        for( float bpm : tempos )
+        {
+            for( int block_samples : block_sizes )
+            {
+                const double period_samples = ( 60.0 * AUDIO_SAMPLE_RATE ) / bpm;
+
+                std::vector< int16_t > output;
+                render_beats( beat_clock, period_samples, block_samples, output );
+
+                // the control tick can be a block and a tick away
+                const int window            = block_samples + static_cast<int>( ( CONTROL_TICK_MS * 2 * AUDIO_SAMPLE_RATE ) / 1000.0f );
+                const TIMING_RESULT result  = measure( output, period_samples, window );
+
+                const bool failed           = beat_clock && ( result.m_num_missed > 0 || result.m_min_error < -MAX_CLOCK_ERROR || result.m_max_error > MAX_CLOCK_ERROR );
+                success                     &= !failed;
+
+                printf( "%-12s %6.1f %6d %6d %7d %8d %8.1f %6d %6d %7d %s\n", beat_clock ? "beat_clock" : "control_tick", bpm, block_samples,
+                        result.m_num_beats, result.m_num_missed, result.m_num_skipped, result.m_mean_error, result.m_min_error, result.m_max_error,
+                        result.m_max_error - result.m_min_error, failed ? "FAILED" : "" );
+            }
+        }
+    }
+
+    printf( "%s\n", success ? "beat clock within a sample of every beat" : "FAILED" );
+    return success ? 0 : 1;
+}
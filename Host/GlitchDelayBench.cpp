@@ -0,0 +1,1024 @@
+//
+//  GlitchDelayBench.cpp
+//
+//  Host micro-benchmarks for the delay buffer and play heads, reported as the cost per AUDIO_BLOCK_SAMPLES block.
+//
+//  build:  g++ -O2 -std=c++11 -pthread Host/GlitchDelayBench.cpp -o glitch_delay_bench
+//  usage:  glitch_delay_bench [benchmark]      (runs all benchmarks when none is given)
+//
+
+#define TARGET_HOST
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+#include "LatencyDelayMemory.h"
+#include "MockCVBus.h"
+
+static const int NUM_BENCH_BLOCKS = 10000;
+static const int NUM_BENCH_RUNS   = 5;
+
+static volatile int bench_sink = 0;      // stops the optimiser removing the work being timed
+static bool bench_failed        = false; // a benchmark's correctness check failed, the exit code
+
+////////////////////////////////////
+
+// time NUM_BENCH_BLOCKS calls of block_func, returns ns per block of the fastest of NUM_BENCH_RUNS runs
+template< typename FUNC >
+double time_blocks( FUNC block_func )
+{
+    double best_time_ns = 0.0;
+
+    for( int r = 0; r < NUM_BENCH_RUNS; ++r )
+    {
+        const auto start_time   = std::chrono::steady_clock::now();
+
+        for( int b = 0; b < NUM_BENCH_BLOCKS; ++b )
+        {
+            block_func( b );
+        }
+
+        const auto end_time     = std::chrono::steady_clock::now();
+
+        const double time_ns    = std::chrono::duration_cast<std::chrono::nanoseconds>( end_time - start_time ).count() / static_cast<double>( NUM_BENCH_BLOCKS );
+        if( r == 0 || time_ns < best_time_ns )
+        {
+            best_time_ns        = time_ns;
+        }
+    }
+
+    return best_time_ns;
+}
+
+static void fill_test_block( int16_t* block, int seed, int size = AUDIO_BLOCK_SAMPLES )
+{
+    for( int x = 0; x < size; ++x )
+    {
+        block[x] = static_cast<int16_t>( ( ( x + seed ) * 2654435761u ) >> 16 );
+    }
+}
+
+////////////////////////////////////
+
+// per-block cost of the specialised format loops against per-sample runtime dispatch on the bit depth
+template< typename FORMAT >
+static void bench_format( DELAY_BUFFER& delay_buffer )
+{
+    delay_buffer.set_bit_depth( FORMAT::BITS );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    fill_test_block( block, FORMAT::BITS );
+
+    const int buffer_blocks = delay_buffer.buffer_size_in_frames() / AUDIO_BLOCK_SAMPLES;
+
+    const double write_runtime = time_blocks( [&]( int b )
+    {
+        const int start = ( b % buffer_blocks ) * AUDIO_BLOCK_SAMPLES;
+        for( int x = 0; x < AUDIO_BLOCK_SAMPLES; ++x )
+        {
+            delay_buffer.write_sample( block[x], start + x );
+        }
+    } );
+
+    const double write_specialised = time_blocks( [&]( int )
+    {
+        delay_buffer.write_to_buffer( block, AUDIO_BLOCK_SAMPLES );
+    } );
+
+    const double read_runtime = time_blocks( [&]( int b )
+    {
+        const int start = ( b % buffer_blocks ) * AUDIO_BLOCK_SAMPLES;
+        int sum = 0;
+        for( int x = 0; x < AUDIO_BLOCK_SAMPLES; ++x )
+        {
+            sum += delay_buffer.read_sample( start + x );
+        }
+        bench_sink = sum;
+    } );
+
+    const double read_specialised = time_blocks( [&]( int b )
+    {
+        int16_t dest[AUDIO_BLOCK_SAMPLES];
+        delay_buffer.read_samples<FORMAT>( dest, ( b % buffer_blocks ) * AUDIO_BLOCK_SAMPLES, AUDIO_BLOCK_SAMPLES );
+        bench_sink = dest[ b % AUDIO_BLOCK_SAMPLES ];
+    } );
+
+    printf( "%2d-bit  write  runtime %8.1f ns  specialised %8.1f ns\n", FORMAT::BITS, write_runtime, write_specialised );
+    printf( "%2d-bit  read   runtime %8.1f ns  specialised %8.1f ns\n", FORMAT::BITS, read_runtime, read_specialised );
+}
+
+static void bench_formats()
+{
+    printf( "sample formats, ns per %d sample block\n", AUDIO_BLOCK_SAMPLES );
+
+    std::unique_ptr< DELAY_BUFFER > delay_buffer( new DELAY_BUFFER() );
+
+    bench_format< SAMPLE_FORMAT_ADPCM_4 >( *delay_buffer );
+    bench_format< SAMPLE_FORMAT_8 >( *delay_buffer );
+    bench_format< SAMPLE_FORMAT_12 >( *delay_buffer );
+    bench_format< SAMPLE_FORMAT_16 >( *delay_buffer );
+}
+
+// one second of each test signal written at each bit depth and read straight back, reporting the error against the
+// signal (16-bit stores it exactly) as a signal to noise ratio, and how long a delay the internal buffer holds
+static void bench_format_quality()
+{
+    static const int    BIT_DEPTHS[]    = { 16, 12, 8, 4 };
+    static const char*  SIGNAL_NAMES[]  = { "sine", "notes", "noise" };
+    static const int    NUM_SIGNALS     = sizeof(SIGNAL_NAMES) / sizeof(SIGNAL_NAMES[0]);
+
+    const int num_blocks                = static_cast<int>( AUDIO_SAMPLE_RATE ) / AUDIO_BLOCK_SAMPLES;
+    const int num_samples               = num_blocks * AUDIO_BLOCK_SAMPLES;
+
+    // a 440Hz sine, a decaying note with an overtone every 250ms, and white noise
+    std::vector< int16_t > signals[NUM_SIGNALS];
+    uint32_t random                     = 1;
+    for( std::vector< int16_t >& signal : signals )
+    {
+        signal.resize( num_samples );
+    }
+    for( int x = 0; x < num_samples; ++x )
+    {
+        const float t                   = x / AUDIO_SAMPLE_RATE;
+        const float note_t              = fmodf( t, 0.25f );
+        const float pitch               = 220.0f * ( 1 + ( ( x / ( num_samples / 4 ) ) % 3 ) );
+        const float phase               = 2.0f * static_cast<float>(M_PI) * pitch * note_t;
+        random                          = ( random * 1664525u ) + 1013904223u;
+
+        signals[0][x]                   = static_cast<int16_t>( 16384.0f * sinf( 2.0f * static_cast<float>(M_PI) * 440.0f * t ) );
+        signals[1][x]                   = static_cast<int16_t>( 16384.0f * expf( -8.0f * note_t ) * ( sinf( phase ) + ( 0.5f * sinf( 3.0f * phase ) ) ) );
+        signals[2][x]                   = static_cast<int16_t>( static_cast<int32_t>( random ) >> 18 );
+    }
+
+    printf( "format quality, SNR against the signal, delay in the internal buffer at %.0f Hz\n", AUDIO_SAMPLE_RATE );
+
+    std::unique_ptr< DELAY_BUFFER > delay_buffer( new DELAY_BUFFER() );
+    for( int bit_depth : BIT_DEPTHS )
+    {
+        delay_buffer->set_bit_depth( bit_depth );
+        printf( "%2d-bit  %6.2f s", bit_depth, delay_buffer->buffer_size_in_frames() / AUDIO_SAMPLE_RATE );
+
+        for( int s = 0; s < NUM_SIGNALS; ++s )
+        {
+            const std::vector< int16_t >& signal = signals[s];
+
+            const int start             = delay_buffer->write_head();
+            for( int b = 0; b < num_blocks; ++b )
+            {
+                delay_buffer->write_to_buffer( signal.data() + ( b * AUDIO_BLOCK_SAMPLES ), AUDIO_BLOCK_SAMPLES );
+            }
+
+            double signal_power         = 0.0;
+            double error_power          = 0.0;
+            for( int x = 0; x < num_samples; ++x )
+            {
+                const double error      = delay_buffer->read_sample( delay_buffer->wrap_to_buffer( start + x ) ) - signal[x];
+                signal_power            += static_cast<double>( signal[x] ) * signal[x];
+                error_power             += error * error;
+            }
+
+            if( error_power > 0.0 )
+            {
+                printf( "  %s %6.1f dB", SIGNAL_NAMES[s], 10.0 * log10( signal_power / error_power ) );
+            }
+            else
+            {
+                printf( "  %s  exact   ", SIGNAL_NAMES[s] );
+            }
+        }
+        printf( "\n" );
+    }
+}
+
+////////////////////////////////////
+
+// the interpolators in double precision from the four samples around position, for check_resampler_full_scale()
+static double reference_interpolation( RESAMPLER::QUALITY quality, const double* y, double t )
+{
+    if( quality == RESAMPLER::LINEAR )
+    {
+        return y[1] + ( ( y[2] - y[1] ) * t );
+    }
+
+    const double c1 = ( y[2] - y[0] ) * 0.5;
+    const double c2 = y[0] - ( 2.5 * y[1] ) + ( 2.0 * y[2] ) - ( 0.5 * y[3] );
+    const double c3 = ( ( y[3] - y[0] ) * 0.5 ) + ( 1.5 * ( y[1] - y[2] ) );
+    return y[1] + ( t * ( c1 + ( t * ( c2 + ( t * c3 ) ) ) ) );
+}
+
+// full scale input alternating every sample is the largest the interpolators' intermediate values get, so the linear
+// and hermite outputs are checked against double precision, and the sinc output's peak is reported
+static bool check_resampler_full_scale()
+{
+    static const int    MAX_ERROR       = 4;
+
+    std::unique_ptr< DELAY_BUFFER > delay_buffer( new DELAY_BUFFER() );
+    delay_buffer->set_bit_depth( 16 );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    for( int x = 0; x < AUDIO_BLOCK_SAMPLES; ++x )
+    {
+        block[x] = ( x & 1 ) ? -32768 : 32767;
+    }
+    for( int b = 0; b < delay_buffer->buffer_size_in_frames() / AUDIO_BLOCK_SAMPLES; ++b )
+    {
+        delay_buffer->write_to_buffer( block, AUDIO_BLOCK_SAMPLES );
+    }
+
+    printf( "full scale alternating input, largest error against double precision\n" );
+
+    const char* quality_names[] = { "linear", "hermite", "sinc" };
+    const RESAMPLER::QUALITY qualities[] = { RESAMPLER::LINEAR, RESAMPLER::HERMITE, RESAMPLER::SINC };
+    const float speeds[] = { 0.5f, 2.0f, -1.0f };
+
+    bool success = true;
+    for( int q = 0; q < 3; ++q )
+    {
+        delay_buffer->set_resample_quality( qualities[q] );
+
+        printf( "%-8s", quality_names[q] );
+        for( float speed : speeds )
+        {
+            // off a whole sample, so -1 goes through the resampler too
+            const float start_head = 1000.25f;
+            float head = start_head;
+            int16_t dest[AUDIO_BLOCK_SAMPLES];
+            delay_buffer->read_with_speed<SAMPLE_FORMAT_16>( dest, AUDIO_BLOCK_SAMPLES, head, speed );
+
+            int max_error = 0;
+            for( int x = 0; x < AUDIO_BLOCK_SAMPLES; ++x )
+            {
+                if( qualities[q] == RESAMPLER::SINC )
+                {
+                    max_error = max_val( max_error, abs( dest[x] ) );
+                    continue;
+                }
+
+                const double position = start_head + ( x * speed );
+                const int index = static_cast<int>( floor( position ) );
+                double y[4];
+                for( int i = 0; i < 4; ++i )
+                {
+                    y[i] = block[ ( index - 1 + i ) & 1 ];
+                }
+
+                const double expected = clamp( round( reference_interpolation( qualities[q], y, position - index ) ), -32768.0, 32767.0 );
+                max_error = max_val( max_error, static_cast<int>( fabs( dest[x] - expected ) ) );
+            }
+
+            const bool failed = qualities[q] != RESAMPLER::SINC && max_error > MAX_ERROR;
+            success = success && !failed;
+            printf( "  x%-4.1f %s %6d%s", speed, qualities[q] == RESAMPLER::SINC ? "peak " : "error", max_error, failed ? " FAILED" : "" );
+        }
+        printf( "\n" );
+    }
+
+    return success;
+}
+
+// cost of reading a block at each speed for each resampler quality
+static void bench_resampler()
+{
+    printf( "resampler, 12-bit, ns per %d sample block\n", AUDIO_BLOCK_SAMPLES );
+
+    std::unique_ptr< DELAY_BUFFER > delay_buffer( new DELAY_BUFFER() );
+    delay_buffer->set_bit_depth( 12 );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    for( int b = 0; b < delay_buffer->buffer_size_in_frames() / AUDIO_BLOCK_SAMPLES; ++b )
+    {
+        fill_test_block( block, b );
+        delay_buffer->write_to_buffer( block, AUDIO_BLOCK_SAMPLES );
+    }
+
+    const char* quality_names[] = { "linear", "hermite", "sinc" };
+    const RESAMPLER::QUALITY qualities[] = { RESAMPLER::LINEAR, RESAMPLER::HERMITE, RESAMPLER::SINC };
+    const float speeds[] = { 0.5f, 1.0f, 1.5f, 2.0f, -1.0f };
+
+    for( int q = 0; q < 3; ++q )
+    {
+        delay_buffer->set_resample_quality( qualities[q] );
+
+        printf( "%-8s", quality_names[q] );
+        for( float speed : speeds )
+        {
+            float head = 1000.0f;
+            const double time_ns = time_blocks( [&]( int )
+            {
+                int16_t dest[AUDIO_BLOCK_SAMPLES];
+                delay_buffer->read_with_speed<SAMPLE_FORMAT_12>( dest, AUDIO_BLOCK_SAMPLES, head, speed );
+                bench_sink = dest[0];
+            } );
+
+            printf( "  x%-4.1f %8.1f ns", speed, time_ns );
+        }
+        printf( "\n" );
+    }
+
+    printf( "\n" );
+    bench_failed = !check_resampler_full_scale() || bench_failed;
+}
+
+////////////////////////////////////
+
+// what a play head draws for each new loop (the size variation and the jitter), for every head in the pool
+static void bench_random()
+{
+    printf( "play head random, ns per %d heads drawing a new loop\n", PLAY_HEAD_POOL_SIZE );
+
+    const char* distribution_names[] = { "uniform", "triangular", "quantized" };
+    const int max_jitter_offset = static_cast<int>( AUDIO_SAMPLE_RATE * 0.1f );
+    const int loop_size         = static_cast<int>( AUDIO_SAMPLE_RATE * 0.25f );
+
+    PLAY_HEAD_RANDOM randoms[PLAY_HEAD_POOL_SIZE];
+    for( int h = 0; h < PLAY_HEAD_POOL_SIZE; ++h )
+    {
+        randoms[h].seed( h );
+    }
+
+    for( int d = 0; d < 3; ++d )
+    {
+        const PLAY_HEAD_RANDOM::DISTRIBUTION distribution = static_cast<PLAY_HEAD_RANDOM::DISTRIBUTION>( d );
+        const double time_ns = time_blocks( [&]( int b )
+        {
+            int sum = 0;
+            for( PLAY_HEAD_RANDOM& random : randoms )
+            {
+                const int variation = random.offset( 512, PLAY_HEAD_RANDOM::UNIFORM, 1 );
+                const int size      = loop_size + ( ( loop_size * variation ) >> 12 );
+                sum                 += size + random.offset( max_jitter_offset, distribution, size / ( 1 + ( b & 7 ) ) );
+            }
+            bench_sink = sum;
+        } );
+
+        printf( "%-12s %8.1f ns\n", distribution_names[d], time_ns );
+    }
+}
+
+////////////////////////////////////
+
+// cost of one play head reading a block, steady state and while repeatedly cross fading to a new position, at each bit
+// depth, so the cost of decoding ADPCM for each head can be set against the PCM formats
+static void bench_play_heads()
+{
+    static const int    BIT_DEPTHS[]    = { 16, 12, 8, 4 };
+
+    printf( "play heads, ns per %d sample block\n", AUDIO_BLOCK_SAMPLES );
+
+    std::unique_ptr< DELAY_BUFFER > delay_buffer( new DELAY_BUFFER() );
+    const float speeds[] = { 1.0f, -1.0f, 0.5f, 2.0f };
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    for( int bit_depth : BIT_DEPTHS )
+    {
+        delay_buffer->set_bit_depth( bit_depth );
+        for( int b = 0; b < delay_buffer->buffer_size_in_frames() / AUDIO_BLOCK_SAMPLES; ++b )
+        {
+            fill_test_block( block, b );
+            delay_buffer->write_to_buffer( block, AUDIO_BLOCK_SAMPLES );
+        }
+
+        for( float speed : speeds )
+        {
+            PLAY_HEAD play_head( *delay_buffer, speed );
+            play_head.disable_loop();
+
+            const double steady_ns = time_blocks( [&]( int )
+            {
+                play_head.read_from_play_head( block, AUDIO_BLOCK_SAMPLES );
+                bench_sink = block[0];
+            } );
+
+            const double fading_ns = time_blocks( [&]( int )
+            {
+                if( !play_head.crossfade_active() )
+                {
+                    play_head.set_play_head( delay_buffer->wrap_to_buffer( play_head.destination_position() + 4096 ) );
+                }
+                play_head.read_from_play_head( block, AUDIO_BLOCK_SAMPLES );
+                bench_sink = block[0];
+            } );
+
+            printf( "%2d-bit  x%-5.1f steady %8.1f ns  cross fading %8.1f ns\n", bit_depth, speed, steady_ns, fading_ns );
+        }
+    }
+}
+
+////////////////////////////////////
+
+// cost of update() as the number of heads grows, for unit speed heads (straight copies) and the default mix of speeds
+static void bench_head_count()
+{
+    printf( "head count, 12-bit, ns per update() (%.0f ns real-time budget)\n", ( AUDIO_BLOCK_SAMPLES * 1e9 ) / AUDIO_SAMPLE_RATE );
+
+    std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT() );
+    effect->set_bit_depth( 12 );
+    effect->set_loop_moving( false );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+
+    for( int num_heads = 1; num_heads <= GLITCH_DELAY_EFFECT::MAX_PLAY_HEADS; ++num_heads )
+    {
+        PLAY_HEAD_CONFIG unit_configs[GLITCH_DELAY_EFFECT::MAX_PLAY_HEADS];
+        PLAY_HEAD_CONFIG mixed_configs[GLITCH_DELAY_EFFECT::MAX_PLAY_HEADS];
+        for( int h = 0; h < num_heads; ++h )
+        {
+            unit_configs[h]                   = { 1.0f, false, 0.5f, 0.0f, h };
+            mixed_configs[h]                  = GLITCH_DELAY_EFFECT::DEFAULT_PLAY_HEADS[ h % GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS ];
+            mixed_configs[h].m_loop_size_ratio = 0.5f;
+            mixed_configs[h].m_output_channel = h;
+        }
+
+        auto time_updates = [&]( const PLAY_HEAD_CONFIG* configs )
+        {
+            effect->configure_play_heads( configs, num_heads );
+
+            return time_blocks( [&]( int b )
+            {
+                fill_test_block( block, b );
+                effect->set_input_block( 0, block );
+                effect->update();
+                bench_sink = effect->output_block( 0 )[0];
+            } );
+        };
+
+        const double unit_ns  = time_updates( unit_configs );
+        const double mixed_ns = time_updates( mixed_configs );
+
+        printf( "%2d heads  unit speed %8.1f ns (%6.1f per head)  mixed speeds %8.1f ns (%6.1f per head)\n",
+                num_heads, unit_ns, unit_ns / num_heads, mixed_ns, mixed_ns / num_heads );
+    }
+}
+
+////////////////////////////////////
+
+// cost of update() per sample for the default heads as the block size and sample rate change, small blocks pay the
+// per block bookkeeping more often
+static void bench_block_size()
+{
+    static const int    BLOCK_SIZES[]   = { 16, 32, 64, 128, 256 };
+    static const float  SAMPLE_RATES[]  = { 44100.0f, 48000.0f, 96000.0f };
+
+    printf( "block size, 12-bit, default heads, ns per sample of update() (%% of the real-time budget)\n" );
+
+    int16_t block[MAX_BLOCK_SAMPLES];
+
+    for( float sample_rate : SAMPLE_RATES )
+    {
+        printf( "%5.0f Hz ", static_cast<double>( sample_rate ) );
+
+        for( int block_size : BLOCK_SIZES )
+        {
+            std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT( ENGINE_CONFIG( sample_rate, block_size ) ) );
+            effect->set_bit_depth( 12 );
+            effect->set_loop_moving( false );
+            for( int h = 0; h < effect->num_play_heads(); ++h )
+            {
+                effect->set_loop_size( h, 0.5f );
+            }
+            effect->publish_parameters();
+
+            const double block_ns   = time_blocks( [&]( int b )
+            {
+                fill_test_block( block, b, block_size );
+                effect->set_input_block( 0, block, block_size );
+                effect->update();
+                bench_sink = effect->output_block( 0 )[0];
+            } );
+
+            const double sample_ns  = block_ns / block_size;
+            printf( "  %3d: %5.1f ns (%4.1f%%)", block_size, sample_ns, sample_ns * sample_rate * 1e-7 );
+        }
+        printf( "\n" );
+    }
+}
+
+////////////////////////////////////
+
+// cost of update() per frame for the default heads with a mono and a stereo interleaved buffer, the head bookkeeping is
+// shared by both channels so stereo should cost well under twice mono
+static void bench_channels()
+{
+    static const int    BIT_DEPTHS[]    = { 4, 8, 12, 16 };
+
+    printf( "channels, default heads, ns per frame of update()\n" );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+
+    for( int bit_depth : BIT_DEPTHS )
+    {
+        double frame_ns[MAX_DELAY_CHANNELS];
+
+        for( int channels = 1; channels <= MAX_DELAY_CHANNELS; ++channels )
+        {
+            std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT( ENGINE_CONFIG( AUDIO_SAMPLE_RATE, AUDIO_BLOCK_SAMPLES, channels ) ) );
+            effect->set_bit_depth( bit_depth );
+            effect->set_loop_moving( false );
+            for( int h = 0; h < effect->num_play_heads(); ++h )
+            {
+                effect->set_loop_size( h, 0.5f );
+            }
+            effect->publish_parameters();
+
+            frame_ns[ channels - 1 ] = time_blocks( [&]( int b )
+            {
+                for( int c = 0; c < channels; ++c )
+                {
+                    fill_test_block( block, b + c );
+                    effect->set_input_block( c, block );
+                }
+                effect->update();
+                bench_sink = effect->output_block( 0 )[0];
+            } ) / AUDIO_BLOCK_SAMPLES;
+        }
+
+        printf( "%2d-bit  mono %5.1f ns", bit_depth, frame_ns[0] );
+        for( int channels = 2; channels <= MAX_DELAY_CHANNELS; ++channels )
+        {
+            printf( "  stereo %5.1f ns (x%.2f)", frame_ns[ channels - 1 ], frame_ns[ channels - 1 ] / frame_ns[0] );
+        }
+        printf( "\n" );
+    }
+}
+
+////////////////////////////////////
+
+// the default heads mixed at the sketch's gains, by a mixer after the effect as AudioMixer4 does (one output block per
+// head, then a block for the sum), against the effect summing them into its one output block
+static void bench_head_mix()
+{
+    static const float  HEAD_GAINS[]    = { 0.3f, 0.5f, 0.2f, 0.4f };
+
+    printf( "head mix, 12-bit, default heads, ns per update() including the mix\n" );
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    int16_t mix_block[AUDIO_BLOCK_SAMPLES];
+
+    for( int mode = 0; mode < 2; ++mode )
+    {
+        const bool mixed_output     = mode == 1;
+
+        std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT() );
+        effect->configure_play_heads( GLITCH_DELAY_EFFECT::DEFAULT_PLAY_HEADS, GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS,
+                                      mixed_output ? GLITCH_DELAY_EFFECT::MIXED_OUTPUT : GLITCH_DELAY_EFFECT::HEAD_OUTPUTS );
+        effect->set_bit_depth( 12 );
+        effect->set_loop_moving( false );
+        for( int h = 0; h < effect->num_play_heads(); ++h )
+        {
+            effect->set_loop_size( h, 0.5f );
+            effect->set_head_gain( h, mixed_output ? HEAD_GAINS[h] : 1.0f );
+        }
+        effect->publish_parameters();
+
+        // AudioMixer4's gains, 16 bits of fraction
+        int32_t multipliers[GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS];
+        for( int h = 0; h < GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS; ++h )
+        {
+            multipliers[h]          = static_cast<int32_t>( HEAD_GAINS[h] * 65536.0f );
+        }
+
+        const int num_outputs       = effect->num_output_channels();
+        const double block_ns       = time_blocks( [&]( int b )
+        {
+            fill_test_block( block, b );
+            effect->set_input_block( 0, block );
+            effect->update();
+
+            if( mixed_output )
+            {
+                bench_sink = effect->output_block( 0 )[0];
+                return;
+            }
+
+            for( int x = 0; x < AUDIO_BLOCK_SAMPLES; ++x )
+            {
+                int32_t sum         = 0;
+                for( int h = 0; h < num_outputs; ++h )
+                {
+                    sum             += ( effect->output_block( h )[x] * multipliers[h] ) >> 16;
+                }
+                mix_block[x]        = clamp( sum, -32768, 32767 );
+            }
+            bench_sink = mix_block[0];
+        } );
+
+        // the sketch's blocks after the effect, including the mixer's
+        const int num_blocks        = mixed_output ? num_outputs : num_outputs + 1;
+        printf( "%-13s %8.1f ns  %d audio blocks per update\n", mixed_output ? "mixed output" : "head outputs", block_ns, num_blocks );
+    }
+}
+
+////////////////////////////////////
+
+// the default heads with jitter and beats, with the buffer in external memory behind the block cache. First the cost of
+// the cache itself, over memory that copies straight away, then hits and stalls for each cache shape over memory
+// with latency, in simulated time (see LatencyDelayMemory.h)
+static void bench_storage()
+{
+    static const int    MEMORY_SIZE_IN_BYTES    = 4 * 1024 * 1024;
+    static const int    BLOCK_SIZES[]           = { 384, 1536, 6144 };
+    static const int    NUM_SLOTS[]             = { 8, 16, 32, 64 };
+    static const int    SECONDS                 = 20;
+    static const float  LATENCY_US              = 20.0f;
+    static const float  BANDWIDTH               = 20.0f;        // MB/s
+
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+
+    auto configure_effect = []( GLITCH_DELAY_EFFECT& effect )
+    {
+        effect.set_bit_depth( 12 );
+        effect.set_loop_moving( false );
+        for( int h = 0; h < effect.num_play_heads(); ++h )
+        {
+            effect.set_loop_size( h, 0.5f );
+            effect.set_jitter( h, 0.3f );
+        }
+        effect.publish_parameters();
+    };
+
+    // a beat every 500ms
+    auto run_block = [&]( GLITCH_DELAY_EFFECT& effect, int b )
+    {
+        if( b % static_cast<int>( ( AUDIO_SAMPLE_RATE * 0.5f ) / AUDIO_BLOCK_SAMPLES ) == 0 )
+        {
+            effect.set_beat();
+            effect.publish_parameters();
+        }
+
+        fill_test_block( block, b );
+        effect.set_input_block( 0, block );
+        effect.update();
+        bench_sink = effect.output_block( 0 )[0];
+    };
+
+    printf( "storage, 12-bit, default heads, ns per update()\n" );
+    {
+        std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT() );
+        configure_effect( *effect );
+        const double internal_ns = time_blocks( [&]( int b ) { run_block( *effect, b ); } );
+
+        std::vector< uint8_t > memory( MEMORY_SIZE_IN_BYTES );
+        std::vector< uint8_t > cache( 32 * 1536 );
+        MAPPED_DELAY_MEMORY mapped_memory( memory.data(), MEMORY_SIZE_IN_BYTES );
+        CACHED_DELAY_STORAGE storage( mapped_memory, cache.data(), 1536, 32 );
+        effect->set_delay_storage( &storage );
+        const double cached_ns = time_blocks( [&]( int b ) { run_block( *effect, b ); } );
+
+        printf( "internal %8.1f ns  cached (32 x 1536 bytes, no latency) %8.1f ns\n", internal_ns, cached_ns );
+    }
+
+    printf( "%d MB external memory, %.0f us + %.0f MB/s, %ds of audio\n", MEMORY_SIZE_IN_BYTES >> 20,
+            static_cast<double>( LATENCY_US ), static_cast<double>( BANDWIDTH ), SECONDS );
+
+    for( int block_size : BLOCK_SIZES )
+    {
+        for( int num_slots : NUM_SLOTS )
+        {
+            std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT() );
+            std::vector< uint8_t > cache( num_slots * block_size );
+            LATENCY_DELAY_MEMORY memory( MEMORY_SIZE_IN_BYTES, LATENCY_US, BANDWIDTH );
+            CACHED_DELAY_STORAGE storage( memory, cache.data(), block_size, num_slots );
+            effect->set_delay_storage( &storage );
+            configure_effect( *effect );
+
+            const int num_blocks = static_cast<int>( ( SECONDS * AUDIO_SAMPLE_RATE ) / AUDIO_BLOCK_SAMPLES );
+            for( int b = 0; b < num_blocks; ++b )
+            {
+                run_block( *effect, b );
+                memory.advance( ( AUDIO_BLOCK_SAMPLES * 1e6 ) / AUDIO_SAMPLE_RATE );
+            }
+
+            const uint32_t accesses = storage.num_hits() + storage.num_late() + storage.num_misses();
+            printf( "%2d x %4d bytes (%3d KB)  %6.2f%% hits  %5u late  %5u misses  %6u stalls  %7.2f us stalled per block\n",
+                    num_slots, block_size, ( num_slots * block_size ) >> 10, ( 100.0 * storage.num_hits() ) / accesses,
+                    storage.num_late(), storage.num_misses(), storage.num_stalls(), memory.stall_us() / num_blocks );
+        }
+    }
+}
+
+////////////////////////////////////
+
+// every field derived from the same count, so a set mixing two publishes can be spotted
+static void fill_stress_parameters( GLITCH_DELAY_PARAMETERS& parameters, uint32_t count )
+{
+    const int bit_depths[]              = { 4, 8, 12, 16 };
+    const float ratio                   = ( count % 1000 ) / 1000.0f;
+
+    parameters.m_sample_size_in_bits    = bit_depths[ count % 4 ];
+    parameters.m_freeze_active          = ( count & 1 ) != 0;
+    parameters.m_beat_count             = count;
+    parameters.m_feedback_gain          = count % ( DELAY_BUFFER::MAX_FEEDBACK + 1 );
+    for( int h = 0; h < PLAY_HEAD_POOL_SIZE; ++h )
+    {
+        parameters.m_loop_size_ratio[h] = ratio;
+        parameters.m_jitter_ratio[h]    = ratio;
+        parameters.m_jitter_distribution[h] = static_cast<PLAY_HEAD_RANDOM::DISTRIBUTION>( count % 3 );
+        parameters.m_jitter_subdivisions[h] = 1 + ( count % 8 );
+        parameters.m_head_gain[h]       = count % GLITCH_DELAY_EFFECT::UNITY_HEAD_GAIN;
+    }
+}
+
+static bool stress_parameters_consistent( const GLITCH_DELAY_PARAMETERS& parameters )
+{
+    GLITCH_DELAY_PARAMETERS expected;
+    fill_stress_parameters( expected, parameters.m_beat_count );
+
+    return memcmp( &expected, &parameters, sizeof(parameters) ) == 0;
+}
+
+// publish from another thread as fast as possible while reading (this is harsher than the Teensy, where loop() can't
+// interrupt update()), then render through the effect while its parameters are published from another thread
+static void bench_parameter_stress()
+{
+    printf( "parameter handoff stress, %d ms per stage\n", 1000 );
+
+    std::atomic< bool > stop( false );
+
+    {
+        std::unique_ptr< SEQLOCK_BUFFER< GLITCH_DELAY_PARAMETERS > > buffer( new SEQLOCK_BUFFER< GLITCH_DELAY_PARAMETERS >() );
+
+        GLITCH_DELAY_PARAMETERS initial;
+        fill_stress_parameters( initial, 0 );
+        buffer->publish( initial );
+
+        uint32_t num_publishes = 0;
+        std::thread writer( [&]()
+        {
+            GLITCH_DELAY_PARAMETERS parameters;
+            while( !stop )
+            {
+                fill_stress_parameters( parameters, ++num_publishes );
+                buffer->publish( parameters );
+            }
+        } );
+
+        int num_reads       = 0;
+        int num_failed      = 0;
+        int num_torn        = 0;
+
+        const auto end_time = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+        while( std::chrono::steady_clock::now() < end_time )
+        {
+            GLITCH_DELAY_PARAMETERS parameters;
+            if( buffer->read( parameters ) )
+            {
+                ++num_reads;
+                num_torn    += stress_parameters_consistent( parameters ) ? 0 : 1;
+            }
+            else
+            {
+                ++num_failed;
+            }
+        }
+
+        stop = true;
+        writer.join();
+
+        printf( "seqlock   %u publishes  %d reads  %d reads gave up  %d torn\n", num_publishes, num_reads, num_failed, num_torn );
+    }
+
+    {
+        stop = false;
+
+        std::unique_ptr< GLITCH_DELAY_EFFECT > effect( new GLITCH_DELAY_EFFECT() );
+
+        uint32_t num_publishes = 0;
+        std::thread writer( [&]()
+        {
+            const int bit_depths[] = { 4, 8, 12, 16 };
+            while( !stop )
+            {
+                const uint32_t count = ++num_publishes;
+                const float ratio = ( count % 1000 ) / 1000.0f;
+
+                effect->set_bit_depth( bit_depths[ ( count / 1000 ) % 4 ] );
+                effect->set_freeze_active( ( count / 5000 ) & 1 );
+                for( int h = 0; h < effect->num_play_heads(); ++h )
+                {
+                    effect->set_loop_size( h, ratio );
+                    effect->set_jitter( h, ratio );
+                    effect->set_jitter_distribution( h, static_cast<PLAY_HEAD_RANDOM::DISTRIBUTION>( count % 3 ), 1 + ( count % 8 ) );
+                }
+                if( count % 100 == 0 )
+                {
+                    effect->set_beat();
+                }
+                effect->publish_parameters();
+            }
+        } );
+
+        int16_t block[AUDIO_BLOCK_SAMPLES];
+        int num_updates     = 0;
+
+        const auto end_time = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+        while( std::chrono::steady_clock::now() < end_time )
+        {
+            fill_test_block( block, num_updates++ );
+            effect->set_input_block( 0, block );
+            effect->update();
+            bench_sink = effect->output_block( 0 )[0];
+        }
+
+        stop = true;
+        writer.join();
+
+        printf( "effect    %u publishes  %d updates\n", num_publishes, num_updates );
+    }
+}
+
+////////////////////////////////////
+
+// channel values derived from the scan sequence, so a frame mixing two scans can be spotted
+static void fill_cv_scan( uint16_t* values, uint8_t sequence )
+{
+    for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+    {
+        values[c]   = ( sequence * 4 + c * 150 ) & 0x3FF;
+    }
+}
+
+static bool cv_frame_consistent( const CV_FRAME& frame )
+{
+    uint16_t expected[CV_NUM_CHANNELS];
+    fill_cv_scan( expected, frame.m_sequence );
+
+    return memcmp( expected, frame.m_values, sizeof(expected) ) == 0;
+}
+
+// each kind of bad transfer once, then loop() against a bus interrupt on another thread that scans and fails at random
+static void bench_cv_acquisition()
+{
+    const uint8_t address       = 111;
+    const uint8_t delta_address = 110;
+    uint16_t values[CV_NUM_CHANNELS];
+
+    {
+        MOCK_CV_BUS bus( address, delta_address );
+        CV_ACQUISITION acquisition( bus, address, delta_address );
+        CV_FRAME frame = CV_FRAME();
+
+        fill_cv_scan( values, 1 );
+        bus.finish_scan( values );
+
+        const bool started      = acquisition.start_read();
+        const bool busy         = !acquisition.start_read();
+        const bool early        = !acquisition.latest_frame( frame );
+        bus.complete_transfer();
+        const bool landed       = acquisition.latest_frame( frame ) && cv_frame_consistent( frame ) && frame.m_sequence == 1;
+        const bool taken        = !acquisition.latest_frame( frame );
+
+        acquisition.start_read();
+        bus.complete_transfer();
+        const bool stale        = !acquisition.latest_frame( frame ) && acquisition.num_stale() == 1;
+
+        bus.finish_scan( values );
+        acquisition.start_read();
+        bus.complete_transfer( MOCK_CV_BUS::FAULT_BIT_FLIP );
+        const bool corrupt      = !acquisition.latest_frame( frame ) && acquisition.num_corrupt() == 1;
+
+        acquisition.start_read();
+        bus.complete_transfer( MOCK_CV_BUS::FAULT_NO_ACK );
+        const bool failed       = !acquisition.latest_frame( frame ) && acquisition.num_failed() == 1;
+
+        // a full read to recover, then a delta with the one channel that moved
+        acquisition.start_read();
+        bus.complete_transfer();
+        const bool recovered    = acquisition.latest_frame( frame ) && frame.m_sequence == 2;
+        values[2]               += 1;
+        bus.finish_scan( values );
+        const uint32_t num_bytes = acquisition.num_bytes();
+        acquisition.start_read();
+        bus.complete_transfer();
+        const bool delta        = acquisition.latest_frame( frame ) && frame.m_values[2] == values[2] && frame.m_sequence == 3 &&
+                                  acquisition.num_bytes() - num_bytes == 5;
+
+        CV_ACQUISITION wrong_address( bus, address + 1, address + 1 );
+        wrong_address.start_read();
+        bus.complete_transfer();
+        const bool unanswered   = wrong_address.num_failed() == 1 && !wrong_address.latest_frame( frame );
+
+        printf( "cv acquisition checks\n" );
+        printf( "  start %s  busy %s  early %s  landed %s  taken %s  stale %s  corrupt %s  failed %s  recovered %s  delta %s  unanswered %s\n",
+                started ? "ok" : "FAIL", busy ? "ok" : "FAIL", early ? "ok" : "FAIL", landed ? "ok" : "FAIL", taken ? "ok" : "FAIL",
+                stale ? "ok" : "FAIL", corrupt ? "ok" : "FAIL", failed ? "ok" : "FAIL", recovered ? "ok" : "FAIL", delta ? "ok" : "FAIL",
+                unanswered ? "ok" : "FAIL" );
+    }
+
+    {
+        MOCK_CV_BUS bus( address, delta_address );
+        CV_ACQUISITION acquisition( bus, address, delta_address );
+
+        std::atomic< bool > stop( false );
+        uint32_t num_scans = 0;
+        std::thread bus_interrupt( [&]()
+        {
+            uint16_t scan_values[CV_NUM_CHANNELS];
+            uint32_t count = 0;
+            while( !stop )
+            {
+                // the PIC finishes a scan between most reads, and 1 in 16 reads fail each way
+                ++count;
+                if( count % 3 != 0 )
+                {
+                    fill_cv_scan( scan_values, ++num_scans );
+                    bus.finish_scan( scan_values );
+                }
+
+                const MOCK_CV_BUS::FAULT fault = count % 16 == 0 ? MOCK_CV_BUS::FAULT_BIT_FLIP :
+                                                 count % 16 == 8 ? MOCK_CV_BUS::FAULT_NO_ACK : MOCK_CV_BUS::FAULT_NONE;
+                while( !bus.complete_transfer( fault ) && !stop )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } );
+
+        int num_ticks       = 0;
+        int num_new_frames  = 0;
+        int num_torn        = 0;
+        int num_repeats     = 0;
+        CV_FRAME frame      = CV_FRAME();
+
+        const auto end_time = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+        while( std::chrono::steady_clock::now() < end_time )
+        {
+            ++num_ticks;
+
+            const uint8_t prev_sequence = frame.m_sequence;
+            if( acquisition.latest_frame( frame ) )
+            {
+                ++num_new_frames;
+                num_torn    += cv_frame_consistent( frame ) ? 0 : 1;
+                num_repeats += frame.m_sequence == prev_sequence ? 1 : 0;
+            }
+
+            acquisition.start_read();
+            std::this_thread::yield();
+        }
+
+        stop = true;
+        bus_interrupt.join();
+
+        printf( "cv acquisition stress, %d ms\n", 1000 );
+        printf( "  %d ticks  %u transfers  %u frames  %u stale  %u corrupt  %u failed\n", num_ticks, acquisition.num_transfers(),
+                acquisition.num_frames(), acquisition.num_stale(), acquisition.num_corrupt(), acquisition.num_failed() );
+        printf( "  %d new frames seen  %d torn  %d repeats\n", num_new_frames, num_torn, num_repeats );
+    }
+}
+
+////////////////////////////////////
+
+struct BENCHMARK
+{
+    const char*     m_name;
+    void            (*m_func)();
+};
+
+static const BENCHMARK BENCHMARKS[] =
+{
+    { "formats",    bench_formats },
+    { "format_quality", bench_format_quality },
+    { "resampler",  bench_resampler },
+    { "random",     bench_random },
+    { "play_heads", bench_play_heads },
+    { "head_count", bench_head_count },
+    { "block_size", bench_block_size },
+    { "channels",   bench_channels },
+    { "head_mix",   bench_head_mix },
+    { "storage",    bench_storage },
+    { "parameter_stress", bench_parameter_stress },
+    { "cv_acquisition", bench_cv_acquisition },
+};
+
+int main( int argc, char** argv )
+{
+    bool found = false;
+
+    for( const BENCHMARK& benchmark : BENCHMARKS )
+    {
+        if( argc < 2 || std::string( argv[1] ) == benchmark.m_name )
+        {
+            benchmark.m_func();
+            printf( "\n" );
+            found = true;
+        }
+    }
+
+    if( !found )
+    {
+        printf( "usage: glitch_delay_bench [benchmark]\nbenchmarks:" );
+        for( const BENCHMARK& benchmark : BENCHMARKS )
+        {
+            printf( " %s", benchmark.m_name );
+        }
+        printf( "\n" );
+        return 1;
+    }
+
+    return bench_failed ? 1 : 0;
+}
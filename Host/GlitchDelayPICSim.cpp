@@ -0,0 +1,336 @@
+//
+//  GlitchDelayPICSim.cpp
+//
+//  Runs the PIC firmware (PIC/CV_I2C.c) against register stubs with noisy simulated CV inputs, and reads it through
+//  CV_ACQUISITION once per control tick, as the Teensy does. Reports the scan rate, the bytes read per tick for full
+//  and delta reads, and how far the values read stray from the inputs.
+//
+//  build:  g++ -O2 -std=c++11 -IHost/PICStubs Host/GlitchDelayPICSim.cpp -o glitch_delay_pic_sim
+//  usage:  glitch_delay_pic_sim [seconds]
+//
+
+#define PIC_HOST_SIM
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../PIC/CV_I2C.c"
+#include "../CVAcquisition.h"
+
+static const int            TIMER_PERIOD_US     = 128;      // timer0, see cv_init()
+static const int            CONVERSION_US       = 23;       // 11.5 TAD at fOSC/32
+static const int            I2C_BYTE_US         = 23;       // 9 bits at 400kHz
+static const int            CONTROL_TICK_US     = 5000;     // CONTROL_RATE_HZ in GlitchDelayV2.ino
+static const float          NOISE_LSB           = 4.0f;
+
+////////////////////////////////////
+
+// the analog side of the PIC, and the I2C master
+class PIC_SIM : public CV_BUS
+{
+    uint32_t                m_random;
+
+    int64_t                 m_time_us;
+    int64_t                 m_next_timer_us;
+    int64_t                 m_conversion_end_us;        // < 0 when the ADC is idle
+
+    // pending read
+    int64_t                 m_read_end_us;              // < 0 when the bus is idle
+    uint8_t                 m_read_address;
+    uint8_t*                m_data;
+    int                     m_max_size;
+    CV_BUS_LISTENER*        m_listener;
+
+    float                   random_noise()
+    {
+        // triangular, -NOISE_LSB to NOISE_LSB
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        const float r1 = ( m_random & 0xFFFF ) / 65536.0f;
+        const float r2 = ( m_random >> 16 ) / 65536.0f;
+        return ( r1 + r2 - 1.0f ) * NOISE_LSB;
+    }
+
+    void                    run_interrupt()
+    {
+        ISR();
+
+        if( ADCON0bits.GO_nDONE && m_conversion_end_us < 0 )
+        {
+            m_conversion_end_us = m_time_us + CONVERSION_US;
+        }
+    }
+
+    // the master's side of the transfer, all at once (the PIC fills its frame when the address arrives)
+    bool                    transfer()
+    {
+        const uint8_t slave_address     = SSP1ADD >> 1;
+        const uint8_t address_mask      = SSP1MSK >> 1;
+        if( ( ( m_read_address ^ slave_address ) & address_mask ) != 0 )
+        {
+            return false;
+        }
+
+        SSP1BUF                         = ( m_read_address << 1 ) | 1;
+        SSP1STATbits.D_nA               = 0;
+        SSP1STATbits.R_nW               = 1;
+        PIR1bits.SSP1IF                 = 1;
+        run_interrupt();
+        m_data[0]                       = SSP1BUF;
+
+        const int size                  = m_listener->read_size( m_data[0] );
+        if( size > m_max_size )
+        {
+            return false;
+        }
+
+        SSP1STATbits.D_nA               = 1;
+        for( int b = 1; b < size; ++b )
+        {
+            PIR1bits.SSP1IF             = 1;
+            run_interrupt();
+            m_data[b]                   = SSP1BUF;
+        }
+
+        return true;
+    }
+
+public:
+
+    float                   m_inputs[NUM_CHANNELS];     // 0-1023, in channel order
+
+    PIC_SIM() :
+        m_random( 0x12345678 ),
+        m_time_us( 0 ),
+        m_next_timer_us( TIMER_PERIOD_US ),
+        m_conversion_end_us( -1 ),
+        m_read_end_us( -1 ),
+        m_read_address( 0 ),
+        m_data( nullptr ),
+        m_max_size( 0 ),
+        m_listener( nullptr ),
+        m_inputs()
+    {
+        // power on
+        ADCON0_stub         = ADCON0_STUB();
+        PIR1_stub           = PIR1_STUB();
+        INTCON_stub         = INTCON_STUB();
+        scan_channel        = 0;
+        scan_samples        = 0;
+        scan_busy           = 0;
+        change_mask         = 0;
+        scan_sequence       = 0;
+        memset( channel_value, 0, sizeof(channel_value) );
+
+        cv_init();
+    }
+
+    int64_t                 time_us() const     { return m_time_us; }
+
+    void                    run_until( int64_t end_time_us )
+    {
+        while( true )
+        {
+            int64_t next_us = m_next_timer_us;
+            next_us         = m_conversion_end_us >= 0 && m_conversion_end_us < next_us ? m_conversion_end_us : next_us;
+            next_us         = m_read_end_us >= 0 && m_read_end_us < next_us ? m_read_end_us : next_us;
+            if( next_us > end_time_us )
+            {
+                break;
+            }
+
+            m_time_us       = next_us;
+
+            if( m_time_us == m_read_end_us )
+            {
+                m_read_end_us = -1;
+                const bool success = transfer();
+                m_listener->read_complete( success );
+            }
+            else if( m_time_us == m_conversion_end_us )
+            {
+                m_conversion_end_us = -1;
+
+                // find which channel the mux is on
+                int channel = 0;
+                while( channel < NUM_CHANNELS && adc_pins[channel] != ADCON0bits.CHS )
+                {
+                    ++channel;
+                }
+
+                const float sample  = m_inputs[channel] + random_noise();
+                const int result    = sample < 0.0f ? 0 : sample > 1023.0f ? 1023 : int( sample + 0.5f );
+
+                ADRESH              = result >> 8;
+                ADRESL              = result & 0xFF;
+                ADCON0bits.GO_nDONE = 0;
+                PIR1bits.ADIF       = 1;
+                run_interrupt();
+            }
+            else
+            {
+                m_next_timer_us     += TIMER_PERIOD_US;
+                if( INTCONbits.TMR0IE )
+                {
+                    INTCONbits.TMR0IF = 1;
+                    run_interrupt();
+                }
+            }
+        }
+
+        m_time_us = end_time_us;
+    }
+
+    // the transfer completes after the bytes have been clocked, sized for the longest read
+    bool                    start_read( uint8_t address, uint8_t* data, int max_size, CV_BUS_LISTENER* listener ) override
+    {
+        if( m_read_end_us >= 0 )
+        {
+            return false;
+        }
+
+        m_read_address      = address;
+        m_data              = data;
+        m_max_size          = max_size;
+        m_listener          = listener;
+        m_read_end_us       = m_time_us + ( max_size + 1 ) * I2C_BYTE_US;
+
+        return true;
+    }
+};
+
+////////////////////////////////////
+
+struct SIM_RESULT
+{
+    int                     m_ticks;
+    uint32_t                m_scans;
+    uint32_t                m_bytes;
+    uint32_t                m_frames;
+    uint32_t                m_corrupt;
+    uint32_t                m_failed;
+    float                   m_max_error;
+    float                   m_mean_error;
+    int                     m_static_changes;           // new values on the channels whose input doesn't move
+    bool                    m_final_frame_matches;      // assembled from deltas, compared to a full read
+};
+
+static void set_inputs( PIC_SIM& pic, float time_s )
+{
+    pic.m_inputs[0] = 512.0f;
+    pic.m_inputs[1] = 100.0f;
+    pic.m_inputs[2] = 512.0f + 400.0f * sinf( time_s * 2.0f * 3.14159265f * 0.25f );   // slow LFO
+    pic.m_inputs[3] = 900.0f;
+    pic.m_inputs[4] = time_s < 3.0f ? 200.0f : 700.0f;                               // gate
+    pic.m_inputs[5] = 0.0f;
+}
+
+static SIM_RESULT run_sim( float seconds, bool delta_reads )
+{
+    PIC_SIM pic;
+    CV_ACQUISITION acquisition( pic, I2C_ADDRESS, delta_reads ? I2C_DELTA_ADDRESS : I2C_ADDRESS );
+
+    SIM_RESULT result       = SIM_RESULT();
+    CV_FRAME frame          = CV_FRAME();
+    CV_FRAME prev_frame     = CV_FRAME();
+    double total_error      = 0.0;
+    int num_errors          = 0;
+
+    const uint8_t first_sequence = scan_sequence;
+    uint32_t num_sequence_wraps = 0;
+    uint8_t prev_sequence   = scan_sequence;
+
+    for( int64_t tick_us = 0; tick_us < int64_t( seconds * 1000000 ); tick_us += CONTROL_TICK_US )
+    {
+        set_inputs( pic, tick_us / 1000000.0f );
+        pic.run_until( tick_us );
+
+        num_sequence_wraps  += scan_sequence < prev_sequence ? 1 : 0;
+        prev_sequence       = scan_sequence;
+
+        if( acquisition.latest_frame( frame ) )
+        {
+            static const int STATIC_CHANNELS[] = { 0, 1, 3, 5 };
+            for( int c : STATIC_CHANNELS )
+            {
+                result.m_static_changes += result.m_ticks > 10 && frame.m_values[c] != prev_frame.m_values[c] ? 1 : 0;
+            }
+            prev_frame = frame;
+        }
+
+        // skip the second or so the first frames take to arrive and the slow LFO
+        if( tick_us > 100000 )
+        {
+            for( int c = 0; c < NUM_CHANNELS; ++c )
+            {
+                if( c == 2 || ( c == 4 && fabsf( tick_us / 1000000.0f - 3.0f ) < 0.1f ) )
+                {
+                    continue;
+                }
+
+                const float error   = fabsf( frame.m_values[c] - pic.m_inputs[c] );
+                result.m_max_error  = error > result.m_max_error ? error : result.m_max_error;
+                total_error         += error;
+                ++num_errors;
+            }
+        }
+
+        acquisition.start_read();
+        ++result.m_ticks;
+    }
+
+    // stop the scanner, take what's left, then check the frame built from deltas against a full read
+    INTCONbits.TMR0IE       = 0;
+    pic.run_until( pic.time_us() + CONTROL_TICK_US );
+    acquisition.latest_frame( frame );
+    acquisition.start_read();
+    pic.run_until( pic.time_us() + CONTROL_TICK_US );
+    acquisition.latest_frame( frame );
+
+    CV_ACQUISITION full_acquisition( pic, I2C_ADDRESS, I2C_ADDRESS );
+    CV_FRAME full_frame     = CV_FRAME();
+    full_acquisition.start_read();
+    pic.run_until( pic.time_us() + CONTROL_TICK_US );
+    full_acquisition.latest_frame( full_frame );
+
+    result.m_final_frame_matches = memcmp( frame.m_values, full_frame.m_values, sizeof(frame.m_values) ) == 0;
+
+    result.m_scans          = num_sequence_wraps * 256 + scan_sequence - first_sequence;
+    result.m_bytes          = acquisition.num_bytes();
+    result.m_frames         = acquisition.num_frames();
+    result.m_corrupt        = acquisition.num_corrupt();
+    result.m_failed         = acquisition.num_failed();
+    result.m_mean_error     = num_errors > 0 ? float( total_error / num_errors ) : 0.0f;
+
+    return result;
+}
+
+static void print_result( const char* name, const SIM_RESULT& result, float seconds )
+{
+    printf( "%-6s  %5.0f scans/s  %5.2f bytes/tick  %6u frames  %u corrupt  %u failed  error mean %.2f max %.1f LSB  "
+            "%d changes on static inputs  final frame %s\n",
+            name, result.m_scans / seconds, float( result.m_bytes ) / result.m_ticks, result.m_frames, result.m_corrupt,
+            result.m_failed, result.m_mean_error, result.m_max_error, result.m_static_changes,
+            result.m_final_frame_matches ? "matches" : "DIFFERS" );
+}
+
+int main( int argc, char** argv )
+{
+    const float seconds = argc > 1 ? float( atof( argv[1] ) ) : 10.0f;
+    if( seconds <= 0.0f )
+    {
+        printf( "usage: glitch_delay_pic_sim [seconds]\n" );
+        return 1;
+    }
+
+    printf( "%.0fs of CV, read every %d us, input noise +/-%.0f LSB, %d x oversampling, change threshold %d LSB\n",
+            seconds, CONTROL_TICK_US, NOISE_LSB, OVERSAMPLE, CHANGE_THRESHOLD );
+
+    print_result( "full", run_sim( seconds, false ), seconds );
+    print_result( "delta", run_sim( seconds, true ), seconds );
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+//
+//  GlitchDelayProfile.cpp
+//
+//  Prints a PROFILER dump, either captured from the Teensy serial port (send 'p' with PROFILE_AUDIO defined) or
+//  written by glitch_delay_render -p.
+//
+//  build:  g++ -O2 -std=c++11 Host/GlitchDelayProfile.cpp -o glitch_delay_profile
+//  usage:  glitch_delay_profile capture.bin
+//
+
+#define TARGET_HOST
+
+#include "ProfileDump.h"
+
+int main( int argc, char** argv )
+{
+    if( argc < 2 )
+    {
+        printf( "usage: glitch_delay_profile capture.bin\n" );
+        return 1;
+    }
+
+    FILE* file = fopen( argv[1], "rb" );
+    if( file == nullptr )
+    {
+        printf( "Unable to read %s\n", argv[1] );
+        return 1;
+    }
+
+    std::vector< uint8_t > data;
+    uint8_t buffer[4096];
+    size_t num_read;
+    while( ( num_read = fread( buffer, 1, sizeof(buffer), file ) ) > 0 )
+    {
+        data.insert( data.end(), buffer, buffer + num_read );
+    }
+    fclose( file );
+
+    PROFILE_DUMP dump;
+    if( !read_profile_dump( data, dump ) )
+    {
+        printf( "No complete profile dump in %s\n", argv[1] );
+        return 1;
+    }
+
+    print_profile_dump( dump );
+
+    return 0;
+}
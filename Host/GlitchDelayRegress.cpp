@@ -0,0 +1,674 @@
+//
+//  GlitchDelayRegress.cpp
+//
+//  Regression check for the effect's sound and cost. Renders fixed test signals through GLITCH_DELAY_EFFECT for each
+//  case in REGRESSION_CASES, with the heads' random numbers seeded the same for every render, and either records the
+//  renders and block costs as the reference or checks them against a reference recorded earlier.
+//
+//  Every case runs the four default heads (half speed, normal, double and reverse) on its own output. The cases
+//  cover the three PCM bit depths and ADPCM, beats, jitter in each distribution, freeze toggling on and off, the
+//  resampler and fade options, stereo and cached external storage.
+//
+//  Each head's render is compared with the reference by its largest sample difference, the level of the difference
+//  against the reference's level, and the change in level, each with its own tolerance. Each case renders once to warm
+//  up then several times, keeping each block's fastest time so that the odd block the OS interrupted drops out while
+//  blocks that always cost more (beats, fades) stay. With -T, the median and worst of those fail if they have grown by
+//  more than the allowed percentage. Block costs only compare on the machine the reference was recorded on, so the
+//  timing check is off by default.
+//
+//  The reference in Host/RegressionReference is recorded from the tree it is committed with, and is the default, so a
+//  check from the top of the repository compares against it. Record it again, and commit it, with any change that is
+//  meant to change the sound.
+//
+//  build:  g++ -O2 -std=c++11 Host/GlitchDelayRegress.cpp -o glitch_delay_regress
+//  usage:  glitch_delay_regress [options] record|check [reference_dir]
+//
+
+#define TARGET_HOST
+
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+#include "RenderJob.h"
+
+struct REGRESSION_CASE
+{
+    const char*             m_name;
+    const char*             m_input;            // one of the test signals below
+    const char*             m_options;          // as given to glitch_delay_render
+};
+
+static const REGRESSION_CASE REGRESSION_CASES[] =
+{
+    // name             input       options
+    { "bits16",         "notes",    "-b 16 -s 0.4 -t 400" },
+    { "bits12",         "notes",    "-b 12 -s 0.4 -t 400" },
+    { "bits8",          "notes",    "-b 8 -s 0.4 -t 400" },
+    { "adpcm",          "notes",    "-b 4 -s 0.4 -t 400" },
+    { "jitter",         "notes",    "-b 12 -s 0.3 -j 0.5 -t 300" },
+    { "jitter_tri",     "notes",    "-b 12 -s 0.3 -j 0.8 -t 300 -J triangular" },
+    { "jitter_steps",   "clicks",   "-b 16 -s 0.5 -j 1 -t 500 -J quantized -u 8" },
+    { "no_beats",       "clicks",   "-b 16" },
+    { "freeze",         "notes",    "-b 12 -s 0.6 -t 400 -F 1000" },
+    { "freeze_clicks",  "clicks",   "-b 8 -s 0.8 -t 250 -F 700" },
+    { "hermite",        "notes",    "-b 16 -s 0.4 -t 400 -q hermite -c equal_power" },
+    { "linear",         "clicks",   "-b 12 -s 0.2 -t 200 -q linear -c raised_cosine" },
+    { "stereo",         "stereo",   "-b 12 -s 0.4 -t 400 -m 2" },
+    { "external",       "notes",    "-b 12 -s 0.4 -t 400 -e 512" },
+    { "feedback",       "notes",    "-b 12 -s 0.4 -t 400 -d 0.3" },
+};
+
+static const int NUM_REGRESSION_CASES = sizeof(REGRESSION_CASES) / sizeof(REGRESSION_CASES[0]);
+
+static const char* DEFAULT_REFERENCE_DIR = "Host/RegressionReference";
+
+struct REGRESSION_OPTIONS
+{
+    int                     m_num_runs;
+    double                  m_median_percent;   // allowed growth in the median block cost
+    double                  m_worst_percent;    // and the worst
+    bool                    m_check_timing;
+    int                     m_max_difference;   // in 16-bit steps
+    double                  m_error_db;         // difference level against the reference level
+    double                  m_level_db;         // allowed change in level
+    std::string             m_failed_dir;       // empty - don't write failed renders
+
+    REGRESSION_OPTIONS() :
+        m_num_runs( 5 ),
+        m_median_percent( 60.0 ),
+        m_worst_percent( 400.0 ),
+        m_check_timing( false ),
+        m_max_difference( 64 ),
+        m_error_db( -60.0 ),
+        m_level_db( 0.1 ),
+        m_failed_dir()
+    {
+    }
+};
+
+// one case's renders and block costs, the reference as read back or the renders just made
+struct CASE_RESULT
+{
+    std::string             m_options;
+    std::vector< WAV_FILE > m_head_outputs;
+    int                     m_num_blocks;
+    int64_t                 m_median_block_ns;
+    int64_t                 m_worst_block_ns;
+
+    CASE_RESULT() :
+        m_options(),
+        m_head_outputs(),
+        m_num_blocks( 0 ),
+        m_median_block_ns( 0 ),
+        m_worst_block_ns( 0 )
+    {
+    }
+};
+
+// the worst over every head
+struct DIFFERENCE
+{
+    bool                    m_identical;
+    int                     m_max_difference;
+    double                  m_error_db;
+    double                  m_level_db;
+
+    DIFFERENCE() :
+        m_identical( true ),
+        m_max_difference( 0 ),
+        m_error_db( -999.0 ),
+        m_level_db( 0.0 )
+    {
+    }
+};
+
+////////////////////////////////////
+
+static const int TEST_SAMPLE_RATE   = 44100;
+static const int TEST_LENGTH_MS     = 4000;
+
+// the signals must never change once references have been recorded, so they use their own noise rather than the
+// C library's, and are rounded to 16 bits before use
+class TEST_NOISE
+{
+    uint32_t                m_state;
+
+public:
+
+    TEST_NOISE() :
+        m_state( 1 )
+    {
+    }
+
+    // -1 to 1
+    double                  next()
+    {
+        m_state             = ( m_state * 1664525u ) + 1013904223u;
+        return static_cast<int32_t>( m_state ) / 2147483648.0;
+    }
+};
+
+static int16_t to_sample( double value )
+{
+    return static_cast<int16_t>( clamp( lround( value * 32767.0 ), -32768l, 32767l ) );
+}
+
+// a decaying note with two overtones every 250ms, cycling through a few pitches, over quiet noise
+static void make_notes( std::vector< double >& signal )
+{
+    static const double PITCHES[]   = { 110.0, 220.0, 164.8, 329.6, 246.9, 440.0, 185.0 };
+    static const int NUM_PITCHES    = sizeof(PITCHES) / sizeof(PITCHES[0]);
+    const int note_samples          = TEST_SAMPLE_RATE / 4;
+
+    TEST_NOISE noise;
+    for( size_t x = 0; x < signal.size(); ++x )
+    {
+        const int note              = static_cast<int>( x ) / note_samples;
+        const double pitch          = PITCHES[ note % NUM_PITCHES ];
+        const double t              = ( static_cast<int>( x ) % note_samples ) / static_cast<double>( TEST_SAMPLE_RATE );
+        const double phase          = 2.0 * M_PI * pitch * t;
+        const double tone           = sin( phase ) + ( 0.5 * sin( 2.0 * phase ) ) + ( 0.25 * sin( 3.0 * phase ) );
+        signal[x]                   = ( 0.3 * tone * exp( -8.0 * t ) ) + ( 0.01 * noise.next() );
+    }
+}
+
+// single sample clicks every 100ms, alternating in sign, getting quieter then louder, so the heads' positions and
+// fades show up sample by sample
+static void make_clicks( std::vector< double >& signal )
+{
+    const int click_samples         = TEST_SAMPLE_RATE / 10;
+    std::fill( signal.begin(), signal.end(), 0.0 );
+    for( size_t x = 0; x < signal.size(); x += click_samples )
+    {
+        const int click             = static_cast<int>( x ) / click_samples;
+        const double level          = 0.1 + ( 0.8 * fabs( ( ( click % 20 ) - 10 ) / 10.0 ) );
+        signal[x]                   = click % 2 == 0 ? level : -level;
+    }
+}
+
+// false for a signal that doesn't exist
+static bool make_input( const std::string& name, WAV_FILE& wav )
+{
+    std::vector< double > notes( ( TEST_SAMPLE_RATE * TEST_LENGTH_MS ) / 1000 );
+    std::vector< double > clicks( notes.size() );
+    make_notes( notes );
+    make_clicks( clicks );
+
+    wav.m_sample_rate               = TEST_SAMPLE_RATE;
+    wav.m_num_channels              = name == "stereo" ? 2 : 1;
+    wav.m_samples.clear();
+
+    for( size_t x = 0; x < notes.size(); ++x )
+    {
+        if( name == "notes" )
+        {
+            wav.m_samples.push_back( to_sample( notes[x] ) );
+        }
+        else if( name == "clicks" )
+        {
+            wav.m_samples.push_back( to_sample( clicks[x] ) );
+        }
+        else if( name == "stereo" )
+        {
+            // notes left, clicks right
+            wav.m_samples.push_back( to_sample( notes[x] ) );
+            wav.m_samples.push_back( to_sample( clicks[x] ) );
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+////////////////////////////////////
+
+static void print_usage()
+{
+    printf( "usage: glitch_delay_regress [options] record|check [reference_dir]  (default %s)\n", DEFAULT_REFERENCE_DIR );
+    printf( "  -R runs      timed renders of each case, each block's fastest is kept (default 5)\n" );
+    printf( "  -T           check block costs too, against a reference recorded on this machine\n" );
+    printf( "  -M percent   allowed growth in the median block cost (default 60)\n" );
+    printf( "  -W percent   allowed growth in the worst block cost (default 400)\n" );
+    printf( "  -d steps     largest sample difference allowed, in 16-bit steps (default 64)\n" );
+    printf( "  -E dB        highest level of the difference against the reference level (default -60)\n" );
+    printf( "  -L dB        largest change in level (default 0.1)\n" );
+    printf( "  -o dir       write the renders of the cases that fail to dir\n" );
+}
+
+static bool parse_case_options( const std::string& options, RENDER_SETTINGS& settings )
+{
+    std::vector< std::string > tokens;
+    std::istringstream stream( options );
+    for( std::string token; stream >> token; )
+    {
+        tokens.push_back( token );
+    }
+
+    if( tokens.size() % 2 != 0 )
+    {
+        return false;
+    }
+
+    for( size_t t = 0; t < tokens.size(); t += 2 )
+    {
+        if( !parse_render_option( tokens[t], tokens[t + 1].c_str(), settings ) )
+        {
+            return false;
+        }
+    }
+
+    return check_render_settings( settings );
+}
+
+static std::string head_filename( const std::string& dir, const std::string& case_name, int head )
+{
+    return dir + "/" + case_name + "_head" + std::to_string( head ) + ".wav";
+}
+
+static int64_t median( std::vector< int32_t > values )
+{
+    if( values.empty() )
+    {
+        return 0;
+    }
+
+    std::nth_element( values.begin(), values.begin() + ( values.size() / 2 ), values.end() );
+    return values[ values.size() / 2 ];
+}
+
+// renders the case once untimed then num_runs times, false if the case isn't valid or its renders differ between runs
+static bool run_case( const REGRESSION_CASE& regression_case, int num_runs, CASE_RESULT& case_result )
+{
+    RENDER_SETTINGS settings;
+    WAV_FILE input;
+    if( !parse_case_options( regression_case.m_options, settings ) || !make_input( regression_case.m_input, input ) )
+    {
+        printf( "%s: invalid case\n", regression_case.m_name );
+        return false;
+    }
+
+    RENDER_RESULT warm_up;
+    render( input, settings, warm_up );
+
+    case_result.m_options           = regression_case.m_options;
+    case_result.m_head_outputs      = warm_up.m_head_outputs;
+    case_result.m_num_blocks        = warm_up.m_num_blocks;
+
+    std::vector< int32_t > fastest_block_ns( warm_up.m_num_blocks, INT32_MAX );
+    for( int r = 0; r < num_runs; ++r )
+    {
+        RENDER_RESULT result;
+        render( input, settings, result );
+
+        for( size_t h = 0; h < result.m_head_outputs.size(); ++h )
+        {
+            if( result.m_head_outputs[h].m_samples != case_result.m_head_outputs[h].m_samples )
+            {
+                printf( "%s: head %d rendered differently on run %d\n", regression_case.m_name, static_cast<int>( h ), r + 1 );
+                return false;
+            }
+        }
+
+        for( int b = 0; b < result.m_num_blocks; ++b )
+        {
+            fastest_block_ns[b]     = min_val( fastest_block_ns[b], result.m_block_times_ns[b] );
+        }
+    }
+
+    case_result.m_median_block_ns   = median( fastest_block_ns );
+    case_result.m_worst_block_ns    = *std::max_element( fastest_block_ns.begin(), fastest_block_ns.end() );
+    return true;
+}
+
+static bool write_renders( const std::string& dir, const std::string& case_name, const CASE_RESULT& case_result )
+{
+    bool success = true;
+    for( size_t h = 0; h < case_result.m_head_outputs.size(); ++h )
+    {
+        success &= write_wav_file( head_filename( dir, case_name, static_cast<int>( h ) ).c_str(), case_result.m_head_outputs[h] );
+    }
+    return success;
+}
+
+static double to_db( double ratio )
+{
+    return ratio > 0.0 ? 10.0 * log10( ratio ) : -999.0;
+}
+
+// false if the renders don't line up (different heads, channels or lengths)
+static bool compare( const CASE_RESULT& reference, const CASE_RESULT& render, DIFFERENCE& difference )
+{
+    if( reference.m_head_outputs.size() != render.m_head_outputs.size() )
+    {
+        return false;
+    }
+
+    for( size_t h = 0; h < render.m_head_outputs.size(); ++h )
+    {
+        const WAV_FILE& reference_head  = reference.m_head_outputs[h];
+        const WAV_FILE& render_head     = render.m_head_outputs[h];
+        if( reference_head.m_num_channels != render_head.m_num_channels || reference_head.m_samples.size() != render_head.m_samples.size() )
+        {
+            return false;
+        }
+
+        double reference_energy         = 0.0;
+        double render_energy            = 0.0;
+        double difference_energy        = 0.0;
+        for( size_t x = 0; x < render_head.m_samples.size(); ++x )
+        {
+            const double reference_sample   = reference_head.m_samples[x];
+            const double render_sample      = render_head.m_samples[x];
+            const int sample_difference     = abs( render_head.m_samples[x] - reference_head.m_samples[x] );
+
+            reference_energy            += reference_sample * reference_sample;
+            render_energy               += render_sample * render_sample;
+            difference_energy           += static_cast<double>( sample_difference ) * sample_difference;
+            difference.m_max_difference = max_val( difference.m_max_difference, sample_difference );
+        }
+
+        if( difference_energy == 0.0 )
+        {
+            continue;
+        }
+
+        // a silent reference that now makes a sound is as different as it can be
+        difference.m_identical          = false;
+        difference.m_error_db           = max_val( difference.m_error_db, reference_energy > 0.0 ? to_db( difference_energy / reference_energy ) : 0.0 );
+        difference.m_level_db           = max_val( difference.m_level_db, fabs( to_db( render_energy ) - to_db( reference_energy ) ) );
+    }
+
+    return true;
+}
+
+static double growth_percent( int64_t reference_ns, int64_t render_ns )
+{
+    return reference_ns > 0 ? ( 100.0 * ( render_ns - reference_ns ) ) / reference_ns : 0.0;
+}
+
+////////////////////////////////////
+
+static const char* REFERENCE_FILENAME = "reference.tsv";
+
+static bool write_reference( const std::string& dir, const std::vector< CASE_RESULT >& case_results )
+{
+    const std::string filename  = dir + "/" + REFERENCE_FILENAME;
+    FILE* file                  = fopen( filename.c_str(), "w" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    fprintf( file, "case\theads\tblocks\tmedian_block_ns\tworst_block_ns\toptions\n" );
+    for( int c = 0; c < NUM_REGRESSION_CASES; ++c )
+    {
+        const CASE_RESULT& case_result = case_results[c];
+        fprintf( file, "%s\t%d\t%d\t%lld\t%lld\t%s\n", REGRESSION_CASES[c].m_name, static_cast<int>( case_result.m_head_outputs.size() ),
+                 case_result.m_num_blocks, static_cast<long long>( case_result.m_median_block_ns ),
+                 static_cast<long long>( case_result.m_worst_block_ns ), case_result.m_options.c_str() );
+    }
+
+    return fclose( file ) == 0;
+}
+
+// the cases recorded, by name, without their renders
+static bool read_reference( const std::string& dir, std::map< std::string, CASE_RESULT >& references, std::map< std::string, int >& num_heads )
+{
+    const std::string filename  = dir + "/" + REFERENCE_FILENAME;
+    FILE* file                  = fopen( filename.c_str(), "r" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    char line_buffer[1024];
+    bool header                 = true;
+    while( fgets( line_buffer, sizeof(line_buffer), file ) != nullptr )
+    {
+        if( header )
+        {
+            header              = false;
+            continue;
+        }
+
+        std::string line( line_buffer );
+        line                    = line.substr( 0, line.find_last_not_of( "\r\n" ) + 1 );
+
+        std::vector< std::string > fields;
+        std::istringstream stream( line );
+        for( std::string field; std::getline( stream, field, '\t' ); )
+        {
+            fields.push_back( field );
+        }
+
+        if( fields.size() != 6 )
+        {
+            fclose( file );
+            return false;
+        }
+
+        CASE_RESULT& reference          = references[ fields[0] ];
+        num_heads[ fields[0] ]          = atoi( fields[1].c_str() );
+        reference.m_num_blocks          = atoi( fields[2].c_str() );
+        reference.m_median_block_ns     = atoll( fields[3].c_str() );
+        reference.m_worst_block_ns      = atoll( fields[4].c_str() );
+        reference.m_options             = fields[5];
+    }
+
+    fclose( file );
+    return !references.empty();
+}
+
+////////////////////////////////////
+
+static int record( const std::string& dir, const REGRESSION_OPTIONS& options )
+{
+    if( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST )
+    {
+        printf( "Unable to create %s\n", dir.c_str() );
+        return 1;
+    }
+
+    printf( "%-16s %7s %12s %12s  %s\n", "case", "blocks", "median(us)", "worst(us)", "options" );
+
+    std::vector< CASE_RESULT > case_results( NUM_REGRESSION_CASES );
+    for( int c = 0; c < NUM_REGRESSION_CASES; ++c )
+    {
+        const REGRESSION_CASE& regression_case = REGRESSION_CASES[c];
+        CASE_RESULT& case_result        = case_results[c];
+        if( !run_case( regression_case, options.m_num_runs, case_result ) )
+        {
+            return 1;
+        }
+
+        if( !write_renders( dir, regression_case.m_name, case_result ) )
+        {
+            printf( "Unable to write the renders of %s to %s\n", regression_case.m_name, dir.c_str() );
+            return 1;
+        }
+
+        printf( "%-16s %7d %12.2f %12.2f  %s\n", regression_case.m_name, case_result.m_num_blocks, case_result.m_median_block_ns / 1e3,
+                case_result.m_worst_block_ns / 1e3, regression_case.m_options );
+    }
+
+    if( !write_reference( dir, case_results ) )
+    {
+        printf( "Unable to write %s/%s\n", dir.c_str(), REFERENCE_FILENAME );
+        return 1;
+    }
+
+    printf( "\nrecorded %d cases in %s\n", NUM_REGRESSION_CASES, dir.c_str() );
+    return 0;
+}
+
+static int check( const std::string& dir, const REGRESSION_OPTIONS& options )
+{
+    std::map< std::string, CASE_RESULT > references;
+    std::map< std::string, int > num_heads;
+    if( !read_reference( dir, references, num_heads ) )
+    {
+        printf( "Unable to read %s/%s, record a reference first\n", dir.c_str(), REFERENCE_FILENAME );
+        return 1;
+    }
+
+    if( !options.m_failed_dir.empty() && mkdir( options.m_failed_dir.c_str(), 0755 ) != 0 && errno != EEXIST )
+    {
+        printf( "Unable to create %s\n", options.m_failed_dir.c_str() );
+        return 1;
+    }
+
+    printf( "%-16s %-10s %6s %9s %9s %20s %20s  %s\n", "case", "sound", "diff", "error dB", "level dB", "median(us)", "worst(us)", "result" );
+
+    int num_failed = 0;
+    for( int c = 0; c < NUM_REGRESSION_CASES; ++c )
+    {
+        const REGRESSION_CASE& regression_case = REGRESSION_CASES[c];
+        const auto found                = references.find( regression_case.m_name );
+        if( found == references.end() || found->second.m_options != regression_case.m_options )
+        {
+            printf( "%-16s %s, record the reference again\n", regression_case.m_name, found == references.end() ? "not in the reference" : "options changed since recorded" );
+            ++num_failed;
+            continue;
+        }
+
+        CASE_RESULT& reference          = found->second;
+        for( int h = 0; h < num_heads[ regression_case.m_name ]; ++h )
+        {
+            WAV_FILE head_output;
+            if( !read_wav_file( head_filename( dir, regression_case.m_name, h ).c_str(), head_output ) )
+            {
+                printf( "Unable to read %s\n", head_filename( dir, regression_case.m_name, h ).c_str() );
+                return 1;
+            }
+            reference.m_head_outputs.push_back( head_output );
+        }
+
+        CASE_RESULT case_result;
+        if( !run_case( regression_case, options.m_num_runs, case_result ) )
+        {
+            ++num_failed;
+            continue;
+        }
+
+        DIFFERENCE difference;
+        const bool comparable           = compare( reference, case_result, difference );
+        const bool sound_passed         = comparable && difference.m_max_difference <= options.m_max_difference &&
+                                          difference.m_error_db <= options.m_error_db && difference.m_level_db <= options.m_level_db;
+
+        const double median_growth      = growth_percent( reference.m_median_block_ns, case_result.m_median_block_ns );
+        const double worst_growth       = growth_percent( reference.m_worst_block_ns, case_result.m_worst_block_ns );
+        const bool median_passed        = !options.m_check_timing || median_growth <= options.m_median_percent;
+        const bool worst_passed         = !options.m_check_timing || worst_growth <= options.m_worst_percent;
+
+        const char* sound               = !comparable ? "MISMATCHED" : difference.m_identical ? "identical" : sound_passed ? "close" : "CHANGED";
+        std::string result              = sound_passed ? "" : "SOUND ";
+        result                          += median_passed ? "" : "MEDIAN ";
+        result                          += worst_passed ? "" : "WORST ";
+
+        char median_text[32];
+        char worst_text[32];
+        snprintf( median_text, sizeof(median_text), "%.2f %+.0f%%", case_result.m_median_block_ns / 1e3, median_growth );
+        snprintf( worst_text, sizeof(worst_text), "%.2f %+.0f%%", case_result.m_worst_block_ns / 1e3, worst_growth );
+
+        printf( "%-16s %-10s %6d %9.1f %9.2f %20s %20s  %s\n", regression_case.m_name, sound, difference.m_max_difference,
+                difference.m_error_db, difference.m_level_db, median_text, worst_text, result.empty() ? "pass" : ( "FAIL " + result ).c_str() );
+
+        if( !result.empty() )
+        {
+            ++num_failed;
+            if( !options.m_failed_dir.empty() && !write_renders( options.m_failed_dir, regression_case.m_name, case_result ) )
+            {
+                printf( "Unable to write the renders of %s to %s\n", regression_case.m_name, options.m_failed_dir.c_str() );
+            }
+        }
+    }
+
+    if( num_failed > 0 )
+    {
+        printf( "\n%d of %d cases FAILED\n", num_failed, NUM_REGRESSION_CASES );
+        return 1;
+    }
+
+    printf( "\nall %d cases passed\n", NUM_REGRESSION_CASES );
+    return 0;
+}
+
+////////////////////////////////////
+
+int main( int argc, char** argv )
+{
+    REGRESSION_OPTIONS options;
+
+    int a = 1;
+    for( ; a < argc && argv[a][0] == '-'; ++a )
+    {
+        const std::string option( argv[a] );
+        const bool has_value        = a + 1 < argc;
+        if( option == "-T" )
+        {
+            options.m_check_timing  = true;
+        }
+        else if( option == "-R" && has_value )
+        {
+            options.m_num_runs      = max_val( atoi( argv[++a] ), 1 );
+        }
+        else if( option == "-M" && has_value )
+        {
+            options.m_median_percent = atof( argv[++a] );
+        }
+        else if( option == "-W" && has_value )
+        {
+            options.m_worst_percent = atof( argv[++a] );
+        }
+        else if( option == "-d" && has_value )
+        {
+            options.m_max_difference = atoi( argv[++a] );
+        }
+        else if( option == "-E" && has_value )
+        {
+            options.m_error_db      = atof( argv[++a] );
+        }
+        else if( option == "-L" && has_value )
+        {
+            options.m_level_db      = atof( argv[++a] );
+        }
+        else if( option == "-o" && has_value )
+        {
+            options.m_failed_dir    = argv[++a];
+        }
+        else
+        {
+            a                       = argc;
+        }
+    }
+
+    if( argc - a != 1 && argc - a != 2 )
+    {
+        print_usage();
+        return 1;
+    }
+
+    const std::string mode( argv[a] );
+    const std::string dir( argc - a == 2 ? argv[a + 1] : DEFAULT_REFERENCE_DIR );
+    if( mode == "record" )
+    {
+        return record( dir, options );
+    }
+    else if( mode == "check" )
+    {
+        return check( dir, options );
+    }
+
+    print_usage();
+    return 1;
+}
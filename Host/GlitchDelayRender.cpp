@@ -0,0 +1,118 @@
+//
+//  GlitchDelayRender.cpp
+//
+//  Host (Linux) build of GLITCH_DELAY_EFFECT. Streams a 16-bit WAV file through update() one block at a time,
+//  writes each play head and a mix of all heads, then reports the cost of update().
+//
+//  build:  g++ -O2 -std=c++11 Host/GlitchDelayRender.cpp -o glitch_delay_render
+//  usage:  glitch_delay_render input.wav output_name [options]
+//
+
+#define TARGET_HOST
+
+#include <string>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+#include "ProfileDump.h"
+#include "RenderJob.h"
+
+static void print_usage()
+{
+    printf( "usage: glitch_delay_render input.wav output_name [options]\n" );
+    print_render_options();
+    printf( "writes output_name_head<n>.wav for each play head and output_name_mix.wav, stereo with -m 2\n" );
+}
+
+static bool parse_settings( int argc, char** argv, RENDER_SETTINGS& settings )
+{
+    for( int a = 3; a < argc; a += 2 )
+    {
+        if( a + 1 >= argc || !parse_render_option( argv[a], argv[a + 1], settings ) )
+        {
+            return false;
+        }
+    }
+
+    return check_render_settings( settings );
+}
+
+int main( int argc, char** argv )
+{
+    RENDER_SETTINGS settings;
+
+    if( argc < 3 || !parse_settings( argc, argv, settings ) )
+    {
+        print_usage();
+        return 1;
+    }
+
+    WAV_FILE input;
+    if( !read_wav_file( argv[1], input ) )
+    {
+        printf( "Unable to read %s (16-bit PCM WAV only)\n", argv[1] );
+        return 1;
+    }
+
+    const std::string output_name( argv[2] );
+
+    RENDER_RESULT result;
+    render( input, settings, result );
+
+    bool write_success = true;
+    for( size_t h = 0; h < result.m_head_outputs.size(); ++h )
+    {
+        const std::string filename = output_name + "_head" + std::to_string( h ) + ".wav";
+        write_success             &= write_wav_file( filename.c_str(), result.m_head_outputs[h] );
+    }
+    write_success                 &= write_wav_file( ( output_name + "_mix.wav" ).c_str(), result.m_mix_output );
+
+    if( !write_success )
+    {
+        printf( "Unable to write output files\n" );
+        return 1;
+    }
+
+    const int block_samples       = settings.m_engine_config.m_max_block_samples;
+    const double total_time_s     = result.m_total_time_ns / 1e9;
+    const double block_budget_ns  = ( block_samples * 1e9 ) / settings.m_engine_config.m_sample_rate;
+
+    printf( "blocks:            %d (%d samples, %d per block at %.0f Hz)\n", result.m_num_blocks, result.m_num_samples, block_samples, static_cast<double>( settings.m_engine_config.m_sample_rate ) );
+    printf( "ns/sample:         %.2f\n", static_cast<double>( result.m_total_time_ns ) / result.m_num_samples );
+    printf( "blocks/sec:        %.0f (%.1fx real-time)\n", result.m_num_blocks / total_time_s, ( result.m_num_blocks / total_time_s ) * block_budget_ns / 1e9 );
+    printf( "worst block:       %.2f us (block %d, %.1f%% of block time)\n", result.m_worst_block_time_ns / 1e3, result.m_worst_block, ( 100.0 * result.m_worst_block_time_ns ) / block_budget_ns );
+
+    if( settings.m_external_kb > 0 )
+    {
+        const uint32_t accesses   = result.m_cache_hits + result.m_cache_late + result.m_cache_misses;
+        printf( "storage:           %d KB external, %d us + %.0f MB/s, %d x %d byte cache blocks\n", settings.m_external_kb,
+                static_cast<int>( settings.m_latency_us ), static_cast<double>( settings.m_bandwidth ), settings.m_cache_slots, settings.m_cache_block_bytes );
+        printf( "cache:             %.2f%% hits, %u late, %u misses, %u prefetches, %u write backs\n",
+                accesses > 0 ? ( 100.0 * result.m_cache_hits ) / accesses : 0.0, result.m_cache_late, result.m_cache_misses,
+                result.m_cache_prefetches, result.m_cache_write_backs );
+        printf( "stalls:            %u, %.1f us in total (%.2f us per block), memory %.1f%% busy\n", result.m_storage_stalls,
+                result.m_stall_us, result.m_stall_us / result.m_num_blocks, 100.0 * result.m_memory_busy );
+    }
+
+    PROFILE_DUMP profile;
+    if( read_profile_dump( result.m_profile_data, profile ) )
+    {
+        printf( "\n" );
+        print_profile_dump( profile );
+    }
+
+    if( !settings.m_profile_filename.empty() )
+    {
+        FILE* file = fopen( settings.m_profile_filename.c_str(), "wb" );
+        if( file == nullptr || fwrite( result.m_profile_data.data(), 1, result.m_profile_data.size(), file ) != result.m_profile_data.size() )
+        {
+            printf( "Unable to write %s\n", settings.m_profile_filename.c_str() );
+        }
+        if( file != nullptr )
+        {
+            fclose( file );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,411 @@
+//
+//  GlitchDelaySnapshot.cpp
+//
+//  Saves a frozen delay buffer through BUFFER_SNAPSHOT, recalls it into a second effect running other audio at another
+//  bit depth, and checks the recalled buffer is bit for bit the saved one, for each bit depth, mono and stereo, and with
+//  the buffer in cached external memory. Audio blocks run between the control ticks as they would on the Teensy. Then
+//  checks that a save fails if the buffer unfreezes, and a recall fails on a corrupt, short or mismatched file.
+//
+//  build:  g++ -O2 -std=c++11 Host/GlitchDelaySnapshot.cpp -o glitch_delay_snapshot
+//  usage:  glitch_delay_snapshot [snapshot file]
+//
+
+#define TARGET_HOST
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../GlitchDelayEffect.ino"
+#include "LatencyDelayMemory.h"
+#include "StdioSnapshotFile.h"
+
+static const double         CONTROL_TICK_US     = 5000.0;   // CONTROL_RATE_HZ in GlitchDelayV2.ino
+static const int            EXTERNAL_SIZE       = 1536 * 512;
+static const int            CACHE_BLOCK_SIZE    = 1536;
+static const int            CACHE_SLOTS         = 32;
+
+////////////////////////////////////
+
+// an effect, its storage, and the clock running its audio blocks between control ticks
+class RIG
+{
+    std::unique_ptr< GLITCH_DELAY_EFFECT >      m_effect;
+    std::unique_ptr< INTERNAL_DELAY_STORAGE >   m_internal_storage;
+    std::unique_ptr< LATENCY_DELAY_MEMORY >     m_memory;
+    std::vector< uint8_t >                      m_cache;
+    std::unique_ptr< CACHED_DELAY_STORAGE >     m_cached_storage;
+
+    int                     m_num_channels;
+    float                   m_frequency;
+    uint32_t                m_random;
+    int64_t                 m_sample;
+    double                  m_time_us;
+    double                  m_next_tick_us;
+
+    double                  m_update_ns;
+    int                     m_num_updates;
+    double                  m_max_update_ns;
+
+    void                    run_block()
+    {
+        int16_t block[MAX_DELAY_CHANNELS][AUDIO_BLOCK_SAMPLES];
+        for( int s = 0; s < AUDIO_BLOCK_SAMPLES; ++s, ++m_sample )
+        {
+            m_random        = m_random * 1664525 + 1013904223;
+            const float t   = m_sample / AUDIO_SAMPLE_RATE;
+            const float x   = ( 0.5f * sinf( 2.0f * 3.14159265f * m_frequency * t ) ) + ( ( static_cast<int32_t>( m_random ) >> 16 ) / 65536.0f );
+            for( int c = 0; c < m_num_channels; ++c )
+            {
+                block[c][s] = static_cast<int16_t>( x * ( c == 0 ? 20000.0f : -15000.0f ) );
+            }
+        }
+        for( int c = 0; c < m_num_channels; ++c )
+        {
+            m_effect->set_input_block( c, block[c] );
+        }
+
+        const auto start    = std::chrono::steady_clock::now();
+        m_effect->update();
+        const double ns     = static_cast<double>( std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count() );
+
+        m_update_ns         += ns;
+        m_max_update_ns     = max_val( m_max_update_ns, ns );
+        ++m_num_updates;
+
+        const double block_us = ( AUDIO_BLOCK_SAMPLES * 1e6 ) / AUDIO_SAMPLE_RATE;
+        m_time_us           += block_us;
+        if( m_memory != nullptr )
+        {
+            m_memory->advance( block_us );
+        }
+    }
+
+public:
+
+    RIG( int num_channels, bool external, int bit_depth, float frequency ) :
+        m_effect( new GLITCH_DELAY_EFFECT( ENGINE_CONFIG( AUDIO_SAMPLE_RATE, AUDIO_BLOCK_SAMPLES, num_channels ) ) ),
+        m_internal_storage(),
+        m_memory(),
+        m_cache(),
+        m_cached_storage(),
+        m_num_channels( num_channels ),
+        m_frequency( frequency ),
+        m_random( static_cast<uint32_t>( frequency ) ),
+        m_sample( 0 ),
+        m_time_us( 0.0 ),
+        m_next_tick_us( 0.0 ),
+        m_update_ns( 0.0 ),
+        m_num_updates( 0 ),
+        m_max_update_ns( 0.0 )
+    {
+        if( external )
+        {
+            m_memory.reset( new LATENCY_DELAY_MEMORY( EXTERNAL_SIZE, 20.0f, 20.0f ) );
+            m_cache.resize( CACHE_SLOTS * CACHE_BLOCK_SIZE );
+            m_cached_storage.reset( new CACHED_DELAY_STORAGE( *m_memory, m_cache.data(), CACHE_BLOCK_SIZE, CACHE_SLOTS ) );
+            m_effect->set_delay_storage( m_cached_storage.get() );
+        }
+        else
+        {
+            m_internal_storage.reset( new INTERNAL_DELAY_STORAGE() );
+            m_effect->set_delay_storage( m_internal_storage.get() );
+        }
+
+        m_effect->set_bit_depth( bit_depth );
+        m_effect->set_loop_moving( false );
+        for( int h = 0; h < m_effect->num_play_heads(); ++h )
+        {
+            m_effect->set_loop_size( h, 0.3f );
+            m_effect->set_jitter( h, 0.2f );
+        }
+        m_effect->publish_parameters();
+    }
+
+    GLITCH_DELAY_EFFECT&    effect()                    { return *m_effect; }
+    INTERNAL_DELAY_STORAGE* internal_storage()          { return m_internal_storage.get(); }
+    uint32_t                num_stalls() const          { return m_cached_storage != nullptr ? m_cached_storage->num_stalls() : 0; }
+
+    // run the audio up to the next control tick
+    void                    tick()
+    {
+        m_next_tick_us      += CONTROL_TICK_US;
+        while( m_time_us < m_next_tick_us )
+        {
+            run_block();
+        }
+    }
+
+    void                    run( float seconds )
+    {
+        for( int t = 0; t < static_cast<int>( ( seconds * 1e6f ) / CONTROL_TICK_US ); ++t )
+        {
+            tick();
+        }
+    }
+
+    void                    freeze( bool active )
+    {
+        m_effect->set_freeze_active( active );
+        m_effect->publish_parameters();
+    }
+
+    void                    reset_timing()
+    {
+        m_update_ns         = 0.0;
+        m_num_updates       = 0;
+        m_max_update_ns     = 0.0;
+    }
+
+    double                  mean_update_ns() const      { return m_num_updates > 0 ? m_update_ns / m_num_updates : 0.0; }
+    double                  max_update_ns() const       { return m_max_update_ns; }
+
+    // the buffer's state, as a save would see it
+    BUFFER_TRANSFER         info()
+    {
+        BUFFER_TRANSFER transfer;
+        m_effect->request_buffer_transfer( transfer );
+        while( !m_effect->collect_buffer_transfer( transfer ) )
+        {
+            run_block();
+        }
+        return transfer;
+    }
+};
+
+////////////////////////////////////
+
+// runs a save or recall to the end, on_tick is called before each control tick
+static BUFFER_SNAPSHOT::STATE run_snapshot( RIG& rig, const std::string& filename, bool save, uint32_t& num_ticks,
+                                            const std::function< void( int ) >& on_tick = nullptr )
+{
+    FILE* file = fopen( filename.c_str(), save ? "wb" : "rb" );
+    if( file == nullptr )
+    {
+        printf( "Unable to open %s\n", filename.c_str() );
+        return BUFFER_SNAPSHOT::FAILED;
+    }
+
+    STDIO_SNAPSHOT_FILE snapshot_file( file );
+    BUFFER_SNAPSHOT snapshot( rig.effect() );
+    if( save ? snapshot.start_save( snapshot_file ) : snapshot.start_recall( snapshot_file ) )
+    {
+        for( int t = 0; snapshot.busy(); ++t )
+        {
+            if( on_tick )
+            {
+                on_tick( t );
+            }
+            rig.tick();
+            snapshot.update();
+        }
+    }
+
+    fclose( file );
+    num_ticks = snapshot.num_ticks();
+    return snapshot.state();
+}
+
+static bool read_file( const std::string& filename, std::vector< uint8_t >& data )
+{
+    FILE* file = fopen( filename.c_str(), "rb" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    uint8_t chunk[4096];
+    data.clear();
+    for( size_t size = fread( chunk, 1, sizeof(chunk), file ); size > 0; size = fread( chunk, 1, sizeof(chunk), file ) )
+    {
+        data.insert( data.end(), chunk, chunk + size );
+    }
+    fclose( file );
+    return true;
+}
+
+static bool write_file( const std::string& filename, const std::vector< uint8_t >& data )
+{
+    FILE* file = fopen( filename.c_str(), "wb" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+    const bool written = fwrite( data.data(), 1, data.size(), file ) == data.size();
+    fclose( file );
+    return written;
+}
+
+static const char* state_name( BUFFER_SNAPSHOT::STATE state )
+{
+    return state == BUFFER_SNAPSHOT::DONE ? "done" : state == BUFFER_SNAPSHOT::FAILED ? "failed" : "busy";
+}
+
+////////////////////////////////////
+
+// save a frozen buffer, recall it into an effect that was playing other audio at another bit depth, and compare
+static bool check_round_trip( const std::string& filename, int bit_depth, int num_channels, bool external )
+{
+    const int other_bit_depth = bit_depth == 16 ? 8 : 16;
+
+    RIG source( num_channels, external, bit_depth, 220.0f );
+    source.run( 2.0f );
+    source.freeze( true );
+    source.run( 0.5f );
+
+    source.reset_timing();
+    source.run( 0.5f );
+    const double frozen_mean_ns = source.mean_update_ns();
+    const double frozen_max_ns  = source.max_update_ns();
+
+    source.reset_timing();
+    const uint32_t frozen_stalls = source.num_stalls();
+    uint32_t save_ticks         = 0;
+    const BUFFER_SNAPSHOT::STATE save_state = run_snapshot( source, filename, true, save_ticks );
+    const double save_mean_ns   = source.mean_update_ns();
+    const double save_max_ns    = source.max_update_ns();
+    const uint32_t save_stalls  = source.num_stalls() - frozen_stalls;
+
+    RIG dest( num_channels, external, other_bit_depth, 330.0f );
+    dest.run( 1.0f );
+
+    uint32_t recall_ticks       = 0;
+    const uint32_t playing_stalls = dest.num_stalls();
+    const BUFFER_SNAPSHOT::STATE recall_state = run_snapshot( dest, filename, false, recall_ticks );
+    const uint32_t recall_stalls = dest.num_stalls() - playing_stalls;
+
+    // the recalled buffer stays frozen while the heads play it
+    dest.run( 0.5f );
+    source.run( 0.5f );
+
+    const BUFFER_TRANSFER source_info = source.info();
+    const BUFFER_TRANSFER dest_info = dest.info();
+    bool match                  = save_state == BUFFER_SNAPSHOT::DONE && recall_state == BUFFER_SNAPSHOT::DONE && dest_info.m_frozen &&
+                                  dest_info.m_sample_size_in_bits == source_info.m_sample_size_in_bits && dest_info.m_write_head == source_info.m_write_head;
+
+    // straight from the storage, then through a second save
+    if( !external )
+    {
+        match                   = match && memcmp( source.internal_storage()->read_block( 0 ), dest.internal_storage()->read_block( 0 ), DELAY_BUFFER_SIZE_IN_BYTES ) == 0;
+    }
+
+    const std::string resaved_filename = filename + ".resaved";
+    uint32_t resave_ticks       = 0;
+    std::vector< uint8_t > saved;
+    std::vector< uint8_t > resaved;
+    match                       = match && run_snapshot( dest, resaved_filename, true, resave_ticks ) == BUFFER_SNAPSHOT::DONE &&
+                                  read_file( filename, saved ) && read_file( resaved_filename, resaved ) && saved == resaved;
+    remove( resaved_filename.c_str() );
+
+    printf( "%2d-bit %-6s %-8s  save %-6s %4u ticks %3u stalls  recall %-6s %4u ticks %3u stalls  %6zu bytes  update() mean %5.0f -> %5.0f ns  max %6.0f -> %6.0f ns  %s\n",
+            bit_depth, num_channels == 2 ? "stereo" : "mono", external ? "external" : "internal", state_name( save_state ), save_ticks, save_stalls,
+            state_name( recall_state ), recall_ticks, recall_stalls, saved.size(), frozen_mean_ns, save_mean_ns, frozen_max_ns, save_max_ns,
+            match ? "bit-exact" : "DIFFERS" );
+
+    return match;
+}
+
+static bool check_failures( const std::string& filename )
+{
+    bool success                = true;
+    uint32_t ticks              = 0;
+
+    auto report = [&]( const char* name, bool passed )
+    {
+        printf( "%-48s %s\n", name, passed ? "ok" : "WRONG" );
+        success                 = success && passed;
+    };
+
+    // saving needs a frozen buffer, from start to end
+    {
+        RIG rig( 1, false, 12, 220.0f );
+        rig.run( 1.0f );
+        report( "save while not frozen fails", run_snapshot( rig, filename, true, ticks ) == BUFFER_SNAPSHOT::FAILED );
+
+        rig.freeze( true );
+        rig.run( 0.5f );
+        report( "save unfrozen part way fails", run_snapshot( rig, filename, true, ticks, [&]( int t ) { if( t == 20 ) { rig.freeze( false ); } } ) == BUFFER_SNAPSHOT::FAILED );
+
+        // a chunk asked for across an unfreeze and refreeze would be of other audio
+        rig.freeze( true );
+        rig.run( 0.5f );
+        BUFFER_TRANSFER transfer = rig.info();
+        rig.freeze( false );
+        rig.run( 0.5f );
+        rig.freeze( true );
+        rig.run( 0.5f );
+        transfer.m_request      = BUFFER_TRANSFER::READ_CHUNK;
+        transfer.m_size         = BUFFER_TRANSFER::MAX_CHUNK_SIZE_IN_BYTES;
+        rig.effect().request_buffer_transfer( transfer );
+        rig.tick();
+        report( "chunk read across a refreeze fails", rig.effect().collect_buffer_transfer( transfer ) && !transfer.m_success && rig.info().m_frozen );
+
+        report( "save", run_snapshot( rig, filename, true, ticks ) == BUFFER_SNAPSHOT::DONE );
+    }
+
+    std::vector< uint8_t > saved;
+    read_file( filename, saved );
+    const std::string bad_filename = filename + ".bad";
+
+    // a bad file is rejected, before the buffer changes when the header is wrong
+    auto recall_fails = [&]( const std::vector< uint8_t >& data, int num_channels, bool buffer_untouched )
+    {
+        write_file( bad_filename, data );
+
+        RIG rig( num_channels, false, 16, 330.0f );
+        rig.run( 0.5f );
+        const BUFFER_TRANSFER before = rig.info();
+        const bool failed       = run_snapshot( rig, bad_filename, false, ticks ) == BUFFER_SNAPSHOT::FAILED;
+        const BUFFER_TRANSFER after = rig.info();
+
+        return failed && ( !buffer_untouched || ( !after.m_frozen && after.m_sample_size_in_bits == before.m_sample_size_in_bits ) );
+    };
+
+    std::vector< uint8_t > corrupt = saved;
+    corrupt[ SNAPSHOT_HEADER_SIZE_IN_BYTES + ( corrupt.size() / 2 ) ] ^= 0x10;
+    report( "recall of a corrupt buffer fails", recall_fails( corrupt, 1, false ) );
+
+    std::vector< uint8_t > truncated( saved.begin(), saved.end() - 100 );
+    report( "recall of a short file fails", recall_fails( truncated, 1, false ) );
+
+    std::vector< uint8_t > bad_magic = saved;
+    bad_magic[0]                = 'X';
+    report( "recall of another file fails untouched", recall_fails( bad_magic, 1, true ) );
+
+    std::vector< uint8_t > bad_depth = saved;
+    bad_depth[6]                = 10;
+    report( "recall of an unknown bit depth fails untouched", recall_fails( bad_depth, 1, true ) );
+
+    report( "recall of mono into stereo fails untouched", recall_fails( saved, 2, true ) );
+
+    remove( bad_filename.c_str() );
+    return success;
+}
+
+int main( int argc, char** argv )
+{
+    const std::string filename = argc > 1 ? argv[1] : "glitch_delay_snapshot.bin";
+
+    printf( "%d byte chunks, a control tick every %.0f us, external memory %d KB behind %d x %d byte cache\n",
+            BUFFER_TRANSFER::MAX_CHUNK_SIZE_IN_BYTES, CONTROL_TICK_US, EXTERNAL_SIZE >> 10, CACHE_SLOTS, CACHE_BLOCK_SIZE );
+
+    bool success = true;
+    static const int BIT_DEPTHS[] = { 4, 8, 12, 16 };
+    for( int bit_depth : BIT_DEPTHS )
+    {
+        success = check_round_trip( filename, bit_depth, 1, false ) && success;
+    }
+    success = check_round_trip( filename, 12, 2, false ) && success;
+    success = check_round_trip( filename, 12, 1, true ) && success;
+    success = check_round_trip( filename, 16, 2, true ) && success;
+    success = check_round_trip( filename, 4, 2, true ) && success;
+
+    success = check_failures( filename ) && success;
+
+    remove( filename.c_str() );
+
+    printf( "%s\n", success ? "all passed" : "FAILED" );
+    return success ? 0 : 1;
+}
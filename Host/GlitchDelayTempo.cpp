@@ -0,0 +1,693 @@
+//
+//  GlitchDelayTempo.cpp
+//
+//  Runs sequences of tap and clock pulses through TEMPO_TRACKER (TempoTracker.h), and through the tap tempo it
+//  replaced, which saw taps at the control tick and averaged the last four intervals.
+//
+//  With no files, runs the built in sequences, which know where the beats really were: a drummer's taps, taps with
+//  strays and missed beats, a change of tempo, a long gap, and external clocks. Before each beat (half a beat ahead,
+//  with only the pulses up to then) each follower is asked when the next beat will be, and the error from the real beat
+//  and the error in tempo are reported. Fails if the tracker strays more than each sequence allows. Also checks that
+//  TEMPO_PULSE_QUEUES hands over every pulse in order from two interrupt threads, and that TAP_DEBOUNCE takes one
+//  press from each bouncing button press.
+//
+//  Recorded sequences are text files of one pulse per line, the time in microseconds and optionally "clock" (the
+//  default is a tap), # starts a comment. They have no real beats to compare with, so the tempo and beat each follower
+//  settles on is reported, with how much it wanders. -w writes the built in sequences in the same format.
+//
+//  build:  g++ -O2 -std=c++11 -pthread Host/GlitchDelayTempo.cpp -o glitch_delay_tempo
+//  usage:  glitch_delay_tempo [-c pulses_per_beat] [-w dir] [pulses.txt ...]
+//
+
+#define TARGET_HOST
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../TempoTracker.h"
+
+static const uint32_t   CONTROL_TICK_US         = 5000;         // CONTROL_RATE_HZ in GlitchDelayV2.ino
+static const int        SETTLE_BEATS            = 4;            // after a sequence starts or changes tempo, not scored
+
+struct PULSE
+{
+    uint32_t                m_time_us;
+    TEMPO_SOURCE            m_source;
+};
+
+struct SEQUENCE
+{
+    std::string             m_name;
+    std::vector< PULSE >    m_pulses;
+    std::vector< double >   m_beats_us;         // where the beats really were
+    std::vector< bool >     m_scored;           // for each beat
+    int                     m_clock_pulses_per_beat;
+    float                   m_max_phase_ms;     // mean error of the tracker's next beat
+    float                   m_max_tempo_pct;    // worst tempo error
+};
+
+////////////////////////////////////
+
+class TEST_RANDOM
+{
+    uint32_t                m_state;
+
+public:
+
+    explicit TEST_RANDOM( uint32_t seed ) :
+        m_state( seed )
+    {
+    }
+
+    // 0-1
+    double                  uniform()
+    {
+        m_state             = ( m_state * 1664525u ) + 1013904223u;
+        return ( m_state >> 8 ) / 16777216.0;
+    }
+
+    double                  gaussian( double deviation )
+    {
+        const double u1     = max_val( uniform(), 1e-9 );
+        const double u2     = uniform();
+        return deviation * sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 );
+    }
+};
+
+////////////////////////////////////
+
+// something that follows pulses and predicts the next beat
+class FOLLOWER
+{
+public:
+
+    virtual ~FOLLOWER() {}
+
+    virtual const char*     name() const = 0;
+    virtual void            add_pulse( const PULSE& pulse ) = 0;
+    virtual bool            valid() const = 0;
+    virtual double          period_us() const = 0;
+    virtual double          next_beat_us( uint32_t time_us ) = 0;
+};
+
+class TRACKER_FOLLOWER : public FOLLOWER
+{
+    TEMPO_TRACKER           m_tracker;
+
+public:
+
+    explicit TRACKER_FOLLOWER( int clock_pulses_per_beat )
+    {
+        TEMPO_SOURCE_CONFIG config  = TEMPO_TRACKER::default_config( TEMPO_SOURCE_CLOCK );
+        config.m_pulses_per_beat    = clock_pulses_per_beat;
+        m_tracker.set_source_config( TEMPO_SOURCE_CLOCK, config );
+    }
+
+    const char*             name() const override                   { return "tracker"; }
+    void                    add_pulse( const PULSE& pulse ) override { m_tracker.add_pulse( pulse.m_source, pulse.m_time_us ); }
+    bool                    valid() const override                  { return m_tracker.locked(); }
+    double                  period_us() const override              { return m_tracker.period_us(); }
+    double                  next_beat_us( uint32_t time_us ) override { return m_tracker.next_beat_us( time_us ); }
+
+    const TEMPO_TRACKER&    tracker() const                         { return m_tracker; }
+};
+
+// the tap tempo before TEMPO_TRACKER (TAP_BPM before it followed the tracker): taps seen at the next control tick in
+// whole ms, the average of the last four intervals, forgotten after a 5s gap, and beats every average from the last
+// tap. It had no clock input
+class LEGACY_FOLLOWER : public FOLLOWER
+{
+    static constexpr float  MAX_DURATION_MS = 5000.0f;
+
+    RUNNING_AVERAGE< float, 4 > m_average_times;
+    float                   m_prev_tap_time_ms;
+    float                   m_next_beat_time_ms;
+
+public:
+
+    LEGACY_FOLLOWER() :
+        m_average_times(),
+        m_prev_tap_time_ms( -1.0f ),
+        m_next_beat_time_ms( 0.0f )
+    {
+    }
+
+    const char*             name() const override                   { return "legacy"; }
+    bool                    valid() const override                  { return m_average_times.size() >= 2; }
+    double                  period_us() const override              { return m_average_times.average() * 1000.0; }
+
+    void                    add_pulse( const PULSE& pulse ) override
+    {
+        if( pulse.m_source != TEMPO_SOURCE_TAP )
+        {
+            return;
+        }
+
+        const uint32_t tick_us  = ( ( pulse.m_time_us + CONTROL_TICK_US - 1 ) / CONTROL_TICK_US ) * CONTROL_TICK_US;
+        const float time_ms     = static_cast<float>( tick_us / 1000 );
+        if( m_prev_tap_time_ms > 0.0f )
+        {
+            const float duration    = time_ms - m_prev_tap_time_ms;
+            if( duration > MAX_DURATION_MS )
+            {
+                m_average_times.reset();
+            }
+            else
+            {
+                m_average_times.add( duration );
+            }
+        }
+
+        m_prev_tap_time_ms      = time_ms;
+        if( valid() )
+        {
+            m_next_beat_time_ms = time_ms + m_average_times.average();
+        }
+    }
+
+    // the auto beats loop() would have sent up to time_us
+    double                  next_beat_us( uint32_t time_us ) override
+    {
+        const float time_ms     = time_us / 1000.0f;
+        while( valid() && m_next_beat_time_ms <= time_ms )
+        {
+            m_next_beat_time_ms += m_average_times.average();
+        }
+        return m_next_beat_time_ms * 1000.0;
+    }
+};
+
+////////////////////////////////////
+
+struct FOLLOW_RESULT
+{
+    int                     m_num_scored;
+    int                     m_num_invalid;      // scored beats with no tempo yet
+    double                  m_mean_phase_ms;
+    double                  m_max_phase_ms;
+    double                  m_mean_tempo_pct;
+    double                  m_max_tempo_pct;
+};
+
+// before each beat, with the pulses up to half a beat ahead of it, compare the follower's next beat and tempo to it
+static FOLLOW_RESULT follow_sequence( const SEQUENCE& sequence, FOLLOWER& follower )
+{
+    FOLLOW_RESULT result    = {};
+    size_t next_pulse       = 0;
+    double total_phase      = 0.0;
+    double total_tempo      = 0.0;
+    for( size_t b = 0; b + 1 < sequence.m_beats_us.size(); ++b )
+    {
+        const double beat_us    = sequence.m_beats_us[b];
+        const double period_us  = b > 0 ? beat_us - sequence.m_beats_us[b - 1] : sequence.m_beats_us[b + 1] - beat_us;
+        const uint32_t query_us = static_cast<uint32_t>( beat_us - ( period_us / 2 ) );
+        for( ; next_pulse < sequence.m_pulses.size() && sequence.m_pulses[next_pulse].m_time_us <= query_us; ++next_pulse )
+        {
+            follower.add_pulse( sequence.m_pulses[next_pulse] );
+        }
+
+        if( !sequence.m_scored[b] )
+        {
+            continue;
+        }
+
+        ++result.m_num_scored;
+        if( !follower.valid() )
+        {
+            ++result.m_num_invalid;
+            continue;
+        }
+
+        const double phase_ms   = fabs( follower.next_beat_us( query_us ) - beat_us ) / 1000.0;
+        const double tempo_pct  = fabs( follower.period_us() - period_us ) * 100.0 / period_us;
+        total_phase             += phase_ms;
+        total_tempo             += tempo_pct;
+        result.m_max_phase_ms   = max_val( result.m_max_phase_ms, phase_ms );
+        result.m_max_tempo_pct  = max_val( result.m_max_tempo_pct, tempo_pct );
+    }
+
+    const int num_valid     = result.m_num_scored - result.m_num_invalid;
+    result.m_mean_phase_ms  = num_valid > 0 ? total_phase / num_valid : 0.0;
+    result.m_mean_tempo_pct = num_valid > 0 ? total_tempo / num_valid : 0.0;
+    return result;
+}
+
+////////////////////////////////////
+
+// beats from start_us at bpm (ramping to end_bpm), the first SETTLE_BEATS not scored, returns the time after the last
+static double add_beats( SEQUENCE& sequence, double start_us, int num_beats, double bpm, double end_bpm )
+{
+    double beat_us          = start_us;
+    for( int b = 0; b < num_beats; ++b )
+    {
+        sequence.m_beats_us.push_back( beat_us );
+        sequence.m_scored.push_back( b >= SETTLE_BEATS );
+        const double ramp_bpm   = bpm + ( ( end_bpm - bpm ) * b ) / num_beats;
+        beat_us                 += 60000000.0 / ramp_bpm;
+    }
+    return beat_us;
+}
+
+// a pulse near each of beats first to last, deviation_us off, pulses_per_beat to a beat
+static void add_pulses( SEQUENCE& sequence, size_t first, size_t last, TEMPO_SOURCE source, int pulses_per_beat, double deviation_us, TEST_RANDOM& random )
+{
+    for( size_t b = first; b < last && b + 1 < sequence.m_beats_us.size(); ++b )
+    {
+        const double beat_us    = sequence.m_beats_us[b];
+        const double grid_us    = ( sequence.m_beats_us[b + 1] - beat_us ) / pulses_per_beat;
+        for( int p = 0; p < pulses_per_beat; ++p )
+        {
+            const PULSE pulse   = { static_cast<uint32_t>( llround( beat_us + ( p * grid_us ) + random.gaussian( deviation_us ) ) ), source };
+            sequence.m_pulses.push_back( pulse );
+        }
+    }
+}
+
+static void sort_pulses( SEQUENCE& sequence )
+{
+    std::stable_sort( sequence.m_pulses.begin(), sequence.m_pulses.end(), []( const PULSE& a, const PULSE& b ) { return a.m_time_us < b.m_time_us; } );
+}
+
+static std::vector< SEQUENCE > built_in_sequences()
+{
+    std::vector< SEQUENCE > sequences;
+    TEST_RANDOM random( 1234 );
+
+    const double start_us   = 1000000.0;
+    const double tap_deviation_us = 12000.0;    // a drummer tapping along
+
+    {
+        SEQUENCE sequence   = { "drummer", {}, {}, {}, 1, 8.0f, 3.0f };
+        add_beats( sequence, start_us, 64, 120.0, 120.0 );
+        add_pulses( sequence, 0, sequence.m_beats_us.size(), TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        sequences.push_back( sequence );
+    }
+
+    {
+        // a stray tap between beats every so often, a double tap, and missed beats
+        SEQUENCE sequence   = { "stray_taps", {}, {}, {}, 1, 10.0f, 3.0f };
+        add_beats( sequence, start_us, 64, 96.0, 96.0 );
+        add_pulses( sequence, 0, sequence.m_beats_us.size(), TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        std::vector< PULSE > pulses;
+        for( size_t p = 0; p < sequence.m_pulses.size(); ++p )
+        {
+            if( p > 8 && p % 11 == 0 )
+            {
+                continue;   // missed
+            }
+            pulses.push_back( sequence.m_pulses[p] );
+            if( p > 8 && p % 7 == 0 )
+            {
+                const PULSE stray   = { sequence.m_pulses[p].m_time_us + static_cast<uint32_t>( ( 0.35 + ( random.uniform() * 0.3 ) ) * 625000.0 ), TEMPO_SOURCE_TAP };
+                pulses.push_back( stray );
+            }
+            if( p == 20 )
+            {
+                const PULSE bounce  = { sequence.m_pulses[p].m_time_us + 40000, TEMPO_SOURCE_TAP };
+                pulses.push_back( bounce );
+            }
+        }
+        sequence.m_pulses   = pulses;
+        sort_pulses( sequence );
+        sequences.push_back( sequence );
+    }
+
+    {
+        SEQUENCE sequence   = { "tempo_change", {}, {}, {}, 1, 15.0f, 3.0f };     // the new tempo is set from three taps, jitter and all
+        const double change_us = add_beats( sequence, start_us, 24, 100.0, 100.0 );
+        add_beats( sequence, change_us, 40, 132.0, 132.0 );
+        add_pulses( sequence, 0, sequence.m_beats_us.size(), TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        sequences.push_back( sequence );
+    }
+
+    {
+        // tapping stops for 8s and starts again at the same tempo, the beats go on through the gap
+        SEQUENCE sequence   = { "gap", {}, {}, {}, 1, 8.0f, 3.0f };
+        add_beats( sequence, start_us, 56, 110.0, 110.0 );
+        add_pulses( sequence, 0, 16, TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        add_pulses( sequence, 31, sequence.m_beats_us.size(), TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        sequences.push_back( sequence );
+    }
+
+    {
+        // a clock at 4 pulses a beat drifting from 126 to 130bpm
+        SEQUENCE sequence   = { "clock", {}, {}, {}, 4, 1.0f, 0.5f };
+        add_beats( sequence, start_us, 96, 126.0, 130.0 );
+        add_pulses( sequence, 0, sequence.m_beats_us.size(), TEMPO_SOURCE_CLOCK, 4, 100.0, random );
+        sequences.push_back( sequence );
+    }
+
+    {
+        // a 24ppqn clock that drops out for a second
+        SEQUENCE sequence   = { "clock_24ppqn", {}, {}, {}, 24, 1.0f, 0.5f };
+        add_beats( sequence, start_us, 64, 140.0, 140.0 );
+        add_pulses( sequence, 0, 30, TEMPO_SOURCE_CLOCK, 24, 50.0, random );
+        add_pulses( sequence, 32, sequence.m_beats_us.size(), TEMPO_SOURCE_CLOCK, 24, 50.0, random );
+        sequences.push_back( sequence );
+    }
+
+    {
+        // taps set the tempo, then a clock at a new tempo takes over
+        SEQUENCE sequence   = { "taps_to_clock", {}, {}, {}, 1, 8.0f, 3.0f };
+        const double change_us = add_beats( sequence, start_us, 20, 90.0, 90.0 );
+        add_beats( sequence, change_us, 40, 120.0, 120.0 );
+        add_pulses( sequence, 0, 20, TEMPO_SOURCE_TAP, 1, tap_deviation_us, random );
+        add_pulses( sequence, 20, sequence.m_beats_us.size(), TEMPO_SOURCE_CLOCK, 1, 100.0, random );
+        sort_pulses( sequence );
+        sequences.push_back( sequence );
+    }
+
+    return sequences;
+}
+
+static bool run_built_in( const std::vector< SEQUENCE >& sequences )
+{
+    printf( "next beat error (ms) and tempo error (%%) over the scored beats\n" );
+    printf( "%-14s %-8s %6s %8s %10s %10s %10s %10s\n", "sequence", "follower", "beats", "no_tempo", "mean_ms", "max_ms", "mean_%", "max_%" );
+
+    bool success            = true;
+    for( const SEQUENCE& sequence : sequences )
+    {
+        TRACKER_FOLLOWER tracker( sequence.m_clock_pulses_per_beat );
+        LEGACY_FOLLOWER legacy;
+        FOLLOWER* followers[] = { &tracker, &legacy };
+        for( FOLLOWER* follower : followers )
+        {
+            const FOLLOW_RESULT result  = follow_sequence( sequence, *follower );
+            const bool failed           = follower == &tracker &&
+                                          ( result.m_num_invalid > 0 || result.m_mean_phase_ms > sequence.m_max_phase_ms || result.m_max_tempo_pct > sequence.m_max_tempo_pct );
+            success                     &= !failed;
+
+            printf( "%-14s %-8s %6d %8d %10.2f %10.2f %10.2f %10.2f %s\n", sequence.m_name.c_str(), follower->name(), result.m_num_scored, result.m_num_invalid,
+                    result.m_mean_phase_ms, result.m_max_phase_ms, result.m_mean_tempo_pct, result.m_max_tempo_pct, failed ? "FAILED" : "" );
+        }
+        printf( "%-14s %-8s %d pulses, %d outliers, %d locks\n", "", "", tracker.tracker().num_pulses(), tracker.tracker().num_outliers(), tracker.tracker().num_locks() );
+    }
+    return success;
+}
+
+////////////////////////////////////
+
+static bool write_sequence( const SEQUENCE& sequence, const std::string& path )
+{
+    FILE* file              = fopen( path.c_str(), "w" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    fprintf( file, "# %s, %d clock pulses per beat\n", sequence.m_name.c_str(), sequence.m_clock_pulses_per_beat );
+    for( const PULSE& pulse : sequence.m_pulses )
+    {
+        fprintf( file, "%u%s\n", pulse.m_time_us, pulse.m_source == TEMPO_SOURCE_CLOCK ? " clock" : "" );
+    }
+    fclose( file );
+    return true;
+}
+
+static bool read_sequence( const char* path, std::vector< PULSE >& pulses )
+{
+    FILE* file              = fopen( path, "r" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    char line[256];
+    while( fgets( line, sizeof(line), file ) != nullptr )
+    {
+        char* comment       = strchr( line, '#' );
+        if( comment != nullptr )
+        {
+            *comment        = '\0';
+        }
+
+        unsigned int time_us;
+        char source[32]     = "";
+        const int num_read  = sscanf( line, "%u %31s", &time_us, source );
+        if( num_read >= 1 )
+        {
+            const PULSE pulse   = { time_us, strcmp( source, "clock" ) == 0 ? TEMPO_SOURCE_CLOCK : TEMPO_SOURCE_TAP };
+            pulses.push_back( pulse );
+        }
+    }
+    fclose( file );
+
+    std::stable_sort( pulses.begin(), pulses.end(), []( const PULSE& a, const PULSE& b ) { return a.m_time_us < b.m_time_us; } );
+    return true;
+}
+
+// a recording has no real beats, so report where each follower settles and how far its beats wander from a steady
+// grid at its final tempo, over the second half of the pulses
+static void run_recorded( const char* path, const std::vector< PULSE >& pulses, int clock_pulses_per_beat )
+{
+    TRACKER_FOLLOWER tracker( clock_pulses_per_beat );
+    LEGACY_FOLLOWER legacy;
+    FOLLOWER* followers[] = { &tracker, &legacy };
+
+    printf( "%s: %d pulses\n", path, static_cast<int>( pulses.size() ) );
+    for( FOLLOWER* follower : followers )
+    {
+        std::vector< double > beats_us;
+        std::vector< double > periods_us;
+        for( size_t p = 0; p < pulses.size(); ++p )
+        {
+            follower->add_pulse( pulses[p] );
+            if( p >= pulses.size() / 2 && follower->valid() )
+            {
+                const double next_us    = follower->next_beat_us( pulses[p].m_time_us );
+                if( beats_us.empty() || next_us - beats_us.back() > follower->period_us() / 2 )
+                {
+                    beats_us.push_back( next_us );
+                }
+                periods_us.push_back( follower->period_us() );
+            }
+        }
+
+        if( beats_us.size() < 2 )
+        {
+            printf( "  %-8s never settled on a tempo\n", follower->name() );
+            continue;
+        }
+
+        double mean_period      = 0.0;
+        for( double period : periods_us )
+        {
+            mean_period         += period;
+        }
+        mean_period             /= periods_us.size();
+
+        double tempo_wander     = 0.0;
+        for( double period : periods_us )
+        {
+            tempo_wander        += ( period - mean_period ) * ( period - mean_period );
+        }
+        tempo_wander            = sqrt( tempo_wander / periods_us.size() ) * 100.0 / mean_period;
+
+        // each beat against the grid through the first at the mean tempo
+        double phase_wander     = 0.0;
+        for( double beat_us : beats_us )
+        {
+            const double grid_us    = beats_us.front() + ( round( ( beat_us - beats_us.front() ) / mean_period ) * mean_period );
+            phase_wander            += ( beat_us - grid_us ) * ( beat_us - grid_us );
+        }
+        phase_wander            = sqrt( phase_wander / beats_us.size() ) / 1000.0;
+
+        printf( "  %-8s %7.2f bpm  tempo wanders %.2f%%  beats wander %.2f ms\n", follower->name(), 60000000.0 / follower->period_us(), tempo_wander, phase_wander );
+    }
+    printf( "  tracker: %d outliers, %d locks\n", tracker.tracker().num_outliers(), tracker.tracker().num_locks() );
+}
+
+////////////////////////////////////
+
+// a tap and a clock interrupt pushing while loop() pops, every pulse not dropped arrives once, in order
+static bool check_queues()
+{
+    const uint32_t num_pushes   = 200000;
+
+    TEMPO_PULSE_QUEUES queues;
+    std::atomic< int > num_running( 2 );
+    uint32_t num_pushed[NUM_TEMPO_SOURCES] = {};
+
+    std::vector< std::thread > interrupts;
+    for( int s = 0; s < NUM_TEMPO_SOURCES; ++s )
+    {
+        interrupts.push_back( std::thread( [&, s]()
+        {
+            for( uint32_t p = 0; p < num_pushes; ++p )
+            {
+                // the source in the bottom bit, so each source's times only rise
+                num_pushed[s]   += queues.push( static_cast<TEMPO_SOURCE>( s ), ( p << 1 ) | s ) ? 1 : 0;
+                if( p % 64 == 0 )
+                {
+                    std::this_thread::yield();
+                }
+            }
+            --num_running;
+        } ) );
+    }
+
+    uint32_t num_popped[NUM_TEMPO_SOURCES] = {};
+    uint32_t prev_time_us[NUM_TEMPO_SOURCES] = {};
+    bool in_order           = true;
+    for( ;; )
+    {
+        const bool running  = num_running > 0;
+
+        TEMPO_SOURCE source;
+        uint32_t time_us;
+        while( queues.pop( source, time_us ) )
+        {
+            in_order        &= ( time_us & 1 ) == static_cast<uint32_t>( source ) && ( num_popped[source] == 0 || time_us > prev_time_us[source] );
+            prev_time_us[source] = time_us;
+            ++num_popped[source];
+        }
+
+        if( !running )
+        {
+            break;
+        }
+        std::this_thread::yield();
+    }
+
+    for( std::thread& interrupt : interrupts )
+    {
+        interrupt.join();
+    }
+
+    bool success            = in_order;
+    for( int s = 0; s < NUM_TEMPO_SOURCES; ++s )
+    {
+        success             &= num_popped[s] == num_pushed[s];
+    }
+
+    printf( "queues     %u pushes  %u dropped when full  %u popped  %s\n", num_pushes * 2, queues.num_dropped(), num_popped[0] + num_popped[1],
+            success ? "in order, none lost" : "FAILED" );
+    return success;
+}
+
+// presses with bounces on the way down and up, each should give one tap at its first edge
+static bool check_debounce()
+{
+    TEST_RANDOM random( 99 );
+    TAP_DEBOUNCE debounce;
+
+    const int num_presses   = 1000;
+    int num_taps            = 0;
+    int num_late            = 0;
+    uint32_t time_us        = 1000000;
+    for( int p = 0; p < num_presses; ++p )
+    {
+        const uint32_t press_us = time_us;
+        const int num_bounces   = static_cast<int>( random.uniform() * 6 );
+        bool pressed            = true;
+        for( int b = 0; b <= num_bounces * 2; ++b )
+        {
+            if( debounce.edge( time_us, pressed ) )
+            {
+                ++num_taps;
+                num_late        += time_us != press_us ? 1 : 0;
+            }
+            time_us             += 50 + static_cast<uint32_t>( random.uniform() * 1500 );
+            pressed             = !pressed;
+        }
+
+        // held down, then released with bounces
+        time_us                 += 60000 + static_cast<uint32_t>( random.uniform() * 100000 );
+        pressed                 = false;
+        for( int b = 0; b <= num_bounces * 2; ++b )
+        {
+            if( debounce.edge( time_us, pressed ) )
+            {
+                ++num_taps;
+            }
+            time_us             += 50 + static_cast<uint32_t>( random.uniform() * 1500 );
+            pressed             = !pressed;
+        }
+        time_us                 += 150000 + static_cast<uint32_t>( random.uniform() * 400000 );
+    }
+
+    const bool success      = num_taps == num_presses && num_late == 0;
+    printf( "debounce   %d bouncing presses  %d taps  %d late  %s\n", num_presses, num_taps, num_late, success ? "ok" : "FAILED" );
+    return success;
+}
+
+////////////////////////////////////
+
+static void usage()
+{
+    printf( "usage: glitch_delay_tempo [-c pulses_per_beat] [-w dir] [pulses.txt ...]\n" );
+    printf( "  -c pulses_per_beat   of the clock in recorded sequences (default 1)\n" );
+    printf( "  -w dir               write the built in sequences to dir as pulse files\n" );
+    printf( "with no files, runs the built in sequences and the queue and debounce checks\n" );
+}
+
+int main( int argc, char** argv )
+{
+    int clock_pulses_per_beat   = 1;
+    const char* write_dir       = nullptr;
+    std::vector< const char* > paths;
+    for( int a = 1; a < argc; ++a )
+    {
+        if( strcmp( argv[a], "-c" ) == 0 && a + 1 < argc )
+        {
+            clock_pulses_per_beat = max_val( atoi( argv[++a] ), 1 );
+        }
+        else if( strcmp( argv[a], "-w" ) == 0 && a + 1 < argc )
+        {
+            write_dir           = argv[++a];
+        }
+        else if( argv[a][0] == '-' )
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            paths.push_back( argv[a] );
+        }
+    }
+
+    if( !paths.empty() )
+    {
+        for( const char* path : paths )
+        {
+            std::vector< PULSE > pulses;
+            if( !read_sequence( path, pulses ) )
+            {
+                printf( "can't read %s\n", path );
+                return 1;
+            }
+            run_recorded( path, pulses, clock_pulses_per_beat );
+        }
+        return 0;
+    }
+
+    const std::vector< SEQUENCE > sequences = built_in_sequences();
+    if( write_dir != nullptr )
+    {
+        for( const SEQUENCE& sequence : sequences )
+        {
+            const std::string path  = std::string( write_dir ) + "/" + sequence.m_name + ".txt";
+            if( !write_sequence( sequence, path ) )
+            {
+                printf( "can't write %s\n", path.c_str() );
+                return 1;
+            }
+        }
+    }
+
+    bool success            = run_built_in( sequences );
+    success                 &= check_queues();
+    success                 &= check_debounce();
+
+    printf( "%s\n", success ? "all passed" : "FAILED" );
+    return success ? 0 : 1;
+}
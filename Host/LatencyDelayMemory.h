@@ -0,0 +1,162 @@
+#pragma once
+
+// stands in for slow external memory behind CACHED_DELAY_STORAGE, so long delays and the cache can be tuned on the host.
+// Time is simulated: a transfer takes the latency plus its size over the bandwidth, the caller advances the clock by
+// each block's duration (update() itself takes no time), and waiting for a transfer moves the clock to its end, which
+// counts as stall time. Transfers that finish while the clock advances call the listener at their end time, as the
+// memory's interrupt would. Data only moves when a transfer finishes, so using a block before it has loaded shows up
+// in the output
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "../DelayStorage.h"
+
+class LATENCY_DELAY_MEMORY : public DELAY_MEMORY
+{
+    std::vector< uint8_t >      m_memory;
+    DELAY_MEMORY_LISTENER*      m_listener;
+    double                      m_latency_us;
+    double                      m_bytes_per_us;
+
+    double                      m_time_us;
+    double                      m_transfer_end_us;
+
+    // transfer in progress
+    bool                        m_pending;
+    bool                        m_pending_write;
+    int                         m_address;
+    uint8_t*                    m_read_data;
+    const uint8_t*              m_write_data;
+    int                         m_size;
+
+    double                      m_stall_us;
+    uint32_t                    m_num_transfers;
+    uint64_t                    m_num_bytes;
+
+    void                        finish()
+    {
+        if( !m_pending || m_time_us < m_transfer_end_us )
+        {
+            return;
+        }
+
+        if( m_pending_write )
+        {
+            memcpy( m_memory.data() + m_address, m_write_data, m_size );
+        }
+        else
+        {
+            memcpy( m_read_data, m_memory.data() + m_address, m_size );
+        }
+        m_pending               = false;
+    }
+
+    bool                        start( int address, int size, bool write )
+    {
+        finish();
+        if( m_pending )
+        {
+            return false;
+        }
+
+        m_pending               = true;
+        m_pending_write         = write;
+        m_address               = address;
+        m_size                  = size;
+        m_transfer_end_us       = m_time_us + m_latency_us + ( size / m_bytes_per_us );
+
+        ++m_num_transfers;
+        m_num_bytes             += size;
+
+        return true;
+    }
+
+public:
+
+    // bandwidth in MB/s
+    LATENCY_DELAY_MEMORY( int size_in_bytes, float latency_us, float bandwidth ) :
+        m_memory( size_in_bytes, 0 ),
+        m_listener( nullptr ),
+        m_latency_us( latency_us ),
+        m_bytes_per_us( bandwidth ),
+        m_time_us( 0.0 ),
+        m_transfer_end_us( 0.0 ),
+        m_pending( false ),
+        m_pending_write( false ),
+        m_address( 0 ),
+        m_read_data( nullptr ),
+        m_write_data( nullptr ),
+        m_size( 0 ),
+        m_stall_us( 0.0 ),
+        m_num_transfers( 0 ),
+        m_num_bytes( 0 )
+    {
+    }
+
+    // time passing between update() calls
+    void                        advance( double time_us )
+    {
+        const double end_us     = m_time_us + time_us;
+        while( m_pending && m_transfer_end_us <= end_us )
+        {
+            m_time_us           = max_val( m_time_us, m_transfer_end_us );
+            finish();
+
+            if( m_listener != nullptr )
+            {
+                m_listener->transfer_complete();
+            }
+        }
+        m_time_us               = end_us;
+    }
+
+    void                        set_listener( DELAY_MEMORY_LISTENER* listener ) override
+    {
+        m_listener              = listener;
+    }
+
+    int                         size_in_bytes() const override      { return static_cast<int>( m_memory.size() ); }
+
+    bool                        start_read( int address, uint8_t* data, int size ) override
+    {
+        if( !start( address, size, false ) )
+        {
+            return false;
+        }
+        m_read_data             = data;
+        return true;
+    }
+
+    bool                        start_write( int address, const uint8_t* data, int size ) override
+    {
+        if( !start( address, size, true ) )
+        {
+            return false;
+        }
+        m_write_data            = data;
+        return true;
+    }
+
+    bool                        transfer_active() override
+    {
+        finish();
+        return m_pending;
+    }
+
+    void                        wait_for_transfer() override
+    {
+        if( m_pending && m_time_us < m_transfer_end_us )
+        {
+            m_stall_us          += m_transfer_end_us - m_time_us;
+            m_time_us           = m_transfer_end_us;
+        }
+        finish();
+    }
+
+    double                      time_us() const         { return m_time_us; }
+    double                      stall_us() const        { return m_stall_us; }
+    uint32_t                    num_transfers() const   { return m_num_transfers; }
+    uint64_t                    num_bytes() const       { return m_num_bytes; }
+};
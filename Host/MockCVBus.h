@@ -0,0 +1,130 @@
+#pragma once
+
+// stands in for the I2C bus and the PIC so CV_ACQUISITION can be driven on the host. start_read() only queues the
+// read, complete_transfer() plays the bus interrupt and can be called from another thread
+
+#include <stdint.h>
+#include <atomic>
+
+#include "../CVAcquisition.h"
+
+class MOCK_CV_BUS : public CV_BUS
+{
+public:
+
+    enum FAULT
+    {
+        FAULT_NONE,
+        FAULT_NO_ACK,               // the PIC didn't answer its address
+        FAULT_BIT_FLIP,             // one bit of the frame was misread
+    };
+
+private:
+
+    uint8_t                     m_full_address;
+    uint8_t                     m_delta_address;
+    CV_FRAME                    m_pic_frame;        // what the PIC would send next
+    uint8_t                     m_change_mask;      // channels changed since they were last sent
+
+    std::atomic< bool >         m_pending;
+    uint8_t                     m_read_address;
+    uint8_t*                    m_data;
+    int                         m_max_size;
+    CV_BUS_LISTENER*            m_listener;
+
+    uint32_t                    m_num_flips;
+
+public:
+
+    MOCK_CV_BUS( uint8_t full_address, uint8_t delta_address ) :
+        m_full_address( full_address ),
+        m_delta_address( delta_address ),
+        m_pic_frame(),
+        m_change_mask( 0 ),
+        m_pending( false ),
+        m_read_address( 0 ),
+        m_data( nullptr ),
+        m_max_size( 0 ),
+        m_listener( nullptr ),
+        m_num_flips( 0 )
+    {
+    }
+
+    // the PIC finished converting every channel
+    void                        finish_scan( const uint16_t* values )
+    {
+        for( int c = 0; c < CV_NUM_CHANNELS; ++c )
+        {
+            m_change_mask           |= values[c] != m_pic_frame.m_values[c] ? 1 << c : 0;
+            m_pic_frame.m_values[c] = values[c];
+        }
+        ++m_pic_frame.m_sequence;
+    }
+
+    bool                        start_read( uint8_t address, uint8_t* data, int max_size, CV_BUS_LISTENER* listener ) override
+    {
+        if( m_pending.load( std::memory_order_acquire ) )
+        {
+            return false;
+        }
+
+        m_read_address  = address;
+        m_data          = data;
+        m_max_size      = max_size;
+        m_listener      = listener;
+
+        m_pending.store( true, std::memory_order_release );
+
+        return true;
+    }
+
+    bool                        transfer_pending() const
+    {
+        return m_pending.load( std::memory_order_acquire );
+    }
+
+    // the bus interrupt, returns false if there was no read to finish
+    bool                        complete_transfer( FAULT fault = FAULT_NONE )
+    {
+        if( !m_pending.load( std::memory_order_acquire ) )
+        {
+            return false;
+        }
+
+        bool success = ( m_read_address == m_full_address || m_read_address == m_delta_address ) && fault != FAULT_NO_ACK;
+        if( success )
+        {
+            // like the PIC, any read sends the changes
+            uint8_t frame_data[CV_MAX_READ_SIZE_IN_BYTES];
+            int frame_size          = CV_FRAME_SIZE_IN_BYTES;
+            if( m_read_address == m_full_address )
+            {
+                encode_cv_frame( m_pic_frame, frame_data );
+            }
+            else
+            {
+                frame_size          = encode_cv_delta( m_pic_frame, m_change_mask, frame_data );
+            }
+            m_change_mask           = 0;
+
+            if( fault == FAULT_BIT_FLIP )
+            {
+                const int bit       = ( m_num_flips++ * 7 ) % ( frame_size * 8 );
+                frame_data[bit / 8] ^= 1 << ( bit % 8 );
+            }
+
+            // the master reads as many bytes as the first says, anything past the frame reads as 1s
+            const int size          = m_listener->read_size( frame_data[0] );
+            success                 = size <= m_max_size;
+            for( int b = 0; b < size && success; ++b )
+            {
+                m_data[b]           = b < frame_size ? frame_data[b] : 0xFF;
+            }
+        }
+
+        m_pending.store( false, std::memory_order_release );
+        m_listener->read_complete( success );
+
+        return true;
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+// just the PIC16F1825 registers PIC/CV_I2C.c uses, as plain variables, so it can be built and driven on the host.
+// Each register and its bits share storage like the real SFRs
+
+#include <stdint.h>
+
+#define interrupt
+
+#define PIC_STUB_REGISTER( name, bit_fields )           \
+    union name##_STUB                                   \
+    {                                                   \
+        uint8_t         value;                          \
+        struct bit_fields bits;                         \
+    };                                                  \
+    name##_STUB         name##_stub;
+
+PIC_STUB_REGISTER( ADCON0,      { unsigned ADON : 1; unsigned GO_nDONE : 1; unsigned CHS : 5; } )
+PIC_STUB_REGISTER( SSP1CON1,    { unsigned SSPM : 4; unsigned CKP : 1; unsigned SSPEN : 1; unsigned SSPOV : 1; unsigned WCOL : 1; } )
+PIC_STUB_REGISTER( SSP1STAT,    { unsigned BF : 1; unsigned UA : 1; unsigned R_nW : 1; unsigned S : 1; unsigned P : 1; unsigned D_nA : 1; } )
+PIC_STUB_REGISTER( PIE1,        { unsigned TMR1IE : 1; unsigned TMR2IE : 1; unsigned CCP1IE : 1; unsigned SSP1IE : 1; unsigned TXIE : 1; unsigned RCIE : 1; unsigned ADIE : 1; } )
+PIC_STUB_REGISTER( PIR1,        { unsigned TMR1IF : 1; unsigned TMR2IF : 1; unsigned CCP1IF : 1; unsigned SSP1IF : 1; unsigned TXIF : 1; unsigned RCIF : 1; unsigned ADIF : 1; } )
+PIC_STUB_REGISTER( INTCON,      { unsigned IOCIF : 1; unsigned INTF : 1; unsigned TMR0IF : 1; unsigned IOCIE : 1; unsigned INTE : 1; unsigned TMR0IE : 1; unsigned PEIE : 1; unsigned GIE : 1; } )
+
+#define ADCON0          ADCON0_stub.value
+#define ADCON0bits      ADCON0_stub.bits
+#define SSP1CON1        SSP1CON1_stub.value
+#define SSP1CON1bits    SSP1CON1_stub.bits
+#define SSP1STAT        SSP1STAT_stub.value
+#define SSP1STATbits    SSP1STAT_stub.bits
+#define PIE1            PIE1_stub.value
+#define PIE1bits        PIE1_stub.bits
+#define PIR1            PIR1_stub.value
+#define PIR1bits        PIR1_stub.bits
+#define INTCON          INTCON_stub.value
+#define INTCONbits      INTCON_stub.bits
+
+uint8_t                 OSCCON;
+uint8_t                 TRISA;
+uint8_t                 TRISC;
+uint8_t                 ANSELA;
+uint8_t                 ANSELC;
+uint8_t                 OPTION_REG;
+uint8_t                 ADCON1;
+uint8_t                 ADRESH;
+uint8_t                 ADRESL;
+uint8_t                 SSP1BUF;
+uint8_t                 SSP1MSK;
+uint8_t                 SSP1ADD;
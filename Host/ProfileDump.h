@@ -0,0 +1,241 @@
+#pragma once
+
+// decodes and prints the binary dump written by PROFILER::dump(), TARGET_HOST must be defined first
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../Profiler.h"
+
+struct PROFILE_DUMP_HISTOGRAM
+{
+    uint32_t                    m_count;
+    uint32_t                    m_min;
+    uint32_t                    m_max;
+    uint32_t                    m_p99;
+    std::vector< uint32_t >     m_buckets;
+};
+
+struct PROFILE_DUMP_BLOCK
+{
+    uint32_t                    m_block;
+    uint8_t                     m_events;
+    std::vector< uint32_t >     m_stage_ticks;
+    std::vector< uint32_t >     m_head_ticks;
+    std::vector< uint8_t >      m_head_events;
+};
+
+struct PROFILE_DUMP
+{
+    uint32_t                    m_ticks_per_second;
+    uint32_t                    m_spike_ticks;
+    int                         m_num_stages;
+    int                         m_num_heads;
+    int                         m_num_buckets;
+    int                         m_min_octave;
+    uint32_t                    m_num_blocks;
+    uint32_t                    m_num_spikes;
+
+    std::vector< PROFILE_DUMP_HISTOGRAM > m_stages;
+    std::vector< PROFILE_DUMP_HISTOGRAM > m_heads_steady;
+    std::vector< PROFILE_DUMP_HISTOGRAM > m_heads_cross_fade;
+
+    PROFILE_DUMP_BLOCK          m_worst;
+    PROFILE_DUMP_BLOCK          m_last_spike;
+};
+
+////////////////////////////////////
+
+class PROFILE_DUMP_READER
+{
+    const std::vector< uint8_t >&   m_data;
+    size_t                          m_offset;
+    bool                            m_valid;
+
+public:
+
+    PROFILE_DUMP_READER( const std::vector< uint8_t >& data, size_t offset ) :
+        m_data( data ),
+        m_offset( offset ),
+        m_valid( true )
+    {
+    }
+
+    bool                        valid() const       { return m_valid; }
+
+    uint32_t                    read( int num_bytes )
+    {
+        if( m_offset + num_bytes > m_data.size() )
+        {
+            m_valid = false;
+            return 0;
+        }
+
+        uint32_t value = 0;
+        for( int b = num_bytes - 1; b >= 0; --b )
+        {
+            value = ( value << 8 ) | m_data[ m_offset + b ];
+        }
+        m_offset += num_bytes;
+
+        return value;
+    }
+
+    void                        read_histogram( PROFILE_DUMP_HISTOGRAM& histogram, int num_buckets )
+    {
+        histogram.m_count       = read( 4 );
+        histogram.m_min         = read( 4 );
+        histogram.m_max         = read( 4 );
+        histogram.m_p99         = read( 4 );
+        histogram.m_buckets.resize( num_buckets );
+        for( uint32_t& bucket : histogram.m_buckets )
+        {
+            bucket              = read( 4 );
+        }
+    }
+
+    void                        read_block( PROFILE_DUMP_BLOCK& block, int num_stages, int num_heads )
+    {
+        block.m_block           = read( 4 );
+        block.m_events          = read( 1 );
+        block.m_stage_ticks.resize( num_stages );
+        for( uint32_t& ticks : block.m_stage_ticks )
+        {
+            ticks               = read( 4 );
+        }
+        block.m_head_ticks.resize( num_heads );
+        block.m_head_events.resize( num_heads );
+        for( int h = 0; h < num_heads; ++h )
+        {
+            block.m_head_ticks[h]   = read( 4 );
+            block.m_head_events[h]  = read( 1 );
+        }
+    }
+};
+
+// reads the last dump in data, which may be a serial capture with other text around it
+inline bool read_profile_dump( const std::vector< uint8_t >& data, PROFILE_DUMP& dump )
+{
+    size_t start = data.size();
+    for( size_t i = 0; i + 4 <= data.size(); ++i )
+    {
+        if( memcmp( &data[i], "GDPF", 4 ) == 0 )
+        {
+            start = i;
+        }
+    }
+
+    if( start == data.size() )
+    {
+        return false;
+    }
+
+    PROFILE_DUMP_READER reader( data, start + 4 );
+    if( reader.read( 1 ) != PROFILER::DUMP_VERSION )
+    {
+        return false;
+    }
+
+    dump.m_ticks_per_second = reader.read( 4 );
+    dump.m_spike_ticks      = reader.read( 4 );
+    dump.m_num_stages       = reader.read( 1 );
+    dump.m_num_heads        = reader.read( 1 );
+    dump.m_num_buckets      = reader.read( 1 );
+    dump.m_min_octave       = reader.read( 1 );
+    dump.m_num_blocks       = reader.read( 4 );
+    dump.m_num_spikes       = reader.read( 4 );
+
+    dump.m_stages.resize( dump.m_num_stages );
+    dump.m_heads_steady.resize( dump.m_num_heads );
+    dump.m_heads_cross_fade.resize( dump.m_num_heads );
+
+    for( PROFILE_DUMP_HISTOGRAM& histogram : dump.m_stages )
+    {
+        reader.read_histogram( histogram, dump.m_num_buckets );
+    }
+    for( PROFILE_DUMP_HISTOGRAM& histogram : dump.m_heads_steady )
+    {
+        reader.read_histogram( histogram, dump.m_num_buckets );
+    }
+    for( PROFILE_DUMP_HISTOGRAM& histogram : dump.m_heads_cross_fade )
+    {
+        reader.read_histogram( histogram, dump.m_num_buckets );
+    }
+
+    reader.read_block( dump.m_worst, dump.m_num_stages, dump.m_num_heads );
+    reader.read_block( dump.m_last_spike, dump.m_num_stages, dump.m_num_heads );
+
+    return reader.valid();
+}
+
+////////////////////////////////////
+
+inline std::string profile_event_names( uint8_t events )
+{
+    static const char* EVENT_NAMES[] = { "cross_fade", "new_loop", "reposition", "beat", "parameters", "bit_depth", "storage_stall",
+                                         "buffer_transfer" };
+
+    std::string names;
+    for( int e = 0; e < 8; ++e )
+    {
+        if( events & ( 1 << e ) )
+        {
+            names += names.empty() ? "" : " ";
+            names += EVENT_NAMES[e];
+        }
+    }
+
+    return names.empty() ? "-" : names;
+}
+
+inline void print_profile_block( const char* title, const PROFILE_DUMP& dump, const PROFILE_DUMP_BLOCK& block )
+{
+    static const char* STAGE_NAMES[] = { "update", "bookkeeping", "audio in", "audio out", "prefetch" };
+
+    printf( "%s: block %u [%s]\n", title, block.m_block, profile_event_names( block.m_events ).c_str() );
+    for( int s = 0; s < dump.m_num_stages && s < 5; ++s )
+    {
+        printf( "  %-14s %10u\n", STAGE_NAMES[s], block.m_stage_ticks[s] );
+    }
+    for( int h = 0; h < dump.m_num_heads; ++h )
+    {
+        printf( "  head %-9d %10u [%s]\n", h, block.m_head_ticks[h], profile_event_names( block.m_head_events[h] ).c_str() );
+    }
+}
+
+inline void print_profile_dump( const PROFILE_DUMP& dump )
+{
+    static const char* STAGE_NAMES[] = { "update", "bookkeeping", "audio in", "audio out", "prefetch" };
+
+    printf( "profile: %u blocks, ticks are %s, %u blocks over %u ticks\n", dump.m_num_blocks,
+            dump.m_ticks_per_second == 1000000000 ? "ns" : "cycles", dump.m_num_spikes, dump.m_spike_ticks );
+
+    printf( "  %-20s %8s %10s %10s %10s\n", "", "count", "min", "p99", "max" );
+
+    auto print_histogram = []( const std::string& name, const PROFILE_DUMP_HISTOGRAM& histogram )
+    {
+        if( histogram.m_count > 0 )
+        {
+            printf( "  %-20s %8u %10u %10u %10u\n", name.c_str(), histogram.m_count, histogram.m_min, histogram.m_p99, histogram.m_max );
+        }
+    };
+
+    for( int s = 0; s < dump.m_num_stages && s < 5; ++s )
+    {
+        print_histogram( STAGE_NAMES[s], dump.m_stages[s] );
+    }
+    for( int h = 0; h < dump.m_num_heads; ++h )
+    {
+        print_histogram( "head " + std::to_string( h ) + " steady", dump.m_heads_steady[h] );
+        print_histogram( "head " + std::to_string( h ) + " cross fade", dump.m_heads_cross_fade[h] );
+    }
+
+    print_profile_block( "worst block", dump, dump.m_worst );
+    if( dump.m_num_spikes > 0 )
+    {
+        print_profile_block( "last spike", dump, dump.m_last_spike );
+    }
+}
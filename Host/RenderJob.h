@@ -0,0 +1,524 @@
+#pragma once
+
+// renders a WAV file through GLITCH_DELAY_EFFECT with the settings given as glitch_delay_render options, shared by the
+// render and batch tools. TARGET_HOST must be defined and GlitchDelayEffect.ino included first
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "LatencyDelayMemory.h"
+#include "WavFile.h"
+
+struct RENDER_SETTINGS
+{
+    ENGINE_CONFIG m_engine_config;
+    int     m_bit_depth;
+    int     m_num_heads;
+    float   m_loop_size;
+    float   m_jitter;
+    PLAY_HEAD_RANDOM::DISTRIBUTION m_jitter_distribution;
+    int     m_jitter_subdivisions;
+    uint32_t m_random_seed;
+    int     m_beat_ms;          // 0 - no beats
+    int     m_freeze_ms;        // < 0 - never freeze
+    int     m_freeze_toggle_ms; // 0 - freeze stays as m_freeze_ms sets it
+    FADE_CURVE::CURVE_TYPE m_fade_curve;
+    RESAMPLER::QUALITY m_resample_quality;
+    std::string m_profile_filename;     // empty - don't write the profile
+    int     m_external_kb;      // 0 - internal buffer
+    float   m_latency_us;
+    float   m_bandwidth;        // MB/s
+    int     m_cache_slots;
+    int     m_cache_block_bytes;
+    float   m_head_gain;        // < 0 - each head on its own output, otherwise the effect mixes the heads at this gain
+    float   m_feedback;
+
+    RENDER_SETTINGS() :
+        m_engine_config(),
+        m_bit_depth( 12 ),
+        m_num_heads( GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS ),
+        m_loop_size( 0.5f ),
+        m_jitter( 0.0f ),
+        m_jitter_distribution( PLAY_HEAD_RANDOM::UNIFORM ),
+        m_jitter_subdivisions( 4 ),
+        m_random_seed( 1 ),
+        m_beat_ms( 0 ),
+        m_freeze_ms( -1 ),
+        m_freeze_toggle_ms( 0 ),
+        m_fade_curve( FADE_CURVE::LINEAR ),
+        m_resample_quality( RESAMPLER::SINC ),
+        m_profile_filename(),
+        m_external_kb( 0 ),
+        m_latency_us( 20.0f ),
+        m_bandwidth( 20.0f ),
+        m_cache_slots( 32 ),
+        m_cache_block_bytes( 1536 ),
+        m_head_gain( -1.0f ),
+        m_feedback( 0.0f )
+    {
+    }
+};
+
+struct RENDER_RESULT
+{
+    std::vector< WAV_FILE > m_head_outputs;     // none when the effect mixes the heads
+    WAV_FILE    m_mix_output;       // equal gain on each head, or the effect's mixed output
+
+    int         m_num_blocks;
+    int         m_num_samples;
+    int64_t     m_total_time_ns;
+    int64_t     m_worst_block_time_ns;
+    int         m_worst_block;
+    std::vector< int32_t > m_block_times_ns;
+
+    // external storage only
+    uint32_t    m_cache_hits;
+    uint32_t    m_cache_late;
+    uint32_t    m_cache_misses;
+    uint32_t    m_cache_prefetches;
+    uint32_t    m_cache_write_backs;
+    uint32_t    m_storage_stalls;
+    double      m_stall_us;
+    double      m_memory_busy;      // fraction of the time the memory was transferring
+
+    std::vector< uint8_t > m_profile_data;
+
+    RENDER_RESULT() :
+        m_head_outputs(),
+        m_mix_output(),
+        m_num_blocks( 0 ),
+        m_num_samples( 0 ),
+        m_total_time_ns( 0 ),
+        m_worst_block_time_ns( 0 ),
+        m_worst_block( 0 ),
+        m_block_times_ns(),
+        m_cache_hits( 0 ),
+        m_cache_late( 0 ),
+        m_cache_misses( 0 ),
+        m_cache_prefetches( 0 ),
+        m_cache_write_backs( 0 ),
+        m_storage_stalls( 0 ),
+        m_stall_us( 0.0 ),
+        m_memory_busy( 0.0 )
+    {
+    }
+};
+
+////////////////////////////////////
+
+inline void print_render_options()
+{
+    printf( "  -b bits      bit depth of the delay buffer 8, 12 or 16, or 4 for ADPCM (default 12)\n" );
+    printf( "  -n heads     number of play heads 1-%d, cycling through the default speeds (default %d)\n", GLITCH_DELAY_EFFECT::MAX_PLAY_HEADS, GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS );
+    printf( "  -s size      loop size 0-1 (default 0.5)\n" );
+    printf( "  -j jitter    jitter 0-1 (default 0)\n" );
+    printf( "  -J dist      jitter distribution uniform, triangular or quantized (default uniform)\n" );
+    printf( "  -u steps     loop subdivisions quantized jitter moves by (default 4)\n" );
+    printf( "  -S seed      random seed for the heads' loop size and jitter variation (default 1)\n" );
+    printf( "  -t ms        beat every ms milliseconds, on the effect's beat clock (default no beats)\n" );
+    printf( "  -f ms        freeze after ms milliseconds (default never)\n" );
+    printf( "  -F ms        toggle freeze every ms milliseconds, starting unfrozen (default never)\n" );
+    printf( "  -c curve     cross fade curve linear, equal_power or raised_cosine (default linear)\n" );
+    printf( "  -q quality   resampling for heads not at normal speed linear, hermite or sinc (default sinc)\n" );
+    printf( "  -p file      write the binary profile dump to file (read with glitch_delay_profile)\n" );
+    printf( "  -r rate      engine sample rate in Hz, the input is not resampled (default %.2f, as the Teensy)\n", static_cast<double>( AUDIO_SAMPLE_RATE ) );
+    printf( "  -k samples   block size 1-%d (default %d)\n", MAX_BLOCK_SAMPLES, AUDIO_BLOCK_SAMPLES );
+    printf( "  -m channels  1, or 2 for the stereo interleaved buffer fed from the first two input channels (default 1)\n" );
+    printf( "  -e kb        keep the delay buffer in simulated external memory of kb KB behind a block cache (default internal)\n" );
+    printf( "  -l us        external memory latency per transfer (default 20)\n" );
+    printf( "  -w MB/s      external memory bandwidth (default 20)\n" );
+    printf( "  -C blocks    cache blocks 2-%d (default 32)\n", CACHED_DELAY_STORAGE::MAX_SLOTS );
+    printf( "  -z bytes     cache block size, a multiple of %d (default 1536)\n", DELAY_STORAGE_BLOCK_ALIGNMENT );
+    printf( "  -d feedback  the outputs summed back into the delay buffer 0-1 (default 0)\n" );
+    printf( "  -g gain      the effect mixes the heads at gain 0-4 into one output, written as the mix (default each head on its own output)\n" );
+}
+
+// one option and its value, returns false if either isn't valid
+inline bool parse_render_option( const std::string& option, const char* value, RENDER_SETTINGS& settings )
+{
+    if( option == "-b" )
+    {
+        settings.m_bit_depth = atoi( value );
+        if( !DELAY_BUFFER::valid_bit_depth( settings.m_bit_depth ) )
+        {
+            return false;
+        }
+    }
+    else if( option == "-n" )
+    {
+        settings.m_num_heads = atoi( value );
+        if( settings.m_num_heads < 1 || settings.m_num_heads > GLITCH_DELAY_EFFECT::MAX_PLAY_HEADS )
+        {
+            return false;
+        }
+    }
+    else if( option == "-s" )
+    {
+        settings.m_loop_size = clamp( static_cast<float>( atof( value ) ), 0.0f, 1.0f );
+    }
+    else if( option == "-j" )
+    {
+        settings.m_jitter = clamp( static_cast<float>( atof( value ) ), 0.0f, 1.0f );
+    }
+    else if( option == "-J" )
+    {
+        const std::string distribution( value );
+        if( distribution == "uniform" )
+        {
+            settings.m_jitter_distribution = PLAY_HEAD_RANDOM::UNIFORM;
+        }
+        else if( distribution == "triangular" )
+        {
+            settings.m_jitter_distribution = PLAY_HEAD_RANDOM::TRIANGULAR;
+        }
+        else if( distribution == "quantized" )
+        {
+            settings.m_jitter_distribution = PLAY_HEAD_RANDOM::QUANTIZED;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if( option == "-u" )
+    {
+        settings.m_jitter_subdivisions = atoi( value );
+        if( settings.m_jitter_subdivisions < 1 )
+        {
+            return false;
+        }
+    }
+    else if( option == "-S" )
+    {
+        settings.m_random_seed = static_cast<uint32_t>( strtoul( value, nullptr, 0 ) );
+    }
+    else if( option == "-t" )
+    {
+        settings.m_beat_ms = atoi( value );
+    }
+    else if( option == "-f" )
+    {
+        settings.m_freeze_ms = atoi( value );
+    }
+    else if( option == "-F" )
+    {
+        settings.m_freeze_toggle_ms = atoi( value );
+        if( settings.m_freeze_toggle_ms < 0 )
+        {
+            return false;
+        }
+    }
+    else if( option == "-c" )
+    {
+        const std::string curve( value );
+        if( curve == "linear" )
+        {
+            settings.m_fade_curve = FADE_CURVE::LINEAR;
+        }
+        else if( curve == "equal_power" )
+        {
+            settings.m_fade_curve = FADE_CURVE::EQUAL_POWER;
+        }
+        else if( curve == "raised_cosine" )
+        {
+            settings.m_fade_curve = FADE_CURVE::RAISED_COSINE;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if( option == "-q" )
+    {
+        const std::string quality( value );
+        if( quality == "linear" )
+        {
+            settings.m_resample_quality = RESAMPLER::LINEAR;
+        }
+        else if( quality == "hermite" )
+        {
+            settings.m_resample_quality = RESAMPLER::HERMITE;
+        }
+        else if( quality == "sinc" )
+        {
+            settings.m_resample_quality = RESAMPLER::SINC;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if( option == "-p" )
+    {
+        settings.m_profile_filename = value;
+    }
+    else if( option == "-r" )
+    {
+        settings.m_engine_config.m_sample_rate = static_cast<float>( atof( value ) );
+        if( settings.m_engine_config.m_sample_rate < 8000.0f || settings.m_engine_config.m_sample_rate > 96000.0f )
+        {
+            return false;
+        }
+    }
+    else if( option == "-m" )
+    {
+        settings.m_engine_config.m_num_channels = atoi( value );
+        if( settings.m_engine_config.m_num_channels < 1 || settings.m_engine_config.m_num_channels > MAX_DELAY_CHANNELS )
+        {
+            return false;
+        }
+    }
+    else if( option == "-k" )
+    {
+        settings.m_engine_config.m_max_block_samples = atoi( value );
+        if( settings.m_engine_config.m_max_block_samples < 1 || settings.m_engine_config.m_max_block_samples > MAX_BLOCK_SAMPLES )
+        {
+            return false;
+        }
+    }
+    else if( option == "-e" )
+    {
+        settings.m_external_kb = atoi( value );
+        if( settings.m_external_kb < 1 )
+        {
+            return false;
+        }
+    }
+    else if( option == "-l" )
+    {
+        settings.m_latency_us = static_cast<float>( atof( value ) );
+        if( settings.m_latency_us < 0.0f )
+        {
+            return false;
+        }
+    }
+    else if( option == "-w" )
+    {
+        settings.m_bandwidth = static_cast<float>( atof( value ) );
+        if( settings.m_bandwidth <= 0.0f )
+        {
+            return false;
+        }
+    }
+    else if( option == "-C" )
+    {
+        settings.m_cache_slots = atoi( value );
+        if( settings.m_cache_slots < 2 || settings.m_cache_slots > CACHED_DELAY_STORAGE::MAX_SLOTS )
+        {
+            return false;
+        }
+    }
+    else if( option == "-z" )
+    {
+        settings.m_cache_block_bytes = atoi( value );
+        if( settings.m_cache_block_bytes < DELAY_STORAGE_BLOCK_ALIGNMENT || settings.m_cache_block_bytes % DELAY_STORAGE_BLOCK_ALIGNMENT != 0 )
+        {
+            return false;
+        }
+    }
+    else if( option == "-d" )
+    {
+        settings.m_feedback = static_cast<float>( atof( value ) );
+        if( settings.m_feedback < 0.0f || settings.m_feedback > 1.0f )
+        {
+            return false;
+        }
+    }
+    else if( option == "-g" )
+    {
+        settings.m_head_gain = static_cast<float>( atof( value ) );
+        if( settings.m_head_gain < 0.0f || settings.m_head_gain > 4.0f )
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// checks the options that depend on each other, once all have been parsed
+inline bool check_render_settings( const RENDER_SETTINGS& settings )
+{
+    return settings.m_external_kb == 0 || ( settings.m_external_kb * 1024 ) / settings.m_cache_block_bytes <= CACHED_DELAY_STORAGE::MAX_BLOCKS;
+}
+
+////////////////////////////////////
+
+// renders on the calling thread, with its own effect, so renders can run on several threads at once
+inline void render( const WAV_FILE& input, const RENDER_SETTINGS& settings, RENDER_RESULT& result )
+{
+    // effect is too large for the stack
+    std::unique_ptr< GLITCH_DELAY_EFFECT > effect_storage( new GLITCH_DELAY_EFFECT( settings.m_engine_config ) );
+    GLITCH_DELAY_EFFECT& effect = *effect_storage;
+
+    // each head on its own output channel, unless the effect mixes them
+    const bool mixed_output       = settings.m_head_gain >= 0.0f;
+    std::vector< PLAY_HEAD_CONFIG > head_configs( settings.m_num_heads );
+    for( int h = 0; h < settings.m_num_heads; ++h )
+    {
+        head_configs[h]                   = GLITCH_DELAY_EFFECT::DEFAULT_PLAY_HEADS[ h % GLITCH_DELAY_EFFECT::NUM_DEFAULT_PLAY_HEADS ];
+        head_configs[h].m_output_channel  = h;
+    }
+    effect.configure_play_heads( head_configs.data(), settings.m_num_heads, mixed_output ? GLITCH_DELAY_EFFECT::MIXED_OUTPUT : GLITCH_DELAY_EFFECT::HEAD_OUTPUTS );
+    effect.set_random_seed( settings.m_random_seed );
+
+    std::unique_ptr< LATENCY_DELAY_MEMORY > external_memory;
+    std::unique_ptr< CACHED_DELAY_STORAGE > cached_storage;
+    std::vector< uint8_t > cache( settings.m_cache_slots * settings.m_cache_block_bytes );
+    if( settings.m_external_kb > 0 )
+    {
+        external_memory.reset( new LATENCY_DELAY_MEMORY( settings.m_external_kb * 1024, settings.m_latency_us, settings.m_bandwidth ) );
+        cached_storage.reset( new CACHED_DELAY_STORAGE( *external_memory, cache.data(), settings.m_cache_block_bytes, settings.m_cache_slots ) );
+        effect.set_delay_storage( cached_storage.get() );
+    }
+
+    const int num_channels        = settings.m_engine_config.m_num_channels;
+    const int num_heads           = effect.num_play_heads();
+    const int num_head_outputs    = mixed_output ? 0 : num_heads;
+    const int block_samples       = settings.m_engine_config.m_max_block_samples;
+    const int num_blocks          = ( input.num_frames() + block_samples - 1 ) / block_samples;
+    const int num_samples         = num_blocks * block_samples;
+    const int freeze_samples      = ( input.m_sample_rate * settings.m_freeze_ms ) / 1000;
+    const int toggle_samples      = ( input.m_sample_rate * settings.m_freeze_toggle_ms ) / 1000;
+
+    std::vector< WAV_FILE >& head_outputs = result.m_head_outputs;
+    head_outputs.resize( num_head_outputs );
+    for( WAV_FILE& head_output : head_outputs )
+    {
+        head_output.m_sample_rate = input.m_sample_rate;
+        head_output.m_num_channels = num_channels;
+        head_output.m_samples.resize( num_samples * num_channels );
+    }
+
+    WAV_FILE& mix_output          = result.m_mix_output;
+    mix_output.m_sample_rate      = input.m_sample_rate;
+    mix_output.m_num_channels     = num_channels;
+    mix_output.m_samples.resize( num_samples * num_channels );
+
+    effect.set_bit_depth( settings.m_bit_depth );
+    effect.set_loop_moving( false );
+    effect.set_fade_curve( settings.m_fade_curve );
+    effect.set_resample_quality( settings.m_resample_quality );
+    effect.set_feedback( settings.m_feedback );
+    for( int h = 0; h < num_heads; ++h )
+    {
+        effect.set_loop_size( h, settings.m_loop_size );
+        effect.set_jitter( h, settings.m_jitter );
+        effect.set_jitter_distribution( h, settings.m_jitter_distribution, settings.m_jitter_subdivisions );
+        if( mixed_output )
+        {
+            effect.set_head_gain( h, settings.m_head_gain );
+        }
+    }
+
+    int16_t input_block[MAX_BLOCK_SAMPLES];
+
+    result.m_num_blocks           = num_blocks;
+    result.m_num_samples          = num_samples;
+    result.m_total_time_ns        = 0;
+    result.m_worst_block_time_ns  = 0;
+    result.m_worst_block          = 0;
+    result.m_block_times_ns.resize( num_blocks );
+
+    // the first beat a beat in, each on its own sample
+    if( settings.m_beat_ms > 0 )
+    {
+        const float beat_samples  = ( input.m_sample_rate * settings.m_beat_ms ) / 1000.0f;
+        effect.set_beat_clock( beat_samples, static_cast<uint32_t>( beat_samples ) );
+    }
+
+    for( int b = 0; b < num_blocks; ++b )
+    {
+        const int block_start     = b * block_samples;
+
+        // use the first channel (or two) of the input, a mono input feeds both sides
+        for( int c = 0; c < num_channels; ++c )
+        {
+            const int input_channel = min_val( c, input.m_num_channels - 1 );
+            for( int x = 0; x < block_samples; ++x )
+            {
+                const int frame   = block_start + x;
+                input_block[x]    = frame < input.num_frames() ? input.m_samples[ ( frame * input.m_num_channels ) + input_channel ] : 0;
+            }
+            effect.set_input_block( c, input_block, block_samples );
+        }
+
+        bool freeze               = freeze_samples >= 0 && block_start >= freeze_samples;
+        if( toggle_samples > 0 )
+        {
+            freeze                = ( ( block_start / toggle_samples ) % 2 ) == 1;
+        }
+        effect.set_freeze_active( freeze );
+        effect.publish_parameters();
+
+        const auto start_time     = std::chrono::steady_clock::now();
+        effect.update();
+        const auto end_time       = std::chrono::steady_clock::now();
+
+        if( external_memory )
+        {
+            external_memory->advance( ( block_samples * 1e6 ) / settings.m_engine_config.m_sample_rate );
+        }
+
+        const int64_t block_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( end_time - start_time ).count();
+        result.m_total_time_ns    += block_time_ns;
+        result.m_block_times_ns[b] = static_cast<int32_t>( min_val<int64_t>( block_time_ns, INT32_MAX ) );
+        if( block_time_ns > result.m_worst_block_time_ns )
+        {
+            result.m_worst_block_time_ns = block_time_ns;
+            result.m_worst_block  = b;
+        }
+
+        for( int x = 0; x < block_samples; ++x )
+        {
+            for( int c = 0; c < num_channels; ++c )
+            {
+                const int index   = ( ( block_start + x ) * num_channels ) + c;
+                if( mixed_output )
+                {
+                    mix_output.m_samples[ index ] = effect.output_block( c )[x];
+                }
+                else
+                {
+                    int mix = 0;
+                    for( int h = 0; h < num_heads; ++h )
+                    {
+                        const int16_t sample              = effect.output_block( ( h * num_channels ) + c )[x];
+                        head_outputs[h].m_samples[ index ] = sample;
+                        mix                               += sample;
+                    }
+
+                    // equal gain on each head
+                    mix_output.m_samples[ index ] = clamp( mix / num_heads, -32768, 32767 );
+                }
+            }
+        }
+    }
+
+    if( cached_storage )
+    {
+        result.m_cache_hits       = cached_storage->num_hits();
+        result.m_cache_late       = cached_storage->num_late();
+        result.m_cache_misses     = cached_storage->num_misses();
+        result.m_cache_prefetches = cached_storage->num_prefetches();
+        result.m_cache_write_backs = cached_storage->num_write_backs();
+        result.m_storage_stalls   = cached_storage->num_stalls();
+        result.m_stall_us         = external_memory->stall_us();
+        result.m_memory_busy      = ( ( external_memory->num_transfers() * settings.m_latency_us ) + ( external_memory->num_bytes() / settings.m_bandwidth ) ) / external_memory->time_us();
+    }
+
+    result.m_profile_data.clear();
+    effect.profiler().dump( [&]( const uint8_t* data, int size )
+    {
+        result.m_profile_data.insert( result.m_profile_data.end(), data, data + size );
+    } );
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// a host file for BUFFER_SNAPSHOT, opened and closed by the caller
+
+#include <stdio.h>
+
+#include "../BufferSnapshot.h"
+
+class STDIO_SNAPSHOT_FILE : public SNAPSHOT_FILE
+{
+    FILE*                       m_file;
+
+public:
+
+    explicit STDIO_SNAPSHOT_FILE( FILE* file ) :
+        m_file( file )
+    {
+    }
+
+    int                         read( uint8_t* data, int size ) override          { return static_cast<int>( fread( data, 1, size, m_file ) ); }
+    int                         write( const uint8_t* data, int size ) override   { return static_cast<int>( fwrite( data, 1, size, m_file ) ); }
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+// minimal 16-bit PCM WAV reading/writing for the host tools
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+struct WAV_FILE
+{
+    int                     m_sample_rate;
+    int                     m_num_channels;
+    std::vector< int16_t >  m_samples;          // interleaved
+
+    WAV_FILE() :
+        m_sample_rate( 44100 ),
+        m_num_channels( 1 ),
+        m_samples()
+    {
+    }
+
+    int                     num_frames() const
+    {
+        return static_cast<int>( m_samples.size() ) / m_num_channels;
+    }
+};
+
+////////////////////////////////////
+
+inline uint32_t read_le( const uint8_t* bytes, int num_bytes )
+{
+    uint32_t value = 0;
+    for( int b = num_bytes - 1; b >= 0; --b )
+    {
+        value = ( value << 8 ) | bytes[b];
+    }
+    return value;
+}
+
+inline void write_le( FILE* file, uint32_t value, int num_bytes )
+{
+    for( int b = 0; b < num_bytes; ++b )
+    {
+        fputc( ( value >> ( b * 8 ) ) & 0xff, file );
+    }
+}
+
+////////////////////////////////////
+
+inline bool read_wav_file( const char* filename, WAV_FILE& wav )
+{
+    FILE* file = fopen( filename, "rb" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    uint8_t riff_header[12];
+    if( fread( riff_header, 1, sizeof(riff_header), file ) != sizeof(riff_header) ||
+        memcmp( riff_header, "RIFF", 4 ) != 0 ||
+        memcmp( riff_header + 8, "WAVE", 4 ) != 0 )
+    {
+        fclose( file );
+        return false;
+    }
+
+    bool format_valid = false;
+    bool data_valid   = false;
+
+    uint8_t chunk_header[8];
+    while( !data_valid && fread( chunk_header, 1, sizeof(chunk_header), file ) == sizeof(chunk_header) )
+    {
+        const uint32_t chunk_size = read_le( chunk_header + 4, 4 );
+
+        if( memcmp( chunk_header, "fmt ", 4 ) == 0 )
+        {
+            std::vector< uint8_t > format( chunk_size );
+            if( chunk_size < 16 || fread( format.data(), 1, chunk_size, file ) != chunk_size )
+            {
+                break;
+            }
+
+            const int audio_format    = read_le( &format[0], 2 );
+            const int bits_per_sample = read_le( &format[14], 2 );
+
+            wav.m_num_channels        = read_le( &format[2], 2 );
+            wav.m_sample_rate         = read_le( &format[4], 4 );
+
+            // PCM or WAVE_FORMAT_EXTENSIBLE, 16-bit only
+            format_valid              = ( audio_format == 1 || audio_format == 0xfffe ) && bits_per_sample == 16 && wav.m_num_channels > 0;
+        }
+        else if( memcmp( chunk_header, "data", 4 ) == 0 && format_valid )
+        {
+            wav.m_samples.resize( chunk_size / sizeof(int16_t) );
+            const size_t num_read = fread( wav.m_samples.data(), sizeof(int16_t), wav.m_samples.size(), file );
+            wav.m_samples.resize( num_read - ( num_read % wav.m_num_channels ) );
+
+            data_valid = true;
+        }
+        else
+        {
+            // skip unknown chunks (padded to an even size)
+            fseek( file, chunk_size + ( chunk_size & 1 ), SEEK_CUR );
+        }
+    }
+
+    fclose( file );
+
+    return data_valid;
+}
+
+inline bool write_wav_file( const char* filename, const WAV_FILE& wav )
+{
+    FILE* file = fopen( filename, "wb" );
+    if( file == nullptr )
+    {
+        return false;
+    }
+
+    const uint32_t data_size = static_cast<uint32_t>( wav.m_samples.size() * sizeof(int16_t) );
+
+    fwrite( "RIFF", 1, 4, file );
+    write_le( file, 36 + data_size, 4 );
+    fwrite( "WAVE", 1, 4, file );
+
+    fwrite( "fmt ", 1, 4, file );
+    write_le( file, 16, 4 );
+    write_le( file, 1, 2 );                                                  // PCM
+    write_le( file, wav.m_num_channels, 2 );
+    write_le( file, wav.m_sample_rate, 4 );
+    write_le( file, wav.m_sample_rate * wav.m_num_channels * 2, 4 );         // bytes per second
+    write_le( file, wav.m_num_channels * 2, 2 );                             // block align
+    write_le( file, 16, 2 );
+
+    fwrite( "data", 1, 4, file );
+    write_le( file, data_size, 4 );
+    const size_t num_written = fwrite( wav.m_samples.data(), sizeof(int16_t), wav.m_samples.size(), file );
+
+    fclose( file );
+
+    return num_written == wav.m_samples.size();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CVAcquisition.h"
+
+// Master reads on I2C0 (Wire's pins) driven from the I2C interrupt, so loop() doesn't wait on the bus like
+// Wire.requestFrom() does. Wire.begin() still sets up the pins and clock, but Wire mustn't be used for anything
+// else on I2C0 once this owns it.
+class I2C_CV_BUS : public CV_BUS
+{
+  enum STATE
+  {
+    IDLE,
+    ADDRESS,                  // address sent, waiting for the PIC to acknowledge
+    RECEIVE,
+  };
+
+  volatile STATE            m_state;
+  uint8_t*                  m_data;
+  int                       m_max_size;
+  volatile int              m_size;             // max_size until the first byte says otherwise
+  volatile int              m_index;
+  CV_BUS_LISTENER*          m_listener;
+
+  static I2C_CV_BUS*        s_bus;
+
+  static void               i2c0_isr();
+  void                      handle_interrupt();
+  void                      finish( bool success );
+
+public:
+
+  I2C_CV_BUS();
+
+  void                      setup();      // after Wire.begin()
+
+  bool                      start_read( uint8_t address, uint8_t* data, int max_size, CV_BUS_LISTENER* listener ) override;
+};
@@ -0,0 +1,126 @@
+#include <Wire.h>
+#include "I2CCVBus.h"
+#include "Util.h"
+
+// below the audio interrupt, the PIC waits with the clock held low while the audio update runs
+const int I2C_CV_BUS_PRIORITY( 224 );
+
+I2C_CV_BUS* I2C_CV_BUS::s_bus = nullptr;
+
+I2C_CV_BUS::I2C_CV_BUS() :
+  m_state( IDLE ),
+  m_data( nullptr ),
+  m_max_size( 0 ),
+  m_size( 0 ),
+  m_index( 0 ),
+  m_listener( nullptr )
+{
+  
+}
+
+void I2C_CV_BUS::setup()
+{
+  s_bus = this;
+
+  attachInterruptVector( IRQ_I2C0, i2c0_isr );
+  NVIC_SET_PRIORITY( IRQ_I2C0, I2C_CV_BUS_PRIORITY );
+  NVIC_ENABLE_IRQ( IRQ_I2C0 );
+}
+
+bool I2C_CV_BUS::start_read( uint8_t address, uint8_t* data, int max_size, CV_BUS_LISTENER* listener )
+{
+  ASSERT_MSG( max_size > 2, "I2C_CV_BUS::start_read() read too short" );
+
+  if( m_state != IDLE || ( I2C0_S & I2C_S_BUSY ) )
+  {
+    return false;
+  }
+
+  m_data      = data;
+  m_max_size  = max_size;
+  m_size      = max_size;
+  m_index     = 0;
+  m_listener  = listener;
+  m_state     = ADDRESS;
+
+  // clear any stale flags, then a start condition and the read address
+  I2C0_S      = I2C_S_IICIF | I2C_S_ARBL;
+  I2C0_C1     = I2C_C1_IICEN | I2C_C1_IICIE | I2C_C1_MST | I2C_C1_TX;
+  I2C0_D      = ( address << 1 ) | 1;
+
+  return true;
+}
+
+void I2C_CV_BUS::i2c0_isr()
+{
+  s_bus->handle_interrupt();
+}
+
+void I2C_CV_BUS::handle_interrupt()
+{
+  const uint8_t status = I2C0_S;
+  I2C0_S = I2C_S_IICIF | ( status & I2C_S_ARBL );
+
+  if( status & I2C_S_ARBL )
+  {
+    I2C0_C1 = I2C_C1_IICEN;
+    finish( false );
+    return;
+  }
+
+  switch( m_state )
+  {
+    case ADDRESS:
+    {
+      if( status & I2C_S_RXAK )
+      {
+        // nobody answered, send a stop
+        I2C0_C1 = I2C_C1_IICEN;
+        finish( false );
+        return;
+      }
+
+      // switch to receive, the dummy read of D clocks in the first byte
+      I2C0_C1 = I2C_C1_IICEN | I2C_C1_IICIE | I2C_C1_MST;
+      (void)I2C0_D;
+      m_state = RECEIVE;
+      break;
+    }
+    case RECEIVE:
+    {
+      if( m_index == m_size - 1 )
+      {
+        // clearing MST sends the stop before the read of D would clock in another byte
+        I2C0_C1 = I2C_C1_IICEN;
+        m_data[m_index++] = I2C0_D;
+        finish( true );
+        return;
+      }
+
+      // TXAK NACKs the last byte to end the read
+      if( m_index == m_size - 2 )
+      {
+        I2C0_C1 |= I2C_C1_TXAK;
+      }
+      m_data[m_index++] = I2C0_D;
+
+      // reads are at least 3 bytes, so the second byte can't be the last and there's time to set TXAK
+      if( m_index == 1 )
+      {
+        m_size = clamp( m_listener->read_size( m_data[0] ), 3, m_max_size );
+      }
+      break;
+    }
+    case IDLE:
+    {
+      break;
+    }
+  }
+}
+
+void I2C_CV_BUS::finish( bool success )
+{
+  m_state = IDLE;
+
+  m_listener->read_complete( success );
+}
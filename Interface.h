@@ -3,23 +3,39 @@
 #include <ADC.h>
 #include <Bounce.h>
 
+#include "CVAcquisition.h"
+
 //////////////////////////////////////
 
+// raw readings are smoothed by a one-pole filter, then the value only moves once the smoothed reading is more
+// than the deadband away from it, so ADC noise doesn't register as the dial being turned
 class DIAL_BASE
 {  
-  int           m_current_value;
+  float         m_max_value;      // raw reading at full scale
+  float         m_smoothing;      // one-pole coefficient per update, 1 is no smoothing
+  float         m_deadband;       // normalised
+  float         m_filtered;       // normalised, before the deadband
+  float         m_value;          // normalised, cached for value()
   bool          m_invert;
+  bool          m_initialised;
+  bool          m_changed;
 
 protected:
 
-  bool         set_current_value( int new_value );
+  bool          set_current_value( int new_value );   // returns true if value() changed
 
 public:
 
-  DIAL_BASE( bool invert );
+  static constexpr float  DEFAULT_SMOOTHING = 0.3f;
+  static constexpr float  DEFAULT_DEADBAND  = 1.0f / 256;
+
+  DIAL_BASE( float max_value, bool invert );
   virtual ~DIAL_BASE();
 
-  float         value( float max_value = 65536.0f ) const;
+  void          set_filter( float smoothing, float deadband );
+
+  float         value() const;    // 0-1
+  bool          changed() const;  // value() moved on the last update
 };
 
 //////////////////////////////////////
@@ -37,13 +53,16 @@ public:
 
 //////////////////////////////////////
 
+// one channel of the CV frame read from the PIC
 class I2C_DIAL : public DIAL_BASE
 {
+  int           m_channel;
+
 public:
 
-  I2C_DIAL( bool invert );
+  I2C_DIAL( int channel, bool invert );
 
-  bool          update();
+  bool          update( const CV_FRAME& frame );
 };
 
 //////////////////////////////////////
@@ -54,14 +73,19 @@ class CV_DIAL
   DIAL          m_dial;
   I2C_DIAL      m_cv;
 
+  float         m_value;          // dial + cv, only recomputed when either moves
+  bool          m_changed;
+
 public:
 
-  CV_DIAL( int dial_pin );
+  CV_DIAL( int dial_pin, int cv_channel );
   
-  bool          update( ADC& adc );
+  bool          update( ADC& adc, const CV_FRAME& cv_frame );   // returns true if value() changed
   const DIAL&   dial() const;
+  void          set_filter( float smoothing, float deadband );
   
   float         value() const;
+  bool          changed() const;
 };
 
 //////////////////////////////////////
@@ -6,9 +6,15 @@
 
 //////////////////////////////////////
 
-DIAL_BASE::DIAL_BASE( bool invert ) :
-  m_current_value( 0 ),
-  m_invert( invert )
+DIAL_BASE::DIAL_BASE( float max_value, bool invert ) :
+  m_max_value( max_value ),
+  m_smoothing( DEFAULT_SMOOTHING ),
+  m_deadband( DEFAULT_DEADBAND ),
+  m_filtered( 0.0f ),
+  m_value( 0.0f ),
+  m_invert( invert ),
+  m_initialised( false ),
+  m_changed( false )
 {
   
 }
@@ -18,33 +24,65 @@ DIAL_BASE::~DIAL_BASE()
   
 }
 
-bool DIAL_BASE::set_current_value( int new_value )
+void DIAL_BASE::set_filter( float smoothing, float deadband )
 {
-  if( new_value != m_current_value )
-  {
-    m_current_value = new_value;
-    return true;
-  }
-
-  return false; 
+  m_smoothing = clamp( smoothing, 0.01f, 1.0f );
+  m_deadband  = clamp( deadband, 0.0f, 0.5f );
 }
 
-float DIAL_BASE::value( float max_value ) const
+bool DIAL_BASE::set_current_value( int new_value )
 {
-  const float vf = m_current_value / max_value;
-
+  float vf = clamp( new_value / m_max_value, 0.0f, 1.0f );
   if( m_invert )
   {
-    return 1.0f - vf;
+    vf = 1.0f - vf;
+  }
+
+  // start from the first reading rather than gliding up from 0
+  const bool first_reading = !m_initialised;
+  if( first_reading )
+  {
+    m_filtered    = vf;
+    m_initialised = true;
   }
   else
   {
-    return vf;
+    m_filtered    += m_smoothing * ( vf - m_filtered );
   }
+
+  // within the deadband of an end stop counts as the end stop, otherwise the dial could never reach it
+  float target = m_filtered;
+  if( target < m_deadband )
+  {
+    target = 0.0f;
+  }
+  else if( target > 1.0f - m_deadband )
+  {
+    target = 1.0f;
+  }
+
+  const float difference = target > m_value ? target - m_value : m_value - target;
+  m_changed = first_reading || difference > m_deadband || ( target != m_value && ( target == 0.0f || target == 1.0f ) );
+  if( m_changed )
+  {
+    m_value = target;
+  }
+
+  return m_changed; 
+}
+
+float DIAL_BASE::value() const
+{
+  return m_value;
+}
+
+bool DIAL_BASE::changed() const
+{
+  return m_changed;
 }
 
 DIAL::DIAL( int data_pin, bool invert ) :
-  DIAL_BASE( invert ),
+  DIAL_BASE( 65536.0f, invert ),
   m_data_pin( data_pin )
 {
 
@@ -59,38 +97,41 @@ bool DIAL::update( ADC& adc )
 
 //////////////////////////////////////
 
-I2C_DIAL::I2C_DIAL( bool invert ) :
-  DIAL_BASE( invert )
+I2C_DIAL::I2C_DIAL( int channel, bool invert ) :
+  DIAL_BASE( 1024.0f, invert ),
+  m_channel( channel )
 {
   
 }
 
-bool I2C_DIAL::update()
+bool I2C_DIAL::update( const CV_FRAME& frame )
 {
-  // I2C should already be setup by this point ( Wire.requestFrom() )
-  const byte b1 = Wire.read();
-  const byte b2 = Wire.read();
-
- int new_value = b1 | ( b2 << 8 );
-
-  return set_current_value( new_value );
+  return set_current_value( frame.m_values[m_channel] );
 }
 
 //////////////////////////////////////
 
-CV_DIAL::CV_DIAL( int dial_pin ) :
+CV_DIAL::CV_DIAL( int dial_pin, int cv_channel ) :
   m_dial( dial_pin ),
-  m_cv(false)
+  m_cv( cv_channel, false ),
+  m_value( 0.0f ),
+  m_changed( false )
 {
 
 }
 
-bool CV_DIAL::update( ADC& adc )
+bool CV_DIAL::update( ADC& adc, const CV_FRAME& cv_frame )
 {
   const bool dial_change  = m_dial.update( adc );
-  const bool cv_change    = m_cv.update();
+  const bool cv_change    = m_cv.update( cv_frame );
 
-  return dial_change || cv_change;
+  m_changed = dial_change || cv_change;
+  if( m_changed )
+  {
+    m_value = clamp( m_dial.value() + m_cv.value(), 0.0f, 1.0f );
+  }
+
+  return m_changed;
 }
 
 const DIAL& CV_DIAL::dial() const
@@ -98,11 +139,20 @@ const DIAL& CV_DIAL::dial() const
   return m_dial;
 }
 
+void CV_DIAL::set_filter( float smoothing, float deadband )
+{
+  m_dial.set_filter( smoothing, deadband );
+  m_cv.set_filter( smoothing, deadband );
+}
+
 float CV_DIAL::value() const
 {
-  const float dial_value  = m_dial.value();
-  const float cv_value    = m_cv.value( 1024.0f );
-  return clamp( dial_value + cv_value, 0.0f, 1.0f );
+  return m_value;
+}
+
+bool CV_DIAL::changed() const
+{
+  return m_changed;
 }
 
 //////////////////////////////////////
@@ -2,6 +2,8 @@
 
 #include <xc.h>
 
+#ifndef PIC_HOST_SIM    // Host/GlitchDelayPICSim.cpp builds this file against register stubs
+
 // CONFIG1
 #pragma config FOSC = INTOSC    // Oscillator Selection (INTOSC oscillator: I/O function on CLKIN pin)
 #pragma config WDTE = OFF       // Watchdog Timer Enable (WDT disabled)
@@ -21,186 +23,293 @@
 #pragma config BORV = LO        // Brown-out Reset Voltage Selection (Brown-out Reset Voltage (Vbor), low trip point selected.)
 #pragma config LVP = OFF        // Low-Voltage Programming Enable (High-voltage on MCLR/VPP must be used for programming)
 
-#define I2C_ADDRESS 111
-#define DATA_SIZE_BYTES 12
-#define DATA_SIZE_WORDS 6
+#endif // !PIC_HOST_SIM
+
+// The timer, ADC and I2C interrupts do all the work (they share the one interrupt vector, so none of them can
+// interrupt another). Each timer interrupt starts a burst of OVERSAMPLE conversions on the selected channel, the
+// ADC interrupt chains them and averages the burst, then selects the next channel, which settles until the next
+// timer interrupt. An average that moves by more than CHANGE_THRESHOLD from the value last stored sets the
+// channel's change flag. The frame formats are described in CVAcquisition.h on the Teensy side.
+
+#define I2C_ADDRESS         111     // full frame
+#define I2C_DELTA_ADDRESS   110     // change mask and only the changed channels, the address mask accepts both
+
+#define NUM_CHANNELS        6
+#define MAX_FRAME_SIZE      ( NUM_CHANNELS * 2 + 3 )
+
+#define OVERSAMPLE_SHIFT    3
+#define OVERSAMPLE          ( 1 << OVERSAMPLE_SHIFT )
+#define CHANGE_THRESHOLD    2       // 10-bit LSBs
+#define MAX_VALUE           1023
 
 typedef unsigned char byte;
+typedef unsigned short word;
 
-volatile int adc_channel = 0;
+//const byte adc_pins[ NUM_CHANNELS ] = { 3, 6, 2, 1, 0, 7 };
+const byte adc_pins[ NUM_CHANNELS ] = { 7, 1, 2, 6, 3, 0 };
 
-volatile int adc_send_index = 0;
+// scanner
+byte scan_channel       = 0;
+byte scan_samples       = 0;
+byte scan_busy          = 0;
+word scan_sum           = 0;        // OVERSAMPLE 10-bit results fit in 16 bits
 
-volatile int adc_result[ DATA_SIZE_WORDS ] = 0;
+// results
+word channel_value[ NUM_CHANNELS ];
+byte change_mask        = 0;        // channels that moved since they were last sent
+byte scan_sequence      = 0;        // bumped each time all the channels have been converted
 
-//volatile int adc_pins[ DATA_SIZE_WORDS ] = { 3, 6, 2, 1, 0, 7 };
-volatile int adc_pins[ DATA_SIZE_WORDS ] = { 7, 1, 2, 6, 3, 0 };
+// frame being sent, filled when a read starts so a conversion finishing mid transfer can't tear a value
+byte send_frame[ MAX_FRAME_SIZE ];
+byte send_size          = 0;
+byte send_index         = 0;
 
 ////////////////////////////////////////////////////////////
 //
-// INTERRUPT HANDLER
+// ADC SCANNER
 //
 ////////////////////////////////////////////////////////////
 
-void interrupt ISR(void)
+void select_channel( byte channel )
 {
-    //////////////////////////////////////////////////////////
-    // I2C SLAVE INTERRUPT
-    // Called when there is activity on the I2C bus
-    if( PIR1bits.SSP1IF )
-    {      
-        PIR1bits.SSP1IF = 0; // clear interrupt flag
+    ADCON0 = 0b00000001 | ( adc_pins[ channel ] << 2 );
+}
 
-        if( !SSP1STATbits.D_nA ) // master has sent our slave address
-        {
-            byte d = SSP1BUF; // read and discard address to clear BF flag
+// the selected input has had a timer period to settle, start its burst
+void timer_interrupt()
+{
+    if( !scan_busy )
+    {
+        scan_busy           = 1;
+        scan_samples        = 0;
+        scan_sum            = 0;
 
-            // Is the master setting up a data READ?
-            if( SSP1STATbits.R_nW )
-            {              
-                SSP1BUF = ((byte*)adc_result)[0];
-                adc_send_index = 1;
-            }
-            else
-            {
-                // dummy data
-                SSP1BUF = 0;
-            }
-        }
-        else // DATA
-        {
-            if( !SSP1STATbits.R_nW ) // MASTER IS WRITING TO SLAVE
-            {
-                    //
-            }
-            else // MASTER IS READING FROM SLAVE
-            {                                              
-                SSP1CON1bits.WCOL = 0; // clear write collision bit
+        ADCON0bits.GO_nDONE = 1;
+    }
+}
+
+void adc_interrupt()
+{
+    word average;
+    word previous;
 
-                SSP1BUF = ((byte*)adc_result)[adc_send_index];
+    scan_sum += ( (word)ADRESH << 8 ) | ADRESL;
 
-                if( ++adc_send_index >= DATA_SIZE_BYTES )
-                {
-                    adc_send_index = 0;
-                }
-            }
-        }
-        
-        SSP1CON1bits.CKP = 1; // release clock
+    // same input, so the next conversion can start straight away
+    if( ++scan_samples < OVERSAMPLE )
+    {
+        ADCON0bits.GO_nDONE = 1;
+        return;
     }
+
+    average     = scan_sum >> OVERSAMPLE_SHIFT;
+    previous    = channel_value[ scan_channel ];
+
+    // noise smaller than the threshold is ignored, but always let the value reach the end stops
+    if( average > previous + CHANGE_THRESHOLD || previous > average + CHANGE_THRESHOLD ||
+        ( average != previous && ( average == 0 || average == MAX_VALUE ) ) )
+    {
+        channel_value[ scan_channel ] = average;
+        change_mask |= 1 << scan_channel;
+    }
+
+    if( ++scan_channel >= NUM_CHANNELS )
+    {
+        scan_channel = 0;
+        ++scan_sequence;
+    }
+
+    select_channel( scan_channel );
+    scan_busy = 0;
 }
 
 ////////////////////////////////////////////////////////////
 //
-// I2C SLAVE INITIALISATION
+// FRAMES
 //
 ////////////////////////////////////////////////////////////
 
-void i2c_init( byte addr )
+void add_channel( byte channel )
+{
+    send_frame[ send_size++ ] = channel_value[ channel ] & 0xFF;
+    send_frame[ send_size++ ] = channel_value[ channel ] >> 8;
+}
+
+// sequence and checksum
+void finish_frame()
+{
+    byte sum = 0;
+    byte i;
+
+    send_frame[ send_size++ ] = scan_sequence;
+
+    for( i = 0; i < send_size; ++i )
+    {
+        sum += send_frame[i];
+    }
+    send_frame[ send_size++ ] = ~sum;
+
+    change_mask = 0;
+}
+
+void fill_full_frame()
+{
+    byte c;
+
+    send_size = 0;
+    for( c = 0; c < NUM_CHANNELS; ++c )
+    {
+        add_channel( c );
+    }
+
+    finish_frame();
+}
+
+void fill_delta_frame()
 {
-    SSP1CON1    	= 0b00100110;   // I2C slave mode, with 7 bit address, enable i2c
-    SSP1MSK     	= 0b01111111;   // address mask bits 0-6
-    SSP1ADD     	= addr<<1;      // set slave address
-    PIE1bits.SSP1IE	= 1;
-	PIR1bits.SSP1IF	= 0;
+    byte c;
+
+    send_size = 0;
+    send_frame[ send_size++ ] = change_mask;
+    for( c = 0; c < NUM_CHANNELS; ++c )
+    {
+        if( change_mask & ( 1 << c ) )
+        {
+            add_channel( c );
+        }
+    }
+
+    finish_frame();
 }
 
+////////////////////////////////////////////////////////////
+//
+// I2C SLAVE
+//
+////////////////////////////////////////////////////////////
 
-enum
+void i2c_interrupt()
 {
-    ADC_CONNECT,
-    ADC_ACQUIRE,
-    ADC_CONVERT                            
-};
+    if( !SSP1STATbits.D_nA ) // master has sent our slave address
+    {
+        byte address = SSP1BUF; // read address to clear BF flag
 
-byte adcState;
+        // Is the master setting up a data READ?
+        if( SSP1STATbits.R_nW )
+        {
+            if( ( address >> 1 ) == I2C_DELTA_ADDRESS )
+            {
+                fill_delta_frame();
+            }
+            else
+            {
+                fill_full_frame();
+            }
+
+            SSP1BUF     = send_frame[0];
+            send_index  = 1;
+        }
+        else
+        {
+            // dummy data
+            SSP1BUF = 0;
+        }
+    }
+    else // DATA
+    {
+        if( !SSP1STATbits.R_nW ) // MASTER IS WRITING TO SLAVE
+        {
+                //
+        }
+        else // MASTER IS READING FROM SLAVE
+        {
+            SSP1CON1bits.WCOL = 0; // clear write collision bit
 
-byte adcInput;
+            // the master NACKs the last byte, but might still clock one more
+            SSP1BUF = send_index < send_size ? send_frame[ send_index++ ] : 0xFF;
+        }
+    }
 
-#define ADC_AQUISITION_DELAY 100
+    SSP1CON1bits.CKP = 1; // release clock
+}
 
-void doADC()
+void i2c_init( byte addr )
 {
-	switch( adcState )
-	{
-		// Connect ADC to the correct analog input
-		case ADC_CONNECT: 
-		{                     
-            int adc_pin   = adc_pins[ adc_channel ];
-			ADCON0        = 0b00000001 | (adc_pin<<2);
-			TMR0          = 0;
-
-			adcState      = ADC_ACQUIRE;
-
-			// fall through
-		}
-
-		// Waiting for a delay while the ADC input settles
-		case ADC_ACQUIRE:
-		{
-			if( TMR0 > ADC_AQUISITION_DELAY )
-			{
-				// Start the conversion
-				ADCON0bits.GO_nDONE = 1;
-				adcState            = ADC_CONVERT;                        
-			}
-
-			break;
-		}
-
-		// Waiting for the conversion to complete
-		case ADC_CONVERT:
-		{
-			if( !ADCON0bits.GO_nDONE )
-			{
-				// store the result
-				adc_result[adc_channel] = (unsigned int)ADRESH<<8;
-				adc_result[adc_channel] |= ADRESL;
-
-				// and prepare for the next ADC
-				if( ++adc_channel>=DATA_SIZE_WORDS )
-				{	
-					adc_channel = 0;
-				}
-
-				adcState = ADC_CONNECT;                        
-			}
-			break;
-		}
-	}                      
+    SSP1CON1        = 0b00100110;   // I2C slave mode, with 7 bit address, enable i2c
+    SSP1MSK         = 0b01111101;   // address mask bits 0-6, ignoring bit 0 so both addresses match
+    SSP1ADD         = addr<<1;      // set slave address
+    PIE1bits.SSP1IE = 1;
+    PIR1bits.SSP1IF = 0;
 }
 
-void main()
+////////////////////////////////////////////////////////////
+//
+// INTERRUPT HANDLER
+//
+////////////////////////////////////////////////////////////
+
+void interrupt ISR(void)
 {
-	// osc control / 16MHz / internal
-	OSCCON      = 0b01111010;
+    // I2C first, the master is waiting on it
+    if( PIR1bits.SSP1IF )
+    {
+        PIR1bits.SSP1IF = 0;
+        i2c_interrupt();
+    }
+
+    if( PIR1bits.ADIF )
+    {
+        PIR1bits.ADIF = 0;
+        adc_interrupt();
+    }
+
+    if( INTCONbits.TMR0IF )
+    {
+        INTCONbits.TMR0IF = 0;
+        timer_interrupt();
+    }
+}
+
+////////////////////////////////////////////////////////////
 
-	// configure io
-	TRISA       = 0b11111111;                    
-	TRISC       = 0b11101111;             
-	ANSELA      = 0b11111111;
-	ANSELC      = 0b11111111;
+void cv_init()
+{
+    // osc control / 16MHz / internal
+    OSCCON      = 0b01111010;
 
-	// timer0... configure source and prescaler
-	OPTION_REG  = 0b10000100;
+    // configure io
+    TRISA       = 0b11111111;
+    TRISC       = 0b11101111;
+    ANSELA      = 0b11111111;
+    ANSELC      = 0b11111111;
 
-	// turn on the ADC
-	ADCON1      = 0b10100000; //fOSC/32
-	ADCON0      = 0b00000001; // Right justify / Vdd / AD on
+    // timer0 on fOSC/4 with a 1:2 prescaler, overflows every 128us to pace the scanner
+    OPTION_REG  = 0b10000000;
 
-	i2c_init(I2C_ADDRESS);
+    // turn on the ADC
+    ADCON1      = 0b10100000; // fOSC/32 / right justify / Vdd
+    select_channel( 0 );
 
-	adcState	= ADC_CONNECT;
+    i2c_init( I2C_ADDRESS );
 
-	adcInput	= 0;
+    // interrupts
+    PIR1bits.ADIF       = 0;
+    PIE1bits.ADIE       = 1;
+    INTCONbits.TMR0IF   = 0;
+    INTCONbits.TMR0IE   = 1;
 
-	// global enable interrupts
+    INTCONbits.PEIE     = 1;
+    INTCONbits.GIE      = 1;
+}
 
-	INTCONbits.GIE  = 1;
-    INTCONbits.PEIE = 1;
+#ifndef PIC_HOST_SIM
+void main()
+{
+    cv_init();
 
-	while(1) 
-	{
-		doADC();
-	}
-}
\ No newline at end of file
+    // everything happens in the interrupts
+    while(1)
+    {
+    }
+}
+#endif // !PIC_HOST_SIM
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+// Each play head's own random numbers for its loop size and jitter, so drawing them costs a few integer instructions
+// wherever the head redraws (every loop, not only on beats), and a render is the same for the same seed whatever else
+// draws random numbers. Xorshift32, with ranges mapped by a 32x32->64 multiply rather than a divide or a float.
+
+////////////////////////////////////
+
+class PLAY_HEAD_RANDOM
+{
+public:
+
+    enum DISTRIBUTION
+    {
+        UNIFORM,
+        TRIANGULAR,                 // sum of two draws, so small offsets are more likely than large ones
+        QUANTIZED,                  // uniform whole steps, see offset()
+    };
+
+private:
+
+    uint32_t                    m_state;            // never 0
+
+public:
+
+    PLAY_HEAD_RANDOM() :
+        m_state( 1 )
+    {
+    }
+
+    // any seed, mixed so that nearby seeds (one per head) give unrelated sequences
+    void                        seed( uint32_t seed )
+    {
+        seed                    = ( seed ^ ( seed >> 16 ) ) * 0x45D9F3Bu;
+        seed                    = ( seed ^ ( seed >> 16 ) ) * 0x45D9F3Bu;
+        seed                    = seed ^ ( seed >> 16 );
+        m_state                 = seed != 0 ? seed : 1;
+    }
+
+    uint32_t                    next()
+    {
+        m_state                 ^= m_state << 13;
+        m_state                 ^= m_state >> 17;
+        m_state                 ^= m_state << 5;
+        return m_state;
+    }
+
+    // 0 to range-1
+    int                         uniform( int range )
+    {
+        return static_cast<int>( ( static_cast<uint64_t>( next() ) * static_cast<uint32_t>( range ) ) >> 32 );
+    }
+
+    // -max_offset to max_offset, for QUANTIZED a whole number of steps
+    int                         offset( int max_offset, DISTRIBUTION distribution, int step )
+    {
+        if( max_offset <= 0 )
+        {
+            return 0;
+        }
+
+        switch( distribution )
+        {
+            case TRIANGULAR:
+            {
+                return uniform( max_offset + 1 ) + uniform( max_offset + 1 ) - max_offset;
+            }
+            case QUANTIZED:
+            {
+                const int max_steps = step > 0 ? max_offset / step : 0;
+                return ( uniform( ( max_steps * 2 ) + 1 ) - max_steps ) * step;
+            }
+            case UNIFORM:
+            default:
+            {
+                return uniform( ( max_offset * 2 ) + 1 ) - max_offset;
+            }
+        }
+    }
+};
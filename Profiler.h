@@ -0,0 +1,385 @@
+#pragma once
+
+#include <stdint.h>
+#include "CompileSwitches.h"
+
+#if defined(PROFILE_AUDIO) && !defined(TARGET_TEENSY)
+#include <chrono>
+#endif
+
+// Cycle counts for each stage of GLITCH_DELAY_EFFECT::update(), and for each play head split into steady state and
+// cross fading blocks. Ticks are CPU cycles on the Teensy (DWT cycle counter) and nanoseconds elsewhere.
+// Without PROFILE_AUDIO (see CompileSwitches.h) PROFILER has no storage and every call compiles away.
+
+enum PROFILE_STAGE
+{
+	PROFILE_UPDATE,                 // the whole of update()
+	PROFILE_BOOKKEEPING,            // parameters and play head loop/jitter updates
+	PROFILE_AUDIO_IN,
+	PROFILE_AUDIO_OUT,              // all the process_audio_out() calls
+	PROFILE_PREFETCH,               // asking the delay storage for the next block's reads, see DelayStorage.h
+	NUM_PROFILE_STAGES,
+};
+
+// what happened during a block, to explain a spike
+enum PROFILE_EVENT
+{
+	PROFILE_EVENT_CROSS_FADE        = 1 << 0,     // head cross faded for some of the block
+	PROFILE_EVENT_NEW_LOOP          = 1 << 1,     // head started a new loop
+	PROFILE_EVENT_REPOSITION        = 1 << 2,     // head moved back behind the write head
+	PROFILE_EVENT_BEAT              = 1 << 3,
+	PROFILE_EVENT_PARAMETERS        = 1 << 4,     // a new parameter set was adopted
+	PROFILE_EVENT_BIT_DEPTH         = 1 << 5,     // buffer cleared for a new bit depth
+	PROFILE_EVENT_STORAGE_STALL     = 1 << 6,     // waited for the delay storage to load a block
+	PROFILE_EVENT_BUFFER_TRANSFER   = 1 << 7,     // carried out a save or restore request, see BufferSnapshot.h
+};
+
+#ifdef PROFILE_AUDIO
+
+////////////////////////////////////
+
+// 2 buckets per octave, the first covers everything below 2^MIN_OCTAVE ticks and the last everything above
+class PROFILE_HISTOGRAM
+{
+public:
+
+	static const int            MIN_OCTAVE      = 6;
+	static const int            NUM_BUCKETS     = 40;
+
+private:
+
+	uint32_t                    m_buckets[NUM_BUCKETS];
+	uint32_t                    m_count;
+	uint32_t                    m_min;
+	uint32_t                    m_max;
+
+public:
+
+	PROFILE_HISTOGRAM()
+	{
+		clear();
+	}
+
+	void                        clear()
+	{
+		for( int b = 0; b < NUM_BUCKETS; ++b )
+		{
+			m_buckets[b]        = 0;
+		}
+		m_count                 = 0;
+		m_min                   = 0xffffffff;
+		m_max                   = 0;
+	}
+
+	static int                  bucket( uint32_t ticks )
+	{
+		const int octave        = 31 - __builtin_clz( ticks | 1 );
+		const int half          = octave > 0 ? ( ticks >> ( octave - 1 ) ) & 1 : 0;
+		const int index         = ( octave * 2 ) + half - ( MIN_OCTAVE * 2 ) + 1;
+
+		return index < 0 ? 0 : ( index >= NUM_BUCKETS ? NUM_BUCKETS - 1 : index );
+	}
+
+	// smallest tick count that lands in the bucket above, so percentiles round up
+	static uint32_t             bucket_limit( int bucket )
+	{
+		if( bucket >= NUM_BUCKETS - 1 )
+		{
+			return 0xffffffff;
+		}
+
+		const int index         = bucket + ( MIN_OCTAVE * 2 ) - 1;
+		const int octave        = index / 2;
+		return ( index & 1 ) ? ( 1u << ( octave + 1 ) ) : ( 3u << ( octave - 1 ) );
+	}
+
+	void                        add( uint32_t ticks )
+	{
+		++m_buckets[ bucket( ticks ) ];
+		++m_count;
+		m_min                   = ticks < m_min ? ticks : m_min;
+		m_max                   = ticks > m_max ? ticks : m_max;
+	}
+
+	uint32_t                    count() const           { return m_count; }
+	uint32_t                    min() const             { return m_count > 0 ? m_min : 0; }
+	uint32_t                    max() const             { return m_max; }
+	uint32_t                    bucket_count( int b ) const { return m_buckets[b]; }
+
+	// upper limit of the bucket holding the per_mille'th sample, capped at the max
+	uint32_t                    percentile( int per_mille ) const
+	{
+		const uint32_t target   = static_cast<uint32_t>( ( static_cast<uint64_t>( m_count ) * per_mille + 999 ) / 1000 );
+
+		uint32_t total          = 0;
+		for( int b = 0; b < NUM_BUCKETS; ++b )
+		{
+			total               += m_buckets[b];
+			if( total >= target && total > 0 )
+			{
+				const uint32_t limit = bucket_limit( b ) - 1;
+				return limit < m_max ? limit : m_max;
+			}
+		}
+
+		return m_max;
+	}
+};
+
+////////////////////////////////////
+
+// per stage and per head ticks for a single block
+struct PROFILE_BLOCK
+{
+	uint32_t                    m_block;
+	uint32_t                    m_stage_ticks[NUM_PROFILE_STAGES];
+	uint32_t                    m_head_ticks[PLAY_HEAD_POOL_SIZE];
+	uint8_t                     m_head_events[PLAY_HEAD_POOL_SIZE];
+	uint8_t                     m_events;
+};
+
+////////////////////////////////////
+
+class PROFILER
+{
+public:
+
+	static const uint8_t        DUMP_VERSION    = 1;
+
+private:
+
+	PROFILE_HISTOGRAM           m_stages[NUM_PROFILE_STAGES];
+	PROFILE_HISTOGRAM           m_heads_steady[PLAY_HEAD_POOL_SIZE];
+	PROFILE_HISTOGRAM           m_heads_cross_fade[PLAY_HEAD_POOL_SIZE];
+	int                         m_num_heads;
+
+	PROFILE_BLOCK               m_current;
+	PROFILE_BLOCK               m_worst;
+	PROFILE_BLOCK               m_last_spike;
+	uint32_t                    m_num_blocks;
+	uint32_t                    m_num_spikes;
+	uint32_t                    m_spike_ticks;      // blocks taking longer than this are kept as m_last_spike
+
+	volatile bool               m_paused;           // stops the audio interrupt recording while loop() dumps
+
+	template< typename WRITE_FUNC >
+	static void                 write_u32( WRITE_FUNC& write, uint32_t value )
+	{
+		const uint8_t bytes[4]  = { static_cast<uint8_t>( value ), static_cast<uint8_t>( value >> 8 ), static_cast<uint8_t>( value >> 16 ), static_cast<uint8_t>( value >> 24 ) };
+		write( bytes, 4 );
+	}
+
+	template< typename WRITE_FUNC >
+	static void                 write_u8( WRITE_FUNC& write, uint8_t value )
+	{
+		write( &value, 1 );
+	}
+
+	template< typename WRITE_FUNC >
+	static void                 write_histogram( WRITE_FUNC& write, const PROFILE_HISTOGRAM& histogram )
+	{
+		write_u32( write, histogram.count() );
+		write_u32( write, histogram.min() );
+		write_u32( write, histogram.max() );
+		write_u32( write, histogram.percentile( 990 ) );
+		for( int b = 0; b < PROFILE_HISTOGRAM::NUM_BUCKETS; ++b )
+		{
+			write_u32( write, histogram.bucket_count( b ) );
+		}
+	}
+
+	template< typename WRITE_FUNC >
+	void                        write_block( WRITE_FUNC& write, const PROFILE_BLOCK& block ) const
+	{
+		write_u32( write, block.m_block );
+		write_u8( write, block.m_events );
+		for( int s = 0; s < NUM_PROFILE_STAGES; ++s )
+		{
+			write_u32( write, block.m_stage_ticks[s] );
+		}
+		for( int h = 0; h < m_num_heads; ++h )
+		{
+			write_u32( write, block.m_head_ticks[h] );
+			write_u8( write, block.m_head_events[h] );
+		}
+	}
+
+public:
+
+	PROFILER() :
+		m_num_heads( 0 ),
+		m_current(),
+		m_worst(),
+		m_last_spike(),
+		m_num_blocks( 0 ),
+		m_num_spikes( 0 ),
+		m_spike_ticks( 0xffffffff ),
+		m_paused( false )
+	{
+#ifdef TARGET_TEENSY
+		// start the DWT cycle counter
+		ARM_DEMCR              |= ARM_DEMCR_TRCENA;
+		ARM_DWT_CTRL           |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+	}
+
+	static uint32_t             now()
+	{
+#ifdef TARGET_TEENSY
+		return ARM_DWT_CYCCNT;
+#else
+		return static_cast<uint32_t>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() );
+#endif
+	}
+
+	static uint32_t             ticks_per_second()
+	{
+#ifdef TARGET_TEENSY
+		return F_CPU;
+#else
+		return 1000000000;
+#endif
+	}
+
+	void                        set_num_heads( int num_heads )      { m_num_heads = num_heads; }
+	void                        set_spike_ticks( uint32_t ticks )   { m_spike_ticks = ticks; }
+
+	void                        clear()
+	{
+		for( PROFILE_HISTOGRAM& histogram : m_stages )
+		{
+			histogram.clear();
+		}
+		for( int h = 0; h < PLAY_HEAD_POOL_SIZE; ++h )
+		{
+			m_heads_steady[h].clear();
+			m_heads_cross_fade[h].clear();
+		}
+		m_worst                 = PROFILE_BLOCK();
+		m_last_spike            = PROFILE_BLOCK();
+		m_num_spikes            = 0;
+	}
+
+	////// audio interrupt
+
+	void                        begin_block()
+	{
+		m_current               = PROFILE_BLOCK();
+		m_current.m_block       = m_num_blocks++;
+	}
+
+	void                        add_event( uint8_t events )
+	{
+		m_current.m_events      |= events;
+	}
+
+	void                        add_stage( PROFILE_STAGE stage, uint32_t ticks )
+	{
+		m_current.m_stage_ticks[stage] += ticks;
+	}
+
+	void                        add_head( int head, uint32_t ticks, uint8_t events )
+	{
+		m_current.m_head_ticks[head]  += ticks;
+		m_current.m_head_events[head] |= events;
+	}
+
+	void                        end_block()
+	{
+		if( m_paused )
+		{
+			return;
+		}
+
+		for( int s = 0; s < NUM_PROFILE_STAGES; ++s )
+		{
+			m_stages[s].add( m_current.m_stage_ticks[s] );
+		}
+
+		for( int h = 0; h < m_num_heads; ++h )
+		{
+			PROFILE_HISTOGRAM& histogram = ( m_current.m_head_events[h] & PROFILE_EVENT_CROSS_FADE ) ? m_heads_cross_fade[h] : m_heads_steady[h];
+			histogram.add( m_current.m_head_ticks[h] );
+		}
+
+		const uint32_t ticks    = m_current.m_stage_ticks[PROFILE_UPDATE];
+		if( ticks >= m_worst.m_stage_ticks[PROFILE_UPDATE] )
+		{
+			m_worst             = m_current;
+		}
+		if( ticks > m_spike_ticks )
+		{
+			m_last_spike        = m_current;
+			++m_num_spikes;
+		}
+	}
+
+	////// loop()
+
+	uint32_t                    num_spikes() const                  { return m_num_spikes; }
+	const PROFILE_BLOCK&        last_spike() const                  { return m_last_spike; }
+	const PROFILE_BLOCK&        worst_block() const                 { return m_worst; }
+	const PROFILE_HISTOGRAM&    stage( PROFILE_STAGE stage ) const  { return m_stages[stage]; }
+	const PROFILE_HISTOGRAM&    head_steady( int head ) const       { return m_heads_steady[head]; }
+	const PROFILE_HISTOGRAM&    head_cross_fade( int head ) const   { return m_heads_cross_fade[head]; }
+	int                         num_heads() const                   { return m_num_heads; }
+
+	// little endian binary dump, write( const uint8_t* data, int size ) is called for each field:
+	//  "GDPF" u8 version, u32 ticks/second, u32 spike ticks, u8 stages, u8 heads, u8 buckets, u8 min octave, u32 blocks, u32 spikes
+	//  histogram (u32 count, min, max, p99, u32 buckets[]) for each stage, then each head steady, then each head cross fading
+	//  worst block, then last spike (u32 block, u8 events, u32 ticks per stage, (u32 ticks, u8 events) per head)
+	template< typename WRITE_FUNC >
+	void                        dump( WRITE_FUNC write )
+	{
+		m_paused                = true;
+
+		write( reinterpret_cast<const uint8_t*>( "GDPF" ), 4 );
+		write_u8( write, DUMP_VERSION );
+		write_u32( write, ticks_per_second() );
+		write_u32( write, m_spike_ticks );
+		write_u8( write, NUM_PROFILE_STAGES );
+		write_u8( write, m_num_heads );
+		write_u8( write, PROFILE_HISTOGRAM::NUM_BUCKETS );
+		write_u8( write, PROFILE_HISTOGRAM::MIN_OCTAVE );
+		write_u32( write, m_num_blocks );
+		write_u32( write, m_num_spikes );
+
+		for( const PROFILE_HISTOGRAM& histogram : m_stages )
+		{
+			write_histogram( write, histogram );
+		}
+		for( int h = 0; h < m_num_heads; ++h )
+		{
+			write_histogram( write, m_heads_steady[h] );
+		}
+		for( int h = 0; h < m_num_heads; ++h )
+		{
+			write_histogram( write, m_heads_cross_fade[h] );
+		}
+
+		write_block( write, m_worst );
+		write_block( write, m_last_spike );
+
+		m_paused                = false;
+	}
+};
+
+#else // PROFILE_AUDIO
+
+class PROFILER
+{
+public:
+
+	static uint32_t             now()                                           { return 0; }
+	static uint32_t             ticks_per_second()                              { return 0; }
+
+	void                        set_num_heads( int )                            {}
+	void                        set_spike_ticks( uint32_t )                     {}
+	void                        begin_block()                                   {}
+	void                        add_event( uint8_t )                            {}
+	void                        add_stage( PROFILE_STAGE, uint32_t )            {}
+	void                        add_head( int, uint32_t, uint8_t )              {}
+	void                        end_block()                                     {}
+};
+
+#endif // !PROFILE_AUDIO
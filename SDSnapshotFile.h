@@ -0,0 +1,21 @@
+#pragma once
+
+#include <SD.h>
+#include "BufferSnapshot.h"
+
+// a file on the SD card for BUFFER_SNAPSHOT, opened and closed by the caller. Only used with STANDALONE_AUDIO, which
+// starts the SD card in setup()
+class SD_SNAPSHOT_FILE : public SNAPSHOT_FILE
+{
+  File&                     m_file;
+
+public:
+
+  explicit SD_SNAPSHOT_FILE( File& file ) :
+    m_file( file )
+  {
+  }
+
+  int                       read( uint8_t* data, int size ) override          { return m_file.read( data, size ); }
+  int                       write( const uint8_t* data, int size ) override   { return static_cast<int>( m_file.write( data, size ) ); }
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Storage formats for DELAY_BUFFER. Each format is a policy type, so the per-sample loops can be instantiated once per format
+// instead of switching on the bit depth for every sample.
+// Samples are stored in groups of SAMPLES_PER_GROUP samples packed into BYTES_PER_GROUP bytes.
+// The PCM formats index single samples, STEREO_FORMAT wraps one of them to index interleaved L/R frames. ADPCM_FORMAT codes
+// each channel on its own in blocks, and indexes frames of either channel count.
+
+////////////////////////////////////
+
+struct SAMPLE_FORMAT_8
+{
+    static const int BITS                   = 8;
+    static const int CHANNELS               = 1;
+    static const int SAMPLES_PER_GROUP      = 1;
+    static const int BYTES_PER_GROUP        = 1;
+
+    static int16_t  read( const uint8_t* buffer, int index )
+    {
+        const int8_t sample                 = buffer[ index ];
+        return sample << 8;
+    }
+
+    static void     write( uint8_t* buffer, int index, int16_t sample )
+    {
+        buffer[ index ]                     = ( sample >> 8 ) & 0x00ff;
+    }
+
+    static void     read_run( const uint8_t* buffer, int index, int16_t* dest, int count )
+    {
+        for( int x = 0; x < count; ++x )
+        {
+            dest[x]                         = read( buffer, index + x );
+        }
+    }
+
+    static void     write_run( uint8_t* buffer, int index, const int16_t* source, int count )
+    {
+        for( int x = 0; x < count; ++x )
+        {
+            write( buffer, index + x, source[x] );
+        }
+    }
+};
+
+////////////////////////////////////
+
+// 2 samples in 3 bytes - [even top 8][even bottom 4 | odd top 4][odd bottom 8]
+struct SAMPLE_FORMAT_12
+{
+    static const int BITS                   = 12;
+    static const int CHANNELS               = 1;
+    static const int SAMPLES_PER_GROUP      = 2;
+    static const int BYTES_PER_GROUP        = 3;
+
+    static int      byte_offset( int index )
+    {
+        return ( ( index >> 1 ) * 3 ) + ( index & 1 );
+    }
+
+    static int16_t  read( const uint8_t* buffer, int index )
+    {
+        const uint8_t* bytes                = buffer + byte_offset( index );
+
+        if( index & 1 )
+        {
+            // odd indices
+            return static_cast<int16_t>( ( ( bytes[0] & 0x0f ) << 12 ) | ( bytes[1] << 4 ) );
+        }
+        else
+        {
+            // even indices
+            return static_cast<int16_t>( ( bytes[0] << 8 ) | ( bytes[1] & 0xf0 ) );
+        }
+    }
+
+    static void     write( uint8_t* buffer, int index, int16_t sample )
+    {
+        uint8_t* bytes                      = buffer + byte_offset( index );
+        const uint16_t sample16             = sample;
+
+        if( index & 1 )
+        {
+            // odd indices
+            bytes[0]                        = ( bytes[0] & 0xf0 ) | ( sample16 >> 12 );
+            bytes[1]                        = ( sample16 >> 4 ) & 0x00ff;
+        }
+        else
+        {
+            // even indices
+            bytes[0]                        = sample16 >> 8;
+            bytes[1]                        = ( sample16 & 0x00f0 ) | ( bytes[1] & 0x0f );
+        }
+    }
+
+    static void     pack_pairs( const int16_t* source, uint8_t* dest, int num_pairs )
+    {
+        for( int p = 0; p < num_pairs; ++p )
+        {
+            const uint16_t even             = source[0];
+            const uint16_t odd              = source[1];
+
+            dest[0]                         = even >> 8;
+            dest[1]                         = ( even & 0x00f0 ) | ( odd >> 12 );
+            dest[2]                         = ( odd >> 4 ) & 0x00ff;
+
+            source                          += 2;
+            dest                            += 3;
+        }
+    }
+
+    static void     unpack_pairs( const uint8_t* source, int16_t* dest, int num_pairs )
+    {
+        for( int p = 0; p < num_pairs; ++p )
+        {
+            const uint8_t b0                = source[0];
+            const uint8_t b1                = source[1];
+            const uint8_t b2                = source[2];
+
+            dest[0]                         = static_cast<int16_t>( ( b0 << 8 ) | ( b1 & 0xf0 ) );
+            dest[1]                         = static_cast<int16_t>( ( ( b1 & 0x0f ) << 12 ) | ( b2 << 4 ) );
+
+            source                          += 3;
+            dest                            += 2;
+        }
+    }
+
+    static void     read_run( const uint8_t* buffer, int index, int16_t* dest, int count )
+    {
+        // the odd sample shares a byte with the previous pair
+        if( ( index & 1 ) && count > 0 )
+        {
+            *dest++                         = read( buffer, index++ );
+            --count;
+        }
+
+        const int num_pairs                 = count / 2;
+        unpack_pairs( buffer + byte_offset( index ), dest, num_pairs );
+
+        if( count & 1 )
+        {
+            dest[ num_pairs * 2 ]           = read( buffer, index + ( num_pairs * 2 ) );
+        }
+    }
+
+    static void     write_run( uint8_t* buffer, int index, const int16_t* source, int count )
+    {
+        // the odd sample shares a byte with the previous pair
+        if( ( index & 1 ) && count > 0 )
+        {
+            write( buffer, index++, *source++ );
+            --count;
+        }
+
+        const int num_pairs                 = count / 2;
+        pack_pairs( source, buffer + byte_offset( index ), num_pairs );
+
+        if( count & 1 )
+        {
+            write( buffer, index + ( num_pairs * 2 ), source[ num_pairs * 2 ] );
+        }
+    }
+};
+
+////////////////////////////////////
+
+struct SAMPLE_FORMAT_16
+{
+    static const int BITS                   = 16;
+    static const int CHANNELS               = 1;
+    static const int SAMPLES_PER_GROUP      = 1;
+    static const int BYTES_PER_GROUP        = 2;
+
+    static int16_t  read( const uint8_t* buffer, int index )
+    {
+        return reinterpret_cast<const int16_t*>(buffer)[ index ];
+    }
+
+    static void     write( uint8_t* buffer, int index, int16_t sample )
+    {
+        reinterpret_cast<int16_t*>(buffer)[ index ] = sample;
+    }
+
+    static void     read_run( const uint8_t* buffer, int index, int16_t* dest, int count )
+    {
+        memcpy( dest, buffer + ( index * sizeof(int16_t) ), count * sizeof(int16_t) );
+    }
+
+    static void     write_run( uint8_t* buffer, int index, const int16_t* source, int count )
+    {
+        memcpy( buffer + ( index * sizeof(int16_t) ), source, count * sizeof(int16_t) );
+    }
+};
+
+////////////////////////////////////
+
+// L/R frames interleaved in FORMAT, so a run of frames is one contiguous run of samples. Indices and counts are in frames
+template< typename FORMAT >
+struct STEREO_FORMAT
+{
+    static const int BITS                   = FORMAT::BITS;
+    static const int CHANNELS               = 2;
+    static const int SAMPLES_PER_GROUP      = FORMAT::SAMPLES_PER_GROUP;
+    static const int BYTES_PER_GROUP        = FORMAT::BYTES_PER_GROUP;
+
+    static void     read_run( const uint8_t* buffer, int index, int16_t* dest, int count )
+    {
+        FORMAT::read_run( buffer, index * CHANNELS, dest, count * CHANNELS );
+    }
+
+    static void     write_run( uint8_t* buffer, int index, const int16_t* source, int count )
+    {
+        FORMAT::write_run( buffer, index * CHANNELS, source, count * CHANNELS );
+    }
+};
+
+////////////////////////////////////
+
+// 4-bit IMA ADPCM in blocks of BLOCK_FRAMES frames, each decodable on its own, so a read starts at the block holding
+// its first frame and decodes no further than its last. A group is one block for each channel, one after the other -
+// [first sample lo][first sample hi][step index][63 codes, 2 per byte, low nibble first][unused nibble]
+// A write of part of a block decodes the rest of it and codes the whole block again. The block keeps its step index, so
+// the samples kept code back to themselves unless they clipped. Indices and counts are in frames, CHANNELS interleaved
+template< int NUM_CHANNELS >
+struct ADPCM_FORMAT
+{
+    static const int BITS                   = 4;
+    static const int CHANNELS               = NUM_CHANNELS;
+    static const int BLOCK_FRAMES           = 64;
+    static const int CHANNEL_BLOCK_BYTES    = 3 + ( BLOCK_FRAMES / 2 );
+    static const int SAMPLES_PER_GROUP      = BLOCK_FRAMES * CHANNELS;
+    static const int BYTES_PER_GROUP        = CHANNEL_BLOCK_BYTES * CHANNELS;
+    static const int MAX_STEP_INDEX         = 88;
+
+    static int      step_size( int step_index )
+    {
+        static const int16_t STEP_SIZES[ MAX_STEP_INDEX + 1 ] =
+        {
+            7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+            107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+            876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+            5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+            27086, 29794, 32767
+        };
+        return STEP_SIZES[ step_index ];
+    }
+
+    static int      next_step_index( int step_index, int code )
+    {
+        static const int8_t INDEX_CHANGES[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+        const int next                      = step_index + INDEX_CHANGES[ code & 7 ];
+        return next < 0 ? 0 : ( next > MAX_STEP_INDEX ? MAX_STEP_INDEX : next );
+    }
+
+    // moves the prediction by code, the coder and decoder both step this way
+    static int      apply_code( int prediction, int step, int code )
+    {
+        int difference                      = step >> 3;
+        if( code & 4 )
+        {
+            difference                      += step;
+        }
+        if( code & 2 )
+        {
+            difference                      += step >> 1;
+        }
+        if( code & 1 )
+        {
+            difference                      += step >> 2;
+        }
+
+        prediction                          = ( code & 8 ) ? prediction - difference : prediction + difference;
+        return prediction < -32768 ? -32768 : ( prediction > 32767 ? 32767 : prediction );
+    }
+
+    // frames first to first + count - 1 of one channel's block into dest, every CHANNELS samples
+    static void     decode_block( const uint8_t* block, int first, int count, int16_t* dest )
+    {
+        int prediction                      = static_cast<int16_t>( block[0] | ( block[1] << 8 ) );
+        int step_index                      = block[2];
+        const uint8_t* codes                = block + 3;
+
+        // decode up to the run without keeping the samples, then keep them
+        int x                               = 1;
+        for( ; x < first; ++x )
+        {
+            const int code                  = ( codes[ ( x - 1 ) >> 1 ] >> ( ( ( x - 1 ) & 1 ) * 4 ) ) & 0x0f;
+            prediction                      = apply_code( prediction, step_size( step_index ), code );
+            step_index                      = next_step_index( step_index, code );
+        }
+
+        if( first == 0 )
+        {
+            *dest                           = static_cast<int16_t>( prediction );
+            dest                            += CHANNELS;
+        }
+
+        const int end                       = first + count;
+        for( ; x < end; ++x )
+        {
+            const int code                  = ( codes[ ( x - 1 ) >> 1 ] >> ( ( ( x - 1 ) & 1 ) * 4 ) ) & 0x0f;
+            prediction                      = apply_code( prediction, step_size( step_index ), code );
+            step_index                      = next_step_index( step_index, code );
+
+            *dest                           = static_cast<int16_t>( prediction );
+            dest                            += CHANNELS;
+        }
+    }
+
+    // a whole block of one channel from source, every CHANNELS samples. A new block picks its first step size from the
+    // first few changes in the audio
+    static void     encode_block( uint8_t* block, const int16_t* source, bool new_block )
+    {
+        int step_index                      = block[2];
+        if( new_block )
+        {
+            int total_change                = 0;
+            for( int x = 1; x <= 8; ++x )
+            {
+                const int change            = source[ x * CHANNELS ] - source[ ( x - 1 ) * CHANNELS ];
+                total_change                += change < 0 ? -change : change;
+            }
+
+            step_index                      = 0;
+            while( step_index < MAX_STEP_INDEX && step_size( step_index ) < total_change / 8 )
+            {
+                ++step_index;
+            }
+        }
+
+        int prediction                      = source[0];
+        block[0]                            = static_cast<uint16_t>( prediction ) & 0x00ff;
+        block[1]                            = static_cast<uint16_t>( prediction ) >> 8;
+        block[2]                            = static_cast<uint8_t>( step_index );
+
+        uint8_t* codes                      = block + 3;
+        for( int x = 1; x < BLOCK_FRAMES; ++x )
+        {
+            const int step                  = step_size( step_index );
+            int difference                  = source[ x * CHANNELS ] - prediction;
+            int code                        = 0;
+            if( difference < 0 )
+            {
+                code                        = 8;
+                difference                  = -difference;
+            }
+            if( difference >= step )
+            {
+                code                        |= 4;
+                difference                  -= step;
+            }
+            if( difference >= ( step >> 1 ) )
+            {
+                code                        |= 2;
+                difference                  -= step >> 1;
+            }
+            if( difference >= ( step >> 2 ) )
+            {
+                code                        |= 1;
+            }
+
+            prediction                      = apply_code( prediction, step, code );
+            step_index                      = next_step_index( step_index, code );
+
+            uint8_t& code_byte              = codes[ ( x - 1 ) >> 1 ];
+            code_byte                       = ( ( x - 1 ) & 1 ) ? ( code_byte & 0x0f ) | ( code << 4 ) : ( code_byte & 0xf0 ) | code;
+        }
+    }
+
+    static void     read_run( const uint8_t* buffer, int index, int16_t* dest, int count )
+    {
+        while( count > 0 )
+        {
+            const int group                 = index / BLOCK_FRAMES;
+            const int first                 = index - ( group * BLOCK_FRAMES );
+            const int run                   = count < BLOCK_FRAMES - first ? count : BLOCK_FRAMES - first;
+
+            const uint8_t* group_bytes      = buffer + ( group * BYTES_PER_GROUP );
+            for( int c = 0; c < CHANNELS; ++c )
+            {
+                decode_block( group_bytes + ( c * CHANNEL_BLOCK_BYTES ), first, run, dest + c );
+            }
+
+            dest                            += run * CHANNELS;
+            index                           += run;
+            count                           -= run;
+        }
+    }
+
+    static void     write_run( uint8_t* buffer, int index, const int16_t* source, int count )
+    {
+        while( count > 0 )
+        {
+            const int group                 = index / BLOCK_FRAMES;
+            const int first                 = index - ( group * BLOCK_FRAMES );
+            const int run                   = count < BLOCK_FRAMES - first ? count : BLOCK_FRAMES - first;
+
+            uint8_t* group_bytes            = buffer + ( group * BYTES_PER_GROUP );
+            int16_t frames[ BLOCK_FRAMES * CHANNELS ];
+            if( run < BLOCK_FRAMES )
+            {
+                read_run( buffer, group * BLOCK_FRAMES, frames, BLOCK_FRAMES );
+            }
+            memcpy( frames + ( first * CHANNELS ), source, run * CHANNELS * sizeof(int16_t) );
+
+            for( int c = 0; c < CHANNELS; ++c )
+            {
+                encode_block( group_bytes + ( c * CHANNEL_BLOCK_BYTES ), frames + c, first == 0 );
+            }
+
+            source                          += run * CHANNELS;
+            index                           += run;
+            count                           -= run;
+        }
+    }
+
+    static int16_t  read( const uint8_t* buffer, int index )
+    {
+        int16_t sample;
+        read_run( buffer, index, &sample, 1 );
+        return sample;
+    }
+
+    static void     write( uint8_t* buffer, int index, int16_t sample )
+    {
+        write_run( buffer, index, &sample, 1 );
+    }
+};
+
+typedef ADPCM_FORMAT<1> SAMPLE_FORMAT_ADPCM_4;
+
+// a stereo ADPCM group codes each channel on its own, so it is not an interleaved mono buffer
+template<>
+struct STEREO_FORMAT< SAMPLE_FORMAT_ADPCM_4 > : public ADPCM_FORMAT<2>
+{
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hands a whole T from one writer to one reader without masking interrupts, either from loop() to the audio interrupt
+// (the effect parameters) or from the I2C interrupt to loop() (CV frames, see CVAcquisition.h).
+// The writer fills the slot the reader isn't using, then publishes it by bumping the sequence. The reader
+// copies the published slot and only keeps the copy if the writer didn't start on that slot meanwhile.
+// The sequence is odd while a slot is being written, and each publish adds 2.
+
+////////////////////////////////////
+
+template< typename T >
+class SEQLOCK_BUFFER
+{
+    static const int            MAX_READ_ATTEMPTS = 4;
+
+    T                           m_slots[2];
+    uint32_t                    m_sequence;
+
+public:
+
+    SEQLOCK_BUFFER() :
+        m_slots(),
+        m_sequence( 0 )
+    {
+    }
+
+    // writer only
+    void                        publish( const T& value )
+    {
+        const uint32_t sequence     = m_sequence;
+
+        __atomic_store_n( &m_sequence, sequence + 1, __ATOMIC_RELAXED );
+        __atomic_thread_fence( __ATOMIC_RELEASE );
+
+        m_slots[ ( ( sequence >> 1 ) + 1 ) & 1 ] = value;
+
+        __atomic_store_n( &m_sequence, sequence + 2, __ATOMIC_RELEASE );
+    }
+
+    // number of publishes so far, so the reader can skip the copy when nothing has changed
+    uint32_t                    publish_count() const
+    {
+        return __atomic_load_n( &m_sequence, __ATOMIC_ACQUIRE ) >> 1;
+    }
+
+    // reader only, returns false (and value is undefined) if every attempt overlapped a write to the slot being read
+    // the writer can't interrupt the audio interrupt on the Teensy, and a CV frame is only published once per transfer
+    // loop() starts, so this only retries when the reader is a thread
+    bool                        read( T& value ) const
+    {
+        for( int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt )
+        {
+            const uint32_t start    = __atomic_load_n( &m_sequence, __ATOMIC_ACQUIRE );
+
+            value                   = m_slots[ ( start >> 1 ) & 1 ];
+
+            __atomic_thread_fence( __ATOMIC_ACQUIRE );
+            const uint32_t end      = __atomic_load_n( &m_sequence, __ATOMIC_RELAXED );
+
+            // the slot read is next written once the sequence passes the following publish
+            if( end - ( start & ~1u ) <= 2 )
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "Util.h"
-#include "Interface.h"
+#include "TempoInput.h"
+#include "TempoTracker.h"
 
 
 class TAP_BPM
@@ -19,25 +20,30 @@ public:
 
   //////////////////////////////////////////////////
 
-  TAP_BPM( int button_pin );
+  TAP_BPM( int button_pin, int clock_pin );   // clock_pin -1 for no external clock
 
   bool                      valid_bpm() const;
   float                     bpm() const;
   float                     beat_duration_ms() const;
+  uint32_t                  next_beat_us( uint32_t time_us ) const;   // the first beat after time_us
+  bool                      tempo_changed() const;                    // the tempo or phase moved on the last update
 
   void                      setup();
-  void                      update( float time_ms );  // returns true on every beat (includes tempo taps)
+  void                      update( uint32_t time_us );
 
   BEAT_TYPE                 beat_type() const;
 
+  const TEMPO_TRACKER&      tracker() const;
+  void                      set_clock_config( const TEMPO_SOURCE_CONFIG& config );
+
 private:
   
-  BUTTON                    m_tap_button;
-  RUNNING_AVERAGE<float, 4> m_average_times;
+  TEMPO_INPUT               m_input;
+  TEMPO_TRACKER             m_tracker;
 
-  float                     m_prev_tap_time_ms;
-  float                     m_next_beat_time_ms;
+  uint32_t                  m_next_beat_us;
+  uint32_t                  m_prev_update_count;
 
   BEAT_TYPE                 m_current_beat;
+  bool                      m_tempo_changed;
 };
-
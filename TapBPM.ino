@@ -1,13 +1,12 @@
 #include "TapBPM.h"
 
-const float MAX_DURATION = 5000;  // 5s between beats
-
-TAP_BPM::TAP_BPM( int button_pin ) :
-  m_tap_button( button_pin, false ),
-  m_average_times(),
-  m_prev_tap_time_ms(-1.0f),
-  m_next_beat_time_ms(0.0f),
-  m_current_beat( NO_BEAT )
+TAP_BPM::TAP_BPM( int button_pin, int clock_pin ) :
+  m_input( button_pin, clock_pin ),
+  m_tracker(),
+  m_next_beat_us(0),
+  m_prev_update_count(0),
+  m_current_beat( NO_BEAT ),
+  m_tempo_changed(false)
 {
   
 }
@@ -17,20 +16,13 @@ bool TAP_BPM::valid_bpm() const
  #ifdef SET_TEMPO
   return true;
  #else
-  return m_average_times.size() >= 2; // 3 taps
+  return m_tracker.locked();
 #endif  
 }
 
 float TAP_BPM::bpm() const
 {
-  //static const float mult = 60 / 1000.0f; 
-  const float dur_ms = beat_duration_ms();
-  const float dur_s = dur_ms / 1000.0f;
-
-  const float bps = 1.0f / dur_s;
-  const float bpm = bps / 60.0f;
-  
-  return bpm;
+  return 60000.0f / beat_duration_ms();
 }
 
 float TAP_BPM::beat_duration_ms() const
@@ -40,62 +32,65 @@ float TAP_BPM::beat_duration_ms() const
   return beat_duration;
  #else
   ASSERT_MSG( valid_bpm(), "beat_duration_ms() invalid_bpm!" );
-  return m_average_times.average();
+  return m_tracker.period_us() / 1000.0f;
 #endif
 }
 
+uint32_t TAP_BPM::next_beat_us( uint32_t time_us ) const
+{
+ #ifdef SET_TEMPO
+  return time_us + static_cast<uint32_t>( beat_duration_ms() * 1000.0f );
+ #else
+  return m_tracker.next_beat_us( time_us );
+#endif
+}
+
+bool TAP_BPM::tempo_changed() const
+{
+  return m_tempo_changed;
+}
+
 void TAP_BPM::setup()
 {
-  m_tap_button.setup();
+  m_input.setup();
 }
 
-void TAP_BPM::update( float time_ms )
+void TAP_BPM::update( uint32_t time_us )
 {  
   m_current_beat = NO_BEAT;
-  
-  m_tap_button.update( time_ms );
 
-  // button pressed
-  if( m_tap_button.single_click() )
+  // the pulses timestamped by the interrupts since the last update, oldest first
+  TEMPO_SOURCE source;
+  uint32_t pulse_us;
+  while( m_input.next_pulse( source, pulse_us ) )
   {
 #ifdef DEBUG_OUTPUT
-    Serial.print("Button down\n");
+    Serial.print( source == TEMPO_SOURCE_TAP ? "Tap " : "Clock " );
+    Serial.print( pulse_us );
+    Serial.print( "\n" );
 #endif // DEBUG_OUTPUT
-    
-    if( m_prev_tap_time_ms > 0.0f )
+
+    m_tracker.add_pulse( source, pulse_us );
+    if( source == TEMPO_SOURCE_TAP )
     {
-      float duration = time_ms - m_prev_tap_time_ms;
-
-      if( duration > MAX_DURATION )
-      {
-        m_average_times.reset();
-      }
-      else
-      {
-        m_average_times.add( duration );
-      }
+      m_current_beat = TAP_BEAT;
     }
+  }
 
-    m_prev_tap_time_ms = time_ms;
+  m_tempo_changed = m_tracker.update_count() != m_prev_update_count;
+  m_prev_update_count = m_tracker.update_count();
 
-    if( valid_bpm() )
+  if( valid_bpm() )
+  {
+    // the beat the last update was waiting for has passed
+    if( m_current_beat == NO_BEAT && !m_tempo_changed && static_cast<int32_t>( time_us - m_next_beat_us ) >= 0 )
     {
-      m_next_beat_time_ms = time_ms + beat_duration_ms();
+      m_current_beat = AUTO_BEAT;
     }
 
-    m_current_beat = TAP_BEAT;
-  }
-  // no button press - wait for next beat
-  else
-  {    
-    if( valid_bpm() )
+    if( m_tempo_changed || m_current_beat == AUTO_BEAT )
     {
-      if( time_ms > m_next_beat_time_ms )
-      {
-        m_next_beat_time_ms = m_next_beat_time_ms + beat_duration_ms();
-  
-        m_current_beat = AUTO_BEAT;
-      }
+      m_next_beat_us = next_beat_us( time_us );
     }
   }
 }
@@ -105,3 +100,12 @@ TAP_BPM::BEAT_TYPE TAP_BPM::beat_type() const
   return m_current_beat;
 }
 
+const TEMPO_TRACKER& TAP_BPM::tracker() const
+{
+  return m_tracker;
+}
+
+void TAP_BPM::set_clock_config( const TEMPO_SOURCE_CONFIG& config )
+{
+  m_tracker.set_source_config( TEMPO_SOURCE_CLOCK, config );
+}
@@ -18,14 +18,14 @@
 
 class TEENSY_AUDIO_STREAM_WRAPPER : public AudioStream
 {
-    audio_block_t*                  m_input_queue_array[1];
+    audio_block_t*                  m_input_queue_array[2];
     
 protected:
     
     // these are the only functions that require bespoke Teensy code
     bool                            process_audio_in( int channel )
     {        
-        audio_block_t* read_block        = receiveReadOnly();
+        audio_block_t* read_block        = receiveReadOnly( channel );
         
         if( read_block != nullptr )
         {
@@ -56,14 +56,79 @@ protected:
         return false;
     }
     
+    // a pair of channels in one call, a missing input block is silent
+    bool                            process_audio_in_stereo( int left_channel )
+    {
+        audio_block_t* left_block        = receiveReadOnly( left_channel );
+        audio_block_t* right_block       = receiveReadOnly( left_channel + 1 );
+        
+        if( left_block == nullptr && right_block == nullptr )
+        {
+            return false;
+        }
+        
+        static const int16_t silence[AUDIO_BLOCK_SAMPLES] = {};
+        process_audio_in_stereo_impl( left_channel, left_block != nullptr ? left_block->data : silence, right_block != nullptr ? right_block->data : silence, AUDIO_BLOCK_SAMPLES );
+        
+        if( left_block != nullptr )
+        {
+            release( left_block );
+        }
+        if( right_block != nullptr )
+        {
+            release( right_block );
+        }
+        
+        return true;
+    }
+    
+    bool                            process_audio_out_stereo( int left_channel )
+    {
+        audio_block_t* left_block        = allocate();
+        audio_block_t* right_block       = allocate();
+        
+        const bool allocated             = left_block != nullptr && right_block != nullptr;
+        if( allocated )
+        {
+            process_audio_out_stereo_impl( left_channel, left_block->data, right_block->data, AUDIO_BLOCK_SAMPLES );
+            
+            transmit( left_block, left_channel );
+            transmit( right_block, left_channel + 1 );
+        }
+        
+        if( left_block != nullptr )
+        {
+            release( left_block );
+        }
+        if( right_block != nullptr )
+        {
+            release( right_block );
+        }
+        
+        return allocated;
+    }
+    
     // add audio processing code in these 2 functions
     virtual void                    process_audio_in_impl( int channel, const int16_t* sample_data, int num_samples ) = 0;
     virtual void                    process_audio_out_impl( int channel, int16_t* sample_data, int num_samples ) = 0;
     
+    // override to process both channels of a pair together
+    virtual void                    process_audio_in_stereo_impl( int left_channel, const int16_t* left_data, const int16_t* right_data, int num_samples )
+    {
+        process_audio_in_impl( left_channel, left_data, num_samples );
+        process_audio_in_impl( left_channel + 1, right_data, num_samples );
+    }
+    
+    virtual void                    process_audio_out_stereo_impl( int left_channel, int16_t* left_data, int16_t* right_data, int num_samples )
+    {
+        process_audio_out_impl( left_channel, left_data, num_samples );
+        process_audio_out_impl( left_channel + 1, right_data, num_samples );
+    }
+    
 public:
     
     TEENSY_AUDIO_STREAM_WRAPPER() :
-        AudioStream( 1, m_input_queue_array ),
+        AudioStream( 2, m_input_queue_array ),
         m_input_queue_array()
     {
         
@@ -79,9 +144,16 @@ public:
 
 #ifdef TARGET_JUCE
 
+#include <algorithm>
 #include <vector>
 #include "../JuceLibraryCode/JuceHeader.h"
 
+// JUCE has no fixed rate or block size, these are only the defaults until the plugin passes the rate from
+// prepareToPlay() to GLITCH_DELAY_EFFECT::configure_engine(), with its block size capped at MAX_BLOCK_SAMPLES. Host blocks
+// can be longer than that, so the plugin calls update_in_blocks() with the same cap rather than update()
+#define AUDIO_BLOCK_SAMPLES         512
+#define AUDIO_SAMPLE_RATE           44100
+
 class TEENSY_AUDIO_STREAM_WRAPPER
 {
     int                             m_num_input_channels;
@@ -92,15 +164,58 @@ protected:
     // store the 16-bit in/out buffers
     typedef std::vector< int16_t >  SAMPLE_BUFFER;
     std::vector< SAMPLE_BUFFER >    m_channel_buffers;
+    std::vector< SAMPLE_BUFFER >    m_host_buffers;         // the whole host block while update_in_blocks() takes it in turns
     
     // these are the only functions that require bespoke JUCE code
     bool                            process_audio_in( int channel );
     bool                            process_audio_out( int channel );
     
+    // a pair of channels in one call, through the same buffers as process_audio_in() and process_audio_out()
+    bool                            process_audio_in_stereo( int left_channel )
+    {
+        if( left_channel + 1 >= static_cast<int>( m_channel_buffers.size() ) )
+        {
+            return false;
+        }
+        
+        const SAMPLE_BUFFER& left_buffer    = m_channel_buffers[left_channel];
+        const SAMPLE_BUFFER& right_buffer   = m_channel_buffers[left_channel + 1];
+        process_audio_in_stereo_impl( left_channel, left_buffer.data(), right_buffer.data(), static_cast<int>( left_buffer.size() ) );
+        
+        return true;
+    }
+    
+    bool                            process_audio_out_stereo( int left_channel )
+    {
+        if( left_channel + 1 >= static_cast<int>( m_channel_buffers.size() ) )
+        {
+            return false;
+        }
+        
+        SAMPLE_BUFFER& left_buffer          = m_channel_buffers[left_channel];
+        SAMPLE_BUFFER& right_buffer         = m_channel_buffers[left_channel + 1];
+        process_audio_out_stereo_impl( left_channel, left_buffer.data(), right_buffer.data(), static_cast<int>( left_buffer.size() ) );
+        
+        return true;
+    }
+    
     // add audio processing code in these 2 functions
     virtual void                    process_audio_in_impl( int channel, const int16_t* sample_data, int num_samples ) = 0;
     virtual void                    process_audio_out_impl( int channel, int16_t* sample_data, int num_samples ) = 0;
     
+    // override to process both channels of a pair together
+    virtual void                    process_audio_in_stereo_impl( int left_channel, const int16_t* left_data, const int16_t* right_data, int num_samples )
+    {
+        process_audio_in_impl( left_channel, left_data, num_samples );
+        process_audio_in_impl( left_channel + 1, right_data, num_samples );
+    }
+    
+    virtual void                    process_audio_out_stereo_impl( int left_channel, int16_t* left_data, int16_t* right_data, int num_samples )
+    {
+        process_audio_out_impl( left_channel, left_data, num_samples );
+        process_audio_out_impl( left_channel + 1, right_data, num_samples );
+    }
+    
 public:
     
     TEENSY_AUDIO_STREAM_WRAPPER();
@@ -113,9 +228,200 @@ public:
     virtual int                     num_input_channels() const = 0;
     virtual int                     num_output_channels() const = 0;
     
+    // between pre_process_audio() and post_process_audio(), runs update() over the host block in turns of at most
+    // max_block_samples, each turn's samples taking the place of the whole block in m_channel_buffers
+    void                            update_in_blocks( int max_block_samples )
+    {
+        int num_samples = 0;
+        for( const SAMPLE_BUFFER& buffer : m_channel_buffers )
+        {
+            num_samples = std::max( num_samples, static_cast<int>( buffer.size() ) );
+        }
+        
+        if( num_samples <= max_block_samples )
+        {
+            update();
+            return;
+        }
+        
+        m_host_buffers.swap( m_channel_buffers );
+        m_channel_buffers.resize( m_host_buffers.size() );
+        for( int start = 0; start < num_samples; start += max_block_samples )
+        {
+            const int run = std::min( max_block_samples, num_samples - start );
+            for( size_t c = 0; c < m_host_buffers.size(); ++c )
+            {
+                m_host_buffers[c].resize( num_samples, 0 );
+                m_channel_buffers[c].assign( m_host_buffers[c].begin() + start, m_host_buffers[c].begin() + start + run );
+            }
+            
+            update();
+            
+            for( size_t c = 0; c < m_host_buffers.size(); ++c )
+            {
+                std::copy( m_channel_buffers[c].begin(), m_channel_buffers[c].begin() + run, m_host_buffers[c].begin() + start );
+            }
+        }
+        m_channel_buffers.swap( m_host_buffers );
+    }
+    
     virtual void                    update() = 0;
 };
 
 #endif // TARGET_JUCE
 
+#ifdef TARGET_HOST
+
+#include <stdlib.h>
+#include <vector>
+
+// match the Teensy audio library, so host renders behave the same as the hardware
+#define AUDIO_BLOCK_SAMPLES         128
+#define AUDIO_SAMPLE_RATE_EXACT     44117.64706
+#define AUDIO_SAMPLE_RATE           AUDIO_SAMPLE_RATE_EXACT
+
+class TEENSY_AUDIO_STREAM_WRAPPER
+{
+    // store the 16-bit in/out blocks
+    typedef std::vector< int16_t >  SAMPLE_BUFFER;
+    std::vector< SAMPLE_BUFFER >    m_input_blocks;
+    std::vector< SAMPLE_BUFFER >    m_output_blocks;
+    int                             m_block_samples;        // length of the next update(), set with the input
+
+    static SAMPLE_BUFFER&           channel_block( std::vector< SAMPLE_BUFFER >& blocks, int channel, int num_samples )
+    {
+        if( channel >= static_cast<int>( blocks.size() ) )
+        {
+            blocks.resize( channel + 1 );
+        }
+
+        SAMPLE_BUFFER& block = blocks[channel];
+        if( static_cast<int>( block.size() ) < num_samples )
+        {
+            block.resize( num_samples, 0 );
+        }
+
+        return block;
+    }
+
+protected:
+
+    // these are the only functions that require bespoke host code
+    bool                            process_audio_in( int channel )
+    {
+        if( channel >= static_cast<int>( m_input_blocks.size() ) || m_input_blocks[channel].empty() )
+        {
+            // nothing received on this channel
+            return false;
+        }
+
+        process_audio_in_impl( channel, m_input_blocks[channel].data(), m_block_samples );
+
+        return true;
+    }
+
+    bool                            process_audio_out( int channel )
+    {
+        SAMPLE_BUFFER& block = channel_block( m_output_blocks, channel, m_block_samples );
+
+        process_audio_out_impl( channel, block.data(), m_block_samples );
+
+        return true;
+    }
+
+    // a pair of channels in one call, a missing input block is silent
+    bool                            process_audio_in_stereo( int left_channel )
+    {
+        const bool left_received    = left_channel < static_cast<int>( m_input_blocks.size() ) && !m_input_blocks[left_channel].empty();
+        const bool right_received   = left_channel + 1 < static_cast<int>( m_input_blocks.size() ) && !m_input_blocks[left_channel + 1].empty();
+        if( !left_received && !right_received )
+        {
+            return false;
+        }
+
+        const SAMPLE_BUFFER silence( m_block_samples, 0 );
+        process_audio_in_stereo_impl( left_channel, left_received ? m_input_blocks[left_channel].data() : silence.data(),
+                                      right_received ? m_input_blocks[left_channel + 1].data() : silence.data(), m_block_samples );
+
+        return true;
+    }
+
+    bool                            process_audio_out_stereo( int left_channel )
+    {
+        // the right channel may resize the block list, so take it first
+        SAMPLE_BUFFER& right_block  = channel_block( m_output_blocks, left_channel + 1, m_block_samples );
+        SAMPLE_BUFFER& left_block   = channel_block( m_output_blocks, left_channel, m_block_samples );
+
+        process_audio_out_stereo_impl( left_channel, left_block.data(), right_block.data(), m_block_samples );
+
+        return true;
+    }
+
+    // add audio processing code in these 2 functions
+    virtual void                    process_audio_in_impl( int channel, const int16_t* sample_data, int num_samples ) = 0;
+    virtual void                    process_audio_out_impl( int channel, int16_t* sample_data, int num_samples ) = 0;
+
+    // override to process both channels of a pair together
+    virtual void                    process_audio_in_stereo_impl( int left_channel, const int16_t* left_data, const int16_t* right_data, int num_samples )
+    {
+        process_audio_in_impl( left_channel, left_data, num_samples );
+        process_audio_in_impl( left_channel + 1, right_data, num_samples );
+    }
+
+    virtual void                    process_audio_out_stereo_impl( int left_channel, int16_t* left_data, int16_t* right_data, int num_samples )
+    {
+        process_audio_out_impl( left_channel, left_data, num_samples );
+        process_audio_out_impl( left_channel + 1, right_data, num_samples );
+    }
+
+public:
+
+    TEENSY_AUDIO_STREAM_WRAPPER() :
+        m_input_blocks(),
+        m_output_blocks(),
+        m_block_samples( AUDIO_BLOCK_SAMPLES )
+    {
+
+    }
+
+    virtual ~TEENSY_AUDIO_STREAM_WRAPPER()      {;}
+
+    // copy in num_samples for each input channel before calling update(), every channel must be the same length
+    // and the effect must have been configured for blocks at least this long
+    void                            set_input_block( int channel, const int16_t* sample_data, int num_samples = AUDIO_BLOCK_SAMPLES )
+    {
+        SAMPLE_BUFFER& block = channel_block( m_input_blocks, channel, num_samples );
+
+        for( int x = 0; x < num_samples; ++x )
+        {
+            block[x] = sample_data[x];
+        }
+
+        m_block_samples = num_samples;
+    }
+
+    int                             block_samples() const
+    {
+        return m_block_samples;
+    }
+
+    // block_samples() written by the last update(), nullptr if the channel has never been written
+    const int16_t*                  output_block( int channel ) const
+    {
+        if( channel >= static_cast<int>( m_output_blocks.size() ) || m_output_blocks[channel].empty() )
+        {
+            return nullptr;
+        }
+
+        return m_output_blocks[channel].data();
+    }
+
+    virtual int                     num_input_channels() const = 0;
+    virtual int                     num_output_channels() const = 0;
+
+    virtual void                    update() = 0;
+};
+
+#endif // TARGET_HOST
+
 #endif /* TeensyJuce_h */
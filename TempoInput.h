@@ -0,0 +1,29 @@
+#pragma once
+
+#include "TempoTracker.h"
+
+// Timestamps the tap tempo button and the external clock input in their pin interrupts, and queues the times for
+// loop() (see TempoTracker.h). The button is debounced from its edges, the clock counts every rising edge.
+class TEMPO_INPUT
+{
+  int                       m_tap_pin;
+  int                       m_clock_pin;        // -1 for none
+
+  TAP_DEBOUNCE              m_tap_debounce;
+  TEMPO_PULSE_QUEUES        m_pulses;
+
+  static TEMPO_INPUT*       s_input;
+
+  static void               tap_isr();
+  static void               clock_isr();
+
+public:
+
+  TEMPO_INPUT( int tap_pin, int clock_pin );
+
+  void                      setup();
+
+  // loop() only, the earliest pulse not yet taken, returns false once there are none
+  bool                      next_pulse( TEMPO_SOURCE& source, uint32_t& time_us );
+  uint32_t                  num_dropped() const;
+};
@@ -0,0 +1,52 @@
+#include "TempoInput.h"
+
+TEMPO_INPUT* TEMPO_INPUT::s_input = nullptr;
+
+TEMPO_INPUT::TEMPO_INPUT( int tap_pin, int clock_pin ) :
+  m_tap_pin( tap_pin ),
+  m_clock_pin( clock_pin ),
+  m_tap_debounce(),
+  m_pulses()
+{
+  
+}
+
+void TEMPO_INPUT::setup()
+{
+  s_input = this;
+
+  // the button pulls the pin low, shared with the BUTTON polling the same pin
+  pinMode( m_tap_pin, INPUT_PULLUP );
+  attachInterrupt( digitalPinToInterrupt( m_tap_pin ), tap_isr, CHANGE );
+
+  if( m_clock_pin >= 0 )
+  {
+    pinMode( m_clock_pin, INPUT );
+    attachInterrupt( digitalPinToInterrupt( m_clock_pin ), clock_isr, RISING );
+  }
+}
+
+void TEMPO_INPUT::tap_isr()
+{
+  const uint32_t time_us = micros();
+  const bool pressed = digitalReadFast( s_input->m_tap_pin ) == LOW;
+  if( s_input->m_tap_debounce.edge( time_us, pressed ) )
+  {
+    s_input->m_pulses.push( TEMPO_SOURCE_TAP, time_us );
+  }
+}
+
+void TEMPO_INPUT::clock_isr()
+{
+  s_input->m_pulses.push( TEMPO_SOURCE_CLOCK, micros() );
+}
+
+bool TEMPO_INPUT::next_pulse( TEMPO_SOURCE& source, uint32_t& time_us )
+{
+  return m_pulses.pop( source, time_us );
+}
+
+uint32_t TEMPO_INPUT::num_dropped() const
+{
+  return m_pulses.num_dropped();
+}
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include "Util.h"
+
+// Follows the tempo and phase of tap tempo presses and external clock pulses. The pin interrupts timestamp each pulse
+// in microseconds and queue it (TEMPO_PULSE_QUEUES), and loop() hands the queued pulses to TEMPO_TRACKER in time order,
+// so the tempo no longer depends on how often loop() polls the button.
+//
+// TEMPO_TRACKER is a phase locked loop on a grid of pulses (one per beat for taps, m_pulses_per_beat for a clock).
+// Each pulse is matched to the nearest grid pulse, and a share of its error moves the phase and the period, so a
+// drummer's timing is smoothed rather than averaged over the last few taps. A pulse too far from the grid is an
+// outlier and is ignored, and skipped pulses just match further along the grid, so a long gap keeps the tempo.
+// The tracker (re)locks when a source's last few intervals agree with each other on a tempo it isn't already
+// following, so three taps set a new tempo as before, and whichever source last started on a steady tempo is followed.
+
+enum TEMPO_SOURCE
+{
+    TEMPO_SOURCE_TAP,
+    TEMPO_SOURCE_CLOCK,
+    NUM_TEMPO_SOURCES,
+};
+
+////////////////////////////////////
+
+// timestamps from one interrupt to loop() without masking interrupts, one writer and one reader. When full the newest
+// pulse is dropped, so the tracker sees a missed pulse rather than a wrong one
+template< int CAPACITY >
+class TIMESTAMP_QUEUE
+{
+    static const uint32_t       MASK    = CAPACITY - 1;    // CAPACITY is a power of 2
+
+    uint32_t                    m_times_us[CAPACITY];
+    uint32_t                    m_write_count;
+    uint32_t                    m_read_count;
+    uint32_t                    m_num_dropped;
+
+public:
+
+    TIMESTAMP_QUEUE() :
+        m_times_us(),
+        m_write_count( 0 ),
+        m_read_count( 0 ),
+        m_num_dropped( 0 )
+    {
+    }
+
+    // writer only, returns false if the queue was full
+    bool                        push( uint32_t time_us )
+    {
+        const uint32_t write_count  = m_write_count;
+        if( write_count - __atomic_load_n( &m_read_count, __ATOMIC_ACQUIRE ) >= CAPACITY )
+        {
+            __atomic_store_n( &m_num_dropped, m_num_dropped + 1, __ATOMIC_RELAXED );
+            return false;
+        }
+
+        m_times_us[ write_count & MASK ] = time_us;
+        __atomic_store_n( &m_write_count, write_count + 1, __ATOMIC_RELEASE );
+        return true;
+    }
+
+    // reader only, the oldest time without taking it, returns false if empty
+    bool                        peek( uint32_t& time_us ) const
+    {
+        if( __atomic_load_n( &m_write_count, __ATOMIC_ACQUIRE ) == m_read_count )
+        {
+            return false;
+        }
+
+        time_us                 = m_times_us[ m_read_count & MASK ];
+        return true;
+    }
+
+    // reader only, after a successful peek()
+    void                        pop()
+    {
+        __atomic_store_n( &m_read_count, m_read_count + 1, __ATOMIC_RELEASE );
+    }
+
+    uint32_t                    num_dropped() const
+    {
+        return __atomic_load_n( &m_num_dropped, __ATOMIC_RELAXED );
+    }
+};
+
+////////////////////////////////////
+
+// a queue per source, as each source is pushed from its own pin interrupt, read back in time order
+class TEMPO_PULSE_QUEUES
+{
+public:
+
+    static const int            CAPACITY    = 32;           // 24ppqn at 300bpm is 120 pulses a second, over 50ms of loop() stalls
+
+private:
+
+    TIMESTAMP_QUEUE< CAPACITY > m_queues[NUM_TEMPO_SOURCES];
+
+public:
+
+    // from the source's interrupt
+    bool                        push( TEMPO_SOURCE source, uint32_t time_us )
+    {
+        return m_queues[source].push( time_us );
+    }
+
+    // loop() only, the earliest pulse from any source, returns false once every queue is empty
+    bool                        pop( TEMPO_SOURCE& source, uint32_t& time_us )
+    {
+        bool found              = false;
+        for( int s = 0; s < NUM_TEMPO_SOURCES; ++s )
+        {
+            uint32_t queued_us;
+            if( m_queues[s].peek( queued_us ) && ( !found || static_cast<int32_t>( queued_us - time_us ) < 0 ) )
+            {
+                source          = static_cast<TEMPO_SOURCE>( s );
+                time_us         = queued_us;
+                found           = true;
+            }
+        }
+
+        if( found )
+        {
+            m_queues[source].pop();
+        }
+        return found;
+    }
+
+    uint32_t                    num_dropped() const
+    {
+        uint32_t num_dropped    = 0;
+        for( int s = 0; s < NUM_TEMPO_SOURCES; ++s )
+        {
+            num_dropped         += m_queues[s].num_dropped();
+        }
+        return num_dropped;
+    }
+};
+
+////////////////////////////////////
+
+// debounces a button from its edges in the pin interrupt. A press only counts once the pin has been still for
+// DEBOUNCE_US, so the bounces after a press and on release are ignored, and the press is timed from its first edge
+class TAP_DEBOUNCE
+{
+public:
+
+    static const uint32_t       DEBOUNCE_US = 20000;
+
+private:
+
+    uint32_t                    m_prev_edge_us;
+    bool                        m_valid;
+
+public:
+
+    TAP_DEBOUNCE() :
+        m_prev_edge_us( 0 ),
+        m_valid( false )
+    {
+    }
+
+    // every edge, returns true for a press to queue
+    bool                        edge( uint32_t time_us, bool pressed )
+    {
+        const bool settled      = !m_valid || time_us - m_prev_edge_us >= DEBOUNCE_US;
+        m_prev_edge_us          = time_us;
+        m_valid                 = true;
+        return pressed && settled;
+    }
+};
+
+////////////////////////////////////
+
+struct TEMPO_SOURCE_CONFIG
+{
+    int                         m_pulses_per_beat;
+    float                       m_phase_gain;       // share of a pulse's phase error taken at once
+    float                       m_period_gain;      // share of a pulse's error per grid pulse taken into the period
+};
+
+class TEMPO_TRACKER
+{
+public:
+
+    static const uint32_t       MIN_BEAT_US         = 200000;       // 300bpm
+    static const uint32_t       MAX_BEAT_US         = 5000000;      // the longest gap between taps that counts
+    static const int            ACQUIRE_INTERVALS   = 2;            // three taps set a tempo
+    static constexpr float      ACQUIRE_TOLERANCE   = 0.1f;         // intervals that agree, and a tempo that differs
+    static constexpr float      OUTLIER_TOLERANCE   = 0.25f;        // of a grid pulse
+
+    // taps wander by tens of ms so are followed gently, a clock is steady and is followed more closely
+    static TEMPO_SOURCE_CONFIG  default_config( TEMPO_SOURCE source )
+    {
+        const TEMPO_SOURCE_CONFIG tap_config    = { 1, 0.3f, 0.05f };
+        const TEMPO_SOURCE_CONFIG clock_config  = { 1, 0.5f, 0.1f };
+        return source == TEMPO_SOURCE_CLOCK ? clock_config : tap_config;
+    }
+
+private:
+
+    struct SOURCE_STATE
+    {
+        TEMPO_SOURCE_CONFIG     m_config;
+        uint32_t                m_prev_pulse_us;
+        bool                    m_prev_pulse_valid;
+        float                   m_intervals_us[ACQUIRE_INTERVALS];     // as a beat at that pulse rate, most recent first
+        int                     m_num_intervals;
+        int                     m_pulse_in_run;     // since the source started after a gap, the first is taken as a beat
+        bool                    m_acquired;         // the intervals agreed at the last pulse
+    };
+
+    SOURCE_STATE                m_sources[NUM_TEMPO_SOURCES];
+
+    bool                        m_locked;
+    TEMPO_SOURCE                m_source;           // locked to
+    float                       m_period_us;        // per beat
+    uint32_t                    m_pulse_us;         // the latest grid pulse, phase corrected
+    int                         m_pulse_in_beat;    // of m_pulse_us, 0 is on the beat
+
+    uint32_t                    m_update_count;     // every time the tempo or phase moves
+    uint32_t                    m_num_pulses;
+    uint32_t                    m_num_outliers;
+    uint32_t                    m_num_locks;
+
+    // this source's last intervals agree with each other, on a beat of period_us
+    bool                        acquired( const SOURCE_STATE& state, float& period_us ) const
+    {
+        if( state.m_num_intervals < ACQUIRE_INTERVALS )
+        {
+            return false;
+        }
+
+        float min_interval      = state.m_intervals_us[0];
+        float max_interval      = state.m_intervals_us[0];
+        float total             = 0.0f;
+        for( int i = 0; i < ACQUIRE_INTERVALS; ++i )
+        {
+            min_interval        = min_val( min_interval, state.m_intervals_us[i] );
+            max_interval        = max_val( max_interval, state.m_intervals_us[i] );
+            total               += state.m_intervals_us[i];
+        }
+
+        period_us               = total / ACQUIRE_INTERVALS;
+        return max_interval - min_interval <= period_us * ACQUIRE_TOLERANCE;
+    }
+
+    // the grid at period_us through the acquired pulses, from the latest, so a tempo is set from the phase of all of
+    // them rather than the last one alone
+    float                       acquired_phase_us( const SOURCE_STATE& state, float period_us ) const
+    {
+        const float grid_us     = period_us / state.m_config.m_pulses_per_beat;
+        float pulse_us          = 0.0f;     // from the latest
+        float total_us          = 0.0f;
+        for( int i = 0; i < ACQUIRE_INTERVALS; ++i )
+        {
+            pulse_us            -= state.m_intervals_us[i] / state.m_config.m_pulses_per_beat;
+            total_us            += pulse_us + ( ( i + 1 ) * grid_us );
+        }
+        return total_us / ( ACQUIRE_INTERVALS + 1 );
+    }
+
+    void                        add_interval( SOURCE_STATE& state, uint32_t time_us )
+    {
+        if( state.m_prev_pulse_valid )
+        {
+            const float beat_us     = static_cast<float>( time_us - state.m_prev_pulse_us ) * state.m_config.m_pulses_per_beat;
+            if( beat_us < MIN_BEAT_US || beat_us > MAX_BEAT_US )
+            {
+                // too close to be a tempo, or after too long a gap to follow on from the pulses before
+                state.m_num_intervals   = 0;
+                state.m_pulse_in_run    = beat_us > MAX_BEAT_US ? 0 : state.m_pulse_in_run + 1;
+            }
+            else
+            {
+                for( int i = ACQUIRE_INTERVALS - 1; i > 0; --i )
+                {
+                    state.m_intervals_us[i] = state.m_intervals_us[i - 1];
+                }
+                state.m_intervals_us[0] = beat_us;
+                state.m_num_intervals   = min_val( state.m_num_intervals + 1, ACQUIRE_INTERVALS );
+                ++state.m_pulse_in_run;
+            }
+        }
+        else
+        {
+            state.m_pulse_in_run        = 0;
+        }
+
+        state.m_prev_pulse_us       = time_us;
+        state.m_prev_pulse_valid    = true;
+    }
+
+    // returns false for an outlier
+    bool                        follow( const SOURCE_STATE& state, uint32_t time_us )
+    {
+        const float grid_us     = m_period_us / state.m_config.m_pulses_per_beat;
+        const float elapsed_us  = static_cast<float>( static_cast<int32_t>( time_us - m_pulse_us ) );
+        const int num_grid      = static_cast<int>( lroundf( elapsed_us / grid_us ) );
+        const float error_us    = elapsed_us - ( num_grid * grid_us );
+        if( num_grid < 1 || fabsf( error_us ) > grid_us * OUTLIER_TOLERANCE )
+        {
+            return false;
+        }
+
+        m_pulse_us              += static_cast<int32_t>( lroundf( ( num_grid * grid_us ) + ( error_us * state.m_config.m_phase_gain ) ) );
+        m_pulse_in_beat         = ( m_pulse_in_beat + num_grid ) % state.m_config.m_pulses_per_beat;
+
+        const float period_us   = m_period_us + ( ( error_us / num_grid ) * state.m_config.m_pulses_per_beat * state.m_config.m_period_gain );
+        m_period_us             = clamp( period_us, static_cast<float>( MIN_BEAT_US ), static_cast<float>( MAX_BEAT_US ) );
+        return true;
+    }
+
+public:
+
+    TEMPO_TRACKER() :
+        m_sources(),
+        m_locked( false ),
+        m_source( TEMPO_SOURCE_TAP ),
+        m_period_us( 0.0f ),
+        m_pulse_us( 0 ),
+        m_pulse_in_beat( 0 ),
+        m_update_count( 0 ),
+        m_num_pulses( 0 ),
+        m_num_outliers( 0 ),
+        m_num_locks( 0 )
+    {
+        for( int s = 0; s < NUM_TEMPO_SOURCES; ++s )
+        {
+            m_sources[s].m_config   = default_config( static_cast<TEMPO_SOURCE>( s ) );
+        }
+    }
+
+    // also forgets the source's pulses so far
+    void                        set_source_config( TEMPO_SOURCE source, const TEMPO_SOURCE_CONFIG& config )
+    {
+        ASSERT_MSG( config.m_pulses_per_beat > 0, "TEMPO_TRACKER::set_source_config() needs a pulse per beat" );
+
+        SOURCE_STATE& state     = m_sources[source];
+        state.m_config          = config;
+        state.m_prev_pulse_valid = false;
+        state.m_num_intervals   = 0;
+        state.m_pulse_in_run    = 0;
+        state.m_acquired        = false;
+        if( m_locked && m_source == source )
+        {
+            m_locked            = false;
+            ++m_update_count;
+        }
+    }
+
+    // pulses in time order, returns true if the tempo or phase moved
+    bool                        add_pulse( TEMPO_SOURCE source, uint32_t time_us )
+    {
+        SOURCE_STATE& state     = m_sources[source];
+        ++m_num_pulses;
+
+        add_interval( state, time_us );
+
+        bool moved              = false;
+        bool outlier            = false;
+        if( m_locked && source == m_source )
+        {
+            moved               = follow( state, time_us );
+            outlier             = !moved;
+            m_num_outliers      += outlier ? 1 : 0;
+        }
+
+        // another source takes over when it starts, not on every pulse, so a running clock doesn't take back a tapped
+        // tempo. A pulse that fits the grid keeps the tempo, so a stray tap and the next beat can't set one between them
+        float period_us         = 0.0f;
+        const bool was_acquired = state.m_acquired;
+        state.m_acquired        = acquired( state, period_us );
+        if( state.m_acquired )
+        {
+            const bool started      = !was_acquired;
+            const bool new_tempo    = outlier && fabsf( period_us - m_period_us ) > m_period_us * ACQUIRE_TOLERANCE;
+            if( !m_locked || ( source != m_source && started ) || ( source == m_source && new_tempo ) )
+            {
+                m_locked        = true;
+                m_source        = source;
+                m_period_us     = period_us;
+                m_pulse_us      = time_us + static_cast<int32_t>( lroundf( acquired_phase_us( state, period_us ) ) );
+                m_pulse_in_beat = state.m_pulse_in_run % state.m_config.m_pulses_per_beat;
+                ++m_num_locks;
+                moved           = true;
+            }
+        }
+
+        m_update_count          += moved ? 1 : 0;
+        return moved;
+    }
+
+    bool                        locked() const                      { return m_locked; }
+    TEMPO_SOURCE                source() const                      { return m_source; }
+    float                       period_us() const                   { return m_period_us; }
+    float                       bpm() const                         { return m_locked ? 60000000.0f / m_period_us : 0.0f; }
+    uint32_t                    update_count() const                { return m_update_count; }
+    uint32_t                    num_pulses() const                  { return m_num_pulses; }
+    uint32_t                    num_outliers() const                { return m_num_outliers; }
+    uint32_t                    num_locks() const                   { return m_num_locks; }
+
+    // the first beat after time_us, or time_us when not locked
+    uint32_t                    next_beat_us( uint32_t time_us ) const
+    {
+        if( !m_locked )
+        {
+            return time_us;
+        }
+
+        const float grid_us     = m_period_us / m_sources[m_source].m_config.m_pulses_per_beat;
+        const uint32_t beat_us  = m_pulse_us - static_cast<int32_t>( lroundf( m_pulse_in_beat * grid_us ) );
+        const float elapsed_us  = static_cast<float>( static_cast<int32_t>( time_us - beat_us ) );
+        const float num_beats   = floorf( elapsed_us / m_period_us ) + 1.0f;
+        return beat_us + static_cast<int32_t>( lroundf( num_beats * m_period_us ) );
+    }
+};